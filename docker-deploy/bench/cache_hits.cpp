@@ -0,0 +1,151 @@
+// Cache index benchmark: threads look up URLs in a cache holding a hot set,
+// 95% hits by default, and insert the URL of every miss, like the proxy
+// does. Compares CacheIndex (lock-free lookups, CLOCK eviction) with the
+// mutex-guarded LRU list it replaced, whose every hit splices the list.
+//
+// Usage: bench_cache_hits [max threads] [seconds per run] [hit percent]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cache.hpp"
+#include "cache_index.hpp"
+
+namespace {
+const size_t MAX_ENTRIES = 10240;
+const size_t HOT_URLS = 8192;
+
+// The previous Cache internals
+class LockedLru {
+public:
+    bool find(std::string_view url, std::shared_ptr<CacheEntry> &entry) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_map.find(url);
+        if (it == m_map.end()) {
+            return false;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        entry = *it->second;
+        return true;
+    }
+
+    void insert(std::shared_ptr<CacheEntry> entry) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_map.find(entry->getUrl());
+        if (it != m_map.end()) {
+            auto position = it->second;
+            m_map.erase(it);
+            *position = entry;
+            m_map.emplace(entry->getUrl(), position);
+            m_entries.splice(m_entries.begin(), m_entries, position);
+            return;
+        }
+        m_entries.push_front(entry);
+        m_map.emplace(entry->getUrl(), m_entries.begin());
+        if (m_entries.size() > MAX_ENTRIES) {
+            m_map.erase(m_entries.back()->getUrl());
+            m_entries.pop_back();
+        }
+    }
+
+private:
+    std::list<std::shared_ptr<CacheEntry>> m_entries;
+    std::unordered_map<std::string_view, std::list<std::shared_ptr<CacheEntry>>::iterator> m_map;
+    std::mutex m_mutex;
+};
+
+const std::string RESPONSE =
+        "HTTP/1.1 200 OK\r\n"
+        "Cache-Control: public, max-age=86400\r\n"
+        "Content-Length: 512\r\n"
+        "\r\n" +
+        std::string(512, 'x');
+
+std::shared_ptr<CacheEntry> make_entry(const std::string &url) {
+    return std::make_shared<CacheEntry>(url, RESPONSE, ResponseMeta::parse(RESPONSE));
+}
+
+std::string url_of(size_t n) {
+    return "http://bench.example.com/static/asset-" + std::to_string(n) + ".js";
+}
+
+// A lookup as the proxy makes it: the locked LRU hands out a reference, the
+// index is read under a guard without one
+bool lookup(LockedLru &lru, std::string_view url) {
+    std::shared_ptr<CacheEntry> entry;
+    return lru.find(url, entry);
+}
+
+bool lookup(const CacheIndex &index, std::string_view url) {
+    EpochReclaimer::Guard guard;
+    return index.find(url) != nullptr;
+}
+
+template <typename Index>
+double run(Index &index, int threads, double seconds, unsigned hit_percent) {
+    std::vector<std::string> hot;
+    for (size_t i = 0; i < HOT_URLS; i++) {
+        hot.push_back(url_of(i));
+        index.insert(make_entry(hot.back()));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            uint64_t state = 0x9e3779b97f4a7c15ull * (t + 1);
+            uint64_t lookups = 0;
+            size_t cold = (t + 1) * 1000000000ull;
+            while (!stop.load(std::memory_order_relaxed)) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                if (state % 100 < hit_percent) {
+                    lookup(index, hot[state % HOT_URLS]);
+                } else {
+                    // A miss, fetched and stored
+                    std::string url = url_of(cold++);
+                    if (!lookup(index, url)) {
+                        index.insert(make_entry(url));
+                    }
+                }
+                lookups++;
+            }
+            total += lookups;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return total / seconds / 1e6;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? std::stoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    double seconds = argc > 2 ? std::stod(argv[2]) : 2.0;
+    unsigned hit_percent = argc > 3 ? std::stoi(argv[3]) : 95;
+
+    std::printf("%zu hot URLs, %zu entries max, %u%% hits, M lookups/s:\n", HOT_URLS, MAX_ENTRIES, hit_percent);
+    std::printf("%-8s %14s %14s\n", "threads", "locked LRU", "CacheIndex");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        LockedLru locked;
+        CacheIndex index(MAX_ENTRIES);
+        double before = run(locked, threads, seconds, hit_percent);
+        double after = run(index, threads, seconds, hit_percent);
+        std::printf("%-8d %14.2f %14.2f\n", threads, before, after);
+    }
+    return 0;
+}
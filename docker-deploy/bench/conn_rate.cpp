@@ -0,0 +1,73 @@
+// Connection-rate benchmark: opens short-lived connections against the proxy as
+// fast as possible from several client threads and reports accepted connections
+// per second. Each connection sends a request the proxy answers locally (an
+// unsupported method gets a 400), so no origin server is involved.
+//
+// Usage: bench_conn_rate [port] [client threads] [seconds]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+    int port = argc > 1 ? std::stoi(argv[1]) : 12345;
+    int threads = argc > 2 ? std::stoi(argv[2]) : 8;
+    int seconds = argc > 3 ? std::stoi(argv[3]) : 5;
+
+    const std::string request = "OPTIONS * HTTP/1.1\r\nHost: 127.0.0.1:" + std::to_string(port) + "\r\n\r\n";
+    std::atomic<bool> stop(false);
+    std::atomic<long> completed(0), failed(0);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < threads; i++) {
+        clients.emplace_back([&]() {
+            char buffer[4096];
+            while (!stop.load(std::memory_order_relaxed)) {
+                int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                // Avoid exhausting ephemeral ports with TIME_WAIT sockets
+                linger lg{1, 0};
+                ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+                if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1 ||
+                    ::send(fd, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size())) {
+                    failed++;
+                    ::close(fd);
+                    continue;
+                }
+                bool ok = false;
+                ssize_t n;
+                while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                    ok = true;
+                }
+                ::close(fd);
+                (ok ? completed : failed)++;
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (std::thread &client : clients) {
+        client.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << "threads=" << threads << " connections=" << completed << " failed=" << failed
+              << " rate=" << static_cast<long>(completed / elapsed) << " conn/s" << std::endl;
+    return 0;
+}
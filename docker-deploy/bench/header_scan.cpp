@@ -0,0 +1,212 @@
+// Header scanning microbenchmark: times the SIMD/scalar HeaderScan kernels
+// against the byte-by-byte paths the parser used before (std::string::find,
+// std::tolower comparisons and the lowercase-copy + regex Host lookup) on a
+// few realistic header blocks.
+//
+// Usage: bench_header_scan [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "header_scan.hpp"
+
+namespace {
+// Previous implementations, kept here as the baseline
+
+size_t old_header_end(const std::string &message) {
+    return message.find("\r\n\r\n");
+}
+
+std::string old_find_header_value(const std::string &message, const std::string &name) {
+    size_t header_end = message.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        header_end = message.size();
+    }
+    size_t line_start = message.find("\r\n");
+    while (line_start != std::string::npos && line_start < header_end) {
+        line_start += 2;
+        size_t line_end = message.find("\r\n", line_start);
+        if (line_end == std::string::npos || line_end > header_end) {
+            line_end = header_end;
+        }
+        size_t colon = message.find(':', line_start);
+        if (colon != std::string::npos && colon < line_end && colon - line_start == name.size() &&
+            std::equal(name.begin(), name.end(), message.begin() + line_start,
+                       [](char a, char b) { return std::tolower(a) == std::tolower(b); })) {
+            size_t value_start = message.find_first_not_of(" \t", colon + 1);
+            if (value_start == std::string::npos || value_start >= line_end) {
+                return "";
+            }
+            size_t value_end = message.find_last_not_of(" \t", line_end - 1);
+            return message.substr(value_start, value_end - value_start + 1);
+        }
+        line_start = line_end;
+    }
+    return "";
+}
+
+std::string old_extract_host(const std::string &request) {
+    static const std::regex re_host(R"(host:\s*([a-zA-Z0-9\.\-\[\]:]+))", std::regex_constants::icase);
+    std::smatch match;
+    std::string lower_request = request;
+    std::transform(lower_request.begin(), lower_request.end(), lower_request.begin(),
+                   [](char c) { return std::tolower(c); });
+    if (!std::regex_search(lower_request, match, re_host)) {
+        return "";
+    }
+    return match[1].str();
+}
+
+bool old_is_token(const std::string &name) {
+    return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || std::string("!#$%&'*+-.^_`|~").find(c) != std::string::npos;
+    });
+}
+
+std::vector<std::string> header_names(const std::string &message) {
+    std::vector<std::string> names;
+    size_t line_start = message.find("\r\n") + 2;
+    size_t header_end = message.find("\r\n\r\n");
+    while (line_start < header_end + 2) {
+        size_t line_end = message.find("\r\n", line_start);
+        names.push_back(message.substr(line_start, message.find(':', line_start) - line_start));
+        line_start = line_end + 2;
+    }
+    return names;
+}
+
+struct Sample {
+    const char *name;
+    std::string message;
+};
+
+std::vector<Sample> samples() {
+    std::string browser_get =
+            "GET http://www.example.com/articles/2023/02/cache-design.html?ref=home HTTP/1.1\r\n"
+            "Host: www.example.com\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/110.0\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+            "Accept-Language: en-US,en;q=0.5\r\n"
+            "Accept-Encoding: gzip, deflate\r\n"
+            "Referer: http://www.example.com/\r\n"
+            "Connection: keep-alive\r\n"
+            "Upgrade-Insecure-Requests: 1\r\n"
+            "If-Modified-Since: Tue, 14 Feb 2023 08:12:31 GMT\r\n"
+            "If-None-Match: \"5e1f-5f4a7c3d2e1b0\"\r\n"
+            "Cache-Control: max-age=0\r\n"
+            "\r\n";
+
+    std::string origin_response =
+            "HTTP/1.1 200 OK\r\n"
+            "Date: Sun, 19 Feb 2023 10:01:02 GMT\r\n"
+            "Server: Apache/2.4.41 (Ubuntu)\r\n"
+            "Last-Modified: Tue, 14 Feb 2023 08:12:31 GMT\r\n"
+            "ETag: \"5e1f-5f4a7c3d2e1b0\"\r\n"
+            "Accept-Ranges: bytes\r\n"
+            "Cache-Control: public, max-age=3600\r\n"
+            "Vary: Accept-Encoding\r\n"
+            "Content-Type: text/html; charset=UTF-8\r\n"
+            "Content-Length: 24095\r\n"
+            "\r\n";
+
+    std::string cookie_heavy = browser_get.substr(0, browser_get.size() - 2);
+    cookie_heavy += "Cookie: ";
+    for (int i = 0; i < 60; i++) {
+        cookie_heavy += "session_token_" + std::to_string(i) + "=a8f5f167f44f4964e6c998dee827110c; ";
+    }
+    cookie_heavy += "\r\nContent-Length: 0\r\n\r\n";
+
+    return {{"browser GET", browser_get}, {"origin 200", origin_response}, {"cookie-heavy GET", cookie_heavy}};
+}
+
+template <typename F>
+double time_ns(long iterations, F &&body) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        body();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+volatile size_t sink;
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? std::stol(argv[1]) : 200000;
+    const std::vector<HeaderScan::Isa> isas = {HeaderScan::Isa::SCALAR, HeaderScan::Isa::SSE42,
+                                               HeaderScan::Isa::AVX2};
+    HeaderScan::select(HeaderScan::Isa::AVX2);
+    std::printf("best supported kernels: %s\n", HeaderScan::isa_name(HeaderScan::isa()));
+
+    for (const Sample &sample : samples()) {
+        const std::string &message = sample.message;
+        std::vector<std::string> names = header_names(message);
+        std::printf("\n%s (%zu bytes, %zu fields), ns per operation\n", sample.name, message.size(), names.size());
+        std::printf("%-24s %10s", "operation", "old");
+        for (HeaderScan::Isa isa : isas) {
+            std::printf(" %10s", HeaderScan::isa_name(isa));
+        }
+        std::printf("\n");
+
+        struct Operation {
+            const char *name;
+            std::function<void()> old_path;
+            std::function<void()> new_path;
+        };
+        std::vector<Operation> operations = {
+                {"header end",
+                 [&]() { sink = old_header_end(message); },
+                 [&]() { sink = HeaderScan::find_header_end(message); }},
+                {"Content-Length lookup",
+                 [&]() { sink = old_find_header_value(message, "Content-Length").size(); },
+                 [&]() {
+                     std::string_view value;
+                     sink = HeaderScan::find_header(message, "Content-Length", value) ? value.size() : 0;
+                 }},
+                {"Host lookup",
+                 [&]() { sink = old_extract_host(message).size(); },
+                 [&]() {
+                     std::string_view value;
+                     sink = HeaderScan::find_header(message, "Host", value) ? value.size() : 0;
+                 }},
+                {"field name validation",
+                 [&]() {
+                     size_t valid = 0;
+                     for (const std::string &name : names) {
+                         valid += old_is_token(name);
+                     }
+                     sink = valid;
+                 },
+                 [&]() {
+                     size_t valid = 0;
+                     for (const std::string &name : names) {
+                         valid += HeaderScan::is_token(name);
+                     }
+                     sink = valid;
+                 }},
+        };
+
+        for (const Operation &operation : operations) {
+            // The regex baseline is slow, fewer rounds keep the run short
+            long rounds = std::string(operation.name) == "Host lookup" ? iterations / 20 : iterations;
+            std::printf("%-24s %10.1f", operation.name, time_ns(rounds, operation.old_path));
+            for (HeaderScan::Isa isa : isas) {
+                HeaderScan::select(isa);
+                if (HeaderScan::isa() != isa) {
+                    std::printf(" %10s", "n/a");
+                    continue;
+                }
+                std::printf(" %10.1f", time_ns(iterations, operation.new_path));
+            }
+            HeaderScan::select(HeaderScan::Isa::AVX2);
+            std::printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Log write benchmark: logs the lines of a cache miss (request, not in cache,
+// requesting, received, cached, responding) for many requests, each with its
+// own UUID, in text or binary format, and reports the time and log bytes per
+// request. The Logger is a singleton, so the format is chosen per run:
+//   bench_log_write text && bench_log_write binary
+//
+// Usage: bench_log_write [text|binary] [requests] [log file]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "cache.hpp"
+#include "logger.hpp"
+
+namespace {
+off_t file_size(const std::string &path) {
+    struct stat st{};
+    return ::stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+// A connected loopback socket, so the request line has a client address
+int client_socket() {
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    ::listen(listener, 1);
+    ::getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &len);
+    int client = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::connect(client, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    int accepted = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+    ::close(client);
+    return accepted;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::string format = argc > 1 ? argv[1] : "text";
+    long requests = argc > 2 ? std::stol(argv[2]) : 200000;
+    std::string log_path = argc > 3 ? argv[3] : "/tmp/bench_log_write." + format;
+    ::unlink(log_path.c_str());
+
+    Logger &logger = Logger::GetInstance(log_path, format == "binary" ? LogFormat::BINARY : LogFormat::TEXT);
+    Cache &cache = Cache::getInstance(logger);
+
+    const std::string host = "bench.example.com";
+    const std::string request =
+            "GET http://bench.example.com/static/js/app.3f9c2e.js HTTP/1.1\r\n"
+            "Host: bench.example.com\r\n"
+            "Accept: */*\r\n"
+            "\r\n";
+    const std::string response =
+            "HTTP/1.1 200 OK\r\n"
+            "Cache-Control: public, max-age=86400\r\n"
+            "Content-Length: 4\r\n"
+            "\r\n"
+            "body";
+    std::shared_ptr<CacheEntry> entry = cache.insert("bench", "http://bench.example.com/static/js/app.3f9c2e.js",
+                                                     response);
+    int fd = client_socket();
+    // As Server::generate_uuid makes them
+    std::vector<std::string> ids;
+    ids.reserve(requests);
+    for (long i = 0; i < requests; i++) {
+        uuid_t uuid;
+        char text[37];
+        uuid_generate(uuid);
+        uuid_unparse(uuid, text);
+        ids.emplace_back(text);
+    }
+    logger.flush();
+    off_t start_size = file_size(log_path);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string &id : ids) {
+        logger.request(id, fd, request);
+        logger.not_in_cache(id);
+        logger.forward_request(id, request);
+        logger.received_response(id, host, response);
+        logger.cache_result(id, entry);
+        logger.responding(id, *entry);
+    }
+    logger.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-8s %10ld requests %10.0f ns/request %8.1f bytes/request\n", format.c_str(), requests,
+                seconds * 1e9 / requests, double(file_size(log_path) - start_size) / requests);
+    ::close(fd);
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Request allocation benchmark: runs the proxy in-process with one worker and
+// counts global heap allocations (operator new) per request while a client
+// sends requests one at a time. The scenarios are answered without an origin:
+// a fresh cache hit (the entry is inserted up front) and a request rejected
+// with a 400. Per-request arena block usage is reported alongside.
+//
+// Usage: bench_request_alloc [port] [requests] [log file]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "cache.hpp"
+#include "logger.hpp"
+#include "request_arena.hpp"
+#include "tcp_server.hpp"
+
+namespace {
+std::atomic<uint64_t> g_allocations{0};
+std::atomic<uint64_t> g_allocated_bytes{0};
+
+void *counted_allocate(size_t size, size_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    void *p = alignment > alignof(std::max_align_t)
+                      ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                      : std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+}  // namespace
+
+void *operator new(size_t size) { return counted_allocate(size, 0); }
+void *operator new[](size_t size) { return counted_allocate(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment) { return counted_allocate(size, size_t(alignment)); }
+void *operator new[](size_t size, std::align_val_t alignment) { return counted_allocate(size, size_t(alignment)); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace {
+// Sends one request and reads the response until the proxy closes the connection
+bool round_trip(const sockaddr_in &addr, const std::string &request) {
+    char buffer[4096];
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    linger lg{1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == -1 ||
+        ::send(fd, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size())) {
+        ::close(fd);
+        return false;
+    }
+    bool ok = false;
+    while (::recv(fd, buffer, sizeof(buffer), 0) > 0) {
+        ok = true;
+    }
+    ::close(fd);
+    return ok;
+}
+
+void run(const char *name, const sockaddr_in &addr, const std::string &request, long requests) {
+    // Warm up the worker's arena block cache and the cache index
+    for (int i = 0; i < 200; i++) {
+        round_trip(addr, request);
+    }
+
+    RequestArena::Stats before = RequestArena::stats();
+    uint64_t allocations = g_allocations.load();
+    uint64_t bytes = g_allocated_bytes.load();
+    long failed = 0;
+    for (long i = 0; i < requests; i++) {
+        failed += !round_trip(addr, request);
+    }
+    // The worker may still be finishing the last request
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    allocations = g_allocations.load() - allocations;
+    bytes = g_allocated_bytes.load() - bytes;
+    RequestArena::Stats after = RequestArena::stats();
+
+    std::printf("%-12s %12.2f %12.1f %14.2f %14.2f %10ld\n", name, double(allocations) / requests,
+                double(bytes) / requests, double(after.heap_blocks - before.heap_blocks) / requests,
+                double(after.reused_blocks - before.reused_blocks) / requests, failed);
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int port = argc > 1 ? std::stoi(argv[1]) : 12399;
+    long requests = argc > 2 ? std::stol(argv[2]) : 2000;
+    std::string log_path = argc > 3 ? argv[3] : "/tmp/bench_request_alloc.log";
+
+    Logger &logger = Logger::GetInstance(log_path);
+    Cache &cache = Cache::getInstance(logger);
+
+    const std::string url = "http://bench.example.com/static/js/app.3f9c2e.js";
+    std::string response =
+            "HTTP/1.1 200 OK\r\n"
+            "Date: Sun, 19 Feb 2023 10:01:02 GMT\r\n"
+            "Cache-Control: public, max-age=86400\r\n"
+            "ETag: \"5e1f-5f4a7c3d2e1b0\"\r\n"
+            "Content-Type: application/javascript\r\n"
+            "Content-Length: 1024\r\n"
+            "\r\n" +
+            std::string(1024, 'x');
+    cache.insert("bench", url, response);
+
+    ServerConfig config;
+    config.tunnel_threads = 0;
+    // Never destroyed, the process exits with the server still running
+    auto *server = new Server(std::to_string(port), 1, logger, cache, config);
+    std::thread([server]() { server->start(); }).detach();
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    const std::string hit =
+            "GET " + url + " HTTP/1.1\r\n"
+            "Host: bench.example.com\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/110.0\r\n"
+            "Accept: */*\r\n"
+            "Accept-Language: en-US,en;q=0.5\r\n"
+            "Accept-Encoding: gzip, deflate\r\n"
+            "Referer: http://bench.example.com/\r\n"
+            "Connection: keep-alive\r\n"
+            "\r\n";
+    const std::string rejected = "OPTIONS * HTTP/1.1\r\nHost: bench.example.com\r\n\r\n";
+
+    std::printf("%d requests per scenario, per request:\n", static_cast<int>(requests));
+    std::printf("%-12s %12s %12s %14s %14s %10s\n", "scenario", "allocations", "bytes", "arena blocks",
+                "reused blocks", "failed");
+    run("cache hit", addr, hit, requests);
+    run("400", addr, rejected, requests);
+
+    // Skip static destructors, the server threads are still running
+    std::fflush(stdout);
+    std::_Exit(0);
+}
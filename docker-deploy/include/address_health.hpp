@@ -0,0 +1,49 @@
+#ifndef ADDRESS_HEALTH_HPP
+#define ADDRESS_HEALTH_HPP
+
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Remembers, for every connect in the process, the origin addresses that
+// recently failed to connect or timed out connecting, and orders resolved
+// addresses for racing as RFC 8305 describes: address families interleaved,
+// starting with the resolver's first choice, and recently failed addresses
+// after all others. Unlike OriginHealth, which fails a whole host fast, this
+// only reorders its addresses.
+class AddressHealth {
+public:
+    static AddressHealth &getInstance();
+
+    // The addresses of list in the order to try them
+    std::vector<const addrinfo *> order(const addrinfo *list);
+
+    void record_failure(const sockaddr *address, socklen_t length);
+
+    void record_success(const sockaddr *address, socklen_t length);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // How long a failure keeps an address at the back
+    static constexpr std::chrono::seconds FAILURE_MEMORY{30};
+    // Failures remembered at most, expired ones are dropped first
+    static const size_t MAX_FAILURES = 4096;
+
+    AddressHealth() = default;
+
+    static std::string key(const sockaddr *address, socklen_t length);
+
+    // Alternates families, keeping the order within each
+    static void interleave(const std::vector<const addrinfo *> &addresses, std::vector<const addrinfo *> &out);
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, Clock::time_point> m_failures;
+};
+
+#endif // ADDRESS_HEALTH_HPP
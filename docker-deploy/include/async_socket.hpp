@@ -0,0 +1,56 @@
+#ifndef ASYNC_SOCKET_HPP
+#define ASYNC_SOCKET_HPP
+
+// C++20 only, part of the coroutine build (make coro)
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "event_loop.hpp"
+#include "tcp_client.hpp"
+#include "task.hpp"
+
+// Non-blocking socket whose operations are coroutines on an EventLoop. Each
+// operation takes a timeout and throws std::runtime_error when it passes or
+// the socket fails.
+class AsyncSocket {
+public:
+    // Not connected
+    explicit AsyncSocket(EventLoop &loop);
+
+    // Takes ownership of fd and makes it non-blocking
+    AsyncSocket(EventLoop &loop, int fd);
+
+    ~AsyncSocket();
+
+    AsyncSocket(const AsyncSocket &) = delete;
+    AsyncSocket &operator=(const AsyncSocket &) = delete;
+
+    // Resolves host on resolver (getaddrinfo blocks) and tries its addresses
+    // in order, each for up to timeout. Returns ConnectError::NONE once
+    // connected.
+    Task<ConnectError> connect(std::string host, std::string port, ThreadPool &resolver,
+                               std::chrono::milliseconds timeout);
+
+    // Reads what is available, up to len bytes. Returns 0 at end of stream.
+    Task<size_t> recv(char *data, size_t len, std::chrono::milliseconds timeout);
+
+    // Sends all of data; timeout applies to each wait for buffer space
+    Task<void> send(std::string_view data, std::chrono::milliseconds timeout);
+
+    // Receives one complete response, see ResponseReader
+    Task<std::string> receive_response(std::chrono::milliseconds idle_timeout);
+
+    int fd() const { return m_fd; }
+
+    // Gives up ownership of the socket and makes it blocking again
+    int release();
+
+private:
+    EventLoop &m_loop;
+    int m_fd;
+};
+
+#endif // ASYNC_SOCKET_HPP
@@ -0,0 +1,151 @@
+#ifndef BINARY_LOG_HPP
+#define BINARY_LOG_HPP
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The log in binary form, written by Logger in binary mode and turned back
+// into the text log by tools/log_decode. Records are buffered and appended to
+// the file in blocks, each written with one write() on an O_APPEND file, so
+// several processes may share a file: every block names the session (one
+// process) it belongs to, and each session has its own string table and
+// request numbers.
+//
+// A block is a BlockHeader and `length` bytes of records; a record is a
+// RecordHeader and `length` bytes of payload. All integers are in host byte
+// order. A session starts with a SESSION record giving the wall-clock time
+// its record times count from. Host names, request lines, status lines and
+// reasons are interned: a STRING record defines an index the first time the
+// string is logged, and may later redefine it after the table was reset. The
+// text ID of a request (its UUID) is logged once in an ID record, and
+// records refer to the request by a 64-bit number.
+class BinaryLog {
+public:
+    static constexpr char MAGIC[4] = {'P', 'X', 'L', 'B'};
+
+    struct BlockHeader {
+        char magic[4];
+        uint32_t length;   // Bytes of records that follow
+        uint64_t session;  // Random, the same in every block of the session
+    };
+
+    struct RecordHeader {
+        uint8_t event;
+        uint8_t variant;  // Event specific, see below
+        uint16_t reserved;
+        uint32_t length;   // Bytes of payload that follow
+        uint64_t request;  // Request number, 0 if the event has none
+        uint64_t time;     // Nanoseconds since the session started
+    };
+
+    // Payloads are listed per event; "string" is a uint32_t string index
+    enum Event : uint8_t {
+        SESSION,          // int64_t wall-clock nanoseconds since the epoch at time 0
+        STRING,           // uint32_t index, then the string
+        ID,               // The 16 bytes of a UUID (variant UUID), else the ID as text
+        REQUEST,          // string request line, in_addr client (variant NO_CLIENT: unknown)
+        NOT_IN_CACHE,     // -
+        CACHE_STATUS,     // - (variant CacheStatus), int64_t expire time in seconds if EXPIRED
+        FORWARD_REQUEST,  // string request line, string host
+        RECEIVED,         // string status line, string host
+        CACHE_RESULT,     // - (variant CacheResult), int64_t expire time in seconds if EXPIRES
+        NO_STORE,         // -
+        NOT_CACHEABLE,    // string reason
+        RESPONDING,       // string status line
+        TUNNEL_CLOSED,    // -
+        NOTE,             // The message as text, for all four
+        NOTE_WITH_ID,
+        WARNING,
+        ERROR,
+    };
+
+    // Variants of ID and REQUEST
+    static const uint8_t UUID = 1;
+    static const uint8_t NO_CLIENT = 1;
+
+    enum CacheStatus : uint8_t {
+        VALIDATORS_FRESH,
+        VALIDATORS_EXPIRED,
+        VALID,
+        EXPIRED,
+        MUST_REVALIDATE,
+        OTHER,
+    };
+
+    enum CacheResult : uint8_t {
+        NEVER_EXPIRES,  // Only in logs of older versions
+        REVALIDATE,
+        EXPIRES,
+    };
+
+    // Takes ownership of fd, a file opened with O_APPEND
+    explicit BinaryLog(int fd);
+
+    ~BinaryLog();
+
+    BinaryLog(const BinaryLog &) = delete;
+    BinaryLog &operator=(const BinaryLog &) = delete;
+
+    // None of these are thread safe, Logger calls them under its lock
+    void write(Event event, std::string_view id, uint8_t variant = 0);
+    void write_strings(Event event, std::string_view id, std::string_view first);
+    void write_strings(Event event, std::string_view id, std::string_view first, std::string_view second);
+    void write_request(std::string_view id, std::string_view request_line, const in_addr *client);
+    void write_time(Event event, std::string_view id, uint8_t variant, std::chrono::system_clock::time_point time);
+    void write_text(Event event, std::string_view id, std::string_view text);
+
+    // Writes out the buffered block. Throws std::runtime_error if write() fails.
+    void flush();
+
+private:
+    // A block is written once it reaches BLOCK_SIZE, or at the first record
+    // FLUSH_INTERVAL after it was started
+    static const size_t BLOCK_SIZE = 1024 * 1024;
+    static constexpr std::chrono::seconds FLUSH_INTERVAL{1};
+    // The string table and the map of IDs that are not UUIDs are cleared when full
+    static const size_t MAX_STRINGS = 65536;
+    static const size_t MAX_IDS = 4096;
+    // Slots of the direct-mapped table of recent UUIDs
+    static const size_t UUID_SLOTS = 4096;
+
+    struct UuidSlot {
+        uint8_t uuid[16];
+        uint64_t request;  // 0 while the slot is unused
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    void append(Event event, uint8_t variant, uint64_t request, const void *payload, size_t length);
+    // Clears the string table unless it has room for this many more
+    void make_room(size_t strings);
+    uint32_t intern(std::string_view string);
+    uint64_t request_number(std::string_view id);
+    uint64_t lookup(std::string_view id);
+
+    int m_fd;
+    uint64_t m_session;
+    Clock::time_point m_start;
+    Clock::time_point m_block_start;
+    std::vector<char> m_block;
+    // Keys point into the deques, whose elements never move
+    std::unordered_map<std::string_view, uint32_t> m_strings;
+    std::deque<std::string> m_string_storage;
+    // A UUID pushed out of its slot by another gets a new number if it is
+    // logged again, the decoder maps both to the same ID
+    std::vector<UuidSlot> m_uuids;
+    // Records of a request mostly follow one another
+    std::string m_last_id;
+    uint64_t m_last_request;
+    std::unordered_map<std::string_view, uint64_t> m_ids;
+    std::deque<std::string> m_id_storage;
+    uint64_t m_next_request;
+};
+
+#endif // BINARY_LOG_HPP
@@ -5,60 +5,153 @@
 #ifndef CACHE_HPP
 #define CACHE_HPP
 
-#include <unordered_map>
 #include <string>
-#include <mutex>
-#include <list>
+#include <string_view>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 #include <memory>
+#include <optional>
 #include <sstream>
 
+#include "cache_index.hpp"
+#include "freshness.hpp"
 #include "logger.hpp"
 #include "http_parser.hpp"
+#include "response_meta.hpp"
+#include "shared_cache.hpp"
+#include "spooled_body.hpp"
+#include "timer_wheel.hpp"
 
 class Logger;
 
+// Entries are immutable once inserted and shared with readers, a hit hands out
+// a reference instead of copying the response.
 class CacheEntry {
 public:
-    CacheEntry(const std::string& url, const std::string& response, bool must_revalidate,
-               bool never_expires, bool no_cache, std::chrono::seconds max_age);
+    // Stores a response received just now, fresh as freshness says. With a
+    // spooled body, response is only the header block.
+    CacheEntry(std::string_view url, const std::string& response, const ResponseMeta& meta,
+               const Freshness& freshness = Freshness(), std::shared_ptr<SpooledBody> body = nullptr);
+
+    // Restores an entry copied out of a SharedCache
+    CacheEntry(std::string_view url, std::string&& response, const ResponseMeta& meta,
+               std::chrono::system_clock::time_point expire_time, std::chrono::seconds initial_age,
+               std::chrono::system_clock::time_point stored_time);
 
     const std::string& getUrl() const { return m_url; }
     const std::string& getResponse() const { return m_response; }
-    bool isMustRevalidate() const { return m_must_revalidate; }
-    bool isNeverExpires() const { return m_never_expires; }
-    bool isNoCache() const { return m_no_cache; }
+    const ResponseMeta& getMeta() const { return m_meta; }
+    // The body when it is kept in a file rather than in getResponse()
+    const SpooledBody* getBody() const { return m_body.get(); }
+    // proxy-revalidate binds shared caches like must-revalidate
+    bool isMustRevalidate() const {
+        return m_meta.has(ResponseMeta::MUST_REVALIDATE) || m_meta.has(ResponseMeta::PROXY_REVALIDATE);
+    }
+    bool isNoCache() const { return m_meta.has(ResponseMeta::NO_CACHE); }
     std::chrono::system_clock::time_point getExpireTime() const { return m_expire_time; }
+    // When the response was received from the origin
+    std::chrono::system_clock::time_point getStoredTime() const { return m_stored_time; }
+    // Age of the response when it was received
+    std::chrono::seconds getInitialAge() const { return m_initial_age; }
+    // Age of the response now (RFC 9111 4.2.3), for its Age header
+    std::chrono::seconds getCurrentAge() const;
+
+    std::string_view getStatusLine() const { return m_meta.status_line(m_response); }
+    std::string_view getETag() const { return m_meta.etag(m_response); }
+    std::string_view getLastModified() const { return m_meta.last_modified(m_response); }
 
     bool isExpired() const;
     bool isFresh() const;
 
+    // Holds a 304 carrying only the validators and Cache-Control of a
+    // response. It can only answer conditional requests on those validators.
+    bool isValidatorOnly() const { return m_meta.status == 304; }
+
+    // The validator-only form of this entry, same URL and expiry
+    std::shared_ptr<CacheEntry> toValidatorOnly() const;
+
+    static std::string makeValidatorResponse(std::string_view etag, std::string_view last_modified,
+                                             std::string_view cache_control);
+
 private:
     std::string m_url;
     std::string m_response;
-    bool m_must_revalidate;
-    bool m_never_expires;
-    bool m_no_cache;
+    ResponseMeta m_meta;
     std::chrono::system_clock::time_point m_expire_time;
+    std::chrono::system_clock::time_point m_stored_time;
+    std::chrono::seconds m_initial_age;
+    std::shared_ptr<SpooledBody> m_body;
 };
 
 class Cache {
 public:
     static Cache& getInstance(Logger &logger);
 
-    std::shared_ptr<CacheEntry> insert(const std::string &id, const std::string& url, const std::string& response);
+    std::shared_ptr<CacheEntry> insert(std::string_view id, std::string_view url, const std::string& response);
 
-    bool get(const std::string& url, std::shared_ptr<CacheEntry>& entry);
+    // Inserts a response whose metadata the caller already parsed. Without
+    // explicit freshness it stays fresh for default_lifetime if given, else
+    // for the heuristic lifetime of the policy. A spooled body stays in its
+    // file; such entries are never put in a SharedCache.
+    std::shared_ptr<CacheEntry> insert(std::string_view id, std::string_view url, const std::string& response,
+                                       const ResponseMeta& meta,
+                                       std::optional<std::chrono::seconds> default_lifetime = std::nullopt,
+                                       std::shared_ptr<SpooledBody> body = nullptr);
+
+    bool get(std::string_view url, std::shared_ptr<CacheEntry>& entry);
+
+    // Looks up url without taking a reference on an in-process entry: it
+    // stays valid while the calling thread holds an EpochReclaimer::Guard.
+    // An entry copied out of a SharedCache is owned by holder instead.
+    const CacheEntry* peek(std::string_view url, std::shared_ptr<CacheEntry>& holder);
+
+    // Keeps entries in a region shared with other processes instead of this
+    // process's memory. Call before the cache is used.
+    void useShared(SharedCache* shared) { m_shared = shared; }
+
+    // Starts a background sweeper for the in-process cache: grace after an
+    // entry expires, it is dropped, or reduced to its validators if it has
+    // any. Entries that never expire or always revalidate are left alone.
+    // Call before the cache is used.
+    void enableSweeper(std::chrono::seconds grace);
+
+    // Sets how responses without explicit freshness are aged. Call before
+    // the cache is used.
+    void setFreshnessPolicy(const FreshnessPolicy& policy) { m_freshness_policy = policy; }
+
+    // Bounds the in-process cache by the total size of the responses it
+    // holds, header and body, spooled bodies included; 0 bounds it by entry
+    // count only. Call before the cache is used.
+    void setMaxBytes(size_t max_bytes);
+
+    // Logs the size of every stored response, for tools/cache_sim. Call
+    // before the cache is used.
+    void setSizeNotes(bool enabled) { m_size_notes = enabled; }
 
 private:
+    static const size_t MAX_ENTRIES = 10240;
+
     Cache(Logger &logger);
 
-    void evict();
+    // Arms or re-arms the expiry timer of entry's URL, m_sweep_mutex held
+    void scheduleExpiry(const std::shared_ptr<CacheEntry>& entry);
+
+    // Runs on the sweeper thread when entry's timer fires
+    void expire(const std::weak_ptr<CacheEntry>& weak);
 
-    std::list<CacheEntry> m_entries;
-    std::unordered_map<std::string, std::list<CacheEntry>::iterator> m_entry_map;
-    std::mutex m_mutex;
+    // Hits take no lock, see CacheIndex
+    CacheIndex m_index;
     Logger &m_logger;
+    SharedCache* m_shared;
+    FreshnessPolicy m_freshness_policy;
+    bool m_size_notes;
+    std::chrono::seconds m_sweep_grace;
+    std::mutex m_sweep_mutex;
+    // Timer and entry of each URL waiting to expire, at most one per URL
+    std::unordered_map<std::string, std::pair<TimerWheel::TimerId, const CacheEntry*>> m_sweep_timers;
+    // Declared last: its thread calls expire until it is destroyed
+    std::unique_ptr<TimerWheel> m_sweeper;
 };
 
 #endif // CACHE_HPP
@@ -0,0 +1,121 @@
+#ifndef CACHE_INDEX_HPP
+#define CACHE_INDEX_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "epoch_reclaimer.hpp"
+
+class CacheEntry;
+
+// URL index of the in-process cache, built for a read-mostly load. Lookups
+// take no lock and write nothing shared but, the first time an entry is seen
+// since the last sweep, its access bit: the table is an open-addressing array
+// of pointers to immutable nodes, published with release stores and read
+// under an EpochReclaimer guard. A node holds its entry until it is freed, so
+// a reader can use the entry for as long as it keeps its guard without
+// taking a reference.
+//
+// Writers are serialized by a mutex. A replaced or evicted node is retired
+// and freed once no reader can still see it. Eviction is CLOCK: a hand
+// sweeps the slots, clearing access bits, and evicts the first node whose
+// bit is already clear. Evicted slots become tombstones; when they fill a
+// quarter of the table it is rebuilt and the new array swapped in.
+//
+// Besides the entry count, the index can be bounded by the total size of the
+// responses it holds, header and body, whether the body is kept in memory or
+// spooled to a file.
+class CacheIndex {
+public:
+    // A max_bytes of 0 bounds the index by entry count only
+    explicit CacheIndex(size_t max_entries, size_t max_bytes = 0);
+
+    ~CacheIndex();
+
+    CacheIndex(const CacheIndex &) = delete;
+    CacheIndex &operator=(const CacheIndex &) = delete;
+
+    // Safe to call from any thread concurrently with writers. The caller
+    // must hold an EpochReclaimer::Guard; the entry stays valid until it is
+    // released. Takes no reference on the entry.
+    const CacheEntry *find(std::string_view url) const;
+
+    // Like find, for callers that keep the entry beyond their guard
+    bool find(std::string_view url, std::shared_ptr<CacheEntry> &entry) const;
+
+    // Adds entry or replaces the one with the same URL. Returns the entries
+    // evicted to make room; an entry larger than the whole byte budget is
+    // not stored and returned as evicted itself.
+    std::vector<std::shared_ptr<CacheEntry>> insert(std::shared_ptr<CacheEntry> entry);
+
+    // Replaces expected, if the index still holds it, with replacement for
+    // the same URL, or removes it if replacement is null. Returns false if
+    // expected was already replaced or evicted.
+    bool replace(const std::shared_ptr<CacheEntry> &expected, std::shared_ptr<CacheEntry> replacement);
+
+    // Changes the byte budget, 0 for none. Returns the entries evicted to
+    // fit under the new one.
+    std::vector<std::shared_ptr<CacheEntry>> set_max_bytes(size_t max_bytes);
+
+    size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+    // Total size of the responses held
+    size_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+
+    // The size an entry counts for against the byte budget
+    static size_t weight(const CacheEntry &entry);
+
+private:
+    struct Node {
+        uint64_t hash;
+        std::shared_ptr<CacheEntry> entry;
+        // Set by readers, cleared by the CLOCK hand
+        mutable std::atomic<bool> referenced{true};
+    };
+
+    struct Table {
+        explicit Table(size_t capacity);
+
+        size_t mask;
+        std::unique_ptr<std::atomic<Node *>[]> slots;
+    };
+
+    // Marks a slot whose node was evicted; probes continue past it
+    static Node *const TOMBSTONE;
+
+    static uint64_t hash(std::string_view url);
+
+    // Readers only, under a guard: marks the node found as referenced
+    const Node *find_node(std::string_view url) const;
+
+    // Puts node in the first empty or tombstone slot of its probe sequence
+    void place(Table &table, Node *node);
+
+    // Writers only
+    std::shared_ptr<CacheEntry> evict(Table &table);
+
+    // Writers only: true while adding incoming bytes needs room first
+    bool over_budget(size_t incoming) const;
+
+    // Writers only: replaces the table with one without tombstones
+    void rebuild();
+
+    const size_t m_max_entries;
+    std::atomic<Table *> m_table;
+    std::mutex m_write_mutex;
+    // Writers only
+    size_t m_max_bytes;
+    // Live nodes; with tombstones, the slots in use
+    std::atomic<size_t> m_size;
+    std::atomic<size_t> m_bytes;
+    size_t m_used;
+    size_t m_hand;
+    EpochReclaimer m_reclaimer;
+};
+
+#endif  // CACHE_INDEX_HPP
@@ -0,0 +1,45 @@
+#ifndef CHUNKED_DECODER_HPP
+#define CHUNKED_DECODER_HPP
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+// Incremental decoder for "Transfer-Encoding: chunked" message bodies.
+// Bytes can be fed in arbitrary pieces as they arrive from the socket; the
+// decoder stops consuming exactly after the terminating chunk and trailer,
+// so anything that follows on the connection is left untouched.
+class ChunkedDecoder {
+public:
+    ChunkedDecoder();
+
+    // Decodes as much of [data, data + len) as possible and appends the chunk
+    // payload to body. Returns the number of bytes consumed, which is less
+    // than len only when the message ended inside the buffer.
+    // Throws std::runtime_error on malformed chunk framing.
+    size_t feed(const char *data, size_t len, std::string &body);
+
+    // True once the last chunk and the trailer section have been consumed.
+    bool done() const { return m_state == State::DONE; }
+
+private:
+    enum class State {
+        SIZE,        // reading the hexadecimal chunk size
+        EXTENSION,   // skipping chunk extensions up to CR
+        SIZE_LF,     // expecting LF after the chunk size line
+        DATA,        // copying chunk payload
+        DATA_CR,     // expecting CR after the payload
+        DATA_LF,     // expecting LF after the payload
+        TRAILER,     // at the start of a trailer line (or the final CRLF)
+        TRAILER_LINE,// skipping a trailer field line
+        TRAILER_LF,  // expecting LF that ends a trailer line
+        FINAL_LF,    // expecting LF of the final empty line
+        DONE
+    };
+
+    State m_state;
+    size_t m_chunk_size;
+    size_t m_size_digits;
+};
+
+#endif // CHUNKED_DECODER_HPP
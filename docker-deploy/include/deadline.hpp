@@ -0,0 +1,94 @@
+#ifndef DEADLINE_HPP
+#define DEADLINE_HPP
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "logger.hpp"
+#include "timer_wheel.hpp"
+
+enum class DeadlineKind {
+    HEADER_READ,       // Client must send the whole request header in time
+    BODY_READ,         // Client must send the whole request body in time
+    UPSTREAM_CONNECT,  // Origin connect attempt
+    UPSTREAM_IDLE,     // No progress talking to the origin
+    TUNNEL_IDLE,       // No traffic in either direction of a CONNECT tunnel
+    COUNT
+};
+
+struct DeadlineConfig {
+    std::chrono::milliseconds header_read{10000};
+    std::chrono::milliseconds body_read{30000};
+    std::chrono::milliseconds upstream_connect{10000};
+    std::chrono::milliseconds upstream_idle{60000};
+    std::chrono::milliseconds tunnel_idle{300000};
+};
+
+// Connection deadlines backed by one shared timer wheel. An expired deadline
+// shuts the socket down, which wakes whoever is blocked on it with EOF or an
+// error, and is counted per kind.
+class Deadlines {
+public:
+    Deadlines(Logger &logger, const DeadlineConfig &config);
+
+    std::chrono::milliseconds timeout(DeadlineKind kind) const;
+
+    uint64_t expired(DeadlineKind kind) const { return m_expired[static_cast<int>(kind)]; }
+
+    // Counts and logs a deadline its caller enforced itself, e.g. as a poll
+    // timeout, and has already acted on
+    void count_expired(DeadlineKind kind);
+
+    static const char *name(DeadlineKind kind);
+
+private:
+    friend class Deadline;
+
+    void on_expired(DeadlineKind kind, int fd);
+
+    Logger &m_logger;
+    DeadlineConfig m_config;
+    std::atomic<uint64_t> m_expired[static_cast<int>(DeadlineKind::COUNT)];
+    TimerWheel m_wheel;
+};
+
+// Keeps one deadline armed on a socket while in scope. Must not outlive the
+// socket: it is only shut down while the guard is alive.
+class Deadline {
+public:
+    Deadline(Deadlines *deadlines, DeadlineKind kind, int fd);
+
+    ~Deadline();
+
+    Deadline(const Deadline &) = delete;
+    Deadline &operator=(const Deadline &) = delete;
+
+    // Records progress, idle deadlines are measured from the last touch.
+    void touch();
+
+private:
+    struct State {
+        std::mutex mutex;
+        bool active;
+        int fd;
+        TimerWheel::TimerId timer;
+        std::atomic<int64_t> last_activity;  // steady_clock ticks
+    };
+
+    // Called with state->mutex held
+    static void arm(Deadlines *deadlines, DeadlineKind kind, const std::shared_ptr<State> &state,
+                    std::chrono::milliseconds delay);
+
+    static void expire(Deadlines *deadlines, DeadlineKind kind, const std::shared_ptr<State> &state);
+
+    Deadlines *m_deadlines;
+    DeadlineKind m_kind;
+    std::shared_ptr<State> m_state;
+};
+
+#endif // DEADLINE_HPP
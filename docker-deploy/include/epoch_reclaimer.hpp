@@ -0,0 +1,61 @@
+#ifndef EPOCH_RECLAIMER_HPP
+#define EPOCH_RECLAIMER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Epoch-based reclamation for structures whose readers take no locks. A
+// reader pins the global epoch with a Guard while it follows pointers; a
+// writer unlinks an object and retires it, and the object is freed once the
+// global epoch has moved on twice, which it only does when every pinned
+// reader has caught up, so none can still hold it.
+//
+// Pinning writes only the calling thread's own record. The epoch and the
+// thread records are shared by all reclaimers in the process.
+class EpochReclaimer {
+public:
+    // Pins the calling thread for its lifetime; guards may nest
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+
+    EpochReclaimer() = default;
+
+    // Frees everything still retired; no reader may be using the structure
+    ~EpochReclaimer();
+
+    EpochReclaimer(const EpochReclaimer &) = delete;
+    EpochReclaimer &operator=(const EpochReclaimer &) = delete;
+
+    // Frees ptr once no reader can see it. Call after ptr has been unlinked;
+    // calls on one reclaimer must be serialized.
+    template <typename T>
+    void retire(T *ptr) {
+        retire(ptr, [](void *p) { delete static_cast<T *>(p); });
+    }
+
+    void retire(void *ptr, void (*deleter)(void *));
+
+    // Objects retired and not freed yet
+    size_t pending() const { return m_retired.size(); }
+
+private:
+    struct Retired {
+        void *ptr;
+        void (*deleter)(void *);
+        uint64_t epoch;
+    };
+
+    // Advances the epoch if all pinned readers are in it, then frees what is old enough
+    void collect();
+
+    std::vector<Retired> m_retired;
+};
+
+#endif  // EPOCH_RECLAIMER_HPP
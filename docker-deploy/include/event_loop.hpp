@@ -0,0 +1,124 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+// C++20 only, part of the coroutine build (make coro)
+
+#include <sys/epoll.h>
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// One epoll thread resuming the coroutines that wait on it. Coroutines wait
+// for a socket to become readable or writable or for a timer, each wait
+// bounded by a timeout, so a handful of loops serve any number of
+// connections with one coroutine frame each instead of one thread each.
+//
+// All waits of a coroutine must be on the loop that runs it. post() is the
+// only member that may be called from other threads.
+class EventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Suspends the awaiting coroutine until fd reports events or the timeout
+    // passes. co_await yields true if fd is ready, false on timeout.
+    class Wait {
+    public:
+        Wait(EventLoop &loop, int fd, uint32_t events, std::chrono::milliseconds timeout);
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle);
+
+        bool await_resume() const noexcept { return m_ready; }
+
+    private:
+        friend class EventLoop;
+
+        EventLoop &m_loop;
+        int m_fd;
+        uint32_t m_events;
+        Clock::time_point m_expires;
+        std::multimap<Clock::time_point, Wait *>::iterator m_timer;
+        std::coroutine_handle<> m_handle;
+        bool m_ready;
+    };
+
+    // Runs fn on a thread pool and resumes the awaiting coroutine on this
+    // loop when it returns; exceptions from fn are rethrown by co_await.
+    template <typename F>
+    class Offload {
+    public:
+        Offload(EventLoop &loop, ThreadPool &pool, F fn) : m_loop(loop), m_pool(pool), m_fn(std::move(fn)) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            m_pool.enqueue([this, handle]() {
+                try {
+                    m_fn();
+                } catch (...) {
+                    m_error = std::current_exception();
+                }
+                m_loop.post([handle]() { handle.resume(); });
+            });
+        }
+
+        void await_resume() {
+            if (m_error) {
+                std::rethrow_exception(m_error);
+            }
+        }
+
+    private:
+        EventLoop &m_loop;
+        ThreadPool &m_pool;
+        F m_fn;
+        std::exception_ptr m_error;
+    };
+
+    EventLoop();
+
+    // Stops the thread. Coroutines still suspended on the loop are not resumed.
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // Runs fn on the loop thread
+    void post(std::function<void()> fn);
+
+    Wait wait(int fd, uint32_t events, std::chrono::milliseconds timeout) {
+        return Wait(*this, fd, events, timeout);
+    }
+
+    Wait sleep_for(std::chrono::milliseconds delay) { return Wait(*this, -1, 0, delay); }
+
+    // For blocking calls such as getaddrinfo
+    template <typename F>
+    Offload<F> offload(ThreadPool &pool, F fn) { return Offload<F>(*this, pool, std::move(fn)); }
+
+private:
+    void run();
+
+    // Wakes w's coroutine, ready says whether fd or the timer fired
+    void complete(Wait *w, bool ready);
+
+    int m_epoll_fd;
+    int m_wake_fd;
+    std::multimap<Clock::time_point, Wait *> m_timers;
+    std::mutex m_mutex;
+    std::vector<std::function<void()>> m_posted;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,37 @@
+#ifndef FRESHNESS_HPP
+#define FRESHNESS_HPP
+
+#include <chrono>
+#include <string_view>
+
+#include "response_meta.hpp"
+
+struct FreshnessPolicy {
+    // A response without explicit freshness but with a Last-Modified stays
+    // fresh for this fraction of its age at the time it was sent...
+    double heuristic_fraction = 0.1;
+    // ...but no longer than this
+    std::chrono::seconds heuristic_cap{24 * 60 * 60};
+};
+
+// How long a shared cache may serve a response without validating it, worked
+// out once when the response is stored (RFC 9111 4.2). The lifetime comes from
+// s-maxage, else max-age, else Expires minus Date, else a fraction of the time
+// since Last-Modified; a response with none of them is stale at once. The age
+// it already had when received is the larger of what its Age header says and
+// how far its Date lies in the past, so a response passed on by another cache,
+// or held up on the way, is fresh for that much less.
+struct Freshness {
+    std::chrono::seconds lifetime{0};     // freshness_lifetime
+    std::chrono::seconds initial_age{0};  // corrected_initial_age
+    bool heuristic = false;               // lifetime guessed from Last-Modified
+
+    // The response carries s-maxage, max-age or Expires
+    static bool is_explicit(std::string_view response, const ResponseMeta &meta);
+
+    // response_time is when response was received
+    static Freshness compute(std::string_view response, const ResponseMeta &meta,
+                             std::chrono::system_clock::time_point response_time, const FreshnessPolicy &policy);
+};
+
+#endif // FRESHNESS_HPP
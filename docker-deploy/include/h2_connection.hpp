@@ -0,0 +1,197 @@
+#ifndef H2_CONNECTION_HPP
+#define H2_CONNECTION_HPP
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chunked_decoder.hpp"
+#include "hpack.hpp"
+#include "logger.hpp"
+
+struct H2Config {
+    // Workers serving the streams of all HTTP/2 connections. 0 turns HTTP/2
+    // off: the connection preface is then refused like any unknown method.
+    size_t stream_threads = 0;
+    // SETTINGS_MAX_CONCURRENT_STREAMS, streams opened beyond it are refused
+    uint32_t max_concurrent_streams = 100;
+    // A connection without open streams is closed with GOAWAY after this long
+    std::chrono::seconds idle_timeout{60};
+    // Request bodies are buffered until complete; longer ones are answered
+    // with 413 and the stream's window is not reopened beyond this
+    size_t max_request_body = 1024 * 1024;
+};
+
+// Serves one HTTP/2 connection opened with prior knowledge (h2c, RFC 9113
+// 3.3) on the calling thread. Each stream is turned into the HTTP/1.1 proxy
+// request the request handlers already serve and dispatched with one end of
+// a socketpair standing in for the client socket; the HTTP/1.1 response the
+// handler writes there, up to its close, is sent back as HEADERS and DATA
+// frames. So the cache, the upstream paths and the log treat streams like
+// any other request, while many of them run at once on one connection.
+//
+// A response is read from its socketpair only while little of it waits for
+// send window, so a client that does not open its windows throttles the
+// handler rather than growing buffers. Server push is
+// off (SETTINGS_ENABLE_PUSH 0) and CONNECT is refused with 501.
+class H2Connection {
+public:
+    // Starts serving a request: request is an HTTP/1.1 request in absolute
+    // form, body included, and its response is to be written to fd, which the
+    // callee closes after it. Called on the connection's thread.
+    using Dispatch = std::function<void(int fd, std::string request)>;
+
+    // What receive_request sees of the client connection preface
+    static constexpr std::string_view REQUEST_LINE = "PRI * HTTP/2.0\r\n\r\n";
+
+    // True if request, as read by the HTTP/1.1 request reader, starts an
+    // HTTP/2 connection
+    static bool is_preface(std::string_view request);
+
+    // received holds what was read from fd after REQUEST_LINE. The connection
+    // sends GOAWAY and winds down once stop_fd is readable.
+    H2Connection(int fd, std::string_view received, Logger &logger, const H2Config &config, int stop_fd,
+                 Dispatch dispatch);
+
+    // Closes the socketpairs of streams still open, not fd
+    ~H2Connection();
+
+    H2Connection(const H2Connection &) = delete;
+    H2Connection &operator=(const H2Connection &) = delete;
+
+    // Returns when the client closes the connection or after GOAWAY
+    void serve();
+
+private:
+    // Frame types and flags, RFC 9113 6
+    enum FrameType : uint8_t {
+        DATA,
+        HEADERS,
+        PRIORITY,
+        RST_STREAM,
+        SETTINGS,
+        PUSH_PROMISE,
+        PING,
+        GOAWAY,
+        WINDOW_UPDATE,
+        CONTINUATION,
+    };
+    static const uint8_t END_STREAM = 0x1;
+    static const uint8_t ACK = 0x1;
+    static const uint8_t END_HEADERS = 0x4;
+    static const uint8_t PADDED = 0x8;
+    static const uint8_t PRIORITY_FLAG = 0x20;
+
+    // Error codes, RFC 9113 7
+    enum ErrorCode : uint32_t {
+        NO_ERROR,
+        PROTOCOL_ERROR,
+        INTERNAL_ERROR,
+        FLOW_CONTROL_ERROR,
+        SETTINGS_TIMEOUT,
+        STREAM_CLOSED,
+        FRAME_SIZE_ERROR,
+        REFUSED_STREAM,
+        CANCEL,
+        COMPRESSION_ERROR,
+        CONNECT_ERROR,
+        ENHANCE_YOUR_CALM,
+    };
+
+    static const size_t FRAME_HEADER_SIZE = 9;
+    // SETTINGS_MAX_FRAME_SIZE we accept, the protocol's default
+    static const uint32_t MAX_FRAME_SIZE = 16384;
+    // Header blocks (with CONTINUATION frames) and decoded header lists
+    static const size_t MAX_HEADER_BLOCK = 64 * 1024;
+    static const int32_t DEFAULT_WINDOW = 65535;
+    static const int64_t MAX_WINDOW = 0x7fffffff;
+    // Response bytes read ahead of the send window, per stream
+    static const size_t STREAM_BUFFER = 64 * 1024;
+    // Frames queued for the client before responses, and the client's own
+    // frames (whose PING and SETTINGS need answers), stop being read
+    static const size_t OUTPUT_BUFFER = 256 * 1024;
+
+    struct Stream {
+        int fd = -1;                  // Our end of the socketpair, -1 once the response is read
+        std::vector<Hpack::Header> headers;
+        std::string body;             // Request body, until END_STREAM
+        bool request_done = false;    // END_STREAM received
+        int64_t send_window = 0;
+        // Response
+        std::string response;         // Read and not converted yet
+        bool headers_sent = false;
+        bool chunked = false;
+        ChunkedDecoder decoder;
+        int64_t remaining = -1;       // Content-Length still to send, -1 if none
+        std::string pending;          // Body bytes waiting for send window
+        bool eof = false;             // The whole body is in pending
+        bool end_sent = false;        // END_STREAM sent
+    };
+
+    void read_frames();
+    void frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void on_headers(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void on_header_block(uint32_t stream_id, bool end_stream);
+    void on_data(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void on_settings(uint8_t flags, std::string_view payload);
+    void on_window_update(uint32_t stream_id, std::string_view payload);
+
+    // Dispatches a complete request, or answers it here
+    void start(uint32_t stream_id, Stream &stream);
+    // The HTTP/1.1 form of the request, false if it is malformed (RFC 9113 8.1.1)
+    static bool make_request(const Stream &stream, std::string &request);
+    void respond_locally(uint32_t stream_id, Stream &stream, int status_code, std::string_view status_text);
+
+    // Reads from a stream's socketpair and converts what arrived
+    void read_response(uint32_t stream_id, Stream &stream);
+    void convert(uint32_t stream_id, Stream &stream, std::string_view data);
+    // Sends HEADERS once the response header is complete, false until then.
+    // Throws std::runtime_error if it is malformed.
+    bool send_response_header(uint32_t stream_id, Stream &stream);
+    // Sends as much of the pending body as the windows allow
+    void send_data(uint32_t stream_id, Stream &stream);
+    void reset(uint32_t stream_id, ErrorCode code);
+    void close_stream(uint32_t stream_id);
+
+    void write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void send_headers(uint32_t stream_id, const std::vector<Hpack::Header> &headers, bool end_stream);
+    void send_goaway(ErrorCode code);
+    // Sends what the socket takes without blocking
+    void flush();
+
+    int m_fd;
+    std::string m_in;
+    std::string m_out;
+    Logger &m_logger;
+    H2Config m_config;
+    int m_stop_fd;
+    Dispatch m_dispatch;
+    Hpack m_decoder;
+    std::map<uint32_t, Stream> m_streams;
+    uint32_t m_last_stream_id;
+    // Stream whose header block continues in CONTINUATION frames, 0 if none
+    uint32_t m_continued_stream;
+    bool m_continued_end_stream;
+    std::string m_header_block;
+    int64_t m_send_window;
+    int64_t m_initial_window;
+    uint32_t m_peer_max_frame;
+    bool m_preface_done;
+    bool m_settings_received;
+    // Frames were left in m_in because the output was full
+    bool m_input_paused;
+    // GOAWAY sent or received, no new streams are served
+    bool m_going_away;
+    // The client closed the connection or it failed
+    bool m_closed;
+};
+
+#endif // H2_CONNECTION_HPP
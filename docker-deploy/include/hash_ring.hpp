@@ -0,0 +1,30 @@
+#ifndef HASH_RING_HPP
+#define HASH_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Consistent-hash ring mapping keys to one of a fixed set of nodes. Each node
+// is placed at several points (virtual nodes) so keys spread evenly, and
+// removing a node only moves the keys it owned. The hash is fixed (FNV-1a
+// with a final mix), so every process built from this code maps a key to
+// the same node given the same node names in the same order.
+class HashRing {
+public:
+    HashRing(const std::vector<std::string> &nodes, size_t virtual_nodes);
+
+    // Index of the node owning key, in the order the nodes were given
+    size_t owner(std::string_view key) const;
+
+    static uint64_t hash(std::string_view key);
+
+private:
+    // Ring points sorted by hash, each with its node index
+    std::vector<std::pair<uint64_t, size_t>> m_points;
+};
+
+#endif // HASH_RING_HPP
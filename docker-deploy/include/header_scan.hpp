@@ -0,0 +1,40 @@
+#ifndef HEADER_SCAN_HPP
+#define HEADER_SCAN_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Scanning kernels for HTTP header blocks. Each kernel has an AVX2, an SSE4.2
+// and a scalar version; the best one the CPU supports is picked on first use.
+class HeaderScan {
+public:
+    enum class Isa { SCALAR, SSE42, AVX2 };
+
+    // Offset of the "\r\n\r\n" ending the header block at or after from, npos if absent.
+    static size_t find_header_end(std::string_view data, size_t from = 0);
+
+    // Offset of the first c at or after from, npos if absent.
+    static size_t find_char(std::string_view data, char c, size_t from = 0);
+
+    // ASCII case-insensitive equality.
+    static bool iequals(std::string_view a, std::string_view b);
+
+    // True if data is a non-empty RFC 9110 token (header field names, methods).
+    static bool is_token(std::string_view data);
+
+    // Looks up a header field in the header block of a message by
+    // case-insensitive name. On success value is the field value without
+    // surrounding whitespace.
+    static bool find_header(std::string_view message, std::string_view name, std::string_view &value);
+
+    static Isa isa();
+
+    static const char *isa_name(Isa isa);
+
+    // Overrides the runtime choice, for benchmarks. Falls back to the best
+    // supported version if the CPU lacks the requested one.
+    static void select(Isa isa);
+};
+
+#endif // HEADER_SCAN_HPP
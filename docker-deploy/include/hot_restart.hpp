@@ -0,0 +1,69 @@
+#ifndef HOT_RESTART_HPP
+#define HOT_RESTART_HPP
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hands the listen sockets and the shared cache of a running proxy over to a
+// new binary started next to it, so a restart drops no connection and does
+// not start from a cold cache.
+//
+// The running process listens on a Unix socket at a fixed path. The new
+// process connects to it and receives the listen sockets and the memfd of
+// the shared cache (SCM_RIGHTS); the sockets keep their accept queues, so no
+// connection is refused while both processes hold them. Once the new
+// process is ready to accept it confirms, the old one stops accepting,
+// drains its requests and tunnels and exits, and the new one takes over the
+// Unix socket path for the next restart. If the new process goes away
+// before confirming, the old one keeps serving.
+class HotRestart {
+public:
+    // What the previous process handed over
+    struct Handoff {
+        std::vector<int> listen_fds;
+        int cache_fd = -1;  // -1 if it had no shared cache
+    };
+
+    explicit HotRestart(std::string path);
+
+    ~HotRestart();
+
+    HotRestart(const HotRestart &) = delete;
+    HotRestart &operator=(const HotRestart &) = delete;
+
+    // Asks the process serving on the path for its sockets. Returns false if
+    // no process serves there. Throws std::runtime_error if the handoff fails
+    // half-way.
+    bool take_over(Handoff &handoff);
+
+    // Tells the previous process that this one accepts connections now
+    void confirm();
+
+    // Serves the next process from a background thread: it is handed
+    // listen_fds and cache_fd (-1 for none), and on_handoff runs once it has
+    // confirmed. Throws std::runtime_error if the path cannot be bound.
+    void serve(std::vector<int> listen_fds, int cache_fd, std::function<void()> on_handoff);
+
+private:
+    // A new process that does not confirm in time is given up on
+    static const int CONFIRM_TIMEOUT_SECONDS = 30;
+    // The kernel caps the descriptors of one message at 253
+    static const size_t MAX_FDS = 253;
+
+    void run();
+
+    // Returns true if the peer confirmed the handoff
+    bool hand_over(int connection);
+
+    std::string m_path;
+    int m_previous;  // Connection to the previous process until confirmed
+    int m_listen;
+    std::vector<int> m_listen_fds;
+    int m_cache_fd;
+    std::function<void()> m_on_handoff;
+    std::thread m_thread;
+};
+
+#endif // HOT_RESTART_HPP
@@ -0,0 +1,64 @@
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HPACK header compression for HTTP/2 (RFC 7541). An instance holds the
+// dynamic table the peer builds with the header blocks it sends, so it
+// decodes the blocks of one direction of one connection, in order. Encoding
+// never adds to the peer's table: fields are indexed in the static table or
+// sent as literals, which keeps the encoder stateless.
+class Hpack {
+public:
+    using Header = std::pair<std::string, std::string>;
+
+    // max_table_size is the SETTINGS_HEADER_TABLE_SIZE we announced, the peer
+    // may not grow the table beyond it. Decoded header lists longer than
+    // max_list_size (names, values and 32 bytes per field) are not returned.
+    explicit Hpack(size_t max_table_size = 4096, size_t max_list_size = 64 * 1024);
+
+    // Decodes a complete header block and appends its fields to headers.
+    // Returns false, with headers left unchanged, if the list is longer than
+    // max_list_size; the table is updated either way. Throws
+    // std::runtime_error if the block is malformed, after which the table is
+    // out of step with the peer's and the connection cannot go on.
+    bool decode(std::string_view block, std::vector<Header> &headers);
+
+    // Appends the header block of headers to out. Names must be lowercase.
+    static void encode(const std::vector<Header> &headers, std::string &out);
+
+    // Huffman code of the HPACK table, the last byte padded with ones
+    static void huffman_encode(std::string_view in, std::string &out);
+    static size_t huffman_length(std::string_view in);
+    // Throws std::runtime_error on an invalid code, EOS or padding
+    static void huffman_decode(std::string_view in, std::string &out);
+
+private:
+    // Reads an integer with an n-bit prefix at block[pos], advancing pos
+    static uint64_t read_integer(std::string_view block, size_t &pos, int prefix_bits);
+    static void write_integer(std::string &out, uint8_t flags, int prefix_bits, uint64_t value);
+    static std::string read_string(std::string_view block, size_t &pos);
+    static void write_string(std::string &out, std::string_view value);
+
+    // Field at a combined static and dynamic table index, from 1
+    Header field(uint64_t index) const;
+    void insert(Header header);
+    void evict_to(size_t size);
+
+    size_t m_max_table_size;
+    size_t m_max_list_size;
+    // Set by the peer's dynamic table size updates, up to m_max_table_size
+    size_t m_capacity;
+    // Sum of the entry sizes (name, value and 32 bytes each)
+    size_t m_size;
+    // Newest entry first, at index 62
+    std::deque<Header> m_table;
+};
+
+#endif // HPACK_HPP
@@ -0,0 +1,46 @@
+#ifndef HTML_LINK_SCANNER_HPP
+#define HTML_LINK_SCANNER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Incremental scanner for the subresources an HTML page loads: stylesheets,
+// icons and preloads from <link href>, <script src> and <img src>. The page
+// can be fed in pieces as it arrives; a tag split across two pieces is carried
+// over. Comments and the contents of <script> and <style> are skipped, so
+// markup inside them does not produce links. This is not an HTML parser:
+// it only tokenizes tags and attributes, and gives up on oversized tags.
+class HtmlLinkScanner {
+public:
+    // Appends the raw attribute values of the links found in data to links.
+    void feed(std::string_view data, std::vector<std::string> &links);
+
+    // The href of the page's <base> element, if one was seen
+    const std::string &base() const { return m_base; }
+
+private:
+    // Longer tags are skipped
+    static const size_t MAX_TAG = 4096;
+
+    enum class State {
+        TEXT,       // Between tags
+        TAG,        // After '<', collecting the tag into m_tag
+        SKIP_TAG,   // Inside a tag that is not collected, until '>'
+        COMMENT,    // Inside <!-- -->
+        RAW_TEXT,   // Inside <script> or <style>, until its end tag
+        RAW_END,    // After '<' in raw text, matching "/script" or "/style"
+    };
+
+    void end_tag(std::vector<std::string> &links);
+
+    State m_state = State::TEXT;
+    std::string m_tag;
+    char m_quote = 0;           // Open quote inside the tag, or 0
+    size_t m_dashes = 0;        // Consecutive '-' seen in a comment
+    std::string_view m_raw_end; // "/script" or "/style"
+    size_t m_raw_matched = 0;   // Characters of m_raw_end matched so far
+    std::string m_base;
+};
+
+#endif // HTML_LINK_SCANNER_HPP
@@ -1,12 +1,19 @@
 #ifndef HTTP_PARSER_HPP
 #define HTTP_PARSER_HPP
 
+#include <chrono>
 #include <string>
+#include <string_view>
 #include <map>
 #include <sstream>
 #include <regex>
 #include <algorithm>
 #include <unordered_map>
+#include <vector>
+#include <cstring>
+#include <memory_resource>
+
+#include "header_scan.hpp"
 
 class HTTP_Parser {
 public:
@@ -19,21 +26,99 @@ public:
 
     static bool has_no_store(const std::string& response);
 
-    static void make_revalidate_request(std::string& response, const std::string& old_response);
+    // Makes a request conditional on the validators of the cached response;
+    // each validator that is present is added on its own.
+    static void make_revalidate_request(std::pmr::string& request, std::string_view etag, std::string_view last_modified);
 
     static std::string get_request_body(const std::string& request);
 
     static int get_status_code(const std::string& response);
 
-    static std::pair<std::string, std::string> extract_host_and_port(const std::string &request);
+    // Functions taking a memory resource build their result in it, the
+    // request handlers pass their RequestArena.
+
+    // Lowercased host and the port (default "80") from the Host header.
+    static std::pair<std::pmr::string, std::pmr::string> extract_host_and_port(
+            std::string_view request, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    // The returned views point into the message.
+    static std::string_view extract_http_method(std::string_view request);
+
+    static std::string_view get_request_line(std::string_view message);
+
+    static std::pmr::string make_error_response(int status_code, std::string_view status_text,
+                                                std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    static int get_content_length(std::string_view request);
+
+    // Case-insensitive lookup of a header in the header block of a message,
+    // returns the value without surrounding whitespace or "" if absent.
+    static std::string_view find_header_value(std::string_view message, std::string_view name);
+
+    // True if the request is conditional on the given validators: its
+    // If-None-Match lists etag (weak comparison) or, without If-None-Match,
+    // its If-Modified-Since equals last_modified.
+    static bool matches_validators(std::string_view request, std::string_view etag, std::string_view last_modified);
+
+    // True if every header field name of a complete header block is a token.
+    static bool has_valid_header_names(std::string_view message);
+
+    // Rebuilds a de-chunked response: drops the final chunked coding from
+    // Transfer-Encoding and frames the decoded body with a Content-Length
+    // instead. If other codings remain, such as gzip, Transfer-Encoding keeps
+    // them and the body is left to end with the connection, without a
+    // Content-Length.
+    static std::string make_dechunked_response(const std::string &header_block, const std::string &body);
+
+    // The header block of make_dechunked_response, for a body of the given
+    // length that is sent separately.
+    static std::string make_dechunked_header(const std::string &header_block, size_t length);
+
+    // Cache key of a request: the absolute request target, origin-form targets
+    // are qualified with the host and port.
+    static std::pmr::string get_cache_key(std::string_view request, std::string_view host, std::string_view port,
+                                          std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    // Returns the message with every line of the named header removed.
+    static std::pmr::string remove_header(std::string_view message, std::string_view name,
+                                          std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    // Parses a "bytes=" Range header against a representation of the given length.
+    // Returns false if the header is not a usable byte range set (it should be
+    // ignored), otherwise fills ranges with the satisfiable [first, last] pairs,
+    // sorted and coalesced. An empty result means 416 Range Not Satisfiable.
+    static bool parse_byte_ranges(std::string_view range, size_t length,
+                                  std::vector<std::pair<size_t, size_t>> &ranges);
+
+    // Builds a 206 response for the given ranges of a complete 200 response,
+    // multiple ranges are sent as multipart/byteranges with the given boundary.
+    static std::pmr::string make_partial_response(std::string_view response,
+                                                  const std::vector<std::pair<size_t, size_t>> &ranges,
+                                                  std::string_view boundary,
+                                                  std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
-    static std::string extract_http_method(const std::string &request);
+    // Header block of a 206 response for bytes first to last of the
+    // representation of the given length, whose 200 response has the given
+    // header block. The range is sent separately.
+    static std::pmr::string make_partial_header(std::string_view header_block, size_t first, size_t last,
+                                                size_t length,
+                                                std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
-    static std::string get_request_line(const std::string &request);
+    // Parses an HTTP-date in any of the three formats of RFC 9110 5.6.7:
+    // IMF-fixdate, the obsolete RFC 850 format and asctime(). Returns false
+    // if value is none of them.
+    static bool parse_http_date(std::string_view value, std::chrono::system_clock::time_point &time);
 
-    static std::string make_error_response(int status_code, const std::string &status_text);
+    // Header block of a stored response served from the cache, whose body is
+    // sent separately. Drops the hop-by-hop Connection, Keep-Alive and
+    // Proxy-Connection fields and the stored Age, then adds an Age of age
+    // seconds, a Via for this proxy, a Date if the origin sent none, and
+    // Connection: close.
+    static std::pmr::string make_hit_header(std::string_view header_block, uint64_t age,
+                                            std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
-    static int get_content_length(const std::string& request);
+    static std::pmr::string make_range_not_satisfiable(
+            size_t length, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 };
 
 #endif // HTTP_PARSER_HPP
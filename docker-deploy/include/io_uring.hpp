@@ -0,0 +1,94 @@
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// Minimal io_uring ring over the raw system calls (no liburing dependency).
+// Not thread-safe: each ring belongs to the one thread that submits to it.
+class IoUring {
+public:
+    explicit IoUring(unsigned entries);
+
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    // Runtime probe: the kernel allows io_uring and supports the opcodes and
+    // features the proxy relies on (multishot accept, provided buffer rings).
+    static bool supported();
+
+    // Next free submission entry, zeroed. Submits pending entries to make room
+    // if the queue is full; returns null if the kernel took none of them.
+    io_uring_sqe *get_sqe();
+
+    // Submits all queued entries and waits for at least wait_nr completions.
+    int submit(unsigned wait_nr = 0);
+
+    // Calls handler for every available completion. Returns how many were seen.
+    unsigned for_each_cqe(const std::function<void(const io_uring_cqe &)> &handler);
+
+    int fd() const { return m_fd; }
+
+    // Ring of provided buffers the kernel picks from for IOSQE_BUFFER_SELECT receives.
+    class BufferRing {
+    public:
+        BufferRing(IoUring &ring, uint16_t group, uint16_t count, size_t buffer_size);
+
+        ~BufferRing();
+
+        BufferRing(const BufferRing &) = delete;
+        BufferRing &operator=(const BufferRing &) = delete;
+
+        uint16_t group() const { return m_group; }
+
+        char *buffer(uint16_t bid) const { return m_buffers + size_t(bid) * m_buffer_size; }
+
+        size_t buffer_size() const { return m_buffer_size; }
+
+        // Hands a buffer back to the kernel once its data has been consumed.
+        void recycle(uint16_t bid);
+
+    private:
+        IoUring &m_ring;
+        uint16_t m_group;
+        uint16_t m_count;
+        size_t m_buffer_size;
+        io_uring_buf *m_ring_mem;
+        size_t m_ring_size;
+        char *m_buffers;
+    };
+
+private:
+    int m_fd;
+    unsigned m_sq_entries;
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    io_uring_sqe *m_sqes;
+    size_t m_sqes_size;
+
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    io_uring_cqe *m_cqes;
+
+    unsigned m_sqe_tail;  // Entries handed out by get_sqe, published on submit
+};
+
+#endif // IO_URING_HPP
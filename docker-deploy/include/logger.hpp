@@ -8,6 +8,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <memory>
 #include <mutex>
 #include <filesystem>
 #include <chrono>
@@ -15,36 +17,54 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include "binary_log.hpp"
 #include "cache.hpp"
 #include "http_parser.hpp"
+#include "request_arena.hpp"
+#include "response_meta.hpp"
 
 class CacheEntry;
 
+enum class LogFormat {
+    TEXT,
+    // Compact records for tools/log_decode to turn into the text, see BinaryLog
+    BINARY,
+};
+
 class Logger {
 public:
-    static Logger &GetInstance(const std::string &filename);
-    
-    void request(const std::string &id, int fd, const std::string &request);
-    void not_in_cache(const std::string &id);
-    void cache_status(const std::string &id, std::shared_ptr<CacheEntry> entry);
-    void forward_request(const std::string &id, const std::string &request);
-    void received_response(const std::string &id, const std::string &host, const std::string &response);
-    void cache_result(const std::string &id, std::shared_ptr<CacheEntry> entry);
-    void no_store(const std::string &id);
-    void responding(const std::string &id, const std::string &response);
-    void tunnel_closed(const std::string &id);
-    void note(const std::string &message);
-    void note_with_id(const std::string &id, const std::string &message);
-    void warning(const std::string &message);
-    void error(const std::string &message);
+    static Logger &GetInstance(const std::string &filename, LogFormat format = LogFormat::TEXT);
+
+    // Messages are formatted in the calling thread's RequestArena when it has one.
+    void request(std::string_view id, int fd, std::string_view request);
+    void not_in_cache(std::string_view id);
+    void cache_status(std::string_view id, const CacheEntry &entry);
+    void forward_request(std::string_view id, std::string_view request);
+    void received_response(std::string_view id, std::string_view host, std::string_view response);
+    void received_response(std::string_view id, std::string_view host, const std::string &response,
+                           const ResponseMeta &meta);
+    void cache_result(std::string_view id, std::shared_ptr<CacheEntry> entry);
+    void no_store(std::string_view id);
+    void not_cacheable(std::string_view id, std::string_view reason);
+    void responding(std::string_view id, std::string_view response);
+    void responding(std::string_view id, const CacheEntry &entry);
+    void tunnel_closed(std::string_view id);
+    void note(std::string_view message);
+    void note_with_id(std::string_view id, std::string_view message);
+    void warning(std::string_view message);
+    void error(std::string_view message);
+
+    // Writes out buffered binary records, e.g. before the process exits with _exit()
+    void flush();
 
 private:
-    Logger(const std::string &filename);
-    void log(const std::string &message);
+    Logger(const std::string &filename, LogFormat format);
+    void log(std::string_view message);
 
     ~Logger();
 
     std::ofstream file_;
+    std::unique_ptr<BinaryLog> binary_;
     std::mutex mutex_;
 };
 
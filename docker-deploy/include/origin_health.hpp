@@ -0,0 +1,87 @@
+#ifndef ORIGIN_HEALTH_HPP
+#define ORIGIN_HEALTH_HPP
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "logger.hpp"
+
+enum class OriginFailure {
+    NO_SUCH_HOST,  // DNS says the name does not exist (NXDOMAIN)
+    CONNECT,       // Every address refused the connection or timed out
+    UPSTREAM,      // Temporary resolver failure, or the exchange failed after connecting
+};
+
+struct NegativeCacheConfig {
+    // Requests to an origin fail fast for this long after a failure of that kind
+    std::chrono::seconds no_such_host_ttl{30};
+    std::chrono::seconds connect_failure_ttl{5};
+    // Lifetime of heuristically cacheable error responses (404, 410, 501...)
+    // that carry no explicit freshness
+    std::chrono::seconds error_response_ttl{10};
+    // Consecutive failures that open an origin's circuit breaker, and how
+    // long it stays open before a probe request is let through
+    unsigned failure_threshold = 5;
+    std::chrono::seconds open_time{30};
+};
+
+// Thrown when an origin cannot be reached, or is not tried because it failed recently.
+class OriginError : public std::runtime_error {
+public:
+    OriginError(OriginFailure failure, const std::string &message) : std::runtime_error(message), m_failure(failure) {}
+
+    OriginFailure failure() const { return m_failure; }
+
+private:
+    OriginFailure m_failure;
+};
+
+// Remembers failing origins (host:port) so requests to them fail fast instead
+// of each tying up a worker in DNS lookups, connects and timeouts. A DNS or
+// connect failure blocks the origin for a short TTL; consecutive failures of
+// any kind open a circuit breaker. When an open breaker's time is up, one
+// request is let through as a probe: success closes the breaker, failure
+// opens it again. Healthy origins are not tracked, so while none is failing
+// allow() is a single atomic load.
+class OriginHealth {
+public:
+    OriginHealth(Logger &logger, const NegativeCacheConfig &config);
+
+    // False if requests to the origin should fail fast. Every request that is
+    // allowed must report its outcome with record_success or record_failure.
+    bool allow(std::string_view host, std::string_view port);
+
+    void record_success(std::string_view host, std::string_view port);
+
+    void record_failure(std::string_view host, std::string_view port, OriginFailure failure);
+
+    static const char *name(OriginFailure failure);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct State {
+        unsigned failures = 0;          // Consecutive
+        bool open = false;              // Circuit breaker tripped
+        bool probing = false;           // A probe request is in flight
+        Clock::time_point blocked_until;
+    };
+
+    // Tracked origins beyond this are pruned of entries that are no longer blocking
+    static const size_t MAX_ORIGINS = 4096;
+
+    void prune(Clock::time_point now);
+
+    Logger &m_logger;
+    NegativeCacheConfig m_config;
+    std::mutex m_mutex;
+    std::map<std::string, State, std::less<>> m_states;
+    std::atomic<size_t> m_tracked;  // m_states.size(), read without the lock
+};
+
+#endif // ORIGIN_HEALTH_HPP
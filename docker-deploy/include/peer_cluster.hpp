@@ -0,0 +1,60 @@
+#ifndef PEER_CLUSTER_HPP
+#define PEER_CLUSTER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hash_ring.hpp"
+
+struct PeerConfig {
+    // host:port of every proxy in the cluster, the same list on every node.
+    // Empty disables peering.
+    std::vector<std::string> peers;
+    // This node, as it appears in peers
+    std::string self;
+    // Ring points per node
+    size_t virtual_nodes = 64;
+};
+
+// Static set of proxy nodes sharing their caches. Every URL has one owner
+// node, picked by a consistent-hash ring over the peer list. A node that
+// misses on a URL owned by another node asks the owner for it instead of
+// the origin, so each object is fetched and stored once in the cluster.
+//
+// The internal protocol is the proxy protocol itself: the client's request
+// is sent to the owner's proxy port with a Via entry naming the sender, as
+// any proxy forwarding a request would add. The owner answers it from its
+// cache or the origin like any request, but never passes a request that came
+// through a peer on to another one, so nodes whose peer lists disagree
+// cannot loop.
+class PeerCluster {
+public:
+    struct Peer {
+        std::string name;  // host:port
+        std::string host;
+        std::string port;
+    };
+
+    // Throws std::invalid_argument if a peer is not host:port or self is not listed.
+    explicit PeerCluster(const PeerConfig &config);
+
+    // The node owning url, or nullptr if this node owns it
+    const Peer *owner(std::string_view url) const;
+
+    const std::string &self() const { return m_peers[m_self].name; }
+
+    // The Via header a request passed on to a peer carries
+    std::string_view via() const { return m_via; }
+
+    // True if request passed through another node of the cluster
+    bool is_peer_request(std::string_view request) const;
+
+private:
+    std::vector<Peer> m_peers;
+    size_t m_self;
+    HashRing m_ring;
+    std::string m_via;
+};
+
+#endif // PEER_CLUSTER_HPP
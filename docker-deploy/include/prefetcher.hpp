@@ -0,0 +1,93 @@
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "cache.hpp"
+#include "logger.hpp"
+
+struct PrefetchConfig {
+    bool enabled = false;
+    // Subresources prefetched per HTML page at most
+    size_t per_page = 16;
+    // Prefetches started per second, over all pages
+    unsigned rate = 10;
+    // Pages waiting to be scanned; more are not prefetched for
+    size_t max_pending_pages = 32;
+    // Bytes scanned from the start of each page
+    size_t scan_limit = 256 * 1024;
+    // A URL is not prefetched again this soon, whatever page links to it;
+    // after that only a fresh cache entry keeps it from being refetched
+    std::chrono::seconds seen_for = std::chrono::seconds(60);
+};
+
+// Warms the cache with the stylesheets, scripts and images of HTML pages the
+// proxy has just fetched, before the browser asks for them. Pages are scanned
+// and their same-origin subresources fetched one at a time on a background
+// thread with a lowered scheduling priority, at a limited rate and up to a
+// budget per page, so prefetching never competes with client requests for
+// workers. A URL is not prefetched again within seen_for of the last time.
+class Prefetcher {
+public:
+    // Fetches one absolute URL into the cache; called on the prefetch thread.
+    // id is the request that fetched the page.
+    using Fetch = std::function<void(const std::string &id, const std::string &url)>;
+
+    Prefetcher(Logger &logger, const PrefetchConfig &config, Fetch fetch);
+
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher &) = delete;
+    Prefetcher &operator=(const Prefetcher &) = delete;
+
+    // Queues a cached response for scanning if it is an HTML page. Never blocks.
+    void offer(std::string_view id, std::shared_ptr<CacheEntry> page);
+
+    // Resolves link against the page's URL (or its <base>) into an absolute
+    // http URL on the same origin. Returns false for other origins and schemes.
+    static bool resolve(std::string_view page_url, std::string_view base, std::string_view link, std::string &url);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Page {
+        std::string id;
+        std::shared_ptr<CacheEntry> entry;
+    };
+
+    // Recently seen URLs kept at most; when full, those older than seen_for
+    // are dropped, and if that frees no room, all of them
+    static const size_t MAX_SEEN = 4096;
+    // Pieces the page is fed to the scanner in
+    static const size_t SCAN_CHUNK = 16 * 1024;
+
+    void run();
+
+    void prefetch(const Page &page);
+
+    // Waits for the next rate limit slot; false if the prefetcher is stopping
+    bool wait_for_slot(std::unique_lock<std::mutex> &lock);
+
+    Logger &m_logger;
+    PrefetchConfig m_config;
+    Fetch m_fetch;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Page> m_pages;
+    // When each recently prefetched URL was last started
+    std::unordered_map<std::string, Clock::time_point> m_seen;
+    Clock::time_point m_next_slot;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+#endif // PREFETCHER_HPP
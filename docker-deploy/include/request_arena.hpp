@@ -0,0 +1,70 @@
+#ifndef REQUEST_ARENA_HPP
+#define REQUEST_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// Monotonic memory resource for the temporaries of one request: the request
+// buffer, parsed fields, log lines and error responses. Allocations are bumped
+// out of fixed-size blocks that go back to a small per-thread cache when the
+// arena is destroyed, so a warmed-up worker handles a request without touching
+// the global heap for them. Deallocating a small allocation does nothing, it
+// is released with the arena; allocations over a quarter of a block, or more
+// aligned than max_align_t, come from the heap and are freed at once.
+//
+// Arenas live on the stack of the thread handling the request. The innermost
+// one is that thread's current() resource, which the logger formats into.
+class RequestArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+    // Blocks each thread keeps for reuse, more are returned to the heap
+    static constexpr size_t CACHED_BLOCKS = 8;
+
+    struct Stats {
+        uint64_t arenas;         // Arenas created
+        uint64_t heap_blocks;    // Blocks allocated from the global heap
+        uint64_t reused_blocks;  // Blocks taken from a thread's cache
+        uint64_t large;          // Allocations larger than a block, served by the heap
+    };
+
+    RequestArena();
+
+    ~RequestArena() override;
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    // Bytes handed out so far, including alignment padding
+    size_t used() const { return m_used; }
+
+    // The innermost arena alive on the calling thread, or the default
+    // resource outside of a request.
+    static std::pmr::memory_resource *current();
+
+    // Process-wide counters
+    static Stats stats();
+
+private:
+    struct Block {
+        Block *next;
+        size_t alignment;  // Of the payload, large allocations only
+    };
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    void *allocate_large(size_t bytes, size_t alignment);
+
+    Block *m_blocks;  // Bump blocks in use, newest first
+    Block *m_large;   // Oversized allocations
+    char *m_cursor;
+    char *m_end;
+    size_t m_used;
+    RequestArena *m_previous;  // Enclosing arena on this thread
+};
+
+#endif // REQUEST_ARENA_HPP
@@ -0,0 +1,67 @@
+#ifndef RESPONSE_META_HPP
+#define RESPONSE_META_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Everything the proxy needs to know about a stored response, parsed once when
+// it is received. Header values are kept as offset/length spans into the
+// response string they were parsed from, so the struct stays small and fixed
+// size and is only meaningful together with that string.
+struct ResponseMeta {
+    // Cache-Control directives, as bits of cache_control
+    enum Directive : uint16_t {
+        CC_PRESENT = 1 << 0,          // The response has a Cache-Control header
+        NO_STORE = 1 << 1,
+        NO_CACHE = 1 << 2,
+        MUST_REVALIDATE = 1 << 3,
+        PROXY_REVALIDATE = 1 << 4,
+        PRIVATE = 1 << 5,
+        PUBLIC = 1 << 6,
+        MAX_AGE = 1 << 7,             // max_age holds the value
+        S_MAXAGE = 1 << 8,            // s_maxage holds the value
+        NO_TRANSFORM = 1 << 9,
+        IMMUTABLE = 1 << 10,
+    };
+
+    uint64_t content_length = 0;      // Bytes after the header block
+    uint32_t header_length = 0;       // Status line and headers including the blank line
+    uint32_t etag_offset = 0;
+    uint32_t last_modified_offset = 0;
+    uint32_t cache_control_offset = 0;
+    int32_t max_age = 0;              // Seconds, valid if MAX_AGE is set
+    int32_t s_maxage = 0;             // Seconds, valid if S_MAXAGE is set
+    uint16_t etag_length = 0;
+    uint16_t last_modified_length = 0;
+    uint16_t cache_control_length = 0;
+    uint16_t status_line_length = 0;  // Without the CRLF
+    uint16_t status = 0;              // 0 if the status line is malformed
+    uint16_t cache_control = 0;
+
+    static ResponseMeta parse(const std::string &response);
+
+    bool has(Directive directive) const { return (cache_control & directive) != 0; }
+
+    size_t body_offset() const { return header_length; }
+
+    std::string_view status_line(const std::string &response) const {
+        return std::string_view(response).substr(0, status_line_length);
+    }
+
+    std::string_view etag(const std::string &response) const {
+        return std::string_view(response).substr(etag_offset, etag_length);
+    }
+
+    std::string_view last_modified(const std::string &response) const {
+        return std::string_view(response).substr(last_modified_offset, last_modified_length);
+    }
+
+    std::string_view cache_control_value(const std::string &response) const {
+        return std::string_view(response).substr(cache_control_offset, cache_control_length);
+    }
+};
+
+static_assert(sizeof(ResponseMeta) <= 48, "ResponseMeta should stay compact");
+
+#endif // RESPONSE_META_HPP
@@ -0,0 +1,72 @@
+#ifndef RESPONSE_READER_HPP
+#define RESPONSE_READER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "chunked_decoder.hpp"
+#include "spooled_body.hpp"
+
+// Frames one HTTP response from the bytes read off an origin connection, so
+// the blocking and the non-blocking clients share the rules: the header ends
+// at the first blank line, 1xx, 204 and 304 have no body, a chunked body ends
+// with its last chunk and is decoded, a Content-Length body ends after that
+// many bytes, and any other body ends when the connection closes.
+//
+// A body larger than the spool threshold is written to a SpooledBody in the
+// spool directory as it arrives instead of being kept in memory.
+class ResponseReader {
+public:
+    ResponseReader();
+
+    // Spools bodies of more than threshold bytes to a file in dir: those
+    // announced that large up front, others once they grow past it. Call
+    // before the first feed.
+    void spool_over(size_t threshold, const std::string &dir);
+
+    // Adds bytes read from the connection. Returns true once the response is
+    // complete; anything after its end is ignored. Throws std::runtime_error
+    // on an invalid Content-Length or chunk framing.
+    bool feed(const char *data, size_t len);
+
+    bool done() const { return m_state == State::DONE; }
+
+    // The response, once done or when the connection closed. Only a body
+    // delimited by the connection closing can end there; a response cut short
+    // in its header, its Content-Length body or its chunks throws
+    // std::runtime_error. Chunked bodies are returned decoded. A spooled body
+    // is not part of the response, which then ends with its header block.
+    std::string finish();
+
+    // The body, if it was spooled
+    std::shared_ptr<SpooledBody> spooled_body() const { return m_spool; }
+
+private:
+    enum class State {
+        HEADER,   // Before the end of the header
+        LENGTH,   // Reading a Content-Length body
+        CHUNKED,  // Decoding a chunked body
+        CLOSE,    // Reading a body delimited by the connection closing
+        DONE
+    };
+
+    // Picks the framing of the body once the header is complete
+    void start_body();
+
+    // Moves the body received so far out of buffer into a new spool file
+    void start_spool(std::string &buffer, size_t body_start);
+
+    State m_state;
+    std::string m_response;
+    size_t m_scanned;
+    size_t m_body_start;
+    size_t m_length;
+    ChunkedDecoder m_decoder;
+    std::string m_body;  // Decoded chunked body
+    size_t m_spool_threshold;  // 0 keeps every body in memory
+    std::string m_spool_dir;
+    std::shared_ptr<SpooledBody> m_spool;
+};
+
+#endif // RESPONSE_READER_HPP
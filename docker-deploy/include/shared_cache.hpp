@@ -0,0 +1,108 @@
+#ifndef SHARED_CACHE_HPP
+#define SHARED_CACHE_HPP
+
+#include <pthread.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "response_meta.hpp"
+
+class CacheEntry;
+
+// Cache storage in a memfd-backed shared memory region, for running several
+// proxy processes on one host with one cache and one memory budget. The
+// region is created and mapped by the parent before it forks the workers,
+// which inherit the mapping.
+//
+// Responses are appended to a byte ring that makes up most of the region;
+// when the ring wraps, the oldest records are overwritten, which is the
+// eviction policy (FIFO). A set-associative index of fixed slots maps URL
+// hashes to ring positions. Positions count every byte ever written, so a
+// slot whose record has been overwritten is recognised and ignored without
+// being cleaned up.
+//
+// The region is guarded by a robust process-shared mutex. If a process dies
+// holding it, the next process to lock it drops every slot whose record does
+// not check out and carries on; records are written before their slot, so a
+// crash loses at most the entry being stored.
+//
+// The memfd can also be passed to a new proxy binary on a hot restart, which
+// attaches to it and keeps the cache warm. The magic number names the layout
+// version and must change with Header, Slot or Record.
+class SharedCache {
+public:
+    struct Stats {
+        uint64_t entries;      // Slots holding a record that has not been overwritten
+        uint64_t capacity;     // Bytes in the ring
+        uint64_t written;      // Bytes ever appended
+        uint64_t recoveries;   // Times the mutex was found with a dead owner
+    };
+
+    // Throws std::runtime_error if the region cannot be created.
+    explicit SharedCache(size_t size);
+
+    // Maps the region in fd, created by another process, and takes ownership
+    // of fd. Throws std::runtime_error if it is not a region of this layout.
+    static std::unique_ptr<SharedCache> attach(int fd);
+
+    ~SharedCache();
+
+    SharedCache(const SharedCache &) = delete;
+    SharedCache &operator=(const SharedCache &) = delete;
+
+    // Copies the entry for url out of the region
+    bool get(std::string_view url, std::shared_ptr<CacheEntry> &entry);
+
+    // Stores a copy of entry, replacing any entry for its URL. Returns false
+    // if it is too large for the region.
+    bool put(const CacheEntry &entry);
+
+    Stats stats();
+
+    // The memfd holding the region
+    int fd() const { return m_fd; }
+
+private:
+    struct Header;
+    struct Slot;
+    struct Record;
+
+    // Entries larger than this part of the ring are not stored
+    static const size_t MAX_RECORD_FRACTION = 8;
+    // Slots per index bucket
+    static const size_t WAYS = 8;
+
+    SharedCache(int fd, void *base, size_t size);
+
+    // Points m_header, m_slots and m_ring into the mapping
+    void locate(size_t slot_count);
+
+    class Lock {
+    public:
+        explicit Lock(SharedCache &cache);
+        ~Lock();
+
+    private:
+        SharedCache &m_cache;
+    };
+
+    // The record a slot points to, or nullptr if it was overwritten or does not check out
+    const Record *record(const Slot &slot) const;
+
+    Slot *bucket(uint64_t hash) const;
+
+    void recover();
+
+    int m_fd;
+    void *m_base;
+    size_t m_size;
+    Header *m_header;
+    Slot *m_slots;
+    char *m_ring;
+};
+
+#endif // SHARED_CACHE_HPP
@@ -0,0 +1,38 @@
+#ifndef SPOOLED_BODY_HPP
+#define SPOOLED_BODY_HPP
+
+#include <cstddef>
+#include <string>
+
+// A response body kept in an unlinked temporary file instead of memory. The
+// file goes away with the last descriptor, so nothing is left behind if the
+// process dies. Written by one thread while the response is received, then
+// only read, which any number of threads may do at once: sending uses
+// sendfile() with an explicit offset and never moves the file position.
+class SpooledBody {
+public:
+    // Creates the file in dir. Throws std::runtime_error if it cannot.
+    explicit SpooledBody(const std::string &dir);
+
+    ~SpooledBody();
+
+    SpooledBody(const SpooledBody &) = delete;
+    SpooledBody &operator=(const SpooledBody &) = delete;
+
+    // Throws std::runtime_error if the write fails, e.g. the disk is full
+    void append(const char *data, size_t len);
+
+    size_t size() const { return m_size; }
+
+    // Sends length bytes from offset to a socket, looping over partial
+    // sends. Throws std::runtime_error if the peer goes away.
+    void send_to(int socket, size_t offset, size_t length) const;
+
+    void send_to(int socket) const { send_to(socket, 0, m_size); }
+
+private:
+    int m_fd;
+    size_t m_size;
+};
+
+#endif // SPOOLED_BODY_HPP
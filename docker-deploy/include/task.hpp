@@ -0,0 +1,142 @@
+#ifndef TASK_HPP
+#define TASK_HPP
+
+// C++20 only, part of the coroutine build (make coro)
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <typename T>
+class Task;
+
+namespace task_detail {
+// Resumes whoever awaited the task once it finishes
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+};
+}  // namespace task_detail
+
+// Lazily started coroutine producing a T. Awaiting a task runs it until it
+// first suspends; when it finishes, the awaiting coroutine is resumed on the
+// same thread (symmetric transfer, so long chains do not grow the stack).
+// Exceptions propagate to the awaiting coroutine.
+template <typename T = void>
+class Task {
+public:
+    using promise_type = task_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) : m_handle(handle) {}
+
+    Task(Task &&other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+
+    T await_resume() {
+        promise_type &promise = m_handle.promise();
+        if (promise.exception) {
+            std::rethrow_exception(promise.exception);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*promise.value);
+        }
+    }
+
+private:
+    Handle m_handle;
+};
+
+namespace task_detail {
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Coroutine that starts at once and frees itself when it finishes
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() noexcept {}
+
+        // Tasks given to spawn handle their own errors
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+}  // namespace task_detail
+
+// Runs task on the calling thread until it first suspends and lets it finish
+// on its own. The task must not throw.
+inline task_detail::Detached spawn(Task<void> task) {
+    co_await std::move(task);
+}
+
+#endif // TASK_HPP
@@ -6,39 +6,85 @@
 #define TCP_CLIENT_HPP
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <vector>
+#include "address_health.hpp"
+#include "deadline.hpp"
 #include "http_parser.hpp"
+#include "response_reader.hpp"
 
 const int BUFFER_SIZE = 1024;
+
+// Why the last connect() failed
+enum class ConnectError {
+    NONE,
+    NO_SUCH_HOST,  // The name does not resolve
+    RESOLVE,       // Temporary or other resolver failure
+    CONNECT,       // Every address refused the connection or timed out
+};
+
 class Client {
    public:
-    Client();
+    // Connect and I/O are bounded by the upstream deadlines when given.
+    explicit Client(Deadlines *deadlines = nullptr);
 
     ~Client();
 
-    bool connect(const std::string &host, const std::string &port);
+    // Races the resolved addresses (RFC 8305): a new attempt starts every
+    // CONNECT_ATTEMPT_DELAY, or as soon as one fails, until one connects or
+    // the upstream connect deadline passes.
+    bool connect(std::string_view host, std::string_view port);
+
+    ConnectError connect_error() const { return m_connect_error; }
+
+    bool send(std::string_view data) const;
 
-    bool send(const std::string &data) const;
+    // Receives one complete response, chunked bodies are decoded and returned
+    // with a Content-Length. Returns "" if the server sent nothing usable.
+    std::string receive();
 
-    std::string receive(int original_client_fd);
+    // Makes receive() spool bodies of more than threshold bytes to a file in
+    // dir; the response then ends with its header block.
+    void spool_over(size_t threshold, const std::string &dir);
+
+    // The body of the last response, if it was spooled
+    std::shared_ptr<SpooledBody> spooled_body() const { return m_spooled_body; }
 
     void close();
 
     int getFd() const { return sockfd; }
 
+    // Gives up ownership of the socket, the caller must close it.
+    int release();
+
    private:
+    static constexpr std::chrono::milliseconds CONNECT_ATTEMPT_DELAY{250};
+
+    // Returns the connected socket, in blocking mode, or -1
+    int race(const std::vector<const addrinfo *> &addresses);
+
     int sockfd;
-    void handle_chunked_response(int original_client_fd, const std::string& response) const;
+    Deadlines *m_deadlines;
+    ConnectError m_connect_error;
+    size_t m_spool_threshold;
+    std::string m_spool_dir;
+    std::shared_ptr<SpooledBody> m_spooled_body;
 };
 
 #endif  // TCP_CLIENT_HPP
@@ -5,89 +5,378 @@
 #define TCP_SERVER_HPP
 
 #include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
 #include <netdb.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <uuid/uuid.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
 
 #include "cache.hpp"
+#include "deadline.hpp"
+#include "epoch_reclaimer.hpp"
+#include "h2_connection.hpp"
 #include "http_parser.hpp"
 #include "logger.hpp"
+#include "origin_health.hpp"
+#include "peer_cluster.hpp"
+#include "prefetcher.hpp"
+#include "request_arena.hpp"
+#include "spooled_body.hpp"
 #include "tcp_client.hpp"
 #include "thread_pool.hpp"
+#include "io_uring.hpp"
+#include "tunnel_reactor.hpp"
+#include "uring_tunnel_reactor.hpp"
+
+#ifdef PROXY_COROUTINES
+#include "async_socket.hpp"
+#include "event_loop.hpp"
+#include "task.hpp"
+#endif
+
+struct ServerConfig {
+    // Listen backlog, the kernel caps it at net.core.somaxconn
+    int backlog = 1024;
+    // With listeners > 1 one SO_REUSEPORT listen socket is opened per acceptor
+    // thread, each acceptor is pinned to its own CPU.
+    size_t listeners = 1;
+    // Listen sockets opened by the parent or handed over by a previous
+    // process, owned by the server from then on. When set no socket is
+    // opened and there is one acceptor per socket.
+    std::vector<int> listen_sockets;
+    DeadlineConfig deadlines;
+    // Threads serving the requests that wait on an origin: misses,
+    // revalidations, POST and CONNECT. Request workers read and classify every
+    // request and answer fresh cache hits themselves, so hits never queue
+    // behind slow origins, and at most this many requests wait on origins at
+    // once. 0 serves everything on the request workers.
+    size_t upstream_threads = 0;
+    // Coroutine build only (make coro): epoll threads running one coroutine
+    // per connection. GET requests are read, answered from the cache and
+    // fetched from the origin without holding a thread; other requests are
+    // handed to the worker threads. 0 keeps one worker thread per request.
+    size_t event_loops = 0;
+    // Threads relaying CONNECT tunnels, 0 keeps each tunnel on its request worker
+    size_t tunnel_threads = 2;
+    // Accept connections and relay tunnels through io_uring when the kernel
+    // supports it; the epoll and blocking paths remain the fallback.
+    bool io_uring = false;
+    // Fail-fast TTLs and circuit breaker for failing origins, and the lifetime
+    // of cached error responses
+    NegativeCacheConfig negative;
+    // Background prefetching of the subresources of fetched HTML pages
+    PrefetchConfig prefetch;
+    // Other proxy nodes sharing their caches with this one
+    PeerConfig cluster;
+    // HTTP/2 with prior knowledge (h2c). A connection is served on the request
+    // worker that read its preface, as long as it stays open; its streams run
+    // on h2.stream_threads threads of their own.
+    H2Config h2;
+    // Response bodies of more than this many bytes are spooled to an unlinked
+    // file in spool_dir while they are fetched, cached in that file and sent
+    // with sendfile(). 0 keeps every body in memory.
+    size_t spool_threshold = 0;
+    std::string spool_dir = "/tmp";
+    // Cache hits whose in-memory body has at least this many bytes are sent
+    // with MSG_ZEROCOPY, from the cached entry without copying it into the
+    // socket buffer. Pays off for bodies of hundreds of kilobytes and up; 0
+    // always copies.
+    size_t zerocopy_threshold = 0;
+};
 
 class Server {
 public:
-    Server(std::string port, size_t numThreads, Logger &logger, Cache &cache);
+    Server(std::string port, size_t numThreads, Logger &logger, Cache &cache,
+           const ServerConfig &config = ServerConfig());
 
     ~Server();
 
+    // Accepts connections until stop_accepting is called
     void start();
     void end();
 
+    // Makes start return; connections already accepted are still served.
+    // Only writes an eventfd, so it may be called from a signal handler.
+    void stop_accepting();
+
+    // Waits for the requests in progress and the tunnels to finish. Returns
+    // false if some are still open after timeout.
+    bool drain(std::chrono::milliseconds timeout);
+
+    const std::vector<int> &listen_sockets() const { return m_listenSockets; }
+
+    // Throws std::runtime_error if no address can be bound
+    static int open_listen_socket(const std::string &port, int backlog, bool reuse_port);
+
 private:
-    static const int BACKLOG = 10;
+    // Larger range sets are answered with the full object
+    static const size_t MAX_RANGES = 32;
+    static const size_t MAX_HEADER_SIZE = 64 * 1024;
+    // Bounds an accept that lost a connection to another process on the same socket
+    static const int ACCEPT_TIMEOUT_SECONDS = 1;
+    // Longest wait for a client to take a response, after which it is dropped
+    static constexpr std::chrono::seconds CLIENT_SEND_TIMEOUT{60};
     std::string m_port;
-    int m_listenSocket;
+    int m_backlog;
+    std::vector<int> m_listenSockets;
+    // Signalled by stop_accepting, never reset
+    int m_stop_fd;
+    // Connections dispatched and not finished yet
+    std::atomic<size_t> m_in_flight;
+    // Request workers of the first acceptor, or of the only one
     ThreadPool m_threadPool;
+    // Request workers of the other acceptors, one pool and queue each
+    std::vector<std::unique_ptr<ThreadPool>> m_acceptor_pools;
+    // Requests that need the origin, when they are kept off m_threadPool
+    std::unique_ptr<ThreadPool> m_slow_lane;
+    // Streams of HTTP/2 connections, null if HTTP/2 is off
+    std::unique_ptr<ThreadPool> m_h2_streams;
+    H2Config m_h2;
     Logger &m_logger;
     Cache &m_cache;
+    Deadlines m_deadlines;
+    OriginHealth m_origins;
+    std::chrono::seconds m_error_response_ttl;
+    size_t m_spool_threshold;
+    std::string m_spool_dir;
+    size_t m_zerocopy_threshold;
+    bool m_io_uring;
+    std::unique_ptr<TunnelRelay> m_tunnels;
+    // URLs whose full object is being fetched in the background for Range requests
+    std::unordered_set<std::string> m_range_fetches;
+    std::mutex m_range_mutex;
+    std::unique_ptr<PeerCluster> m_cluster;
+    // Declared last: its thread calls back into the server until it is destroyed
+    std::unique_ptr<Prefetcher> m_prefetcher;
+#ifdef PROXY_COROUTINES
+    // Destroyed in end(), after the pools whose tasks resume coroutines on them
+    std::vector<std::unique_ptr<EventLoop>> m_loops;
+    std::atomic<size_t> m_next_loop{0};
+    // First block of the per-connection arena, it grows as needed
+    static constexpr size_t CONNECTION_ARENA_SIZE = 16 * 1024;
+#endif
+
+    // Request workers each acceptor gets, numThreads split evenly
+    static size_t workers_per_acceptor(size_t numThreads, const ServerConfig &config);
+
+    void accept_loop(int listenSocket, ThreadPool &workers);
 
-    std::string receive_request(int clientSocket);
+    void accept_loop_uring(int listenSocket, ThreadPool &workers);
 
-    std::string generate_uuid();
+    void dispatch(int clientSocket, ThreadPool &workers);
+
+    // Request handlers allocate their temporaries from the request's arena
+    std::pmr::string receive_request(int clientSocket, std::pmr::memory_resource *arena);
+
+    std::pmr::string generate_uuid(std::pmr::memory_resource *arena);
 
     void handle_request(int clientSocket);
 
+    // Runs a request handed to the slow lane
+    void handle_slow(int clientSocket, const std::string &id, const std::string &request);
+
+    // Serves an HTTP/2 connection whose preface request has been read, then
+    // closes clientSocket
+    void serve_h2(int clientSocket, std::string_view request);
+
+    // Serves a request that may need the origin. Closes clientSocket unless a
+    // tunnel took it over.
+    void handle_upstream(int clientSocket,
+                         std::pmr::memory_resource *arena,
+                         std::string_view id,
+                         std::string_view host,
+                         std::string_view port,
+                         std::string_view method,
+                         std::string_view request);
+
+    // Answers a GET from the cache if it holds a fresh entry that needs no
+    // revalidation. Returns false, having sent nothing, otherwise. Entries
+    // that are quick to send are sent under an EpochReclaimer::Guard without
+    // taking a reference on them.
+    bool serve_fresh_hit(int clientSocket,
+                         std::pmr::memory_resource *arena,
+                         std::string_view id,
+                         std::string_view host,
+                         std::string_view port,
+                         std::string_view request);
+
+    // True if forward_entry sends entry from memory without waiting on the
+    // kernel: no spooled body and no MSG_ZEROCOPY
+    bool quick_to_send(const CacheEntry &entry) const;
+
     void handle_GET(int clientSocket,
-                    const std::string &id,
-                    const std::string &host,
-                    const std::string &port,
-                    const std::string &request);
+                    std::pmr::memory_resource *arena,
+                    std::string_view id,
+                    std::string_view host,
+                    std::string_view port,
+                    std::string_view request);
 
     void handle_miss(int clientSocket,
-                     const std::string &id,
-                     const std::string &host,
-                     const std::string &port,
-                     const std::string &request);
+                     std::pmr::memory_resource *arena,
+                     std::string_view id,
+                     std::string_view host,
+                     std::string_view port,
+                     std::string_view url,
+                     std::string_view request);
+
+    // Serves a GET whose entry only holds validators: answers a conditional
+    // request on them, refreshing them when they expired; anything else is a miss
+    void handle_validators(int clientSocket,
+                           std::pmr::memory_resource *arena,
+                           std::string_view id,
+                           std::string_view host,
+                           std::string_view port,
+                           std::string_view url,
+                           std::string_view request,
+                           std::shared_ptr<CacheEntry> entry);
 
     void handle_refresh(int clientSocket,
-                        const std::string &id,
-                        const std::string &host,
-                        const std::string &port,
-                        const std::string &request,
+                        std::string_view id,
+                        std::string_view host,
+                        std::string_view port,
+                        std::string_view url,
+                        std::string_view request,
                         std::shared_ptr<CacheEntry> entry);
 
     void handle_revalidate(int clientSocket,
-                           const std::string &id,
-                           const std::string &host,
-                           const std::string &port,
-                           const std::string &request,
+                           std::pmr::memory_resource *arena,
+                           std::string_view id,
+                           std::string_view host,
+                           std::string_view port,
+                           std::string_view url,
+                           std::string_view request,
                            std::shared_ptr<CacheEntry> entry);
 
-    void handle_CONNECT(int clientSocket,
-                        const std::string &id,
-                        const std::string &host,
-                        const std::string &port);
+    void handle_range(int clientSocket,
+                      std::pmr::memory_resource *arena,
+                      std::string_view id,
+                      std::string_view host,
+                      std::string_view port,
+                      std::string_view url,
+                      std::string_view request,
+                      std::string_view range);
+
+    void fetch_full_object(std::pmr::memory_resource *arena,
+                           std::string_view id,
+                           std::string_view host,
+                           std::string_view port,
+                           std::string_view url,
+                           std::string_view request);
+
+    // Returns true if the connection was handed to the tunnel reactor
+    bool handle_CONNECT(int clientSocket,
+                        std::string_view id,
+                        std::string_view host,
+                        std::string_view port);
 
     void handle_POST(int clientSocket,
-                     const std::string &id,
-                     const std::string &host,
-                     const std::string &port,
-                     const std::string &request);
+                     std::pmr::memory_resource *arena,
+                     std::string_view id,
+                     std::string_view host,
+                     std::string_view port,
+                     std::string_view request);
+
+    // Serves a miss from the node of the cluster that owns url. Returns false
+    // if this node owns it or the owner could not be reached.
+    bool fetch_from_peer(int clientSocket,
+                         std::pmr::memory_resource *arena,
+                         std::string_view id,
+                         std::string_view url,
+                         std::string_view request);
+
+    // Caches a response from the origin if its status and headers allow it.
+    // Returns the new entry, or null if the response was not cached.
+    std::shared_ptr<CacheEntry> store_response(std::string_view id, std::string_view url,
+                                               const std::string &response, const ResponseMeta &meta,
+                                               std::shared_ptr<SpooledBody> body = nullptr);
+
+    // Fetches a subresource of a page into the cache, on the prefetch thread
+    void prefetch(const std::string &id, const std::string &url);
+
+    void forward_data(int client_fd, int server_fd, std::string_view id);
+
+    // Throws OriginError if the origin cannot be reached or is failing fast.
+    // If body is given, a body over the spool threshold is spooled to it and
+    // left out of the returned response.
+    std::string forward_request(std::string_view host, std::string_view port, std::string_view request,
+                                std::shared_ptr<SpooledBody> *body = nullptr);
+
+    // Connects to the origin, recording the outcome in m_origins
+    void connect_origin(Client &client, std::string_view host, std::string_view port);
+
+    // Sends response, then body if it was spooled
+    void forward_response(int clientSocket, std::string_view response, const SpooledBody *body = nullptr);
+
+    // Sends a cached response with its header rewritten for this hit (see
+    // HTTP_Parser::make_hit_header), the body straight from the entry
+    void forward_entry(int clientSocket, const CacheEntry &entry);
+
+    // The rewritten header of a hit on entry, empty if the stored response
+    // has no header block to rewrite
+    static std::pmr::string hit_header(const CacheEntry &entry, std::pmr::memory_resource *resource);
+
+    // Sends header and body with as few sendmsg() calls as the socket allows;
+    // flags are added to each call
+    static void send_gather(int clientSocket, std::string_view header, std::string_view body, int flags = 0);
+
+    // As send_gather, with MSG_ZEROCOPY. Returns once the kernel no longer
+    // reads from body, resetting the connection if the client does not take
+    // it within CLIENT_SEND_TIMEOUT.
+    static void send_zerocopy(int clientSocket, std::string_view header, std::string_view body);
+
+    // Pool running blocking origin work: the slow lane if there is one
+    ThreadPool &upstream_pool() { return m_slow_lane ? *m_slow_lane : m_threadPool; }
+
+#ifdef PROXY_COROUTINES
+    // Coroutine counterparts of handle_request, receive_request and
+    // forward_request, run on an event loop
+    Task<void> handle_request_async(EventLoop &loop, int clientSocket);
+
+    Task<void> serve_async(EventLoop &loop, AsyncSocket &client, std::pmr::memory_resource *arena);
+
+    Task<std::pmr::string> receive_request_async(AsyncSocket &client, std::pmr::memory_resource *arena);
+
+    // Answers a GET miss or an expired entry, entry is null on a miss
+    Task<void> handle_get_async(EventLoop &loop,
+                                AsyncSocket &client,
+                                std::pmr::memory_resource *arena,
+                                std::string_view id,
+                                std::string_view host,
+                                std::string_view port,
+                                std::string_view url,
+                                std::string_view request,
+                                std::shared_ptr<CacheEntry> entry);
 
-    void forward_data(int client_fd, int server_fd, const std::string &id);
+    Task<std::string> forward_request_async(EventLoop &loop,
+                                            std::string_view host,
+                                            std::string_view port,
+                                            std::string_view request);
 
-    std::string forward_request(int clientSocket, const std::string &host, const std::string &port, const std::string &request);
+    // Coroutine counterpart of forward_entry for entries kept in memory
+    Task<void> send_entry_async(AsyncSocket &client, std::pmr::memory_resource *arena, const CacheEntry &entry);
 
-    void forward_response(int clientSocket, const std::string &response);
+    // Serves the request with the blocking handlers on a worker thread
+    void hand_off(AsyncSocket &client, std::string_view id, std::string_view request);
+#endif
 };
 
 #endif  // TCP_SERVER_HPP
@@ -25,6 +25,9 @@ public:
     // Adds a task to the task queue and waits for a worker thread to execute it.
     void enqueue(std::function<void()> task);
 
+    // Runs the queued tasks and stops all worker threads. Safe to call more than once.
+    void shutdown();
+
 private:
     std::vector<std::thread> m_workers; // Array of worker threads.
     std::queue<std::function<void()>> m_tasks; // Task queue.
@@ -0,0 +1,72 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timer wheel driven by its own ticking thread.
+// Scheduling and cancelling are O(1); each tick only touches the slot that
+// becomes due, and timers in the coarser levels are cascaded down as their
+// slot comes around. Callbacks run on the ticking thread outside the lock.
+class TimerWheel {
+public:
+    using TimerId = uint64_t;
+
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100));
+
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // Runs callback once after delay (rounded up to the next tick).
+    TimerId schedule(std::chrono::milliseconds delay, std::function<void()> callback);
+
+    // Returns false if the timer already fired or was cancelled.
+    bool cancel(TimerId id);
+
+    size_t size();
+
+private:
+    static const int LEVEL_BITS = 6;
+    static const int SLOTS = 1 << LEVEL_BITS;  // Slots per level
+    static const int LEVELS = 4;               // 64^4 ticks, about 19 days at 100ms
+
+    struct Timer {
+        TimerId id;
+        uint64_t expires;  // Absolute tick
+        std::function<void()> callback;
+    };
+    using Slot = std::list<Timer>;
+
+    struct Location {
+        Slot *slot;
+        Slot::iterator it;
+    };
+
+    void place(Timer timer);
+    void advance(std::vector<std::function<void()>> &due);
+    void run();
+
+    std::chrono::milliseconds m_tick;
+    Slot m_slots[LEVELS][SLOTS];
+    std::unordered_map<TimerId, Location> m_index;
+    uint64_t m_now;  // Ticks elapsed since start
+    TimerId m_next_id;
+    std::chrono::steady_clock::time_point m_start;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+#endif // TIMER_WHEEL_HPP
@@ -0,0 +1,115 @@
+#ifndef TUNNEL_REACTOR_HPP
+#define TUNNEL_REACTOR_HPP
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "deadline.hpp"
+#include "logger.hpp"
+
+// Relays established CONNECT tunnels off the request workers.
+class TunnelRelay {
+public:
+    virtual ~TunnelRelay() = default;
+
+    // Takes ownership of both sockets, they are closed when the tunnel ends.
+    virtual void add(int client_fd, int server_fd, const std::string &id) = 0;
+
+    // Tunnels added and not closed yet
+    size_t active() const { return m_active; }
+
+protected:
+    std::atomic<size_t> m_active{0};
+};
+
+// Relays tunnels on a few epoll threads instead of one request worker per
+// tunnel. Each direction has its own buffer; a side is only read while the
+// buffer towards its peer has room, so a slow reader throttles the writer
+// instead of growing memory.
+class TunnelReactor : public TunnelRelay {
+public:
+    TunnelReactor(size_t numThreads, Logger &logger, Deadlines *deadlines);
+
+    ~TunnelReactor() override;
+
+    TunnelReactor(const TunnelReactor &) = delete;
+    TunnelReactor &operator=(const TunnelReactor &) = delete;
+
+    void add(int client_fd, int server_fd, const std::string &id) override;
+
+private:
+    static const size_t BUFFER_CAPACITY = 64 * 1024;
+
+    struct Tunnel;
+
+    // Bytes read from one side and waiting to be written to the other
+    struct Direction {
+        std::unique_ptr<char[]> data;
+        size_t start = 0;
+        size_t end = 0;
+        bool eof = false;       // Source sent FIN
+        bool shut = false;      // FIN forwarded to the destination
+    };
+
+    struct Endpoint {
+        int fd = -1;
+        Tunnel *tunnel = nullptr;
+        uint32_t events = 0;    // Currently registered epoll interest
+        bool hup = false;       // Hung up: drained from its peer's events, no longer polled
+        bool removed = false;   // Taken out of the epoll set after the hang-up
+    };
+
+    struct Tunnel {
+        std::string id;
+        Endpoint client;
+        Endpoint server;
+        Direction upstream;     // client -> server
+        Direction downstream;   // server -> client
+        std::unique_ptr<Deadline> idle;
+    };
+
+    struct Loop {
+        int epoll_fd = -1;
+        int wake_fd = -1;
+        std::thread thread;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Tunnel>> pending;
+        std::unordered_map<Tunnel *, std::unique_ptr<Tunnel>> tunnels;
+        // Closed during the current batch, freed after it: later events of the
+        // batch may still point into them
+        std::vector<std::unique_ptr<Tunnel>> closed;
+    };
+
+    void run(Loop &loop);
+    void register_tunnel(Loop &loop, std::unique_ptr<Tunnel> tunnel);
+    // Returns false once the tunnel is finished or broken
+    bool on_event(Tunnel &tunnel, Endpoint &endpoint, uint32_t events);
+    bool fill(Direction &direction, int fd);
+    bool flush(Direction &direction, int fd);
+    // Relays what a hung-up endpoint still has to its peer, as far as the
+    // peer takes it. Returns false on errors.
+    bool drain(Direction &direction, int fd, int peer_fd);
+    void update_interest(Loop &loop, Tunnel &tunnel);
+    void close_tunnel(Loop &loop, Tunnel *tunnel);
+    // Closes the sockets of a tunnel and stops counting it
+    void release(Tunnel &tunnel);
+
+    Logger &m_logger;
+    Deadlines *m_deadlines;
+    std::vector<std::unique_ptr<Loop>> m_loops;
+    std::atomic<size_t> m_next;
+    std::atomic<bool> m_stop;
+};
+
+#endif // TUNNEL_REACTOR_HPP
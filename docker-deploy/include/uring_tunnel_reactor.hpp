@@ -0,0 +1,114 @@
+#ifndef URING_TUNNEL_REACTOR_HPP
+#define URING_TUNNEL_REACTOR_HPP
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "deadline.hpp"
+#include "io_uring.hpp"
+#include "logger.hpp"
+#include "tunnel_reactor.hpp"
+
+// io_uring flavour of the tunnel relay. Every direction keeps exactly one
+// operation chain in flight: a receive into a buffer the kernel picks from the
+// loop's provided buffer ring, then a send of that buffer linked to the next
+// receive, so both go to the kernel in one submission and the next read only
+// starts once the peer has taken the data. Sockets stay blocking, the kernel
+// drives them asynchronously.
+class UringTunnelReactor : public TunnelRelay {
+public:
+    UringTunnelReactor(size_t numThreads, Logger &logger, Deadlines *deadlines);
+
+    ~UringTunnelReactor() override;
+
+    UringTunnelReactor(const UringTunnelReactor &) = delete;
+    UringTunnelReactor &operator=(const UringTunnelReactor &) = delete;
+
+    void add(int client_fd, int server_fd, const std::string &id) override;
+
+private:
+    static constexpr unsigned RING_ENTRIES = 1024;
+    static constexpr uint16_t BUFFER_COUNT = 256;
+    static constexpr size_t BUFFER_SIZE = 16 * 1024;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+
+    struct Tunnel;
+    struct Direction;
+
+    enum class OpKind { RECV, SEND, HUP };
+
+    // user_data of a submission, null marks the wake-up read
+    struct Op {
+        Direction *direction = nullptr;
+        OpKind kind = OpKind::RECV;
+    };
+
+    struct Direction {
+        Tunnel *tunnel = nullptr;
+        int src = -1;
+        int dst = -1;
+        Op recv_op;
+        Op send_op;
+        Op hup_op;              // Poll for POLLHUP/POLLERR on src
+        int bid = -1;           // Buffer being sent, -1 when none
+        size_t length = 0;
+        bool eof = false;       // FIN received and forwarded
+        bool hup = false;       // src can neither be read nor written any more
+    };
+
+    struct Tunnel {
+        std::string id;
+        int client_fd = -1;
+        int server_fd = -1;
+        Direction upstream;     // client -> server
+        Direction downstream;   // server -> client
+        int inflight = 0;       // Submitted operations not completed yet
+        bool closing = false;
+        std::unique_ptr<Deadline> idle;
+    };
+
+    struct Loop {
+        std::unique_ptr<IoUring> ring;
+        std::unique_ptr<IoUring::BufferRing> buffers;
+        int wake_fd = -1;
+        uint64_t wake_value = 0;
+        bool wake_armed = false;
+        std::thread thread;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Tunnel>> pending;
+        std::unordered_map<Tunnel *, std::unique_ptr<Tunnel>> tunnels;
+        // Receives that found the buffer ring empty, retried when a buffer comes back
+        std::vector<Direction *> starved;
+    };
+
+    void run(Loop &loop);
+    // Returns false for the wake-up read
+    bool dispatch(Loop &loop, const io_uring_cqe &cqe);
+    void arm_wake(Loop &loop);
+    void register_tunnel(Loop &loop, std::unique_ptr<Tunnel> tunnel);
+    // These return false if the submission queue stayed full
+    bool submit_recv(Loop &loop, Direction &direction);
+    bool submit_send(Loop &loop, Direction &direction);
+    void on_recv(Loop &loop, Direction &direction, const io_uring_cqe &cqe);
+    void on_send(Loop &loop, Direction &direction, const io_uring_cqe &cqe);
+    void release_buffer(Loop &loop, Direction &direction);
+    void close_tunnel(Loop &loop, Tunnel &tunnel);
+    void finish_if_idle(Loop &loop, Tunnel &tunnel);
+
+    Logger &m_logger;
+    Deadlines *m_deadlines;
+    std::vector<std::unique_ptr<Loop>> m_loops;
+    std::atomic<size_t> m_next;
+    std::atomic<bool> m_stop;
+};
+
+#endif // URING_TUNNEL_REACTOR_HPP
@@ -0,0 +1,67 @@
+#include "address_health.hpp"
+
+AddressHealth &AddressHealth::getInstance() {
+    static AddressHealth instance;
+    return instance;
+}
+
+std::string AddressHealth::key(const sockaddr *address, socklen_t length) {
+    return std::string(reinterpret_cast<const char *>(address), length);
+}
+
+void AddressHealth::interleave(const std::vector<const addrinfo *> &addresses, std::vector<const addrinfo *> &out) {
+    if (addresses.empty()) {
+        return;
+    }
+    std::vector<const addrinfo *> first, other;
+    for (const addrinfo *p : addresses) {
+        (p->ai_family == addresses[0]->ai_family ? first : other).push_back(p);
+    }
+    for (size_t i = 0; i < first.size() || i < other.size(); i++) {
+        if (i < first.size()) {
+            out.push_back(first[i]);
+        }
+        if (i < other.size()) {
+            out.push_back(other[i]);
+        }
+    }
+}
+
+std::vector<const addrinfo *> AddressHealth::order(const addrinfo *list) {
+    std::vector<const addrinfo *> healthy, failed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Clock::time_point now = Clock::now();
+        for (const addrinfo *p = list; p != nullptr; p = p->ai_next) {
+            auto it = m_failures.empty() ? m_failures.end() : m_failures.find(key(p->ai_addr, p->ai_addrlen));
+            bool recent = it != m_failures.end() && now - it->second < FAILURE_MEMORY;
+            (recent ? failed : healthy).push_back(p);
+        }
+    }
+    std::vector<const addrinfo *> ordered;
+    ordered.reserve(healthy.size() + failed.size());
+    interleave(healthy, ordered);
+    interleave(failed, ordered);
+    return ordered;
+}
+
+void AddressHealth::record_failure(const sockaddr *address, socklen_t length) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+    if (m_failures.size() >= MAX_FAILURES) {
+        for (auto it = m_failures.begin(); it != m_failures.end();) {
+            it = now - it->second >= FAILURE_MEMORY ? m_failures.erase(it) : std::next(it);
+        }
+        if (m_failures.size() >= MAX_FAILURES) {
+            m_failures.clear();
+        }
+    }
+    m_failures[key(address, length)] = now;
+}
+
+void AddressHealth::record_success(const sockaddr *address, socklen_t length) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_failures.empty()) {
+        m_failures.erase(key(address, length));
+    }
+}
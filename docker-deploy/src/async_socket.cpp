@@ -0,0 +1,143 @@
+#include "async_socket.hpp"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "address_health.hpp"
+#include "response_reader.hpp"
+
+AsyncSocket::AsyncSocket(EventLoop &loop) : m_loop(loop), m_fd(-1) {}
+
+AsyncSocket::AsyncSocket(EventLoop &loop, int fd) : m_loop(loop), m_fd(fd) {
+    ::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+}
+
+AsyncSocket::~AsyncSocket() {
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+}
+
+int AsyncSocket::release() {
+    int fd = m_fd;
+    m_fd = -1;
+    if (fd != -1) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    }
+    return fd;
+}
+
+Task<ConnectError> AsyncSocket::connect(std::string host, std::string port, ThreadPool &resolver,
+                                        std::chrono::milliseconds timeout) {
+    addrinfo *res = nullptr;
+    int status = 0;
+    co_await m_loop.offload(resolver, [&]() {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        status = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    });
+    if (status != 0) {
+        // Same classification as Client::connect
+        if (status == EAI_NONAME) {
+            co_return ConnectError::NO_SUCH_HOST;
+        }
+#ifdef EAI_NODATA
+        if (status == EAI_NODATA) {
+            co_return ConnectError::NO_SUCH_HOST;
+        }
+#endif
+        co_return ConnectError::RESOLVE;
+    }
+
+    // Tried one at a time, but in the order Client::connect races them
+    AddressHealth &health = AddressHealth::getInstance();
+    ConnectError result = ConnectError::CONNECT;
+    for (const addrinfo *p : health.order(res)) {
+        int fd = ::socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        bool connected = ::connect(fd, p->ai_addr, p->ai_addrlen) == 0;
+        if (!connected && errno == EINPROGRESS && co_await m_loop.wait(fd, EPOLLOUT, timeout)) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            connected = ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+        }
+        if (connected) {
+            health.record_success(p->ai_addr, p->ai_addrlen);
+            int optval = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
+            m_fd = fd;
+            result = ConnectError::NONE;
+            break;
+        }
+        health.record_failure(p->ai_addr, p->ai_addrlen);
+        ::close(fd);
+    }
+    ::freeaddrinfo(res);
+    co_return result;
+}
+
+Task<size_t> AsyncSocket::recv(char *data, size_t len, std::chrono::milliseconds timeout) {
+    while (true) {
+        ssize_t n = ::recv(m_fd, data, len, 0);
+        if (n >= 0) {
+            co_return static_cast<size_t>(n);
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            throw std::runtime_error("recv error: " + std::string(std::strerror(errno)));
+        }
+        if (!co_await m_loop.wait(m_fd, EPOLLIN, timeout)) {
+            throw std::runtime_error("Timed out waiting to receive.");
+        }
+    }
+}
+
+Task<void> AsyncSocket::send(std::string_view data, std::chrono::milliseconds timeout) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(m_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n >= 0) {
+            sent += n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            throw std::runtime_error("send error: " + std::string(std::strerror(errno)));
+        }
+        if (!co_await m_loop.wait(m_fd, EPOLLOUT, timeout)) {
+            throw std::runtime_error("Timed out waiting to send.");
+        }
+    }
+}
+
+Task<std::string> AsyncSocket::receive_response(std::chrono::milliseconds idle_timeout) {
+    ResponseReader reader;
+    char chunk[16 * 1024];
+    while (!reader.done()) {
+        size_t n = 0;
+        try {
+            n = co_await recv(chunk, sizeof(chunk), idle_timeout);
+        } catch (const std::runtime_error &) {
+            // Like the blocking client, an error or timeout ends the response where
+            // it is, and finish throws unless the body was delimited by the close
+        }
+        if (n == 0) {
+            break;
+        }
+        reader.feed(chunk, n);
+    }
+    co_return reader.finish();
+}
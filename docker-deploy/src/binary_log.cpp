@@ -0,0 +1,212 @@
+#include "binary_log.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+namespace {
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Only IDs that uuid_unparse_lower() prints back the same are stored as 16 bytes
+bool parse_uuid(std::string_view id, uint8_t *uuid) {
+    if (id.size() != 36 || id[8] != '-' || id[13] != '-' || id[18] != '-' || id[23] != '-') {
+        return false;
+    }
+    size_t in = 0;
+    for (size_t out = 0; out < 16; out++) {
+        if (id[in] == '-') {
+            in++;
+        }
+        int high = hex_digit(id[in]);
+        int low = hex_digit(id[in + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        uuid[out] = static_cast<uint8_t>(high << 4 | low);
+        in += 2;
+    }
+    return true;
+}
+}  // namespace
+
+BinaryLog::BinaryLog(int fd)
+        : m_fd(fd), m_session(0), m_start(Clock::now()), m_block_start(m_start), m_last_request(0),
+          m_next_request(1) {
+    std::random_device random;
+    m_session = (static_cast<uint64_t>(random()) << 32) | random();
+    m_block.reserve(BLOCK_SIZE + BLOCK_SIZE / 8);
+    m_block.resize(sizeof(BlockHeader));
+    m_uuids.resize(UUID_SLOTS);
+
+    int64_t wall_clock = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    append(SESSION, 0, 0, &wall_clock, sizeof(wall_clock));
+}
+
+BinaryLog::~BinaryLog() {
+    try {
+        flush();
+    } catch (const std::exception &) {
+        // Nowhere left to report it
+    }
+    ::close(m_fd);
+}
+
+void BinaryLog::append(Event event, uint8_t variant, uint64_t request, const void *payload, size_t length) {
+    Clock::time_point now = Clock::now();
+    RecordHeader header{};
+    header.event = event;
+    header.variant = variant;
+    header.length = static_cast<uint32_t>(length);
+    header.request = request;
+    header.time = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_start).count();
+
+    const char *bytes = reinterpret_cast<const char *>(&header);
+    m_block.insert(m_block.end(), bytes, bytes + sizeof(header));
+    bytes = static_cast<const char *>(payload);
+    m_block.insert(m_block.end(), bytes, bytes + length);
+
+    if (m_block.size() >= BLOCK_SIZE || now - m_block_start >= FLUSH_INTERVAL) {
+        flush();
+    }
+}
+
+void BinaryLog::flush() {
+    if (m_block.size() > sizeof(BlockHeader)) {
+        BlockHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.length = static_cast<uint32_t>(m_block.size() - sizeof(BlockHeader));
+        header.session = m_session;
+        std::memcpy(m_block.data(), &header, sizeof(header));
+
+        // One write() keeps the block in one piece next to other processes' blocks
+        size_t written = 0;
+        while (written < m_block.size()) {
+            ssize_t n = ::write(m_fd, m_block.data() + written, m_block.size() - written);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                m_block.resize(sizeof(BlockHeader));
+                throw std::runtime_error(std::string("Failed to write log block: ") + std::strerror(errno));
+            }
+            written += n;
+        }
+        m_block.resize(sizeof(BlockHeader));
+    }
+    m_block_start = Clock::now();
+}
+
+void BinaryLog::make_room(size_t strings) {
+    if (m_strings.size() + strings > MAX_STRINGS) {
+        // Indices start over, the decoder takes the latest definition
+        m_strings.clear();
+        m_string_storage.clear();
+    }
+}
+
+uint32_t BinaryLog::intern(std::string_view string) {
+    auto it = m_strings.find(string);
+    if (it != m_strings.end()) {
+        return it->second;
+    }
+    make_room(1);
+    auto index = static_cast<uint32_t>(m_strings.size());
+    std::string_view stored = m_string_storage.emplace_back(string);
+    m_strings.emplace(stored, index);
+
+    std::string payload(sizeof(index), '\0');
+    std::memcpy(payload.data(), &index, sizeof(index));
+    payload.append(string);
+    append(STRING, 0, 0, payload.data(), payload.size());
+    return index;
+}
+
+uint64_t BinaryLog::request_number(std::string_view id) {
+    if (id.empty()) {
+        return 0;
+    }
+    if (id == m_last_id) {
+        return m_last_request;
+    }
+    m_last_id = id;
+    m_last_request = lookup(id);
+    return m_last_request;
+}
+
+uint64_t BinaryLog::lookup(std::string_view id) {
+    uint8_t uuid[16];
+    if (parse_uuid(id, uuid)) {
+        uint64_t hash;
+        std::memcpy(&hash, uuid, sizeof(hash));
+        UuidSlot &slot = m_uuids[hash % UUID_SLOTS];
+        if (slot.request != 0 && std::memcmp(slot.uuid, uuid, sizeof(uuid)) == 0) {
+            return slot.request;
+        }
+        std::memcpy(slot.uuid, uuid, sizeof(uuid));
+        slot.request = m_next_request++;
+        append(ID, UUID, slot.request, uuid, sizeof(uuid));
+        return slot.request;
+    }
+
+    auto it = m_ids.find(id);
+    if (it != m_ids.end()) {
+        return it->second;
+    }
+    if (m_ids.size() == MAX_IDS) {
+        // Finished requests are not logged again, a request still running
+        // gets a second number for the same ID
+        m_ids.clear();
+        m_id_storage.clear();
+    }
+    uint64_t number = m_next_request++;
+    std::string_view stored = m_id_storage.emplace_back(id);
+    m_ids.emplace(stored, number);
+    append(ID, 0, number, id.data(), id.size());
+    return number;
+}
+
+void BinaryLog::write(Event event, std::string_view id, uint8_t variant) {
+    append(event, variant, request_number(id), nullptr, 0);
+}
+
+void BinaryLog::write_strings(Event event, std::string_view id, std::string_view first) {
+    uint64_t request = request_number(id);
+    uint32_t payload = intern(first);
+    append(event, 0, request, &payload, sizeof(payload));
+}
+
+void BinaryLog::write_strings(Event event, std::string_view id, std::string_view first, std::string_view second) {
+    uint64_t request = request_number(id);
+    // Interning the second string must not redefine the index of the first
+    make_room(2);
+    uint32_t payload[2] = {intern(first), intern(second)};
+    append(event, 0, request, payload, sizeof(payload));
+}
+
+void BinaryLog::write_request(std::string_view id, std::string_view request_line, const in_addr *client) {
+    uint64_t request = request_number(id);
+    uint32_t payload[2] = {intern(request_line), client != nullptr ? client->s_addr : 0};
+    append(REQUEST, client != nullptr ? 0 : NO_CLIENT, request, payload, sizeof(payload));
+}
+
+void BinaryLog::write_time(Event event, std::string_view id, uint8_t variant,
+                           std::chrono::system_clock::time_point time) {
+    int64_t seconds = std::chrono::system_clock::to_time_t(time);
+    append(event, variant, request_number(id), &seconds, sizeof(seconds));
+}
+
+void BinaryLog::write_text(Event event, std::string_view id, std::string_view text) {
+    append(event, 0, request_number(id), text.data(), text.size());
+}
@@ -4,25 +4,45 @@
 
 #include "cache.hpp"
 
+#include <algorithm>
+
 #include "http_parser.hpp"
 
-CacheEntry::CacheEntry(const std::string &url, const std::string &response, bool must_revalidate,
-                       bool never_expires, bool no_cache, std::chrono::seconds max_age)
+CacheEntry::CacheEntry(std::string_view url, const std::string &response, const ResponseMeta &meta,
+                       const Freshness &freshness, std::shared_ptr<SpooledBody> body)
         : m_url(url),
           m_response(response),
-          m_must_revalidate(must_revalidate),
-          m_never_expires(never_expires),
-          m_no_cache(no_cache),
-          m_expire_time(std::chrono::system_clock::now() + max_age) {}
+          m_meta(meta),
+          m_stored_time(std::chrono::system_clock::now()),
+          m_initial_age(freshness.initial_age),
+          m_body(std::move(body)) {
+    // Fresh while the current age is below the lifetime
+    m_expire_time = m_stored_time + freshness.lifetime - freshness.initial_age;
+    if (m_body) {
+        m_meta.content_length = m_body->size();
+    }
+}
+
+CacheEntry::CacheEntry(std::string_view url, std::string &&response, const ResponseMeta &meta,
+                       std::chrono::system_clock::time_point expire_time, std::chrono::seconds initial_age,
+                       std::chrono::system_clock::time_point stored_time)
+        : m_url(url),
+          m_response(std::move(response)),
+          m_meta(meta),
+          m_expire_time(expire_time),
+          m_stored_time(stored_time),
+          m_initial_age(initial_age) {}
+
+std::chrono::seconds CacheEntry::getCurrentAge() const {
+    auto resident = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - m_stored_time);
+    return m_initial_age + std::max(resident, std::chrono::seconds(0));
+}
 
 bool CacheEntry::isExpired() const {
-    if (m_never_expires) {
-        return false;
-    }
-    if (m_must_revalidate) {
+    if (isMustRevalidate()) {
         return true;
     }
-    if (m_no_cache) {
+    if (isNoCache()) {
         return true;
     }
     auto now = std::chrono::system_clock::now();
@@ -30,95 +50,192 @@ bool CacheEntry::isExpired() const {
 }
 
 bool CacheEntry::isFresh() const {
-    if (m_never_expires) {
-        return true;
-    }
     std::chrono::system_clock::time_point current_time = std::chrono::system_clock::now();
     return current_time < m_expire_time;
 }
 
+std::shared_ptr<CacheEntry> CacheEntry::toValidatorOnly() const {
+    std::string response = makeValidatorResponse(getETag(), getLastModified(), m_meta.cache_control_value(m_response));
+    ResponseMeta meta = ResponseMeta::parse(response);
+    return std::make_shared<CacheEntry>(m_url, std::move(response), meta, m_expire_time, m_initial_age,
+                                        m_stored_time);
+}
+
+std::string CacheEntry::makeValidatorResponse(std::string_view etag, std::string_view last_modified,
+                                              std::string_view cache_control) {
+    std::string response = "HTTP/1.1 304 Not Modified\r\n";
+    if (!etag.empty()) {
+        response.append("ETag: ").append(etag).append("\r\n");
+    }
+    if (!last_modified.empty()) {
+        response.append("Last-Modified: ").append(last_modified).append("\r\n");
+    }
+    if (!cache_control.empty()) {
+        response.append("Cache-Control: ").append(cache_control).append("\r\n");
+    }
+    response.append("\r\n");
+    return response;
+}
+
 Cache &Cache::getInstance(Logger &logger) {
     static Cache instance(logger);
     return instance;
 }
 
-Cache::Cache(Logger &logger) : m_logger(logger) {}
+Cache::Cache(Logger &logger)
+        : m_index(MAX_ENTRIES), m_logger(logger), m_shared(nullptr), m_freshness_policy(), m_size_notes(false),
+          m_sweep_grace(0) {}
 
-std::shared_ptr<CacheEntry> Cache::insert(const std::string &id, const std::string &url, const std::string &response) {
-    auto headers = HTTP_Parser::parse_headers(response);
-    auto cache_control = HTTP_Parser::parse_cache_control(headers["Cache-Control"]);
-    auto max_age_str = cache_control["max-age"];
-    auto must_revalidate = cache_control.count("must-revalidate") > 0;
-    auto no_cache = cache_control.count("no-cache") > 0;
-    auto max_age = std::chrono::seconds(max_age_str.empty() ? 0 : std::stoi(max_age_str));
-    std::string etag = HTTP_Parser::get_header_value("ETag", headers);
-    std::string cache_control_str = HTTP_Parser::get_header_value("Cache-Control", headers);
-    auto never_expires = cache_control_str.empty() ? true : false;
+void Cache::enableSweeper(std::chrono::seconds grace) {
+    m_sweep_grace = grace;
+    m_sweeper = std::make_unique<TimerWheel>(std::chrono::seconds(1));
+}
 
-    if (!etag.empty()) {
-        std::string message = "ETag: " + etag;
+void Cache::setMaxBytes(size_t max_bytes) {
+    for (const auto& e : m_index.set_max_bytes(max_bytes)) {
+        m_logger.note("evicted " + e->getUrl() + " from cache");
+    }
+}
+
+std::shared_ptr<CacheEntry> Cache::insert(std::string_view id, std::string_view url, const std::string &response) {
+    return insert(id, url, response, ResponseMeta::parse(response));
+}
+
+std::shared_ptr<CacheEntry> Cache::insert(std::string_view id, std::string_view url, const std::string &response,
+                                          const ResponseMeta &meta, std::optional<std::chrono::seconds> default_lifetime,
+                                          std::shared_ptr<SpooledBody> body) {
+    Freshness freshness = Freshness::compute(response, meta, std::chrono::system_clock::now(), m_freshness_policy);
+    if (default_lifetime && !Freshness::is_explicit(response, meta)) {
+        freshness.lifetime = *default_lifetime;
+        freshness.heuristic = false;
+    }
+    auto entry = std::make_shared<CacheEntry>(url, response, meta, freshness, std::move(body));
+
+    if (meta.etag_length > 0) {
+        std::string message = "ETag: " + std::string(entry->getETag());
         m_logger.note_with_id(id, message);
     }
 
-    if (!cache_control_str.empty()) {
-        std::string message = "Cache-Control: " + cache_control_str;
+    if (meta.has(ResponseMeta::CC_PRESENT)) {
+        std::string message = "Cache-Control: " + std::string(meta.cache_control_value(entry->getResponse()));
         m_logger.note_with_id(id, message);
     }
 
-    std::unique_lock<std::mutex> lock(m_mutex);
-
-    // Check if the entry already exists in the cache
-    auto it = m_entry_map.find(url);
-    if (it != m_entry_map.end()) {
-        // Update the existing entry
-        auto &entry = *(it->second);
-        entry = CacheEntry(url, response, must_revalidate, never_expires, no_cache, max_age);
-        // Move the entry to the front of the list
-        m_entries.splice(m_entries.begin(), m_entries, it->second);
-    } else {
-        // Create a new entry
-        m_entries.emplace_front(url, response, must_revalidate, never_expires, no_cache, max_age);
-        // Add the new entry to the map
-        m_entry_map[url] = m_entries.begin();
-
-        // Check if the cache size exceeds the limit
-        if (m_entries.size() > 10240) {
-            evict();
+    if (freshness.heuristic) {
+        m_logger.note_with_id(id, "no explicit freshness, fresh for " + std::to_string(freshness.lifetime.count()) +
+                                          " seconds judging by Last-Modified");
+    }
+    if (freshness.initial_age.count() > 0) {
+        m_logger.note_with_id(id, "Age on arrival: " + std::to_string(freshness.initial_age.count()) + " seconds");
+    }
+
+    // Header and body, what the entry weighs in the index; read by tools/cache_sim
+    if (m_size_notes) {
+        m_logger.note_with_id(id, "Size: " + std::to_string(CacheIndex::weight(*entry)) + " bytes");
+    }
+
+    if (m_shared != nullptr) {
+        // The spool file is private to this process
+        if (entry->getBody() != nullptr) {
+            m_logger.note_with_id(id, "body spooled to disk, not stored in the shared cache");
+            return entry;
+        }
+        // Other processes see the entry from now on, this one keeps no copy
+        if (!m_shared->put(*entry)) {
+            m_logger.note_with_id(id, "too large for the shared cache, not stored");
         }
+        return entry;
     }
 
-// Return a shared pointer to the inserted cache entry
-    return std::make_shared<CacheEntry>(*m_entry_map[url]);
+    // A full index evicts by CLOCK to make room
+    std::vector<std::shared_ptr<CacheEntry>> evicted = m_index.insert(entry);
+    for (const auto& e : evicted) {
+        m_logger.note("evicted " + e->getUrl() + " from cache");
+    }
+    if (m_sweeper) {
+        std::lock_guard<std::mutex> lock(m_sweep_mutex);
+        for (const auto& e : evicted) {
+            auto it = m_sweep_timers.find(e->getUrl());
+            if (it != m_sweep_timers.end() && it->second.second == e.get()) {
+                m_sweeper->cancel(it->second.first);
+                m_sweep_timers.erase(it);
+            }
+        }
+        // A concurrent insert of the same URL may already have replaced
+        // entry in the index; the timer is that newer entry's to arm
+        std::shared_ptr<CacheEntry> current;
+        if (m_index.find(entry->getUrl(), current) && current == entry) {
+            scheduleExpiry(entry);
+        }
+    }
+
+    return entry;
 }
 
 
-bool Cache::get(const std::string &url, std::shared_ptr<CacheEntry> &entry) {
-    std::unique_lock<std::mutex> lock(m_mutex);
+bool Cache::get(std::string_view url, std::shared_ptr<CacheEntry> &entry) {
+    if (m_shared != nullptr) {
+        return m_shared->get(url, entry);
+    }
 
-    auto it = m_entry_map.find(url);
-    if (it != m_entry_map.end()) {
-        auto &cacheEntry = *(it->second);
-        // Move the entry to the front of the list
-        m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return m_index.find(url, entry);
+}
 
-        entry = std::make_shared<CacheEntry>(cacheEntry);
-        return true;
+const CacheEntry* Cache::peek(std::string_view url, std::shared_ptr<CacheEntry>& holder) {
+    if (m_shared != nullptr) {
+        return m_shared->get(url, holder) ? holder.get() : nullptr;
     }
 
-    return false;
+    return m_index.find(url);
 }
 
-void Cache::evict() {
-    if (!m_entries.empty()) {
-        // Remove the least recently used entry from the cache
-        auto &entry = m_entries.back();
+void Cache::scheduleExpiry(const std::shared_ptr<CacheEntry> &entry) {
+    // A replaced entry's timer goes with it
+    auto it = m_sweep_timers.find(entry->getUrl());
+    if (it != m_sweep_timers.end()) {
+        m_sweeper->cancel(it->second.first);
+        m_sweep_timers.erase(it);
+    }
+    // Revalidated entries keep their body for 304s, they are left to eviction
+    if (entry->isMustRevalidate() || entry->isNoCache()) {
+        return;
+    }
+
+    auto due = std::chrono::duration_cast<std::chrono::milliseconds>(entry->getExpireTime() + m_sweep_grace -
+                                                                     std::chrono::system_clock::now());
+    TimerWheel::TimerId id = m_sweeper->schedule(std::max(due, std::chrono::milliseconds(0)),
+                                                 [this, weak = std::weak_ptr<CacheEntry>(entry)]() { expire(weak); });
+    m_sweep_timers.emplace(entry->getUrl(), std::make_pair(id, entry.get()));
+}
 
-        std::string response, host;
-        response = entry.getResponse();
-        host = entry.getUrl();
-        m_logger.note("evicted " + host + " from cache");
+void Cache::expire(const std::weak_ptr<CacheEntry> &weak) {
+    std::shared_ptr<CacheEntry> entry = weak.lock();
+    if (!entry) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sweep_mutex);
+        auto it = m_sweep_timers.find(entry->getUrl());
+        if (it == m_sweep_timers.end() || it->second.second != entry.get()) {
+            return;
+        }
+        if (std::chrono::system_clock::now() < entry->getExpireTime() + m_sweep_grace) {
+            // Expiries beyond the wheel's range fire early, wait again
+            scheduleExpiry(entry);
+            return;
+        }
+        m_sweep_timers.erase(it);
+    }
+    if (entry->isValidatorOnly()) {
+        return;
+    }
 
-        m_entry_map.erase(entry.getUrl());
-        m_entries.pop_back();
+    // Keep what a conditional request needs, the body goes
+    if (entry->getETag().empty() && entry->getLastModified().empty()) {
+        if (m_index.replace(entry, nullptr)) {
+            m_logger.note("dropped expired " + entry->getUrl() + " from cache");
+        }
+    } else if (m_index.replace(entry, entry->toValidatorOnly())) {
+        m_logger.note("reduced expired " + entry->getUrl() + " to its validators");
     }
 }
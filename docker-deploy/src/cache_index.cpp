@@ -0,0 +1,226 @@
+#include "cache_index.hpp"
+
+#include <functional>
+
+#include "cache.hpp"
+
+namespace {
+// Never dereferenced, only compared against
+alignas(8) char tombstone_marker;
+}  // namespace
+
+CacheIndex::Node *const CacheIndex::TOMBSTONE = reinterpret_cast<CacheIndex::Node *>(&tombstone_marker);
+
+CacheIndex::Table::Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<Node *>[capacity]) {
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+CacheIndex::CacheIndex(size_t max_entries, size_t max_bytes)
+        : m_max_entries(max_entries), m_table(nullptr), m_max_bytes(max_bytes), m_size(0), m_bytes(0), m_used(0),
+          m_hand(0) {
+    // At most half full with live entries, so probe sequences stay short
+    size_t capacity = 16;
+    while (capacity < 2 * max_entries) {
+        capacity *= 2;
+    }
+    m_table.store(new Table(capacity), std::memory_order_release);
+}
+
+CacheIndex::~CacheIndex() {
+    Table *table = m_table.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= table->mask; i++) {
+        Node *node = table->slots[i].load(std::memory_order_relaxed);
+        if (node != nullptr && node != TOMBSTONE) {
+            delete node;
+        }
+    }
+    delete table;
+}
+
+uint64_t CacheIndex::hash(std::string_view url) {
+    return std::hash<std::string_view>()(url);
+}
+
+size_t CacheIndex::weight(const CacheEntry &entry) {
+    return entry.getMeta().header_length + entry.getMeta().content_length;
+}
+
+bool CacheIndex::over_budget(size_t incoming) const {
+    size_t bytes = m_bytes.load(std::memory_order_relaxed);
+    return m_max_bytes > 0 && bytes + incoming > m_max_bytes;
+}
+
+const CacheIndex::Node *CacheIndex::find_node(std::string_view url) const {
+    const Table *table = m_table.load(std::memory_order_acquire);
+    uint64_t h = hash(url);
+    size_t slot = h & table->mask;
+    for (size_t probes = 0; probes <= table->mask; probes++, slot = (slot + 1) & table->mask) {
+        const Node *node = table->slots[slot].load(std::memory_order_acquire);
+        if (node == nullptr) {
+            return nullptr;
+        }
+        if (node == TOMBSTONE || node->hash != h || node->entry->getUrl() != url) {
+            continue;
+        }
+        // Only the first hit after a sweep writes the bit
+        if (!node->referenced.load(std::memory_order_relaxed)) {
+            node->referenced.store(true, std::memory_order_relaxed);
+        }
+        return node;
+    }
+    return nullptr;
+}
+
+const CacheEntry *CacheIndex::find(std::string_view url) const {
+    const Node *node = find_node(url);
+    return node != nullptr ? node->entry.get() : nullptr;
+}
+
+bool CacheIndex::find(std::string_view url, std::shared_ptr<CacheEntry> &entry) const {
+    EpochReclaimer::Guard guard;
+    const Node *node = find_node(url);
+    if (node == nullptr) {
+        return false;
+    }
+    entry = node->entry;
+    return true;
+}
+
+std::vector<std::shared_ptr<CacheEntry>> CacheIndex::insert(std::shared_ptr<CacheEntry> entry) {
+    std::vector<std::shared_ptr<CacheEntry>> evicted;
+    size_t size = weight(*entry);
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    if (m_max_bytes > 0 && size > m_max_bytes) {
+        evicted.push_back(std::move(entry));
+        return evicted;
+    }
+
+    Table *table = m_table.load(std::memory_order_relaxed);
+    uint64_t h = hash(entry->getUrl());
+    auto *node = new Node{h, std::move(entry)};
+
+    // Replace the node of the same URL, readers holding the old entry keep it
+    size_t slot = h & table->mask;
+    for (size_t probes = 0; probes <= table->mask; probes++, slot = (slot + 1) & table->mask) {
+        Node *current = table->slots[slot].load(std::memory_order_relaxed);
+        if (current == nullptr) {
+            break;
+        }
+        if (current != TOMBSTONE && current->hash == h && current->entry->getUrl() == node->entry->getUrl()) {
+            table->slots[slot].store(node, std::memory_order_release);
+            m_bytes.fetch_add(size - weight(*current->entry), std::memory_order_relaxed);
+            m_reclaimer.retire(current);
+            // A larger response may need room, the new node is not spared
+            while (over_budget(0)) {
+                evicted.push_back(evict(*table));
+            }
+            return evicted;
+        }
+    }
+
+    while (m_size.load(std::memory_order_relaxed) > 0 &&
+           (m_size.load(std::memory_order_relaxed) >= m_max_entries || over_budget(size))) {
+        evicted.push_back(evict(*table));
+    }
+    if ((m_used + 1) * 4 > (table->mask + 1) * 3) {
+        rebuild();
+        table = m_table.load(std::memory_order_relaxed);
+    }
+    place(*table, node);
+    m_size.fetch_add(1, std::memory_order_relaxed);
+    m_bytes.fetch_add(size, std::memory_order_relaxed);
+    return evicted;
+}
+
+std::vector<std::shared_ptr<CacheEntry>> CacheIndex::set_max_bytes(size_t max_bytes) {
+    std::vector<std::shared_ptr<CacheEntry>> evicted;
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    m_max_bytes = max_bytes;
+    Table *table = m_table.load(std::memory_order_relaxed);
+    while (over_budget(0)) {
+        evicted.push_back(evict(*table));
+    }
+    return evicted;
+}
+
+bool CacheIndex::replace(const std::shared_ptr<CacheEntry> &expected, std::shared_ptr<CacheEntry> replacement) {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    Table *table = m_table.load(std::memory_order_relaxed);
+    uint64_t h = hash(expected->getUrl());
+    size_t slot = h & table->mask;
+    for (size_t probes = 0; probes <= table->mask; probes++, slot = (slot + 1) & table->mask) {
+        Node *current = table->slots[slot].load(std::memory_order_relaxed);
+        if (current == nullptr) {
+            return false;
+        }
+        if (current == TOMBSTONE || current->entry != expected) {
+            continue;
+        }
+        m_bytes.fetch_sub(weight(*current->entry), std::memory_order_relaxed);
+        if (replacement) {
+            m_bytes.fetch_add(weight(*replacement), std::memory_order_relaxed);
+            auto *node = new Node{h, std::move(replacement)};
+            node->referenced.store(current->referenced.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            table->slots[slot].store(node, std::memory_order_release);
+        } else {
+            table->slots[slot].store(TOMBSTONE, std::memory_order_release);
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+        }
+        m_reclaimer.retire(current);
+        return true;
+    }
+    return false;
+}
+
+void CacheIndex::place(Table &table, Node *node) {
+    size_t slot = node->hash & table.mask;
+    while (true) {
+        Node *current = table.slots[slot].load(std::memory_order_relaxed);
+        if (current == nullptr || current == TOMBSTONE) {
+            m_used += current == nullptr;
+            table.slots[slot].store(node, std::memory_order_release);
+            return;
+        }
+        slot = (slot + 1) & table.mask;
+    }
+}
+
+std::shared_ptr<CacheEntry> CacheIndex::evict(Table &table) {
+    // Ends within two turns: the first clears every bit it passes
+    while (true) {
+        size_t slot = m_hand;
+        m_hand = (m_hand + 1) & table.mask;
+        Node *node = table.slots[slot].load(std::memory_order_relaxed);
+        if (node == nullptr || node == TOMBSTONE) {
+            continue;
+        }
+        if (node->referenced.load(std::memory_order_relaxed)) {
+            node->referenced.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        table.slots[slot].store(TOMBSTONE, std::memory_order_release);
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        m_bytes.fetch_sub(weight(*node->entry), std::memory_order_relaxed);
+        std::shared_ptr<CacheEntry> evicted = node->entry;
+        m_reclaimer.retire(node);
+        return evicted;
+    }
+}
+
+void CacheIndex::rebuild() {
+    Table *old_table = m_table.load(std::memory_order_relaxed);
+    auto *table = new Table(old_table->mask + 1);
+    m_used = 0;
+    for (size_t i = 0; i <= old_table->mask; i++) {
+        Node *node = old_table->slots[i].load(std::memory_order_relaxed);
+        if (node != nullptr && node != TOMBSTONE) {
+            place(*table, node);
+        }
+    }
+    // The nodes move to the new table, only the old array is retired
+    m_table.store(table, std::memory_order_release);
+    m_reclaimer.retire(old_table);
+    m_hand = 0;
+}
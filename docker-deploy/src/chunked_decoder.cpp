@@ -0,0 +1,116 @@
+#include "chunked_decoder.hpp"
+
+#include <algorithm>
+
+namespace {
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+}  // namespace
+
+ChunkedDecoder::ChunkedDecoder() : m_state(State::SIZE), m_chunk_size(0), m_size_digits(0) {}
+
+size_t ChunkedDecoder::feed(const char *data, size_t len, std::string &body) {
+    size_t pos = 0;
+    while (pos < len && m_state != State::DONE) {
+        char c = data[pos];
+        switch (m_state) {
+            case State::SIZE: {
+                int digit = hex_value(c);
+                if (digit >= 0) {
+                    // 15 hex digits is far beyond any sane chunk, reject before overflowing
+                    if (++m_size_digits > 15) {
+                        throw std::runtime_error("Chunk size too large.");
+                    }
+                    m_chunk_size = (m_chunk_size << 4) | static_cast<size_t>(digit);
+                } else if (m_size_digits == 0) {
+                    throw std::runtime_error("Malformed chunk size.");
+                } else if (c == '\r') {
+                    m_state = State::SIZE_LF;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    m_state = State::EXTENSION;
+                } else {
+                    throw std::runtime_error("Malformed chunk size.");
+                }
+                ++pos;
+                break;
+            }
+            case State::EXTENSION:
+                if (c == '\r') {
+                    m_state = State::SIZE_LF;
+                }
+                ++pos;
+                break;
+            case State::SIZE_LF:
+                if (c != '\n') {
+                    throw std::runtime_error("Malformed chunk size line.");
+                }
+                ++pos;
+                m_state = m_chunk_size == 0 ? State::TRAILER : State::DATA;
+                break;
+            case State::DATA: {
+                // Copy as much of the current chunk as this buffer holds in one go
+                size_t n = std::min(m_chunk_size, len - pos);
+                body.append(data + pos, n);
+                pos += n;
+                m_chunk_size -= n;
+                if (m_chunk_size == 0) {
+                    m_state = State::DATA_CR;
+                }
+                break;
+            }
+            case State::DATA_CR:
+                if (c != '\r') {
+                    throw std::runtime_error("Missing CRLF after chunk data.");
+                }
+                ++pos;
+                m_state = State::DATA_LF;
+                break;
+            case State::DATA_LF:
+                if (c != '\n') {
+                    throw std::runtime_error("Missing CRLF after chunk data.");
+                }
+                ++pos;
+                m_size_digits = 0;
+                m_state = State::SIZE;
+                break;
+            case State::TRAILER:
+                // An empty line ends the message, anything else is a trailer field we drop
+                m_state = c == '\r' ? State::FINAL_LF : State::TRAILER_LINE;
+                ++pos;
+                break;
+            case State::TRAILER_LINE:
+                if (c == '\r') {
+                    m_state = State::TRAILER_LF;
+                }
+                ++pos;
+                break;
+            case State::TRAILER_LF:
+                if (c != '\n') {
+                    throw std::runtime_error("Malformed chunked trailer.");
+                }
+                ++pos;
+                m_state = State::TRAILER;
+                break;
+            case State::FINAL_LF:
+                if (c != '\n') {
+                    throw std::runtime_error("Malformed chunked trailer.");
+                }
+                ++pos;
+                m_state = State::DONE;
+                break;
+            case State::DONE:
+                break;
+        }
+    }
+    return pos;
+}
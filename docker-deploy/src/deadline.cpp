@@ -0,0 +1,108 @@
+#include "deadline.hpp"
+
+namespace {
+int64_t now_ticks() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+}  // namespace
+
+Deadlines::Deadlines(Logger &logger, const DeadlineConfig &config) : m_logger(logger), m_config(config) {
+    for (auto &count : m_expired) {
+        count = 0;
+    }
+}
+
+std::chrono::milliseconds Deadlines::timeout(DeadlineKind kind) const {
+    switch (kind) {
+        case DeadlineKind::HEADER_READ:
+            return m_config.header_read;
+        case DeadlineKind::BODY_READ:
+            return m_config.body_read;
+        case DeadlineKind::UPSTREAM_CONNECT:
+            return m_config.upstream_connect;
+        case DeadlineKind::UPSTREAM_IDLE:
+            return m_config.upstream_idle;
+        default:
+            return m_config.tunnel_idle;
+    }
+}
+
+const char *Deadlines::name(DeadlineKind kind) {
+    switch (kind) {
+        case DeadlineKind::HEADER_READ:
+            return "header-read";
+        case DeadlineKind::BODY_READ:
+            return "body-read";
+        case DeadlineKind::UPSTREAM_CONNECT:
+            return "upstream-connect";
+        case DeadlineKind::UPSTREAM_IDLE:
+            return "upstream-idle";
+        default:
+            return "tunnel-idle";
+    }
+}
+
+void Deadlines::on_expired(DeadlineKind kind, int fd) {
+    // Wakes up any blocked recv/send/connect/select on the socket
+    ::shutdown(fd, SHUT_RDWR);
+    count_expired(kind);
+}
+
+void Deadlines::count_expired(DeadlineKind kind) {
+    uint64_t total = ++m_expired[static_cast<int>(kind)];
+    m_logger.note(std::string(name(kind)) + " deadline expired, closed connection (total " +
+                  std::to_string(total) + ")");
+}
+
+Deadline::Deadline(Deadlines *deadlines, DeadlineKind kind, int fd) : m_deadlines(deadlines), m_kind(kind) {
+    if (m_deadlines == nullptr || fd < 0) {
+        return;
+    }
+    m_state = std::make_shared<State>();
+    m_state->active = true;
+    m_state->fd = fd;
+    m_state->timer = 0;
+    m_state->last_activity = now_ticks();
+
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    arm(m_deadlines, m_kind, m_state, m_deadlines->timeout(m_kind));
+}
+
+Deadline::~Deadline() {
+    if (!m_state) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->active = false;
+    m_deadlines->m_wheel.cancel(m_state->timer);
+}
+
+void Deadline::touch() {
+    if (m_state) {
+        m_state->last_activity.store(now_ticks(), std::memory_order_relaxed);
+    }
+}
+
+void Deadline::arm(Deadlines *deadlines, DeadlineKind kind, const std::shared_ptr<State> &state,
+                   std::chrono::milliseconds delay) {
+    state->timer = deadlines->m_wheel.schedule(delay, [deadlines, kind, state]() { expire(deadlines, kind, state); });
+}
+
+void Deadline::expire(Deadlines *deadlines, DeadlineKind kind, const std::shared_ptr<State> &state) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (!state->active) {
+        return;
+    }
+
+    // Touched since the timer was armed: push it back instead of firing
+    auto timeout = deadlines->timeout(kind);
+    auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::duration(now_ticks() - state->last_activity.load(std::memory_order_relaxed)));
+    if (idle < timeout) {
+        arm(deadlines, kind, state, timeout - idle);
+        return;
+    }
+
+    state->active = false;
+    deadlines->on_expired(kind, state->fd);
+}
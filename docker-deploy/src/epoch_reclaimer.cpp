@@ -0,0 +1,105 @@
+#include "epoch_reclaimer.hpp"
+
+#include <atomic>
+
+namespace {
+// One per thread that ever pinned; records are reused by later threads and
+// never freed. epoch is 0 while the thread is not pinned.
+struct ThreadRecord {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> taken{true};
+    ThreadRecord *next = nullptr;
+};
+
+std::atomic<uint64_t> g_epoch{1};
+std::atomic<ThreadRecord *> g_records{nullptr};
+
+ThreadRecord *acquire_record() {
+    for (ThreadRecord *r = g_records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+        bool taken = false;
+        if (r->taken.compare_exchange_strong(taken, true)) {
+            return r;
+        }
+    }
+    auto *record = new ThreadRecord;
+    record->next = g_records.load(std::memory_order_relaxed);
+    while (!g_records.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+    }
+    return record;
+}
+
+struct ThreadHandle {
+    ThreadRecord *record = acquire_record();
+    unsigned depth = 0;
+
+    ~ThreadHandle() {
+        record->epoch.store(0, std::memory_order_release);
+        record->taken.store(false, std::memory_order_release);
+    }
+};
+
+thread_local ThreadHandle t_handle;
+}  // namespace
+
+EpochReclaimer::Guard::Guard() {
+    if (t_handle.depth++ > 0) {
+        return;
+    }
+    // Publish the epoch, then check it did not move in between: a writer
+    // that advanced meanwhile may not have seen this thread
+    uint64_t epoch = g_epoch.load(std::memory_order_seq_cst);
+    while (true) {
+        t_handle.record->epoch.store(epoch, std::memory_order_seq_cst);
+        uint64_t current = g_epoch.load(std::memory_order_seq_cst);
+        if (current == epoch) {
+            break;
+        }
+        epoch = current;
+    }
+}
+
+EpochReclaimer::Guard::~Guard() {
+    if (--t_handle.depth == 0) {
+        t_handle.record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+EpochReclaimer::~EpochReclaimer() {
+    for (const Retired &r : m_retired) {
+        r.deleter(r.ptr);
+    }
+}
+
+void EpochReclaimer::retire(void *ptr, void (*deleter)(void *)) {
+    m_retired.push_back({ptr, deleter, g_epoch.load(std::memory_order_seq_cst)});
+    collect();
+}
+
+void EpochReclaimer::collect() {
+    uint64_t epoch = g_epoch.load(std::memory_order_seq_cst);
+    bool quiescent = true;
+    for (ThreadRecord *r = g_records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+        uint64_t pinned = r->epoch.load(std::memory_order_seq_cst);
+        if (pinned != 0 && pinned != epoch) {
+            quiescent = false;
+            break;
+        }
+    }
+    if (quiescent) {
+        // Another reclaimer may have advanced it already, either way it moved
+        g_epoch.compare_exchange_strong(epoch, epoch + 1);
+        epoch = g_epoch.load(std::memory_order_seq_cst);
+    }
+
+    // Readers pinned when an object was retired are gone two epochs later
+    size_t kept = 0;
+    for (size_t i = 0; i < m_retired.size(); i++) {
+        if (m_retired[i].epoch + 2 <= epoch) {
+            m_retired[i].deleter(m_retired[i].ptr);
+        } else {
+            m_retired[kept++] = m_retired[i];
+        }
+    }
+    m_retired.resize(kept);
+}
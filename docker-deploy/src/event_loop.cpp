@@ -0,0 +1,110 @@
+#include "event_loop.hpp"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+EventLoop::Wait::Wait(EventLoop &loop, int fd, uint32_t events, std::chrono::milliseconds timeout)
+        : m_loop(loop), m_fd(fd), m_events(events), m_expires(Clock::now() + timeout), m_ready(false) {}
+
+void EventLoop::Wait::await_suspend(std::coroutine_handle<> handle) {
+    m_handle = handle;
+    if (m_fd != -1) {
+        epoll_event ev{};
+        ev.events = m_events | EPOLLONESHOT;
+        ev.data.ptr = this;
+        if (::epoll_ctl(m_loop.m_epoll_fd, EPOLL_CTL_ADD, m_fd, &ev) == -1) {
+            // Treated as ready, the next call on the socket reports the error
+            m_ready = true;
+            m_loop.post([handle]() { handle.resume(); });
+            return;
+        }
+    }
+    m_timer = m_loop.m_timers.emplace(m_expires, this);
+}
+
+EventLoop::EventLoop() : m_epoll_fd(-1), m_wake_fd(-1), m_stop(false) {
+    m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    m_wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll_fd == -1 || m_wake_fd == -1) {
+        throw std::runtime_error("event loop setup error: " + std::string(std::strerror(errno)));
+    }
+    // The wake-up eventfd is registered with a null pointer
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &ev);
+    m_thread = std::thread(&EventLoop::run, this);
+}
+
+EventLoop::~EventLoop() {
+    post([this]() { m_stop = true; });
+    m_thread.join();
+    ::close(m_epoll_fd);
+    ::close(m_wake_fd);
+}
+
+void EventLoop::post(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_posted.push_back(std::move(fn));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = ::write(m_wake_fd, &one, sizeof(one));
+    (void) ignored;
+}
+
+void EventLoop::complete(Wait *w, bool ready) {
+    m_timers.erase(w->m_timer);
+    if (w->m_fd != -1) {
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, w->m_fd, nullptr);
+    }
+    w->m_ready = ready;
+    w->m_handle.resume();
+}
+
+void EventLoop::run() {
+    epoll_event events[64];
+    std::vector<std::function<void()>> posted;
+    while (!m_stop) {
+        int timeout = -1;
+        if (!m_timers.empty()) {
+            auto delay = std::chrono::ceil<std::chrono::milliseconds>(m_timers.begin()->first - Clock::now());
+            timeout = static_cast<int>(std::max<int64_t>(0, delay.count()));
+        }
+        int n = ::epoll_wait(m_epoll_fd, events, 64, timeout);
+        if (n == -1 && errno != EINTR) {
+            std::cerr << "event loop epoll_wait: " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == nullptr) {
+                uint64_t count;
+                ssize_t ignored = ::read(m_wake_fd, &count, sizeof(count));
+                (void) ignored;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    posted.swap(m_posted);
+                }
+                for (auto &fn : posted) {
+                    fn();
+                }
+                posted.clear();
+                continue;
+            }
+            complete(static_cast<Wait *>(events[i].data.ptr), true);
+        }
+
+        // Resumed coroutines may add timers, take the earliest each time
+        Clock::time_point now = Clock::now();
+        while (!m_timers.empty() && m_timers.begin()->first <= now) {
+            complete(m_timers.begin()->second, false);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#include "freshness.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+#include "http_parser.hpp"
+
+bool Freshness::is_explicit(std::string_view response, const ResponseMeta &meta) {
+    return meta.has(ResponseMeta::S_MAXAGE) || meta.has(ResponseMeta::MAX_AGE) ||
+           !HTTP_Parser::find_header_value(response, "Expires").empty();
+}
+
+Freshness Freshness::compute(std::string_view response, const ResponseMeta &meta,
+                             std::chrono::system_clock::time_point response_time, const FreshnessPolicy &policy) {
+    using std::chrono::seconds;
+    Freshness freshness;
+
+    // Without a valid Date the response counts as sent when it was received
+    std::chrono::system_clock::time_point date = response_time;
+    HTTP_Parser::parse_http_date(HTTP_Parser::find_header_value(response, "Date"), date);
+
+    // The Age header is ignored unless it is a plain number. How long the
+    // request took is not known here, so it is not added to it.
+    seconds apparent_age = std::max(std::chrono::duration_cast<seconds>(response_time - date), seconds(0));
+    seconds age_value(0);
+    std::string_view age = HTTP_Parser::find_header_value(response, "Age");
+    int64_t age_seconds = 0;
+    auto [end, error] = std::from_chars(age.data(), age.data() + age.size(), age_seconds);
+    if (!age.empty() && error == std::errc() && end == age.data() + age.size() && age_seconds > 0) {
+        age_value = seconds(age_seconds);
+    }
+    freshness.initial_age = std::max(apparent_age, age_value);
+
+    std::string_view expires = HTTP_Parser::find_header_value(response, "Expires");
+    std::chrono::system_clock::time_point time;
+    if (meta.has(ResponseMeta::S_MAXAGE)) {
+        freshness.lifetime = seconds(meta.s_maxage);
+    } else if (meta.has(ResponseMeta::MAX_AGE)) {
+        freshness.lifetime = seconds(meta.max_age);
+    } else if (!expires.empty()) {
+        // An invalid Expires, such as "0", is a time in the past
+        if (HTTP_Parser::parse_http_date(expires, time) && time > date) {
+            freshness.lifetime = std::chrono::duration_cast<seconds>(time - date);
+        }
+    } else if (HTTP_Parser::parse_http_date(HTTP_Parser::find_header_value(response, "Last-Modified"), time) &&
+               time < date) {
+        std::chrono::duration<double> unchanged = date - time;
+        freshness.lifetime = std::min(std::chrono::duration_cast<seconds>(unchanged * policy.heuristic_fraction),
+                                      policy.heuristic_cap);
+        freshness.heuristic = true;
+    }
+    return freshness;
+}
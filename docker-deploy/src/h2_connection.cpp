@@ -0,0 +1,905 @@
+#include "h2_connection.hpp"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "http_parser.hpp"
+#include "request_arena.hpp"
+
+namespace {
+// A connection error (RFC 9113 5.4.1): GOAWAY with the code, then close
+class ConnectionError : public std::runtime_error {
+public:
+    ConnectionError(uint32_t code, const std::string &message) : std::runtime_error(message), code(code) {}
+
+    uint32_t code;
+};
+
+const std::string_view PREFACE_REST = "SM\r\n\r\n";
+
+enum Setting : uint16_t {
+    HEADER_TABLE_SIZE = 1,
+    ENABLE_PUSH,
+    MAX_CONCURRENT_STREAMS,
+    INITIAL_WINDOW_SIZE,
+    MAX_FRAME_SIZE_SETTING,
+    MAX_HEADER_LIST_SIZE,
+};
+
+uint32_t read_u32(std::string_view data) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(data[0])) << 24 |
+           static_cast<uint32_t>(static_cast<unsigned char>(data[1])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(data[2])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(data[3]));
+}
+
+void append_u32(std::string &out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+void append_setting(std::string &out, uint16_t id, uint32_t value) {
+    out.push_back(static_cast<char>(id >> 8));
+    out.push_back(static_cast<char>(id));
+    append_u32(out, value);
+}
+
+// Strips the pad length and padding of a padded frame, false if the padding
+// does not fit in it
+bool unpad(std::string_view &payload) {
+    if (payload.empty() || static_cast<unsigned char>(payload[0]) >= payload.size()) {
+        return false;
+    }
+    payload = payload.substr(1, payload.size() - 1 - static_cast<unsigned char>(payload[0]));
+    return true;
+}
+
+bool is_connection_specific(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// No CR, LF or NUL, which would split the HTTP/1.1 form of the field
+bool is_safe_value(std::string_view value) {
+    return value.find_first_of(std::string_view("\r\n\0", 3)) == std::string_view::npos;
+}
+
+// "if-none-match" -> "If-None-Match", as HTTP/1.1 clients write field names
+void append_title_case(std::string &out, std::string_view name) {
+    bool start = true;
+    for (char c : name) {
+        out.push_back(start && c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c);
+        start = c == '-';
+    }
+}
+
+std::string lowercase(std::string_view name) {
+    std::string lower(name);
+    for (char &c : lower) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return lower;
+}
+
+std::string_view trim(std::string_view value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+}
+}  // namespace
+
+bool H2Connection::is_preface(std::string_view request) {
+    return request.substr(0, REQUEST_LINE.size()) == REQUEST_LINE;
+}
+
+H2Connection::H2Connection(int fd, std::string_view received, Logger &logger, const H2Config &config, int stop_fd,
+                           Dispatch dispatch)
+        : m_fd(fd), m_in(received), m_logger(logger), m_config(config), m_stop_fd(stop_fd),
+          m_dispatch(std::move(dispatch)), m_decoder(4096, MAX_HEADER_BLOCK), m_last_stream_id(0),
+          m_continued_stream(0), m_continued_end_stream(false), m_send_window(DEFAULT_WINDOW),
+          m_initial_window(DEFAULT_WINDOW), m_peer_max_frame(MAX_FRAME_SIZE), m_preface_done(false),
+          m_settings_received(false), m_input_paused(false), m_going_away(false), m_closed(false) {
+    ::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    // The server preface: our SETTINGS, push off
+    std::string settings;
+    append_setting(settings, ENABLE_PUSH, 0);
+    append_setting(settings, MAX_CONCURRENT_STREAMS, m_config.max_concurrent_streams);
+    append_setting(settings, MAX_HEADER_LIST_SIZE, MAX_HEADER_BLOCK);
+    write_frame(SETTINGS, 0, 0, settings);
+}
+
+H2Connection::~H2Connection() {
+    for (auto &[id, stream] : m_streams) {
+        if (stream.fd != -1) {
+            ::close(stream.fd);
+        }
+    }
+}
+
+void H2Connection::serve() {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point last_active = Clock::now();
+    std::vector<pollfd> fds;
+    std::vector<uint32_t> ids;
+    try {
+        // Frames that came with the preface
+        read_frames();
+        while (!m_closed) {
+            // What this turn logs is formatted here, not in the arena of the
+            // request that opened the connection, which lives as long as it
+            RequestArena turn;
+            if (m_going_away && m_streams.empty() && m_out.empty()) {
+                break;
+            }
+            fds.clear();
+            ids.clear();
+            // A client that does not read what it asks for is not read either
+            if (m_input_paused && m_out.size() < OUTPUT_BUFFER) {
+                read_frames();
+            }
+            short events = m_out.size() < OUTPUT_BUFFER ? POLLIN : 0;
+            fds.push_back({m_fd, static_cast<short>(m_out.empty() ? events : events | POLLOUT), 0});
+            // stop_fd stays readable once signalled
+            fds.push_back({m_stop_fd, static_cast<short>(m_going_away ? 0 : POLLIN), 0});
+            if (m_out.size() < OUTPUT_BUFFER) {
+                for (auto &[id, stream] : m_streams) {
+                    if (stream.fd != -1 && stream.pending.size() < STREAM_BUFFER) {
+                        fds.push_back({stream.fd, POLLIN, 0});
+                        ids.push_back(id);
+                    }
+                }
+            }
+
+            int timeout = -1;
+            if (m_streams.empty()) {
+                auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - last_active);
+                timeout = static_cast<int>(std::max<int64_t>(
+                        0, std::chrono::milliseconds(m_config.idle_timeout).count() - idle.count()));
+            }
+            int ready = ::poll(fds.data(), fds.size(), timeout);
+            if (ready == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("poll: ") + std::strerror(errno));
+            }
+            if (ready == 0) {
+                send_goaway(NO_ERROR);
+                break;
+            }
+
+            if ((fds[0].revents & (POLLIN | POLLERR | POLLHUP)) && m_out.size() < OUTPUT_BUFFER) {
+                read_frames();
+                last_active = Clock::now();
+            }
+            if ((fds[1].revents & POLLIN) && !m_going_away) {
+                // The proxy is stopping: streams already opened are finished
+                send_goaway(NO_ERROR);
+            }
+            for (size_t i = 2; i < fds.size(); i++) {
+                auto it = m_streams.find(ids[i - 2]);
+                // Frames read above may have reset the stream
+                if (fds[i].revents != 0 && it != m_streams.end() && it->second.fd == fds[i].fd) {
+                    read_response(it->first, it->second);
+                }
+            }
+            for (auto it = m_streams.begin(); it != m_streams.end();) {
+                uint32_t id = it->first;
+                Stream &stream = it->second;
+                ++it;
+                send_data(id, stream);
+                if (stream.end_sent) {
+                    // Answered before the request was complete, the rest is not needed
+                    if (!stream.request_done) {
+                        std::string code;
+                        append_u32(code, NO_ERROR);
+                        write_frame(RST_STREAM, 0, id, code);
+                    }
+                    close_stream(id);
+                }
+            }
+            if (!m_streams.empty()) {
+                last_active = Clock::now();
+            }
+            flush();
+        }
+    } catch (const ConnectionError &e) {
+        m_logger.note(std::string("HTTP/2 connection error: ") + e.what());
+        send_goaway(static_cast<ErrorCode>(e.code));
+    }
+
+    // Last frames, GOAWAY in particular, if the client still takes them
+    auto deadline = Clock::now() + std::chrono::seconds(1);
+    while (!m_closed && !m_out.empty() && Clock::now() < deadline) {
+        pollfd pfd{m_fd, POLLOUT, 0};
+        if (::poll(&pfd, 1, 100) > 0) {
+            flush();
+        }
+    }
+}
+
+void H2Connection::read_frames() {
+    char buffer[16 * 1024];
+    // Enough to work on; the rest is read on the next round
+    while (m_in.size() < 1024 * 1024) {
+        ssize_t n = ::recv(m_fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            m_in.append(buffer, n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            m_closed = true;
+        }
+        break;
+    }
+
+    if (!m_preface_done) {
+        if (m_in.size() < PREFACE_REST.size()) {
+            return;
+        }
+        if (std::string_view(m_in).substr(0, PREFACE_REST.size()) != PREFACE_REST) {
+            throw ConnectionError(PROTOCOL_ERROR, "invalid connection preface");
+        }
+        m_in.erase(0, PREFACE_REST.size());
+        m_preface_done = true;
+    }
+
+    size_t pos = 0;
+    m_input_paused = false;
+    while (m_in.size() - pos >= FRAME_HEADER_SIZE) {
+        if (m_out.size() >= OUTPUT_BUFFER) {
+            m_input_paused = true;
+            break;
+        }
+        std::string_view header = std::string_view(m_in).substr(pos, FRAME_HEADER_SIZE);
+        uint32_t length = read_u32(header) >> 8;
+        auto type = static_cast<uint8_t>(header[3]);
+        auto flags = static_cast<uint8_t>(header[4]);
+        uint32_t stream_id = read_u32(header.substr(5)) & 0x7fffffff;
+        if (length > MAX_FRAME_SIZE) {
+            throw ConnectionError(FRAME_SIZE_ERROR, "frame larger than SETTINGS_MAX_FRAME_SIZE");
+        }
+        if (m_in.size() - pos - FRAME_HEADER_SIZE < length) {
+            break;
+        }
+        if (!m_settings_received && type != SETTINGS) {
+            throw ConnectionError(PROTOCOL_ERROR, "connection preface without SETTINGS");
+        }
+        frame(type, flags, stream_id, std::string_view(m_in).substr(pos + FRAME_HEADER_SIZE, length));
+        pos += FRAME_HEADER_SIZE + length;
+    }
+    m_in.erase(0, pos);
+}
+
+void H2Connection::frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (m_continued_stream != 0 && (type != CONTINUATION || stream_id != m_continued_stream)) {
+        throw ConnectionError(PROTOCOL_ERROR, "header block interrupted");
+    }
+    switch (type) {
+        case DATA:
+            on_data(flags, stream_id, payload);
+            break;
+        case HEADERS:
+            on_headers(flags, stream_id, payload);
+            break;
+        case PRIORITY:
+            // Deprecated by RFC 9113, the streams are served as they come
+            if (stream_id == 0) {
+                throw ConnectionError(PROTOCOL_ERROR, "PRIORITY on stream 0");
+            }
+            if (payload.size() != 5) {
+                reset(stream_id, FRAME_SIZE_ERROR);
+            }
+            break;
+        case RST_STREAM:
+            if (stream_id == 0 || stream_id > m_last_stream_id) {
+                throw ConnectionError(PROTOCOL_ERROR, "RST_STREAM on an idle stream");
+            }
+            if (payload.size() != 4) {
+                throw ConnectionError(FRAME_SIZE_ERROR, "RST_STREAM of wrong size");
+            }
+            // Closing the socketpair makes the handler's next send fail
+            close_stream(stream_id);
+            break;
+        case SETTINGS:
+            if (stream_id != 0) {
+                throw ConnectionError(PROTOCOL_ERROR, "SETTINGS on a stream");
+            }
+            on_settings(flags, payload);
+            break;
+        case PUSH_PROMISE:
+            throw ConnectionError(PROTOCOL_ERROR, "PUSH_PROMISE from a client");
+        case PING:
+            if (stream_id != 0) {
+                throw ConnectionError(PROTOCOL_ERROR, "PING on a stream");
+            }
+            if (payload.size() != 8) {
+                throw ConnectionError(FRAME_SIZE_ERROR, "PING of wrong size");
+            }
+            if (!(flags & ACK)) {
+                write_frame(PING, ACK, 0, payload);
+            }
+            break;
+        case GOAWAY:
+            if (stream_id != 0) {
+                throw ConnectionError(PROTOCOL_ERROR, "GOAWAY on a stream");
+            }
+            // The client opens no more streams, those it has are finished
+            m_going_away = true;
+            break;
+        case WINDOW_UPDATE:
+            on_window_update(stream_id, payload);
+            break;
+        case CONTINUATION:
+            if (m_continued_stream == 0) {
+                throw ConnectionError(PROTOCOL_ERROR, "CONTINUATION without HEADERS");
+            }
+            if (m_header_block.size() + payload.size() > MAX_HEADER_BLOCK) {
+                throw ConnectionError(ENHANCE_YOUR_CALM, "header block too large");
+            }
+            m_header_block.append(payload);
+            if (flags & END_HEADERS) {
+                m_continued_stream = 0;
+                on_header_block(stream_id, m_continued_end_stream);
+            }
+            break;
+        default:
+            // Unknown frame types are ignored
+            break;
+    }
+}
+
+void H2Connection::on_headers(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (stream_id == 0) {
+        throw ConnectionError(PROTOCOL_ERROR, "HEADERS on stream 0");
+    }
+    if ((flags & PADDED) && !unpad(payload)) {
+        throw ConnectionError(PROTOCOL_ERROR, "padding exceeds the frame");
+    }
+    if (flags & PRIORITY_FLAG) {
+        if (payload.size() < 5) {
+            throw ConnectionError(FRAME_SIZE_ERROR, "HEADERS too short for its priority");
+        }
+        payload.remove_prefix(5);
+    }
+    m_header_block.assign(payload);
+    if (!(flags & END_HEADERS)) {
+        m_continued_stream = stream_id;
+        m_continued_end_stream = (flags & END_STREAM) != 0;
+        return;
+    }
+    on_header_block(stream_id, (flags & END_STREAM) != 0);
+}
+
+void H2Connection::on_header_block(uint32_t stream_id, bool end_stream) {
+    std::vector<Hpack::Header> headers;
+    bool fits;
+    try {
+        fits = m_decoder.decode(m_header_block, headers);
+    } catch (const std::runtime_error &e) {
+        throw ConnectionError(COMPRESSION_ERROR, e.what());
+    }
+    m_header_block.clear();
+
+    auto it = m_streams.find(stream_id);
+    if (it != m_streams.end()) {
+        // Trailers, which end the request; their fields are dropped
+        Stream &stream = it->second;
+        if (stream.request_done) {
+            reset(stream_id, STREAM_CLOSED);
+        } else if (!end_stream) {
+            reset(stream_id, PROTOCOL_ERROR);
+        } else {
+            stream.request_done = true;
+            // Answered early (431), nothing is dispatched
+            if (!stream.headers_sent) {
+                start(stream_id, stream);
+            }
+        }
+        return;
+    }
+    if (stream_id % 2 == 0) {
+        throw ConnectionError(PROTOCOL_ERROR, "client opened an even-numbered stream");
+    }
+    if (stream_id <= m_last_stream_id) {
+        throw ConnectionError(STREAM_CLOSED, "HEADERS on a closed stream");
+    }
+    m_last_stream_id = stream_id;
+    if (m_going_away) {
+        // Past our GOAWAY, the client retries it elsewhere
+        return;
+    }
+    if (m_streams.size() >= m_config.max_concurrent_streams) {
+        std::string code;
+        append_u32(code, REFUSED_STREAM);
+        write_frame(RST_STREAM, 0, stream_id, code);
+        return;
+    }
+
+    Stream &stream = m_streams[stream_id];
+    stream.send_window = m_initial_window;
+    stream.request_done = end_stream;
+    if (!fits) {
+        respond_locally(stream_id, stream, 431, "Request Header Fields Too Large");
+        return;
+    }
+    stream.headers = std::move(headers);
+    if (end_stream) {
+        start(stream_id, stream);
+    }
+}
+
+void H2Connection::on_data(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (stream_id == 0) {
+        throw ConnectionError(PROTOCOL_ERROR, "DATA on stream 0");
+    }
+    if (stream_id > m_last_stream_id) {
+        throw ConnectionError(PROTOCOL_ERROR, "DATA on an idle stream");
+    }
+    // Data is buffered only up to max_request_body per stream, and dropped
+    // for streams already answered, so the connection window is reopened
+    // right away; padding counts against the windows too
+    std::string increment;
+    append_u32(increment, static_cast<uint32_t>(payload.size()));
+    if (!payload.empty()) {
+        write_frame(WINDOW_UPDATE, 0, 0, increment);
+    }
+    std::string_view data = payload;
+    if ((flags & PADDED) && !unpad(data)) {
+        throw ConnectionError(PROTOCOL_ERROR, "padding exceeds the frame");
+    }
+
+    auto it = m_streams.find(stream_id);
+    if (it == m_streams.end()) {
+        // Reset by one side while the data was under way
+        return;
+    }
+    Stream &stream = it->second;
+    if (stream.request_done) {
+        reset(stream_id, STREAM_CLOSED);
+        return;
+    }
+    if (stream.headers_sent) {
+        // Answered early (413, 431), nothing is dispatched
+        stream.request_done = (flags & END_STREAM) != 0;
+        return;
+    }
+    if (stream.body.size() + data.size() > m_config.max_request_body) {
+        stream.body.clear();
+        stream.body.shrink_to_fit();
+        stream.request_done = (flags & END_STREAM) != 0;
+        respond_locally(stream_id, stream, 413, "Content Too Large");
+        return;
+    }
+    stream.body.append(data);
+    if (flags & END_STREAM) {
+        stream.request_done = true;
+        start(stream_id, stream);
+    } else if (!payload.empty() && stream.body.size() < m_config.max_request_body) {
+        write_frame(WINDOW_UPDATE, 0, stream_id, increment);
+    }
+}
+
+void H2Connection::on_settings(uint8_t flags, std::string_view payload) {
+    if (flags & ACK) {
+        if (!payload.empty()) {
+            throw ConnectionError(FRAME_SIZE_ERROR, "SETTINGS ACK with a payload");
+        }
+        return;
+    }
+    if (payload.size() % 6 != 0) {
+        throw ConnectionError(FRAME_SIZE_ERROR, "SETTINGS of wrong size");
+    }
+    for (size_t pos = 0; pos < payload.size(); pos += 6) {
+        auto id = static_cast<uint16_t>(static_cast<unsigned char>(payload[pos]) << 8 |
+                                        static_cast<unsigned char>(payload[pos + 1]));
+        uint32_t value = read_u32(payload.substr(pos + 2));
+        switch (id) {
+            case ENABLE_PUSH:
+                if (value > 1) {
+                    throw ConnectionError(PROTOCOL_ERROR, "invalid SETTINGS_ENABLE_PUSH");
+                }
+                break;
+            case INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW) {
+                    throw ConnectionError(FLOW_CONTROL_ERROR, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+                }
+                // Applies to the open streams as well, their windows may go negative
+                int64_t delta = static_cast<int64_t>(value) - m_initial_window;
+                for (auto &[stream_id, stream] : m_streams) {
+                    stream.send_window += delta;
+                    if (stream.send_window > MAX_WINDOW) {
+                        throw ConnectionError(FLOW_CONTROL_ERROR, "stream window overflow");
+                    }
+                }
+                m_initial_window = value;
+                break;
+            }
+            case MAX_FRAME_SIZE_SETTING:
+                if (value < MAX_FRAME_SIZE || value > 0xffffff) {
+                    throw ConnectionError(PROTOCOL_ERROR, "invalid SETTINGS_MAX_FRAME_SIZE");
+                }
+                m_peer_max_frame = value;
+                break;
+            default:
+                // The header table size only matters to an encoder that
+                // indexes, the others to a server that opens streams
+                break;
+        }
+    }
+    m_settings_received = true;
+    write_frame(SETTINGS, ACK, 0, {});
+}
+
+void H2Connection::on_window_update(uint32_t stream_id, std::string_view payload) {
+    if (payload.size() != 4) {
+        throw ConnectionError(FRAME_SIZE_ERROR, "WINDOW_UPDATE of wrong size");
+    }
+    uint32_t increment = read_u32(payload) & 0x7fffffff;
+    if (stream_id == 0) {
+        if (increment == 0) {
+            throw ConnectionError(PROTOCOL_ERROR, "WINDOW_UPDATE of 0");
+        }
+        m_send_window += increment;
+        if (m_send_window > MAX_WINDOW) {
+            throw ConnectionError(FLOW_CONTROL_ERROR, "connection window overflow");
+        }
+        return;
+    }
+    auto it = m_streams.find(stream_id);
+    if (it == m_streams.end()) {
+        return;
+    }
+    if (increment == 0) {
+        reset(stream_id, PROTOCOL_ERROR);
+        return;
+    }
+    it->second.send_window += increment;
+    if (it->second.send_window > MAX_WINDOW) {
+        reset(stream_id, FLOW_CONTROL_ERROR);
+    }
+}
+
+bool H2Connection::make_request(const Stream &stream, std::string &request) {
+    std::string_view method, scheme, authority, path;
+    std::string fields;
+    std::string cookie;
+    bool regular = false;
+    for (const auto &[name, value] : stream.headers) {
+        if (!is_safe_value(value)) {
+            return false;
+        }
+        if (!name.empty() && name[0] == ':') {
+            std::string_view *pseudo = name == ":method" ? &method
+                                     : name == ":scheme" ? &scheme
+                                     : name == ":authority" ? &authority
+                                     : name == ":path" ? &path
+                                     : nullptr;
+            // Pseudo-header fields come first, once each
+            if (pseudo == nullptr || regular || !pseudo->empty() || value.empty()) {
+                return false;
+            }
+            *pseudo = value;
+            continue;
+        }
+        regular = true;
+        if (name.empty() || lowercase(name) != name || is_connection_specific(name) ||
+            (name == "te" && value != "trailers")) {
+            return false;
+        }
+        if (name == "host") {
+            if (authority.empty()) {
+                authority = value;
+            }
+            continue;
+        }
+        if (name == "content-length") {
+            // Set from the body received
+            continue;
+        }
+        if (name == "cookie") {
+            // Split into crumbs for compression, joined again for HTTP/1.1
+            cookie.append(cookie.empty() ? "Cookie: " : "; ").append(value);
+            continue;
+        }
+        append_title_case(fields, name);
+        fields.append(": ").append(value).append("\r\n");
+    }
+    if (method.empty() || scheme.empty() || path.empty() || authority.empty() ||
+        authority.find_first_of(" /") != std::string_view::npos || path.find(' ') != std::string_view::npos) {
+        return false;
+    }
+
+    request.clear();
+    request.reserve(fields.size() + cookie.size() + stream.body.size() + 128);
+    request.append(method).append(" ").append(scheme).append("://").append(authority);
+    request.append(path).append(" HTTP/1.1\r\n");
+    request.append("Host: ").append(authority).append("\r\n");
+    request.append(fields);
+    if (!cookie.empty()) {
+        request.append(cookie).append("\r\n");
+    }
+    if (!stream.body.empty() || method == "POST") {
+        request.append("Content-Length: ").append(std::to_string(stream.body.size())).append("\r\n");
+    }
+    request.append("\r\n").append(stream.body);
+    return true;
+}
+
+void H2Connection::start(uint32_t stream_id, Stream &stream) {
+    for (const auto &[name, value] : stream.headers) {
+        if (name == ":method" && value == "CONNECT") {
+            // Tunnels over a stream (RFC 9113 8.5) are not relayed
+            respond_locally(stream_id, stream, 501, "Not Implemented");
+            return;
+        }
+    }
+    std::string request;
+    if (!make_request(stream, request)) {
+        reset(stream_id, PROTOCOL_ERROR);
+        return;
+    }
+    int pair[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1) {
+        reset(stream_id, REFUSED_STREAM);
+        return;
+    }
+    ::fcntl(pair[0], F_SETFL, O_NONBLOCK);
+    stream.fd = pair[0];
+    stream.headers.clear();
+    stream.body.clear();
+    stream.body.shrink_to_fit();
+    m_dispatch(pair[1], std::move(request));
+}
+
+void H2Connection::respond_locally(uint32_t stream_id, Stream &stream, int status_code, std::string_view status_text) {
+    std::pmr::string response = HTTP_Parser::make_error_response(status_code, status_text);
+    stream.eof = false;
+    convert(stream_id, stream, response);
+}
+
+void H2Connection::read_response(uint32_t stream_id, Stream &stream) {
+    char buffer[16 * 1024];
+    ssize_t n = ::recv(stream.fd, buffer, std::min(sizeof(buffer), STREAM_BUFFER - stream.pending.size()), 0);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        // The handler is done with the stream
+        ::close(stream.fd);
+        stream.fd = -1;
+        n = 0;
+    }
+    convert(stream_id, stream, std::string_view(buffer, n));
+}
+
+void H2Connection::convert(uint32_t stream_id, Stream &stream, std::string_view data) {
+    bool closed = stream.fd == -1;
+    std::string rest;
+    try {
+        if (!stream.headers_sent) {
+            stream.response.append(data);
+            if (!send_response_header(stream_id, stream)) {
+                if (stream.response.size() > MAX_HEADER_BLOCK) {
+                    throw std::runtime_error("response header too large");
+                }
+                if (closed) {
+                    // The handler failed before it could answer
+                    stream.response.clear();
+                    respond_locally(stream_id, stream, 502, "Bad Gateway");
+                }
+                return;
+            }
+            rest.swap(stream.response);
+            data = rest;
+        }
+        // A response without a body is complete with its header
+        if (!stream.eof) {
+            if (stream.chunked) {
+                stream.decoder.feed(data.data(), data.size(), stream.pending);
+                stream.eof = stream.decoder.done();
+            } else if (stream.remaining >= 0) {
+                size_t take = std::min<size_t>(data.size(), stream.remaining);
+                stream.pending.append(data.substr(0, take));
+                stream.remaining -= take;
+                stream.eof = stream.remaining == 0;
+            } else {
+                // Delimited by the handler closing the socketpair
+                stream.pending.append(data);
+                stream.eof = closed;
+            }
+            if (closed && !stream.eof) {
+                throw std::runtime_error("response truncated");
+            }
+        }
+    } catch (const std::runtime_error &e) {
+        m_logger.note("HTTP/2 stream " + std::to_string(stream_id) + ": " + e.what());
+        reset(stream_id, INTERNAL_ERROR);
+        return;
+    }
+    if (stream.eof && stream.fd != -1) {
+        ::close(stream.fd);
+        stream.fd = -1;
+    }
+    send_data(stream_id, stream);
+}
+
+bool H2Connection::send_response_header(uint32_t stream_id, Stream &stream) {
+    while (true) {
+        size_t end = stream.response.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return false;
+        }
+        std::string_view block = std::string_view(stream.response).substr(0, end + 2);
+        // "HTTP/1.1 200 OK"
+        size_t line_end = block.find("\r\n");
+        std::string_view status_line = block.substr(0, line_end);
+        if (status_line.size() < 12 || status_line.substr(0, 5) != "HTTP/" || status_line[8] != ' ') {
+            throw std::runtime_error("malformed status line");
+        }
+        std::string_view code = status_line.substr(9, 3);
+        if (!std::all_of(code.begin(), code.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            throw std::runtime_error("malformed status line");
+        }
+        int status = std::stoi(std::string(code));
+        if (status >= 100 && status < 200) {
+            // Interim responses are not passed on
+            stream.response.erase(0, end + 4);
+            continue;
+        }
+
+        std::vector<Hpack::Header> headers;
+        headers.emplace_back(":status", std::string(code));
+        int64_t content_length = -1;
+        for (size_t pos = line_end + 2; pos < block.size();) {
+            size_t next = block.find("\r\n", pos);
+            std::string_view line = block.substr(pos, next - pos);
+            pos = next + 2;
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos || colon == 0) {
+                continue;
+            }
+            std::string name = lowercase(line.substr(0, colon));
+            std::string_view value = trim(line.substr(colon + 1));
+            if (name == "transfer-encoding") {
+                // HTTP/2 carries no transfer codings, only chunked framing can be undone here
+                for (size_t start = 0; start <= value.size();) {
+                    size_t comma = std::min(value.find(',', start), value.size());
+                    std::string coding = lowercase(trim(value.substr(start, comma - start)));
+                    if (coding != "chunked" && !coding.empty()) {
+                        throw std::runtime_error("transfer coding " + coding + " cannot be sent over HTTP/2");
+                    }
+                    stream.chunked = stream.chunked || coding == "chunked";
+                    start = comma + 1;
+                }
+            }
+            if (is_connection_specific(name)) {
+                continue;
+            }
+            if (name == "content-length") {
+                content_length = std::strtoll(std::string(value).c_str(), nullptr, 10);
+            }
+            headers.emplace_back(std::move(name), std::string(value));
+        }
+        if (stream.chunked) {
+            // The decoded body is sent as it comes, its length is not known
+            headers.erase(std::remove_if(headers.begin(), headers.end(),
+                                         [](const Hpack::Header &h) { return h.first == "content-length"; }),
+                          headers.end());
+        } else {
+            stream.remaining = content_length;
+        }
+        stream.eof = status == 204 || status == 304 || stream.remaining == 0;
+        send_headers(stream_id, headers, stream.eof);
+        stream.headers_sent = true;
+        stream.end_sent = stream.eof;
+        stream.response.erase(0, end + 4);
+        return true;
+    }
+}
+
+void H2Connection::send_data(uint32_t stream_id, Stream &stream) {
+    if (!stream.headers_sent || stream.end_sent) {
+        return;
+    }
+    while (!stream.pending.empty() && m_out.size() < OUTPUT_BUFFER) {
+        int64_t allowed = std::min({stream.send_window, m_send_window, static_cast<int64_t>(m_peer_max_frame),
+                                    static_cast<int64_t>(stream.pending.size())});
+        if (allowed <= 0) {
+            return;
+        }
+        bool last = stream.eof && static_cast<size_t>(allowed) == stream.pending.size();
+        write_frame(DATA, last ? END_STREAM : 0, stream_id, std::string_view(stream.pending).substr(0, allowed));
+        stream.pending.erase(0, allowed);
+        stream.send_window -= allowed;
+        m_send_window -= allowed;
+        if (last) {
+            stream.end_sent = true;
+            return;
+        }
+    }
+    if (stream.eof && stream.pending.empty()) {
+        write_frame(DATA, END_STREAM, stream_id, {});
+        stream.end_sent = true;
+    }
+}
+
+void H2Connection::reset(uint32_t stream_id, ErrorCode code) {
+    std::string payload;
+    append_u32(payload, code);
+    write_frame(RST_STREAM, 0, stream_id, payload);
+    close_stream(stream_id);
+}
+
+void H2Connection::close_stream(uint32_t stream_id) {
+    auto it = m_streams.find(stream_id);
+    if (it == m_streams.end()) {
+        return;
+    }
+    if (it->second.fd != -1) {
+        ::close(it->second.fd);
+    }
+    m_streams.erase(it);
+}
+
+void H2Connection::write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    append_u32(m_out, static_cast<uint32_t>(payload.size()) << 8 | type);
+    m_out.push_back(static_cast<char>(flags));
+    append_u32(m_out, stream_id);
+    m_out.append(payload);
+}
+
+void H2Connection::send_headers(uint32_t stream_id, const std::vector<Hpack::Header> &headers, bool end_stream) {
+    std::string block;
+    Hpack::encode(headers, block);
+    // Blocks larger than a frame continue in CONTINUATION frames
+    std::string_view rest = block;
+    uint8_t type = HEADERS;
+    uint8_t flags = end_stream ? END_STREAM : 0;
+    do {
+        std::string_view part = rest.substr(0, m_peer_max_frame);
+        rest.remove_prefix(part.size());
+        write_frame(type, rest.empty() ? flags | END_HEADERS : flags, stream_id, part);
+        type = CONTINUATION;
+        flags = 0;
+    } while (!rest.empty());
+}
+
+void H2Connection::send_goaway(ErrorCode code) {
+    std::string payload;
+    append_u32(payload, m_last_stream_id);
+    append_u32(payload, code);
+    write_frame(GOAWAY, 0, 0, payload);
+    m_going_away = true;
+}
+
+void H2Connection::flush() {
+    size_t sent = 0;
+    while (sent < m_out.size()) {
+        ssize_t n = ::send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                m_closed = true;
+            }
+            break;
+        }
+        sent += n;
+    }
+    m_out.erase(0, sent);
+}
@@ -0,0 +1,41 @@
+#include "hash_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+HashRing::HashRing(const std::vector<std::string> &nodes, size_t virtual_nodes) {
+    if (nodes.empty() || virtual_nodes == 0) {
+        throw std::invalid_argument("A hash ring needs at least one node and one point per node.");
+    }
+    m_points.reserve(nodes.size() * virtual_nodes);
+    for (size_t node = 0; node < nodes.size(); node++) {
+        for (size_t i = 0; i < virtual_nodes; i++) {
+            m_points.emplace_back(hash(nodes[node] + "#" + std::to_string(i)), node);
+        }
+    }
+    std::sort(m_points.begin(), m_points.end());
+}
+
+size_t HashRing::owner(std::string_view key) const {
+    auto it = std::lower_bound(m_points.begin(), m_points.end(), std::make_pair(hash(key), size_t(0)));
+    if (it == m_points.end()) {
+        it = m_points.begin();
+    }
+    return it->second;
+}
+
+uint64_t HashRing::hash(std::string_view key) {
+    uint64_t h = 14695981039346656037ull;
+    for (char c : key) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    // FNV alone clusters keys that only differ at the end, such as URLs
+    // and virtual node names, the splitmix64 finalizer spreads them
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
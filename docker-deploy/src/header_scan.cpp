@@ -0,0 +1,418 @@
+#include "header_scan.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEADER_SCAN_X86 1
+#endif
+
+namespace {
+struct Kernels {
+    HeaderScan::Isa isa;
+    size_t (*find_header_end)(const char *data, size_t length, size_t from);
+    size_t (*find_char)(const char *data, size_t length, char c, size_t from);
+    bool (*iequals)(const char *a, const char *b, size_t length);
+    bool (*is_token)(const char *data, size_t length);
+};
+
+// tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." / "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+bool is_tchar(unsigned char c) {
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+        return true;
+    }
+    return c != 0 && std::strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+
+// Lookup tables built once from is_tchar. The nibble tables drive the SIMD
+// classification: byte c is a tchar iff nibble_low[c & 15] & nibble_high[c >> 4].
+struct TokenTables {
+    bool scalar[256];
+    uint8_t nibble_low[16];
+    uint8_t nibble_high[16];
+
+    TokenTables() : nibble_low(), nibble_high() {
+        for (int c = 0; c < 256; c++) {
+            scalar[c] = is_tchar(static_cast<unsigned char>(c));
+            if (scalar[c]) {
+                nibble_low[c & 15] |= static_cast<uint8_t>(1 << (c >> 4));
+            }
+        }
+        // Only bytes below 0x80 can be tchars, high nibbles 8-15 match nothing
+        for (int high = 0; high < 8; high++) {
+            nibble_high[high] = static_cast<uint8_t>(1 << high);
+        }
+    }
+};
+
+const TokenTables &token_tables() {
+    static const TokenTables tables;
+    return tables;
+}
+
+inline char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+// Scalar kernels, also used for the tails the vector loops leave
+
+size_t find_header_end_scalar(const char *data, size_t length, size_t from) {
+    // Jump between line feeds with memchr, every "\r\n\r\n" has one at offset 3
+    for (size_t i = from + 3; i < length;) {
+        const void *found = std::memchr(data + i, '\n', length - i);
+        if (found == nullptr) {
+            break;
+        }
+        i = static_cast<const char *>(found) - data;
+        if (data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r') {
+            return i - 3;
+        }
+        i++;
+    }
+    return std::string_view::npos;
+}
+
+size_t find_char_scalar(const char *data, size_t length, char c, size_t from) {
+    if (from >= length) {
+        return std::string_view::npos;
+    }
+    const void *found = std::memchr(data + from, c, length - from);
+    return found == nullptr ? std::string_view::npos : static_cast<const char *>(found) - data;
+}
+
+bool iequals_scalar(const char *a, const char *b, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (fold(a[i]) != fold(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool is_token_scalar(const char *data, size_t length) {
+    const TokenTables &tables = token_tables();
+    for (size_t i = 0; i < length; i++) {
+        if (!tables.scalar[static_cast<unsigned char>(data[i])]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const Kernels SCALAR_KERNELS = {HeaderScan::Isa::SCALAR, find_header_end_scalar, find_char_scalar, iequals_scalar,
+                                is_token_scalar};
+
+#ifdef HEADER_SCAN_X86
+
+// SSE4.2 kernels, 16 bytes per step
+
+__attribute__((target("sse4.2")))
+size_t find_header_end_sse42(const char *data, size_t length, size_t from) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = from;
+    // Compare the four shifted windows at once, bit k is set where "\r\n\r\n" starts at i + k
+    for (; i + 16 + 3 <= length; i += 16) {
+        // Long lines (cookies, user agents) have no final LF in most blocks.
+        // memchr, which libc vectorizes wider and unrolls, finds the next one
+        // faster than this loop would step to it.
+        __m128i b3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 3));
+        __m128i lf3 = _mm_cmpeq_epi8(b3, lf);
+        if (_mm_movemask_epi8(lf3) == 0) {
+            const void *found = std::memchr(data + i + 16 + 3, '\n', length - (i + 16 + 3));
+            if (found == nullptr) {
+                return std::string_view::npos;
+            }
+            // Loop step included, the block starts with the match ending at that LF
+            i = static_cast<const char *>(found) - data - 3 - 16;
+            continue;
+        }
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 1));
+        __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 2));
+        __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, cr), _mm_cmpeq_epi8(b1, lf)),
+                                      _mm_and_si128(_mm_cmpeq_epi8(b2, cr), lf3));
+        int mask = _mm_movemask_epi8(match);
+        if (mask != 0) {
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+    return find_header_end_scalar(data, length, i);
+}
+
+__attribute__((target("sse4.2")))
+size_t find_char_sse42(const char *data, size_t length, char c, size_t from) {
+    // One block covers most header lines; past it memchr is faster
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = from;
+    if (i + 16 <= length) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask != 0) {
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+        i += 16;
+    }
+    return find_char_scalar(data, length, c, i);
+}
+
+// Sets bit 5 of the bytes in 'A'..'Z'; bytes >= 0x80 are negative and never match
+__attribute__((target("sse4.2")))
+inline __m128i fold_sse42(__m128i block) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(block, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(block, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse4.2")))
+bool iequals_sse42(const char *a, const char *b, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block_a = fold_sse42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        __m128i block_b = fold_sse42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block_a, block_b)) != 0xFFFF) {
+            return false;
+        }
+    }
+    return iequals_scalar(a + i, b + i, length - i);
+}
+
+__attribute__((target("sse4.2")))
+bool is_token_sse42(const char *data, size_t length) {
+    const TokenTables &tables = token_tables();
+    const __m128i low_table = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.nibble_low));
+    const __m128i high_table = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.nibble_high));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i low = _mm_shuffle_epi8(low_table, _mm_and_si128(block, nibble));
+        __m128i high = _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+        if (_mm_movemask_epi8(invalid) != 0) {
+            return false;
+        }
+    }
+    return is_token_scalar(data + i, length - i);
+}
+
+const Kernels SSE42_KERNELS = {HeaderScan::Isa::SSE42, find_header_end_sse42, find_char_sse42, iequals_sse42,
+                               is_token_sse42};
+
+// AVX2 kernels, 32 bytes per step. The tails go to the SSE4.2 versions; GCC may
+// tail-call them with dirty upper halves, so clear them explicitly first to
+// avoid the AVX-SSE transition penalty on every short input.
+
+__attribute__((target("avx2")))
+size_t find_header_end_avx2(const char *data, size_t length, size_t from) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = from;
+    for (; i + 32 + 3 <= length; i += 32) {
+        __m256i b3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 3));
+        __m256i lf3 = _mm256_cmpeq_epi8(b3, lf);
+        if (_mm256_movemask_epi8(lf3) == 0) {
+            // As in the SSE4.2 version
+            const void *found = std::memchr(data + i + 32 + 3, '\n', length - (i + 32 + 3));
+            if (found == nullptr) {
+                _mm256_zeroupper();
+                return std::string_view::npos;
+            }
+            i = static_cast<const char *>(found) - data - 3 - 32;
+            continue;
+        }
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 1));
+        __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 2));
+        __m256i match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, cr), _mm256_cmpeq_epi8(b1, lf)),
+                                         _mm256_and_si256(_mm256_cmpeq_epi8(b2, cr), lf3));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    _mm256_zeroupper();
+    return find_header_end_sse42(data, length, i);
+}
+
+__attribute__((target("avx2")))
+size_t find_char_avx2(const char *data, size_t length, char c, size_t from) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = from;
+    if (i + 32 <= length) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 32;
+    }
+    _mm256_zeroupper();
+    return find_char_sse42(data, length, c, i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i fold_avx2(__m256i block) {
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), block));
+    return _mm256_or_si256(block, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+bool iequals_avx2(const char *a, const char *b, size_t length) {
+    if (length < 32) {
+        return iequals_sse42(a, b, length);
+    }
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block_a = fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+        __m256i block_b = fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        if (static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block_a, block_b))) != 0xFFFFFFFFu) {
+            return false;
+        }
+    }
+    _mm256_zeroupper();
+    return iequals_sse42(a + i, b + i, length - i);
+}
+
+__attribute__((target("avx2")))
+bool is_token_avx2(const char *data, size_t length) {
+    // Most field names are shorter than one vector, skip the table setup for them
+    if (length < 32) {
+        return is_token_sse42(data, length);
+    }
+    const TokenTables &tables = token_tables();
+    const __m256i low_table =
+            _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.nibble_low)));
+    const __m256i high_table =
+            _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.nibble_high)));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(block, nibble));
+        __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+        if (_mm256_movemask_epi8(invalid) != 0) {
+            return false;
+        }
+    }
+    _mm256_zeroupper();
+    return is_token_sse42(data + i, length - i);
+}
+
+const Kernels AVX2_KERNELS = {HeaderScan::Isa::AVX2, find_header_end_avx2, find_char_avx2, iequals_avx2,
+                              is_token_avx2};
+
+#endif // HEADER_SCAN_X86
+
+bool cpu_supports(HeaderScan::Isa isa) {
+#ifdef HEADER_SCAN_X86
+    switch (isa) {
+        case HeaderScan::Isa::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case HeaderScan::Isa::SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        case HeaderScan::Isa::SCALAR:
+            return true;
+    }
+    return false;
+#else
+    return isa == HeaderScan::Isa::SCALAR;
+#endif
+}
+
+const Kernels *kernels_for(HeaderScan::Isa isa) {
+#ifdef HEADER_SCAN_X86
+    if (isa == HeaderScan::Isa::AVX2 && cpu_supports(HeaderScan::Isa::AVX2)) {
+        return &AVX2_KERNELS;
+    }
+    if (isa != HeaderScan::Isa::SCALAR && cpu_supports(HeaderScan::Isa::SSE42)) {
+        return &SSE42_KERNELS;
+    }
+#else
+    (void) isa;
+#endif
+    return &SCALAR_KERNELS;
+}
+
+std::atomic<const Kernels *> &active() {
+    static std::atomic<const Kernels *> kernels(kernels_for(HeaderScan::Isa::AVX2));
+    return kernels;
+}
+
+inline const Kernels &kernels() {
+    return *active().load(std::memory_order_relaxed);
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t' || value.back() == '\r')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+}  // namespace
+
+size_t HeaderScan::find_header_end(std::string_view data, size_t from) {
+    return kernels().find_header_end(data.data(), data.size(), from);
+}
+
+size_t HeaderScan::find_char(std::string_view data, char c, size_t from) {
+    return kernels().find_char(data.data(), data.size(), c, from);
+}
+
+bool HeaderScan::iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && kernels().iequals(a.data(), b.data(), a.size());
+}
+
+bool HeaderScan::is_token(std::string_view data) {
+    return !data.empty() && kernels().is_token(data.data(), data.size());
+}
+
+bool HeaderScan::find_header(std::string_view message, std::string_view name, std::string_view &value) {
+    const Kernels &k = kernels();
+    size_t header_end = k.find_header_end(message.data(), message.size(), 0);
+    if (header_end == std::string_view::npos) {
+        header_end = message.size();
+    }
+    std::string_view headers = message.substr(0, header_end);
+
+    // Skip the start line, then compare the name of each field line
+    size_t line_end = k.find_char(headers.data(), headers.size(), '\n', 0);
+    while (line_end != std::string_view::npos) {
+        size_t line_start = line_end + 1;
+        line_end = k.find_char(headers.data(), headers.size(), '\n', line_start);
+        size_t line_length = (line_end == std::string_view::npos ? headers.size() : line_end) - line_start;
+        if (line_length > name.size() && headers[line_start + name.size()] == ':' &&
+            k.iequals(headers.data() + line_start, name.data(), name.size())) {
+            value = trim(headers.substr(line_start + name.size() + 1, line_length - name.size() - 1));
+            return true;
+        }
+    }
+    return false;
+}
+
+HeaderScan::Isa HeaderScan::isa() {
+    return kernels().isa;
+}
+
+const char *HeaderScan::isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::AVX2:
+            return "avx2";
+        case Isa::SSE42:
+            return "sse4.2";
+        case Isa::SCALAR:
+            return "scalar";
+    }
+    return "unknown";
+}
+
+void HeaderScan::select(Isa isa) {
+    active().store(kernels_for(isa), std::memory_order_relaxed);
+}
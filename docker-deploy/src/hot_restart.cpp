@@ -0,0 +1,199 @@
+#include "hot_restart.hpp"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+const char REQUEST = 'T';
+const char CONFIRM = 'R';
+const uint32_t OFFER_MAGIC = 0x48525031;  // "HRP1"
+
+// Sent along with the descriptors: the listen sockets, then the cache memfd
+struct Offer {
+    uint32_t magic;
+    uint32_t listeners;
+    uint32_t has_cache;
+};
+
+sockaddr_un make_address(const std::string &path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Bad hot restart socket path \"" + path + "\".");
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+}  // namespace
+
+HotRestart::HotRestart(std::string path) : m_path(std::move(path)), m_previous(-1), m_listen(-1), m_cache_fd(-1) {}
+
+HotRestart::~HotRestart() {
+    if (m_thread.joinable()) {
+        // Wakes the thread blocked in accept
+        ::shutdown(m_listen, SHUT_RDWR);
+        m_thread.join();
+    }
+    if (m_listen != -1) {
+        ::close(m_listen);
+    }
+    if (m_previous != -1) {
+        ::close(m_previous);
+    }
+}
+
+bool HotRestart::take_over(Handoff &handoff) {
+    sockaddr_un address = make_address(m_path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        throw std::runtime_error("socket error: " + std::string(std::strerror(errno)));
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+        // No socket file, or a stale one left by a process that is gone
+        ::close(fd);
+        return false;
+    }
+
+    Offer offer{};
+    iovec iov{&offer, sizeof(offer)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (::send(fd, &REQUEST, 1, MSG_NOSIGNAL) != 1 ||
+        ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC | MSG_WAITALL) != sizeof(offer)) {
+        ::close(fd);
+        throw std::runtime_error("The running proxy did not hand over its sockets.");
+    }
+
+    std::vector<int> fds;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char *data = CMSG_DATA(cmsg);
+            for (size_t i = 0; i < count; i++) {
+                int received;
+                std::memcpy(&received, data + i * sizeof(int), sizeof(int));
+                fds.push_back(received);
+            }
+        }
+    }
+    if (offer.magic != OFFER_MAGIC || (message.msg_flags & MSG_CTRUNC) || offer.listeners == 0 ||
+        fds.size() != offer.listeners + (offer.has_cache ? 1 : 0)) {
+        for (int received : fds) {
+            ::close(received);
+        }
+        ::close(fd);
+        throw std::runtime_error("The running proxy sent a malformed handoff.");
+    }
+
+    handoff.listen_fds.assign(fds.begin(), fds.begin() + offer.listeners);
+    handoff.cache_fd = offer.has_cache ? fds.back() : -1;
+    m_previous = fd;
+    return true;
+}
+
+void HotRestart::confirm() {
+    if (m_previous == -1) {
+        return;
+    }
+    if (::send(m_previous, &CONFIRM, 1, MSG_NOSIGNAL) != 1) {
+        std::cerr << "hot restart: failed to confirm the handoff: " << std::strerror(errno) << std::endl;
+    }
+    ::close(m_previous);
+    m_previous = -1;
+}
+
+void HotRestart::serve(std::vector<int> listen_fds, int cache_fd, std::function<void()> on_handoff) {
+    if (listen_fds.empty() || listen_fds.size() + 1 > MAX_FDS) {
+        throw std::invalid_argument("A hot restart hands over between 1 and 252 listen sockets.");
+    }
+    sockaddr_un address = make_address(m_path);
+    m_listen = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listen == -1) {
+        throw std::runtime_error("socket error: " + std::string(std::strerror(errno)));
+    }
+    // The previous process, if any, keeps its connection to the old socket file
+    ::unlink(m_path.c_str());
+    if (::bind(m_listen, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 ||
+        ::listen(m_listen, 4) == -1) {
+        int error = errno;
+        ::close(m_listen);
+        m_listen = -1;
+        throw std::runtime_error("Failed to listen on " + m_path + ": " + std::strerror(error));
+    }
+    m_listen_fds = std::move(listen_fds);
+    m_cache_fd = cache_fd;
+    m_on_handoff = std::move(on_handoff);
+    m_thread = std::thread(&HotRestart::run, this);
+}
+
+void HotRestart::run() {
+    // Process signals such as SIGTERM are left to the other threads
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+    while (true) {
+        int connection = ::accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // Shut down by the destructor
+            return;
+        }
+        bool confirmed = hand_over(connection);
+        ::close(connection);
+        if (confirmed) {
+            // The path now belongs to the new process, it is not unlinked
+            m_on_handoff();
+            return;
+        }
+        std::cerr << "hot restart: the new process did not take over, still serving" << std::endl;
+    }
+}
+
+bool HotRestart::hand_over(int connection) {
+    timeval timeout{CONFIRM_TIMEOUT_SECONDS, 0};
+    ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char byte = 0;
+    if (::recv(connection, &byte, 1, 0) != 1 || byte != REQUEST) {
+        return false;
+    }
+
+    std::vector<int> fds = m_listen_fds;
+    if (m_cache_fd != -1) {
+        fds.push_back(m_cache_fd);
+    }
+    Offer offer{OFFER_MAGIC, static_cast<uint32_t>(m_listen_fds.size()), m_cache_fd != -1};
+    iovec iov{&offer, sizeof(offer)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)]{};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    if (::sendmsg(connection, &message, MSG_NOSIGNAL) != sizeof(offer)) {
+        return false;
+    }
+
+    // The new process confirms once it accepts connections
+    return ::recv(connection, &byte, 1, 0) == 1 && byte == CONFIRM;
+}
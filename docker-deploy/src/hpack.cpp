@@ -0,0 +1,368 @@
+#include "hpack.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+struct StaticField {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Code length of each symbol, EOS (256) last. The code is canonical: codes of
+// one length are consecutive in symbol order, each length continuing where the
+// shorter ones left off, so the lengths determine it.
+const uint8_t CODE_LENGTHS[257] = {
+        13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+        28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+        6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+        5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+        13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+        7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+        15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+        6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+        20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+        24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+        22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+        21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+        26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+        19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+        20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+        26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+        30,
+};
+// Appendix A, index 1 first
+const StaticField STATIC_TABLE[] = {
+        {":authority", ""},
+        {":method", "GET"},
+        {":method", "POST"},
+        {":path", "/"},
+        {":path", "/index.html"},
+        {":scheme", "http"},
+        {":scheme", "https"},
+        {":status", "200"},
+        {":status", "204"},
+        {":status", "206"},
+        {":status", "304"},
+        {":status", "400"},
+        {":status", "404"},
+        {":status", "500"},
+        {"accept-charset", ""},
+        {"accept-encoding", "gzip, deflate"},
+        {"accept-language", ""},
+        {"accept-ranges", ""},
+        {"accept", ""},
+        {"access-control-allow-origin", ""},
+        {"age", ""},
+        {"allow", ""},
+        {"authorization", ""},
+        {"cache-control", ""},
+        {"content-disposition", ""},
+        {"content-encoding", ""},
+        {"content-language", ""},
+        {"content-length", ""},
+        {"content-location", ""},
+        {"content-range", ""},
+        {"content-type", ""},
+        {"cookie", ""},
+        {"date", ""},
+        {"etag", ""},
+        {"expect", ""},
+        {"expires", ""},
+        {"from", ""},
+        {"host", ""},
+        {"if-match", ""},
+        {"if-modified-since", ""},
+        {"if-none-match", ""},
+        {"if-range", ""},
+        {"if-unmodified-since", ""},
+        {"last-modified", ""},
+        {"link", ""},
+        {"location", ""},
+        {"max-forwards", ""},
+        {"proxy-authenticate", ""},
+        {"proxy-authorization", ""},
+        {"range", ""},
+        {"referer", ""},
+        {"refresh", ""},
+        {"retry-after", ""},
+        {"server", ""},
+        {"set-cookie", ""},
+        {"strict-transport-security", ""},
+        {"transfer-encoding", ""},
+        {"user-agent", ""},
+        {"vary", ""},
+        {"via", ""},
+        {"www-authenticate", ""},
+};
+
+const size_t STATIC_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+const uint32_t EOS = 256;
+// Per RFC 7541 4.1
+const size_t ENTRY_OVERHEAD = 32;
+
+struct HuffmanTables {
+    uint32_t codes[257];
+    // Codes of length n are first[n] up to first[n] + count[n] - 1, for the
+    // symbols from symbols[offset[n]]
+    uint32_t first[31];
+    uint32_t count[31];
+    uint32_t offset[31];
+    uint16_t symbols[257];
+
+    HuffmanTables() : codes(), first(), count(), offset(), symbols() {
+        for (uint8_t length : CODE_LENGTHS) {
+            count[length]++;
+        }
+        uint32_t code = 0;
+        uint32_t index = 0;
+        for (int length = 1; length <= 30; length++) {
+            code <<= 1;
+            first[length] = code;
+            offset[length] = index;
+            code += count[length];
+            index += count[length];
+        }
+        uint32_t next[31];
+        std::copy(std::begin(first), std::end(first), next);
+        uint32_t filled[31] = {};
+        for (uint32_t symbol = 0; symbol <= EOS; symbol++) {
+            uint8_t length = CODE_LENGTHS[symbol];
+            codes[symbol] = next[length]++;
+            symbols[offset[length] + filled[length]++] = static_cast<uint16_t>(symbol);
+        }
+    }
+};
+
+const HuffmanTables &huffman() {
+    static const HuffmanTables tables;
+    return tables;
+}
+}  // namespace
+
+Hpack::Hpack(size_t max_table_size, size_t max_list_size)
+        : m_max_table_size(max_table_size), m_max_list_size(max_list_size), m_capacity(max_table_size), m_size(0) {}
+
+size_t Hpack::huffman_length(std::string_view in) {
+    size_t bits = 0;
+    for (unsigned char c : in) {
+        bits += CODE_LENGTHS[c];
+    }
+    return (bits + 7) / 8;
+}
+
+void Hpack::huffman_encode(std::string_view in, std::string &out) {
+    const HuffmanTables &tables = huffman();
+    uint64_t buffer = 0;
+    int bits = 0;
+    for (unsigned char c : in) {
+        buffer = (buffer << CODE_LENGTHS[c]) | tables.codes[c];
+        bits += CODE_LENGTHS[c];
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>(buffer >> bits));
+        }
+    }
+    if (bits > 0) {
+        // Padded with the most significant bits of EOS, all ones
+        out.push_back(static_cast<char>((buffer << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+void Hpack::huffman_decode(std::string_view in, std::string &out) {
+    const HuffmanTables &tables = huffman();
+    uint32_t code = 0;
+    int length = 0;
+    for (unsigned char byte : in) {
+        for (int bit = 7; bit >= 0; bit--) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            length++;
+            // A longer code starts with a value past the codes of this length
+            if (code - tables.first[length] < tables.count[length]) {
+                uint16_t symbol = tables.symbols[tables.offset[length] + code - tables.first[length]];
+                if (symbol == EOS) {
+                    throw std::runtime_error("Huffman string contains EOS.");
+                }
+                out.push_back(static_cast<char>(symbol));
+                code = 0;
+                length = 0;
+            } else if (length == 30) {
+                throw std::runtime_error("Invalid Huffman code.");
+            }
+        }
+    }
+    // At most 7 bits of padding, the start of EOS
+    if (length > 7 || code != (1u << length) - 1) {
+        throw std::runtime_error("Invalid Huffman padding.");
+    }
+}
+
+uint64_t Hpack::read_integer(std::string_view block, size_t &pos, int prefix_bits) {
+    if (pos >= block.size()) {
+        throw std::runtime_error("Header block truncated.");
+    }
+    uint64_t max_prefix = (1u << prefix_bits) - 1;
+    uint64_t value = static_cast<unsigned char>(block[pos++]) & max_prefix;
+    if (value < max_prefix) {
+        return value;
+    }
+    for (int shift = 0;; shift += 7) {
+        // Nothing in a header block needs more than 32 bits
+        if (pos >= block.size() || shift > 28) {
+            throw std::runtime_error("Invalid integer in header block.");
+        }
+        auto byte = static_cast<unsigned char>(block[pos++]);
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+void Hpack::write_integer(std::string &out, uint8_t flags, int prefix_bits, uint64_t value) {
+    uint64_t max_prefix = (1u << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out.push_back(static_cast<char>(flags | max_prefix));
+    value -= max_prefix;
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+std::string Hpack::read_string(std::string_view block, size_t &pos) {
+    if (pos >= block.size()) {
+        throw std::runtime_error("Header block truncated.");
+    }
+    bool huffman_coded = (block[pos] & 0x80) != 0;
+    uint64_t length = read_integer(block, pos, 7);
+    if (length > block.size() - pos) {
+        throw std::runtime_error("Header block truncated.");
+    }
+    std::string value;
+    if (huffman_coded) {
+        huffman_decode(block.substr(pos, length), value);
+    } else {
+        value.assign(block.substr(pos, length));
+    }
+    pos += length;
+    return value;
+}
+
+void Hpack::write_string(std::string &out, std::string_view value) {
+    size_t coded = huffman_length(value);
+    if (coded < value.size()) {
+        write_integer(out, 0x80, 7, coded);
+        huffman_encode(value, out);
+    } else {
+        write_integer(out, 0, 7, value.size());
+        out.append(value);
+    }
+}
+
+Hpack::Header Hpack::field(uint64_t index) const {
+    if (index == 0 || index > STATIC_SIZE + m_table.size()) {
+        throw std::runtime_error("Header table index " + std::to_string(index) + " out of range.");
+    }
+    if (index <= STATIC_SIZE) {
+        return {std::string(STATIC_TABLE[index - 1].name), std::string(STATIC_TABLE[index - 1].value)};
+    }
+    return m_table[index - STATIC_SIZE - 1];
+}
+
+void Hpack::evict_to(size_t size) {
+    while (m_size > size) {
+        m_size -= m_table.back().first.size() + m_table.back().second.size() + ENTRY_OVERHEAD;
+        m_table.pop_back();
+    }
+}
+
+void Hpack::insert(Header header) {
+    size_t size = header.first.size() + header.second.size() + ENTRY_OVERHEAD;
+    // An entry larger than the table empties it and is not added
+    evict_to(size <= m_capacity ? m_capacity - size : 0);
+    if (size <= m_capacity) {
+        m_size += size;
+        m_table.push_front(std::move(header));
+    }
+}
+
+bool Hpack::decode(std::string_view block, std::vector<Header> &headers) {
+    size_t first = headers.size();
+    size_t list_size = 0;
+    bool fits = true;
+    size_t pos = 0;
+    bool leading = true;
+    while (pos < block.size()) {
+        auto byte = static_cast<unsigned char>(block[pos]);
+        Header header;
+        if (byte & 0x80) {
+            // Indexed field
+            header = field(read_integer(block, pos, 7));
+        } else if ((byte & 0xe0) == 0x20) {
+            // Dynamic table size update, only at the start of a block
+            uint64_t capacity = read_integer(block, pos, 5);
+            if (!leading || capacity > m_max_table_size) {
+                throw std::runtime_error("Invalid dynamic table size update.");
+            }
+            m_capacity = capacity;
+            evict_to(m_capacity);
+            continue;
+        } else {
+            // Literal with incremental indexing (01), without indexing (0000)
+            // or never indexed (0001)
+            bool indexing = (byte & 0xc0) == 0x40;
+            uint64_t index = read_integer(block, pos, indexing ? 6 : 4);
+            header.first = index == 0 ? read_string(block, pos) : field(index).first;
+            header.second = read_string(block, pos);
+            if (indexing) {
+                insert(header);
+            }
+        }
+        leading = false;
+        list_size += header.first.size() + header.second.size() + ENTRY_OVERHEAD;
+        if (list_size > m_max_list_size) {
+            // Decoding goes on to keep the table in step
+            fits = false;
+        }
+        if (fits) {
+            headers.push_back(std::move(header));
+        }
+    }
+    if (!fits) {
+        headers.resize(first);
+    }
+    return fits;
+}
+
+void Hpack::encode(const std::vector<Header> &headers, std::string &out) {
+    for (const auto &[name, value] : headers) {
+        size_t name_index = 0;
+        size_t index = 0;
+        for (size_t i = 0; i < STATIC_SIZE && index == 0; i++) {
+            if (STATIC_TABLE[i].name == name) {
+                if (name_index == 0) {
+                    name_index = i + 1;
+                }
+                if (STATIC_TABLE[i].value == value) {
+                    index = i + 1;
+                }
+            }
+        }
+        if (index != 0) {
+            write_integer(out, 0x80, 7, index);
+            continue;
+        }
+        // Literal without indexing
+        write_integer(out, 0, 4, name_index);
+        if (name_index == 0) {
+            write_string(out, name);
+        }
+        write_string(out, value);
+    }
+}
@@ -0,0 +1,223 @@
+#include "html_link_scanner.hpp"
+
+#include <cctype>
+
+#include "header_scan.hpp"
+
+namespace {
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && is_space(value.front())) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && is_space(value.back())) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// Attribute values in URLs only need &amp; decoded in practice
+std::string decode_url(std::string_view value) {
+    std::string url;
+    url.reserve(value.size());
+    for (size_t i = 0; i < value.size(); i++) {
+        url.push_back(value[i]);
+        if (value[i] == '&' && value.compare(i + 1, 4, "amp;") == 0) {
+            i += 4;
+        }
+    }
+    return url;
+}
+
+// True if the whitespace separated list contains token, ignoring case
+bool has_token(std::string_view list, std::string_view token) {
+    size_t pos = 0;
+    while (pos < list.size()) {
+        while (pos < list.size() && is_space(list[pos])) {
+            pos++;
+        }
+        size_t end = pos;
+        while (end < list.size() && !is_space(list[end])) {
+            end++;
+        }
+        if (end > pos && HeaderScan::iequals(list.substr(pos, end - pos), token)) {
+            return true;
+        }
+        pos = end;
+    }
+    return false;
+}
+}  // namespace
+
+void HtmlLinkScanner::feed(std::string_view data, std::vector<std::string> &links) {
+    size_t i = 0;
+    while (i < data.size()) {
+        switch (m_state) {
+            case State::TEXT: {
+                size_t lt = data.find('<', i);
+                if (lt == std::string_view::npos) {
+                    return;
+                }
+                m_tag.clear();
+                m_quote = 0;
+                m_state = State::TAG;
+                i = lt + 1;
+                break;
+            }
+            case State::TAG: {
+                char c = data[i++];
+                if (m_quote != 0) {
+                    if (c == m_quote) {
+                        m_quote = 0;
+                    }
+                } else if (c == '>') {
+                    end_tag(links);
+                    break;
+                } else if ((c == '"' || c == '\'') && trim(m_tag).size() > 0 && trim(m_tag).back() == '=') {
+                    m_quote = c;
+                } else if (m_tag.empty() && !std::isalpha(static_cast<unsigned char>(c)) && c != '/' && c != '!') {
+                    // A '<' that does not open a tag is text
+                    m_state = State::TEXT;
+                    i--;
+                    break;
+                }
+                if (m_tag.size() >= MAX_TAG) {
+                    m_state = State::SKIP_TAG;
+                    break;
+                }
+                m_tag.push_back(c);
+                if (m_tag == "!--") {
+                    m_dashes = 0;
+                    m_state = State::COMMENT;
+                }
+                break;
+            }
+            case State::SKIP_TAG: {
+                size_t gt = data.find('>', i);
+                if (gt == std::string_view::npos) {
+                    return;
+                }
+                m_state = State::TEXT;
+                i = gt + 1;
+                break;
+            }
+            case State::COMMENT: {
+                char c = data[i++];
+                if (c == '>' && m_dashes >= 2) {
+                    m_state = State::TEXT;
+                }
+                m_dashes = c == '-' ? m_dashes + 1 : 0;
+                break;
+            }
+            case State::RAW_TEXT: {
+                size_t lt = data.find('<', i);
+                if (lt == std::string_view::npos) {
+                    return;
+                }
+                m_raw_matched = 0;
+                m_state = State::RAW_END;
+                i = lt + 1;
+                break;
+            }
+            case State::RAW_END: {
+                char c = static_cast<char>(std::tolower(static_cast<unsigned char>(data[i])));
+                if (c != m_raw_end[m_raw_matched]) {
+                    // Not the end tag, the character is raw text again (and may be another '<')
+                    m_state = State::RAW_TEXT;
+                    break;
+                }
+                i++;
+                if (++m_raw_matched == m_raw_end.size()) {
+                    m_state = State::SKIP_TAG;
+                }
+                break;
+            }
+        }
+    }
+}
+
+void HtmlLinkScanner::end_tag(std::vector<std::string> &links) {
+    m_state = State::TEXT;
+    std::string_view tag = m_tag;
+
+    size_t pos = 0;
+    while (pos < tag.size() && std::isalnum(static_cast<unsigned char>(tag[pos]))) {
+        pos++;
+    }
+    std::string_view name = tag.substr(0, pos);
+    if (name.empty()) {
+        // End tags, doctype and processing instructions
+        return;
+    }
+    bool is_script = HeaderScan::iequals(name, "script");
+    if (is_script || HeaderScan::iequals(name, "style")) {
+        m_raw_end = is_script ? "/script" : "/style";
+        m_state = State::RAW_TEXT;
+    }
+
+    bool is_link = HeaderScan::iequals(name, "link");
+    bool is_base = HeaderScan::iequals(name, "base");
+    if (!is_script && !is_link && !is_base && !HeaderScan::iequals(name, "img")) {
+        return;
+    }
+
+    std::string_view src, href, rel;
+    while (pos < tag.size()) {
+        while (pos < tag.size() && (is_space(tag[pos]) || tag[pos] == '/')) {
+            pos++;
+        }
+        size_t name_start = pos;
+        while (pos < tag.size() && !is_space(tag[pos]) && tag[pos] != '=' && tag[pos] != '/') {
+            pos++;
+        }
+        std::string_view attribute = tag.substr(name_start, pos - name_start);
+        while (pos < tag.size() && is_space(tag[pos])) {
+            pos++;
+        }
+        std::string_view value;
+        if (pos < tag.size() && tag[pos] == '=') {
+            pos++;
+            while (pos < tag.size() && is_space(tag[pos])) {
+                pos++;
+            }
+            if (pos < tag.size() && (tag[pos] == '"' || tag[pos] == '\'')) {
+                size_t close = tag.find(tag[pos], pos + 1);
+                if (close == std::string_view::npos) {
+                    close = tag.size();
+                }
+                value = tag.substr(pos + 1, close - pos - 1);
+                pos = close + 1;
+            } else {
+                size_t value_start = pos;
+                while (pos < tag.size() && !is_space(tag[pos])) {
+                    pos++;
+                }
+                value = tag.substr(value_start, pos - value_start);
+            }
+        }
+
+        if (HeaderScan::iequals(attribute, "src")) {
+            src = trim(value);
+        } else if (HeaderScan::iequals(attribute, "href")) {
+            href = trim(value);
+        } else if (HeaderScan::iequals(attribute, "rel")) {
+            rel = value;
+        }
+    }
+
+    if (is_base) {
+        if (m_base.empty() && !href.empty()) {
+            m_base = decode_url(href);
+        }
+    } else if (is_link) {
+        if (!href.empty() && (has_token(rel, "stylesheet") || has_token(rel, "icon") ||
+                              has_token(rel, "preload") || has_token(rel, "modulepreload"))) {
+            links.push_back(decode_url(href));
+        }
+    } else if (!src.empty()) {
+        links.push_back(decode_url(src));
+    }
+}
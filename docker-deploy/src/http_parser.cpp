@@ -1,5 +1,75 @@
 #include "http_parser.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+
+namespace {
+void append_number(std::pmr::string &out, size_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+// Readers for the parts of an HTTP-date, each consumes what it matched
+bool read_literal(std::string_view &text, std::string_view literal) {
+    if (text.compare(0, literal.size(), literal) != 0) {
+        return false;
+    }
+    text.remove_prefix(literal.size());
+    return true;
+}
+
+bool read_number(std::string_view &text, size_t digits, int &value) {
+    if (text.size() < digits) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < digits; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+    text.remove_prefix(digits);
+    return true;
+}
+
+bool read_month(std::string_view &text, int &month) {
+    static const char *const MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                         "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    for (int i = 0; i < 12; i++) {
+        if (read_literal(text, MONTHS[i])) {
+            month = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// hour ":" minute ":" second
+bool read_time_of_day(std::string_view &text, std::tm &tm) {
+    return read_number(text, 2, tm.tm_hour) && read_literal(text, ":") && read_number(text, 2, tm.tm_min) &&
+           read_literal(text, ":") && read_number(text, 2, tm.tm_sec) && tm.tm_hour < 24 && tm.tm_min < 60 &&
+           tm.tm_sec <= 60;
+}
+
+// Length of the day name text starts with: 3 for "Sun", 6 for "Sunday", 0 if none
+size_t day_name_length(std::string_view text) {
+    static const char *const DAYS[] = {"Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"};
+    for (const char *day : DAYS) {
+        std::string_view name(day);
+        if (text.compare(0, name.size(), name) == 0) {
+            return name.size();
+        }
+        if (text.compare(0, 3, name.substr(0, 3)) == 0) {
+            return 3;
+        }
+    }
+    return 0;
+}
+}  // namespace
+
 std::map<std::string, std::string> HTTP_Parser::parse_headers(const std::string &response) {
     std::map<std::string, std::string> headers;
 
@@ -73,31 +143,27 @@ std::string HTTP_Parser::get_request_body(const std::string &request) {
     return "";
 }
 
-void HTTP_Parser::make_revalidate_request(std::string &response, const std::string &old_response) {
-    // 解析旧响应头
-    auto headers = parse_headers(old_response);
+void HTTP_Parser::make_revalidate_request(std::pmr::string &request, std::string_view etag,
+                                          std::string_view last_modified) {
+    std::pmr::memory_resource *resource = request.get_allocator().resource();
+    // 去掉客户端自带的条件头，改用缓存响应的验证器
+    request = remove_header(remove_header(request, "If-None-Match", resource), "If-Modified-Since", resource);
 
-    // 获取当前响应的ETag值
-    auto etag = get_header_value("ETag", headers);
-
-    // 如果当前响应没有ETag值，不能使用revalidate，返回
-    if (etag.empty()) {
-        return;
+    std::pmr::string conditions(resource);
+    // 有ETag时添加If-None-Match
+    if (!etag.empty()) {
+        conditions.append("If-None-Match: ").append(etag).append("\r\n");
     }
-
-    // 添加If-None-Match字段，值为当前响应的ETag值
-    response += "If-None-Match: " + etag + "\r\n";
-
-    // 获取当前响应的Last-Modified值
-    auto last_modified = get_header_value("Last-Modified", headers);
-
-    // 如果当前响应没有Last-Modified值，不能使用重新验证，返回
-    if (last_modified.empty()) {
-        return;
+    // 有Last-Modified时添加If-Modified-Since
+    if (!last_modified.empty()) {
+        conditions.append("If-Modified-Since: ").append(last_modified).append("\r\n");
     }
 
-    // 添加If-Modified-Since字段，值为当前响应的Last-Modified值
-    response += "If-Modified-Since: " + last_modified + "\r\n";
+    // 插入到头部末尾的空行之前
+    size_t header_end = request.find("\r\n\r\n");
+    if (header_end != std::string::npos) {
+        request.insert(header_end + 2, conditions);
+    }
 }
 
 int HTTP_Parser::get_status_code(const std::string &response) {
@@ -120,35 +186,37 @@ int HTTP_Parser::get_status_code(const std::string &response) {
     return -1;
 }
 
-std::pair<std::string, std::string> HTTP_Parser::extract_host_and_port(const std::string &request) {
-    static const std::regex re_host(R"(host:\s*([a-zA-Z0-9\.\-\[\]:]+))", std::regex_constants::icase);
-    static const std::regex re_port(":\\s*([0-9]+)", std::regex_constants::icase);
-    std::smatch match;
-
-    std::string lower_request = request;
-    std::transform(lower_request.begin(), lower_request.end(), lower_request.begin(), [](char c) { return std::tolower(c); });
-    if (!std::regex_search(lower_request, match, re_host)) {
+std::pair<std::pmr::string, std::pmr::string> HTTP_Parser::extract_host_and_port(std::string_view request,
+                                                                                 std::pmr::memory_resource *resource) {
+    std::string_view value;
+    if (!HeaderScan::find_header(request, "Host", value) || value.empty()) {
         // 如果没有Host头，则返回默认值
         throw std::runtime_error("Failed to extract host and port from request: no Host header found.");
     }
+    std::pmr::string host(value, resource);
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (!std::all_of(host.begin(), host.end(),
+                     [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || std::strchr(".-[]:", c); })) {
+        throw std::runtime_error("Failed to extract host and port from request: invalid Host header.");
+    }
 
-    std::string host = match[1].str();
-
-    // 提取端口号
-    if (std::regex_search(host, match, re_port)) {
-        std::string port = match[1].str();
+    // 提取端口号（IPv6地址中的冒号在方括号内）
+    size_t colon = host.rfind(':');
+    if (colon != std::string::npos && (host[0] != '[' || host.find(']') < colon)) {
+        std::pmr::string port(std::string_view(host).substr(colon + 1), resource);
         if (port.empty() || !std::all_of(port.begin(), port.end(), [](char c) { return std::isdigit(c); })) {
             throw std::runtime_error("Failed to extract host and port from request: invalid port number.");
         }
-        host = match.prefix().str();
-        return std::make_pair(host, port);
+        host.resize(colon);
+        return std::make_pair(std::move(host), std::move(port));
     }
 
     // 没有端口号，返回默认端口
-    return std::make_pair(host, "80");
+    return std::make_pair(std::move(host), std::pmr::string("80", resource));
 }
 
-std::string HTTP_Parser::extract_http_method(const std::string &request) {
+std::string_view HTTP_Parser::extract_http_method(std::string_view request) {
     size_t pos = request.find(' ');
     if (pos == std::string::npos) {
         throw std::runtime_error("Invalid HTTP request: missing HTTP method.");
@@ -156,54 +224,453 @@ std::string HTTP_Parser::extract_http_method(const std::string &request) {
     return request.substr(0, pos);
 }
 
-std::string HTTP_Parser::get_request_line(const std::string &request) {
-    size_t end = request.find('\n');
+std::string_view HTTP_Parser::get_request_line(std::string_view message) {
+    size_t end = message.find('\n');
     if (end == std::string::npos) {
         throw std::runtime_error("Invalid request format");
-        return "";
     }
-    return request.substr(0, end - 1);
+    return message.substr(0, end > 0 && message[end - 1] == '\r' ? end - 1 : end);
 }
 
-std::string HTTP_Parser::make_error_response(int status_code, const std::string &status_text) {
-    std::stringstream ss;
-    ss << "HTTP/1.1 " << status_code << " " << status_text << "\r\n"
-       << "Content-Type: text/plain\r\n"
-       << "Content-Length: " << status_text.length() << "\r\n"
-       << "Connection: close\r\n"
-       << "\r\n"
-       << status_text;
-    return ss.str();
+std::pmr::string HTTP_Parser::make_error_response(int status_code, std::string_view status_text,
+                                                  std::pmr::memory_resource *resource) {
+    std::pmr::string response(resource);
+    response.reserve(96 + 2 * status_text.size());
+    response.append("HTTP/1.1 ");
+    append_number(response, status_code);
+    response.append(" ").append(status_text).append("\r\n");
+    response.append("Content-Type: text/plain\r\n");
+    response.append("Content-Length: ");
+    append_number(response, status_text.length());
+    response.append("\r\n");
+    response.append("Connection: close\r\n");
+    response.append("\r\n");
+    response.append(status_text);
+    return response;
 }
 
-int HTTP_Parser::get_content_length(const std::string& request) {
-    // 获取请求头部和消息体之间的空行的位置
-    size_t header_end_pos = request.find("\r\n\r\n");
-    if (header_end_pos == std::string::npos) {
+int HTTP_Parser::get_content_length(std::string_view request) {
+    // 请求头不完整时无法确定长度
+    if (HeaderScan::find_header_end(request) == std::string::npos) {
         return -1;
     }
 
     // 获取 Content-Length 字段的值
-    std::string content_length_str;
-    size_t content_length_pos = request.find("Content-Length: ");
-    if (content_length_pos != std::string::npos) {
-        content_length_pos += strlen("Content-Length: ");
-        size_t end_pos = request.find("\r\n", content_length_pos);
-        content_length_str = request.substr(content_length_pos, end_pos - content_length_pos);
-    } else {
+    std::string_view value;
+    if (!HeaderScan::find_header(request, "Content-Length", value) || value.empty() || value.size() > 9 ||
+        !std::all_of(value.begin(), value.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
         return -1;
     }
+    int length = 0;
+    for (char c : value) {
+        length = length * 10 + (c - '0');
+    }
+    return length;
+}
 
-    // 转换 Content-Length 字段的值为整数
-    int content_length = -1;
-    try {
-        content_length = std::stoi(content_length_str);
-    } catch (const std::invalid_argument&) {
-        return -1;
-    } catch (const std::out_of_range&) {
-        return -1;
+
+std::string_view HTTP_Parser::find_header_value(std::string_view message, std::string_view name) {
+    std::string_view value;
+    if (!HeaderScan::find_header(message, name, value)) {
+        return std::string_view();
+    }
+    return value;
+}
+
+bool HTTP_Parser::matches_validators(std::string_view request, std::string_view etag,
+                                     std::string_view last_modified) {
+    // 弱比较：忽略W/前缀
+    auto opaque = [](std::string_view tag) { return tag.compare(0, 2, "W/") == 0 ? tag.substr(2) : tag; };
+
+    std::string_view if_none_match = find_header_value(request, "If-None-Match");
+    if (!if_none_match.empty()) {
+        if (etag.empty()) {
+            return false;
+        }
+        // 逐个比较列表中的实体标签
+        size_t start = 0;
+        while (start < if_none_match.size()) {
+            size_t comma = if_none_match.find(',', start);
+            if (comma == std::string_view::npos) {
+                comma = if_none_match.size();
+            }
+            std::string_view tag = if_none_match.substr(start, comma - start);
+            tag.remove_prefix(std::min(tag.find_first_not_of(" \t"), tag.size()));
+            tag = tag.substr(0, tag.find_last_not_of(" \t") + 1);
+            if (tag == "*" || opaque(tag) == opaque(etag)) {
+                return true;
+            }
+            start = comma + 1;
+        }
+        return false;
+    }
+    std::string_view if_modified_since = find_header_value(request, "If-Modified-Since");
+    return !if_modified_since.empty() && if_modified_since == last_modified;
+}
+
+bool HTTP_Parser::has_valid_header_names(std::string_view message) {
+    size_t header_end = HeaderScan::find_header_end(message);
+    if (header_end == std::string::npos) {
+        return false;
+    }
+    // 逐行检查字段名，字段名与冒号之间不允许有空白
+    size_t line_end = HeaderScan::find_char(message, '\n');
+    while (line_end < header_end) {
+        size_t line_start = line_end + 1;
+        line_end = HeaderScan::find_char(message, '\n', line_start);
+        size_t colon = HeaderScan::find_char(message.substr(0, line_end), ':', line_start);
+        if (colon == std::string::npos || !HeaderScan::is_token(message.substr(line_start, colon - line_start))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string HTTP_Parser::make_dechunked_response(const std::string &header_block, const std::string &body) {
+    std::string response = make_dechunked_header(header_block, body.size());
+    response += body;
+    return response;
+}
+
+std::string HTTP_Parser::make_dechunked_header(const std::string &header_block, size_t length) {
+    std::string response;
+    response.reserve(header_block.size() + 32);
+
+    // 保留除Transfer-Encoding和Content-Length以外的所有头部行，
+    // Transfer-Encoding的各个编码按顺序收集，可能分布在多行
+    std::vector<std::string_view> codings;
+    std::string_view block(header_block);
+    size_t line_start = 0;
+    while (line_start < block.size()) {
+        size_t line_end = block.find("\r\n", line_start);
+        if (line_end == std::string::npos) {
+            line_end = block.size();
+        }
+        if (line_end == line_start) {
+            break;
+        }
+        std::string_view line = block.substr(line_start, line_end - line_start);
+        if (line.size() >= 18 && HeaderScan::iequals(line.substr(0, 18), "transfer-encoding:")) {
+            std::string_view value = line.substr(18);
+            while (!value.empty()) {
+                size_t comma = value.find(',');
+                std::string_view coding = value.substr(0, comma);
+                size_t first = coding.find_first_not_of(" \t");
+                if (first != std::string::npos) {
+                    codings.push_back(coding.substr(first, coding.find_last_not_of(" \t") + 1 - first));
+                }
+                value = comma == std::string::npos ? std::string_view() : value.substr(comma + 1);
+            }
+        } else if (line.size() < 15 || !HeaderScan::iequals(line.substr(0, 15), "content-length:")) {
+            response.append(line).append("\r\n");
+        }
+        line_start = line_end + 2;
+    }
+
+    // 只去掉已经解码的最后一层chunked，其余编码（如gzip）原样保留
+    if (!codings.empty() && HeaderScan::iequals(codings.back(), "chunked")) {
+        codings.pop_back();
+    }
+    if (!codings.empty()) {
+        // 仍有传输编码时消息以关闭连接结束，不能再带Content-Length（RFC 9112 6.2）
+        response += "Transfer-Encoding: ";
+        for (size_t i = 0; i < codings.size(); i++) {
+            response.append(i == 0 ? "" : ", ").append(codings[i]);
+        }
+        response += "\r\n\r\n";
+        return response;
+    }
+
+    // 用解码后的长度重新声明消息体
+    response += "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+    return response;
+}
+
+std::pmr::string HTTP_Parser::get_cache_key(std::string_view request, std::string_view host, std::string_view port,
+                                            std::pmr::memory_resource *resource) {
+    std::string_view request_line = get_request_line(request);
+    size_t start = request_line.find(' ');
+    if (start == std::string::npos) {
+        throw std::runtime_error("Invalid request format");
+    }
+    size_t end = request_line.find(' ', start + 1);
+    std::string_view target = request_line.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+    std::pmr::string key(resource);
+    if (!target.empty() && target[0] == '/') {
+        key.append("http://").append(host);
+        if (port != "80") {
+            key.append(":").append(port);
+        }
+    }
+    key.append(target);
+    return key;
+}
+
+std::pmr::string HTTP_Parser::remove_header(std::string_view message, std::string_view name,
+                                            std::pmr::memory_resource *resource) {
+    std::pmr::string result(resource);
+    size_t header_end = message.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        result.assign(message);
+        return result;
+    }
+
+    result.reserve(message.size());
+    size_t line_start = 0;
+    while (line_start < header_end + 2) {
+        size_t line_end = message.find("\r\n", line_start);
+        bool matches = line_start > 0 && line_end - line_start > name.size() &&
+                       message[line_start + name.size()] == ':' &&
+                       HeaderScan::iequals(message.substr(line_start, name.size()), name);
+        if (!matches) {
+            result.append(message.substr(line_start, line_end + 2 - line_start));
+        }
+        line_start = line_end + 2;
+    }
+    // 保留空行和消息体
+    result.append(message.substr(header_end + 2));
+    return result;
+}
+
+bool HTTP_Parser::parse_byte_ranges(std::string_view range, size_t length,
+                                    std::vector<std::pair<size_t, size_t>> &ranges) {
+    ranges.clear();
+    size_t pos = range.find('=');
+    if (pos == std::string::npos) {
+        return false;
+    }
+    std::string unit(range.substr(0, pos));
+    unit.erase(unit.find_last_not_of(" \t") + 1);
+    std::transform(unit.begin(), unit.end(), unit.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (unit != "bytes") {
+        return false;
+    }
+
+    std::vector<std::pair<size_t, size_t>> requested;
+    std::istringstream ss(std::string(range.substr(pos + 1)));
+    std::string spec;
+    while (std::getline(ss, spec, ',')) {
+        spec.erase(0, spec.find_first_not_of(" \t"));
+        spec.erase(spec.find_last_not_of(" \t") + 1);
+        if (spec.empty()) {
+            continue;
+        }
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos) {
+            return false;
+        }
+        std::string first = spec.substr(0, dash);
+        std::string last = spec.substr(dash + 1);
+        auto is_number = [](const std::string &s) {
+            return !s.empty() && s.size() <= 18 && std::all_of(s.begin(), s.end(), [](char c) { return std::isdigit(c); });
+        };
+        if (first.empty()) {
+            // 后缀范围 "-N"：最后N个字节
+            if (!is_number(last)) {
+                return false;
+            }
+            size_t suffix = std::stoull(last);
+            if (suffix > 0 && length > 0) {
+                requested.emplace_back(length - std::min(suffix, length), length - 1);
+            }
+            continue;
+        }
+        if (!is_number(first) || (!last.empty() && !is_number(last))) {
+            return false;
+        }
+        size_t first_pos = std::stoull(first);
+        size_t last_pos = last.empty() ? length - 1 : std::stoull(last);
+        if (!last.empty() && last_pos < first_pos) {
+            return false;
+        }
+        if (first_pos < length) {
+            requested.emplace_back(first_pos, std::min(last_pos, length - 1));
+        }
+    }
+
+    // 排序并合并重叠或相邻的范围
+    std::sort(requested.begin(), requested.end());
+    for (const auto &r : requested) {
+        if (!ranges.empty() && r.first <= ranges.back().second + 1) {
+            ranges.back().second = std::max(ranges.back().second, r.second);
+        } else {
+            ranges.push_back(r);
+        }
+    }
+    return true;
+}
+
+std::pmr::string HTTP_Parser::make_partial_response(std::string_view response,
+                                                    const std::vector<std::pair<size_t, size_t>> &ranges,
+                                                    std::string_view boundary, std::pmr::memory_resource *resource) {
+    size_t header_end = response.find("\r\n\r\n");
+    size_t body_start = header_end + 4;
+    size_t length = response.size() - body_start;
+    std::string_view content_type = find_header_value(response, "Content-Type");
+
+    // 复制原响应头，去掉状态行以及与消息体长度相关的字段
+    std::pmr::string headers(response.substr(0, body_start), resource);
+    headers = remove_header(headers, "Content-Length", resource);
+    headers = remove_header(headers, "Content-Range", resource);
+    headers = remove_header(headers, "Transfer-Encoding", resource);
+    if (ranges.size() > 1) {
+        headers = remove_header(headers, "Content-Type", resource);
+    }
+    headers.erase(headers.size() - 2);
+    headers.replace(0, headers.find("\r\n"), "HTTP/1.1 206 Partial Content");
+
+    // Content-Range: bytes first-last/length
+    auto append_content_range = [length](std::pmr::string &out, size_t first, size_t last) {
+        out.append("Content-Range: bytes ");
+        append_number(out, first);
+        out.append("-");
+        append_number(out, last);
+        out.append("/");
+        append_number(out, length);
+        out.append("\r\n");
+    };
+
+    std::pmr::string body(resource);
+    if (ranges.size() == 1) {
+        size_t first = ranges[0].first;
+        size_t last = ranges[0].second;
+        append_content_range(headers, first, last);
+        body.assign(response.substr(body_start + first, last - first + 1));
+    } else {
+        headers.append("Content-Type: multipart/byteranges; boundary=").append(boundary).append("\r\n");
+        for (const auto &r : ranges) {
+            body.append("\r\n--").append(boundary).append("\r\n");
+            if (!content_type.empty()) {
+                body.append("Content-Type: ").append(content_type).append("\r\n");
+            }
+            append_content_range(body, r.first, r.second);
+            body.append("\r\n");
+            body.append(response.substr(body_start + r.first, r.second - r.first + 1));
+        }
+        body.append("\r\n--").append(boundary).append("--\r\n");
+    }
+    headers.append("Content-Length: ");
+    append_number(headers, body.size());
+    headers.append("\r\n\r\n");
+    headers.append(body);
+    return headers;
+}
+
+std::pmr::string HTTP_Parser::make_partial_header(std::string_view header_block, size_t first, size_t last,
+                                                  size_t length, std::pmr::memory_resource *resource) {
+    std::pmr::string headers(header_block, resource);
+    headers = remove_header(headers, "Content-Length", resource);
+    headers = remove_header(headers, "Content-Range", resource);
+    headers = remove_header(headers, "Transfer-Encoding", resource);
+    headers.erase(headers.size() - 2);
+    headers.replace(0, headers.find("\r\n"), "HTTP/1.1 206 Partial Content");
+    headers.append("Content-Range: bytes ");
+    append_number(headers, first);
+    headers.append("-");
+    append_number(headers, last);
+    headers.append("/");
+    append_number(headers, length);
+    headers.append("\r\nContent-Length: ");
+    append_number(headers, last - first + 1);
+    headers.append("\r\n\r\n");
+    return headers;
+}
+
+bool HTTP_Parser::parse_http_date(std::string_view value, std::chrono::system_clock::time_point &time) {
+    std::tm tm{};
+    int year = 0;
+    bool valid = false;
+    size_t day_name = day_name_length(value);
+    value.remove_prefix(day_name);
+    if (day_name == 3 && read_literal(value, ", ")) {
+        // IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
+        valid = read_number(value, 2, tm.tm_mday) && read_literal(value, " ") && read_month(value, tm.tm_mon) &&
+                read_literal(value, " ") && read_number(value, 4, year) && read_literal(value, " ") &&
+                read_time_of_day(value, tm) && read_literal(value, " GMT");
+    } else if (day_name > 3 && read_literal(value, ", ")) {
+        // RFC 850: Sunday, 06-Nov-94 08:49:37 GMT
+        valid = read_number(value, 2, tm.tm_mday) && read_literal(value, "-") && read_month(value, tm.tm_mon) &&
+                read_literal(value, "-") && read_number(value, 2, year) && read_literal(value, " ") &&
+                read_time_of_day(value, tm) && read_literal(value, " GMT");
+        // 两位数的年份取不晚于今后50年的那一个
+        std::time_t now = std::time(nullptr);
+        std::tm today;
+        gmtime_r(&now, &today);
+        int this_year = today.tm_year + 1900;
+        year += this_year - this_year % 100;
+        if (year > this_year + 50) {
+            year -= 100;
+        }
+    } else if (day_name == 3 && read_literal(value, " ")) {
+        // asctime(): Sun Nov  6 08:49:37 1994
+        valid = read_month(value, tm.tm_mon) && read_literal(value, " ") &&
+                (read_literal(value, " ") ? read_number(value, 1, tm.tm_mday) : read_number(value, 2, tm.tm_mday)) &&
+                read_literal(value, " ") && read_time_of_day(value, tm) && read_literal(value, " ") &&
+                read_number(value, 4, year);
+    }
+    if (!valid || !value.empty() || tm.tm_mday < 1 || tm.tm_mday > 31) {
+        return false;
     }
 
-    return content_length;
+    tm.tm_year = year - 1900;
+    int day = tm.tm_mday;
+    std::time_t seconds = timegm(&tm);
+    // timegm把不存在的日期（如2月30日）规范化成别的日期
+    if (tm.tm_mday != day) {
+        return false;
+    }
+    time = std::chrono::system_clock::from_time_t(seconds);
+    return true;
 }
 
+std::pmr::string HTTP_Parser::make_hit_header(std::string_view header_block, uint64_t age,
+                                              std::pmr::memory_resource *resource) {
+    std::pmr::string headers(resource);
+    headers.reserve(header_block.size() + 96);
+    bool has_date = false;
+
+    size_t line_start = 0;
+    while (line_start < header_block.size()) {
+        size_t line_end = header_block.find("\r\n", line_start);
+        if (line_end == std::string_view::npos || line_end == line_start) {
+            break;
+        }
+        std::string_view line = header_block.substr(line_start, line_end - line_start);
+        std::string_view name = line.substr(0, line.find(':'));
+        if (line_start > 0 && name.size() < line.size() && HeaderScan::iequals(name, "Age")) {
+            // 保存的Age由当前的Age代替
+        } else if (line_start == 0 || (!HeaderScan::iequals(name, "Connection") &&
+                                       !HeaderScan::iequals(name, "Keep-Alive") &&
+                                       !HeaderScan::iequals(name, "Proxy-Connection"))) {
+            has_date = has_date || HeaderScan::iequals(name, "Date");
+            headers.append(line).append("\r\n");
+        }
+        line_start = line_end + 2;
+    }
+
+    if (!has_date) {
+        char date[40];
+        std::time_t now = std::time(nullptr);
+        std::tm tm;
+        gmtime_r(&now, &tm);
+        headers.append("Date: ").append(date, std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm));
+        headers.append("\r\n");
+    }
+    headers.append("Age: ");
+    append_number(headers, age);
+    headers.append("\r\nVia: 1.1 http_cache_proxy\r\nConnection: close\r\n\r\n");
+    return headers;
+}
+
+std::pmr::string HTTP_Parser::make_range_not_satisfiable(size_t length, std::pmr::memory_resource *resource) {
+    std::pmr::string response(resource);
+    response.append("HTTP/1.1 416 Range Not Satisfiable\r\n");
+    response.append("Content-Range: bytes */");
+    append_number(response, length);
+    response.append("\r\n");
+    response.append("Content-Length: 0\r\n");
+    response.append("Connection: close\r\n");
+    response.append("\r\n");
+    return response;
+}
@@ -0,0 +1,199 @@
+#include "io_uring.hpp"
+
+#include <algorithm>
+
+namespace {
+int io_uring_setup(unsigned entries, io_uring_params *params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+}  // namespace
+
+IoUring::IoUring(unsigned entries) : m_sq_ptr(MAP_FAILED), m_cq_ptr(MAP_FAILED), m_sqes(nullptr), m_sqe_tail(0) {
+    io_uring_params params{};
+    std::memset(&params, 0, sizeof(params));
+    m_fd = io_uring_setup(entries, &params);
+    if (m_fd < 0) {
+        throw std::runtime_error("io_uring_setup error: " + std::string(std::strerror(errno)));
+    }
+    m_sq_entries = params.sq_entries;
+
+    // Map the submission and completion rings (a single mapping on newer kernels)
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+    }
+    m_sq_ptr = ::mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+        ::close(m_fd);
+        throw std::runtime_error("io_uring mmap error: " + std::string(std::strerror(errno)));
+    }
+    m_cq_ptr = single_mmap ? m_sq_ptr
+                           : ::mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                                    IORING_OFF_CQ_RING);
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+        if (!single_mmap && m_cq_ptr != MAP_FAILED) {
+            ::munmap(m_cq_ptr, m_cq_size);
+        }
+        ::munmap(m_sq_ptr, m_sq_size);
+        ::close(m_fd);
+        throw std::runtime_error("io_uring mmap error: " + std::string(std::strerror(errno)));
+    }
+    m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(m_sq_ptr);
+    char *cq = static_cast<char *>(m_cq_ptr);
+    m_sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    m_sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    m_cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    m_sqe_tail = *m_sq_tail;
+}
+
+IoUring::~IoUring() {
+    ::munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != m_sq_ptr) {
+        ::munmap(m_cq_ptr, m_cq_size);
+    }
+    ::munmap(m_sq_ptr, m_sq_size);
+    ::close(m_fd);
+}
+
+bool IoUring::supported() {
+    try {
+        IoUring ring(4);
+
+        // Check every opcode the backend submits
+        size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::string probe_mem(probe_size, '\0');
+        auto *probe = reinterpret_cast<io_uring_probe *>(&probe_mem[0]);
+        if (io_uring_register(ring.fd(), IORING_REGISTER_PROBE, probe, 256) < 0) {
+            return false;
+        }
+        for (int op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+
+        // Provided buffer rings came with multishot accept (5.19), registering one checks both
+        BufferRing buffers(ring, 0, 1, 64);
+        return true;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+io_uring_sqe *IoUring::get_sqe() {
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries) {
+        // Queue full: push what we have to the kernel first
+        submit(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries) {
+            return nullptr;
+        }
+    }
+    io_uring_sqe *sqe = &m_sqes[m_sqe_tail & *m_sq_mask];
+    m_sq_array[m_sqe_tail & *m_sq_mask] = m_sqe_tail & *m_sq_mask;
+    m_sqe_tail++;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit(unsigned wait_nr) {
+    unsigned to_submit = m_sqe_tail - *m_sq_tail;
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    while (true) {
+        int ret = io_uring_enter(m_fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret < 0 && errno == EINTR) {
+            // Entries were consumed before the wait was interrupted, only wait again
+            to_submit = 0;
+            continue;
+        }
+        return ret;
+    }
+}
+
+unsigned IoUring::for_each_cqe(const std::function<void(const io_uring_cqe &)> &handler) {
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    unsigned seen = 0;
+    while (head != tail) {
+        // Copy the entry so the slot can be released before the handler runs
+        io_uring_cqe cqe = m_cqes[head & *m_cq_mask];
+        head++;
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        handler(cqe);
+        seen++;
+        if (head == tail) {
+            tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        }
+    }
+    return seen;
+}
+
+IoUring::BufferRing::BufferRing(IoUring &ring, uint16_t group, uint16_t count, size_t buffer_size)
+        : m_ring(ring), m_group(group), m_count(count), m_buffer_size(buffer_size), m_buffers(nullptr) {
+    // The kernel requires a power-of-two number of ring entries
+    if (count == 0 || (count & (count - 1)) != 0) {
+        throw std::invalid_argument("buffer ring size must be a power of two");
+    }
+    m_ring_size = count * sizeof(io_uring_buf);
+    void *mem = ::mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        throw std::runtime_error("buffer ring mmap error: " + std::string(std::strerror(errno)));
+    }
+    m_ring_mem = static_cast<io_uring_buf *>(mem);
+
+    io_uring_buf_reg reg{};
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(mem);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (io_uring_register(ring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        ::munmap(mem, m_ring_size);
+        throw std::runtime_error("IORING_REGISTER_PBUF_RING error: " + std::string(std::strerror(errno)));
+    }
+
+    m_buffers = new char[size_t(count) * buffer_size];
+    for (uint16_t bid = 0; bid < count; bid++) {
+        recycle(bid);
+    }
+}
+
+IoUring::BufferRing::~BufferRing() {
+    io_uring_buf_reg reg{};
+    std::memset(&reg, 0, sizeof(reg));
+    reg.bgid = m_group;
+    io_uring_register(m_ring.fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    ::munmap(m_ring_mem, m_ring_size);
+    delete[] m_buffers;
+}
+
+void IoUring::BufferRing::recycle(uint16_t bid) {
+    // The ring tail lives in the first entry's reserved field. io_uring_buf_ring
+    // is not used directly: in C++ its flexible array does not start at offset 0.
+    uint16_t *tail = &m_ring_mem[0].resv;
+    uint16_t next = *tail;
+    io_uring_buf &buf = m_ring_mem[next & (m_count - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf.len = static_cast<uint32_t>(m_buffer_size);
+    buf.bid = bid;
+    __atomic_store_n(tail, static_cast<uint16_t>(next + 1), __ATOMIC_RELEASE);
+}
@@ -4,7 +4,10 @@
 
 #include <logger.hpp>
 
-Logger::Logger(const std::string &filename) {
+#include <fcntl.h>
+#include <unistd.h>
+
+Logger::Logger(const std::string &filename, LogFormat format) {
     // Extract the directory path from the given filename
     const std::string dir_path = filename.substr(0, filename.find_last_of('/'));
 
@@ -13,6 +16,16 @@ Logger::Logger(const std::string &filename) {
         std::filesystem::create_directories(dir_path);
     }
 
+    if (format == LogFormat::BINARY) {
+        // Blocks are appended with write(), O_APPEND keeps those of several processes apart
+        int fd = ::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            throw std::runtime_error("Failed to open log file: " + filename);
+        }
+        binary_ = std::make_unique<BinaryLog>(fd);
+        return;
+    }
+
     // Open the file in append mode and create it if it does not exist
     file_.open(filename, std::fstream::out | std::fstream::app);
 
@@ -29,12 +42,19 @@ Logger::~Logger() {
     }
 }
 
-Logger &Logger::GetInstance(const std::string &filename) {
-    static Logger instance(filename);
+Logger &Logger::GetInstance(const std::string &filename, LogFormat format) {
+    static Logger instance(filename, format);
     return instance;
 }
 
-void Logger::log(const std::string &message) {
+void Logger::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (binary_) {
+        binary_->flush();
+    }
+}
+
+void Logger::log(std::string_view message) {
     // Check if the file is open before writing to it
     if (file_.is_open()) {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -45,115 +65,257 @@ void Logger::log(const std::string &message) {
     }
 }
 
-std::string getClientIP(int fd) {
+namespace {
+// Concatenates the parts into one string allocated from the current request arena
+template <typename... Parts>
+std::pmr::string format(const Parts &...parts) {
+    std::pmr::string message(RequestArena::current());
+    message.reserve((std::string_view(parts).size() + ...));
+    (message.append(std::string_view(parts)), ...);
+    return message;
+}
+}  // namespace
+
+bool getClientAddress(int fd, in_addr *address) {
     sockaddr_in addr;
     socklen_t addr_len = sizeof(addr);
     if (getpeername(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        return false;
+    }
+    *address = addr.sin_addr;
+    return true;
+}
+
+const char *getClientIP(int fd, char *buffer, size_t size) {
+    in_addr address;
+    if (!getClientAddress(fd, &address) || inet_ntop(AF_INET, &address, buffer, size) == nullptr) {
         // error handling
         std::cerr << "Failed to get peer name" << std::endl;
-        return "";
+        buffer[0] = '\0';
     }
-    return inet_ntoa(addr.sin_addr);
+    return buffer;
 }
 
-std::string getCurrentTime() {
+const char *getCurrentTime(char *buffer, size_t size) {
     auto now = std::chrono::system_clock::now();
     std::time_t now_c = std::chrono::system_clock::to_time_t(now);
-    std::tm now_tm = *std::gmtime(&now_c);
-    char time_str[80];
-    std::strftime(time_str, sizeof(time_str), "%a %b %d %H:%M:%S %Y", &now_tm);
-    return std::string{time_str};
+    std::tm now_tm;
+    gmtime_r(&now_c, &now_tm);
+    std::strftime(buffer, size, "%a %b %d %H:%M:%S %Y", &now_tm);
+    return buffer;
 }
 
-void Logger::request(const std::string &id, int fd, const std::string &request) {
-    std::string client_ip = getClientIP(fd);
-    std::string request_line = HTTP_Parser::get_request_line(request);
-    std::string time_str = getCurrentTime();
+// Local time with zone, as std::put_time(..., "%c %Z") prints it
+const char *formatExpireTime(std::chrono::system_clock::time_point time, char *buffer, size_t size) {
+    std::time_t t = std::chrono::system_clock::to_time_t(time);
+    std::tm tm;
+    localtime_r(&t, &tm);
+    std::strftime(buffer, size, "%c %Z", &tm);
+    return buffer;
+}
+
+void Logger::request(std::string_view id, int fd, std::string_view request) {
+    char client_ip[INET_ADDRSTRLEN];
+    char time_str[80];
+    std::string_view request_line = HTTP_Parser::get_request_line(request);
+    if (binary_) {
+        // The decoder prints the time of the record
+        in_addr address;
+        bool known = getClientAddress(fd, &address);
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_request(id, request_line, known ? &address : nullptr);
+        return;
+    }
 
     // Format log message and call log method
-    std::string message = id + ": \"" + request_line + "\" from " + client_ip + " @ " + time_str;
-    log(message);
+    log(format(id, ": \"", request_line, "\" from ", getClientIP(fd, client_ip, sizeof(client_ip)), " @ ",
+               getCurrentTime(time_str, sizeof(time_str))));
 }
 
-void Logger::not_in_cache(const std::string &id) {
-    std::string message = id + ": not in cache";
-    log(message);
+void Logger::not_in_cache(std::string_view id) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write(BinaryLog::NOT_IN_CACHE, id);
+        return;
+    }
+    log(format(id, ": not in cache"));
 }
 
-void Logger::cache_status(const std::string &id, std::shared_ptr<CacheEntry> entry) {
-    std::ostringstream oss;
-    oss << "in cache, ";
-    if (entry->isFresh()) {
-        oss << "valid";
-    } else if (entry->isExpired()) {
-        std::time_t t = std::chrono::system_clock::to_time_t(entry->getExpireTime());
-        std::tm tm = *std::localtime(&t);
-        oss << "but expired at " << std::put_time(&tm, "%c %Z");
-    } else if (entry->isMustRevalidate()) {
-        oss << "requires validation";
+BinaryLog::CacheStatus getCacheStatus(const CacheEntry &entry) {
+    if (entry.isValidatorOnly()) {
+        return entry.isFresh() ? BinaryLog::VALIDATORS_FRESH : BinaryLog::VALIDATORS_EXPIRED;
+    } else if (entry.isFresh()) {
+        return BinaryLog::VALID;
+    } else if (entry.isExpired()) {
+        return BinaryLog::EXPIRED;
+    } else if (entry.isMustRevalidate()) {
+        return BinaryLog::MUST_REVALIDATE;
     }
-    std::string message = id + ": " + oss.str();
-    log(message);
+    return BinaryLog::OTHER;
 }
 
-void Logger::forward_request(const std::string &id, const std::string &request) {
-    std::string request_line = HTTP_Parser::get_request_line(request);
-    std::string host;
-    std::tie(host, std::ignore) = HTTP_Parser::extract_host_and_port(request);
-    std::string message = id + ": Requesting \"" + request_line + "\" from " + host;
-    log(message);
+void Logger::cache_status(std::string_view id, const CacheEntry &entry) {
+    char time_str[80];
+    BinaryLog::CacheStatus status = getCacheStatus(entry);
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (status == BinaryLog::EXPIRED) {
+            binary_->write_time(BinaryLog::CACHE_STATUS, id, status, entry.getExpireTime());
+        } else {
+            binary_->write(BinaryLog::CACHE_STATUS, id, status);
+        }
+        return;
+    }
+
+    switch (status) {
+        case BinaryLog::VALIDATORS_FRESH:
+            log(format(id, ": in cache, validators only"));
+            break;
+        case BinaryLog::VALIDATORS_EXPIRED:
+            log(format(id, ": in cache, validators only, expired"));
+            break;
+        case BinaryLog::VALID:
+            log(format(id, ": in cache, valid"));
+            break;
+        case BinaryLog::EXPIRED:
+            log(format(id, ": in cache, but expired at ",
+                       formatExpireTime(entry.getExpireTime(), time_str, sizeof(time_str))));
+            break;
+        case BinaryLog::MUST_REVALIDATE:
+            log(format(id, ": in cache, requires validation"));
+            break;
+        default:
+            log(format(id, ": in cache, "));
+    }
 }
 
-void Logger::no_store(const std::string &id) {
-    std::string message = id + ": not cacheable, \"no-store\" founded.";
-    log(message);
+void Logger::forward_request(std::string_view id, std::string_view request) {
+    std::string_view request_line = HTTP_Parser::get_request_line(request);
+    auto host_and_port = HTTP_Parser::extract_host_and_port(request, RequestArena::current());
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_strings(BinaryLog::FORWARD_REQUEST, id, request_line, host_and_port.first);
+        return;
+    }
+    log(format(id, ": Requesting \"", request_line, "\" from ", host_and_port.first));
 }
 
-void Logger::received_response(const std::string &id, const std::string &host, const std::string &response) {
-    std::string response_line = HTTP_Parser::get_request_line(response);
-    std::string message = id + ": Received \"" + response_line + "\" from " + host;
-    log(message);
+void Logger::no_store(std::string_view id) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write(BinaryLog::NO_STORE, id);
+        return;
+    }
+    log(format(id, ": not cacheable, \"no-store\" founded."));
 }
 
-void Logger::cache_result(const std::string &id, std::shared_ptr<CacheEntry> entry) {
-    std::ostringstream oss;
-    oss << "cached, ";
-    if (entry->isNeverExpires()) {
-        oss << "never expires";
-    } else if (entry->isNoCache() || entry->isMustRevalidate()) {
-        oss << "but requires re-validation";
+void Logger::not_cacheable(std::string_view id, std::string_view reason) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_strings(BinaryLog::NOT_CACHEABLE, id, reason);
+        return;
+    }
+    log(format(id, ": not cacheable because ", reason));
+}
+
+void Logger::received_response(std::string_view id, std::string_view host, std::string_view response) {
+    std::string_view response_line = HTTP_Parser::get_request_line(response);
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_strings(BinaryLog::RECEIVED, id, response_line, host);
+        return;
+    }
+    log(format(id, ": Received \"", response_line, "\" from ", host));
+}
+
+void Logger::received_response(std::string_view id, std::string_view host, const std::string &response,
+                               const ResponseMeta &meta) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_strings(BinaryLog::RECEIVED, id, meta.status_line(response), host);
+        return;
+    }
+    log(format(id, ": Received \"", meta.status_line(response), "\" from ", host));
+}
+
+void Logger::cache_result(std::string_view id, std::shared_ptr<CacheEntry> entry) {
+    char time_str[80];
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entry->isNoCache() || entry->isMustRevalidate()) {
+            binary_->write(BinaryLog::CACHE_RESULT, id, BinaryLog::REVALIDATE);
+        } else {
+            binary_->write_time(BinaryLog::CACHE_RESULT, id, BinaryLog::EXPIRES, entry->getExpireTime());
+        }
+        return;
+    }
+    if (entry->isNoCache() || entry->isMustRevalidate()) {
+        log(format(id, ": cached, but requires re-validation"));
     } else {
-        std::time_t t = std::chrono::system_clock::to_time_t(entry->getExpireTime());
-        std::tm tm = *std::localtime(&t);
-        oss << "expires at " << std::put_time(&tm, "%c %Z");
+        log(format(id, ": cached, expires at ", formatExpireTime(entry->getExpireTime(), time_str, sizeof(time_str))));
     }
-    std::string message = id + ": " + oss.str();
-    log(message);
 }
 
-void Logger::responding(const std::string &id, const std::string &response) {
-    std::string response_line = HTTP_Parser::get_request_line(response);
-    std::string message = id + ": Responding \"" + response_line + "\"";
-    log(message);
+void Logger::responding(std::string_view id, std::string_view response) {
+    std::string_view response_line = HTTP_Parser::get_request_line(response);
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_strings(BinaryLog::RESPONDING, id, response_line);
+        return;
+    }
+    log(format(id, ": Responding \"", response_line, "\""));
 }
 
-void Logger::tunnel_closed(const std::string &id) {
-    std::string message = id + ": Tunnel closed";
-    log(message);
+void Logger::responding(std::string_view id, const CacheEntry &entry) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_strings(BinaryLog::RESPONDING, id, entry.getStatusLine());
+        return;
+    }
+    log(format(id, ": Responding \"", entry.getStatusLine(), "\""));
 }
 
-void Logger::note(const std::string &message) {
-    log("[INFO] " + message);
+void Logger::tunnel_closed(std::string_view id) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write(BinaryLog::TUNNEL_CLOSED, id);
+        return;
+    }
+    log(format(id, ": Tunnel closed"));
+}
+
+void Logger::note(std::string_view message) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_text(BinaryLog::NOTE, {}, message);
+        return;
+    }
+    log(format("[INFO] ", message));
 }
 
-void Logger::note_with_id(const std::string &id, const std::string &message) {
-    log(id + ": [INFO] " + message);
+void Logger::note_with_id(std::string_view id, std::string_view message) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_text(BinaryLog::NOTE_WITH_ID, id, message);
+        return;
+    }
+    log(format(id, ": [INFO] ", message));
 }
 
-void Logger::warning(const std::string &message) {
-    log("[WARN] " + message);
+void Logger::warning(std::string_view message) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_text(BinaryLog::WARNING, {}, message);
+        return;
+    }
+    log(format("[WARN] ", message));
 }
 
-void Logger::error(const std::string &message) {
-    log("[ERROR] " + message);
+void Logger::error(std::string_view message) {
+    if (binary_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        binary_->write_text(BinaryLog::ERROR, {}, message);
+        return;
+    }
+    log(format("[ERROR] ", message));
 }
@@ -2,32 +2,406 @@
 // Created by Rocco Su on 2/16/23.
 //
 
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "cache.hpp"
+#include "hot_restart.hpp"
 #include "logger.hpp"
+#include "shared_cache.hpp"
 #include "tcp_client.hpp"
 #include "tcp_server.hpp"
 #include "thread_pool.hpp"
 
 const int PORT = 12345;
 const int NUMBER_OF_WORKERS = 100;
+// Workers for requests that wait on an origin, kept apart from the request
+// workers that answer fresh cache hits; 0 runs everything on the request workers
+const int UPSTREAM_WORKERS = 64;
+// Coroutine build (make coro): epoll threads serving GET requests without a
+// thread per connection
+const int EVENT_LOOPS = 2;
+// Pending connection queue of each listen socket
+const int LISTEN_BACKLOG = 1024;
+// 1: a single acceptor thread, N > 1: N SO_REUSEPORT listeners with CPU-pinned
+// acceptors, 0: one listener per core
+const int REUSEPORT_LISTENERS = 1;
+// Connection deadlines, expired connections are closed
+const std::chrono::milliseconds HEADER_READ_TIMEOUT(10000);
+const std::chrono::milliseconds BODY_READ_TIMEOUT(30000);
+const std::chrono::milliseconds UPSTREAM_CONNECT_TIMEOUT(10000);
+const std::chrono::milliseconds UPSTREAM_IDLE_TIMEOUT(60000);
+const std::chrono::milliseconds TUNNEL_IDLE_TIMEOUT(300000);
+// Epoll threads relaying CONNECT tunnels, 0 keeps each tunnel on a request worker
+const int TUNNEL_THREADS = 2;
+// Use io_uring for accepting and tunnels when the kernel supports it
+const bool USE_IO_URING = true;
+// Negative caching: requests to an origin that failed DNS or connect fail fast
+// for a while, and error responses without explicit freshness are cached briefly
+const std::chrono::seconds NO_SUCH_HOST_TTL(30);
+const std::chrono::seconds CONNECT_FAILURE_TTL(5);
+const std::chrono::seconds ERROR_RESPONSE_TTL(10);
+// Consecutive failures that open an origin's circuit breaker, and how long it stays open
+const unsigned CIRCUIT_FAILURE_THRESHOLD = 5;
+const std::chrono::seconds CIRCUIT_OPEN_TIME(30);
+// Responses without Cache-Control max-age/s-maxage or Expires but with a
+// Last-Modified are fresh for this fraction of the time since they last
+// changed, at most HEURISTIC_FRESHNESS_CAP; those without any are stale at once
+const double HEURISTIC_FRESHNESS_FRACTION = 0.1;
+const std::chrono::seconds HEURISTIC_FRESHNESS_CAP(24 * 60 * 60);
+// Expired entries stay whole this long (served if the origin fails), then a
+// background sweeper drops them or keeps only their validators. Negative
+// disables the sweeper.
+const std::chrono::seconds EXPIRED_ENTRY_GRACE(60);
+// Response bodies larger than SPOOL_THRESHOLD bytes are kept in unlinked
+// files in SPOOL_DIR instead of memory, and sent from there with sendfile().
+// 0 keeps every body in memory.
+const size_t SPOOL_THRESHOLD = 8 * 1024 * 1024;
+const std::string SPOOL_DIR = "/tmp";
+// The in-process cache evicts once the responses it holds, headers and
+// bodies in memory or spooled, add up to more than CACHE_MAX_BYTES. 0 leaves
+// it bounded by entry count only.
+const size_t CACHE_MAX_BYTES = 1024UL * 1024 * 1024;
+// Cache hits with an in-memory body of at least ZEROCOPY_THRESHOLD bytes are
+// sent with MSG_ZEROCOPY. 0 turns it off.
+const size_t ZEROCOPY_THRESHOLD = 0;
+// HTTP/2 with prior knowledge (h2c): threads serving the streams of all
+// connections, 0 turns it off, and the streams served at once per connection
+const size_t H2_STREAM_THREADS = 8;
+const uint32_t H2_MAX_CONCURRENT_STREAMS = 100;
+// Prefetch the stylesheets, scripts and images of fetched HTML pages in the
+// background: at most PREFETCH_PER_PAGE per page and PREFETCH_RATE per second
+const bool PREFETCH_SUBRESOURCES = false;
+const size_t PREFETCH_PER_PAGE = 16;
+const unsigned PREFETCH_RATE = 10;
+// Cache cluster: host:port of every proxy node, the same list on each of them,
+// and this node's entry. Empty runs the proxy on its own. Overridden by -P and -n.
+const std::vector<std::string> PEERS = {};
+const std::string PEER_SELF = "";
+// Pre-fork mode: with more than one worker process every process runs its own
+// server on a SO_REUSEPORT listener held by the parent, and they share one
+// cache of SHARED_CACHE_SIZE bytes in shared memory. Overridden by -w.
+const int WORKER_PROCESSES = 1;
+const size_t SHARED_CACHE_SIZE = 256 * 1024 * 1024;
+// Hot restart: a proxy started with the same socket path as a running one
+// takes over its listen sockets and shared cache, and the old one drains for
+// up to DRAIN_TIMEOUT. Empty disables it. Overridden by -r.
+const std::string HOT_RESTART_SOCKET = "";
+// Time given to requests and tunnels in progress on SIGTERM or a hot restart
+const std::chrono::seconds DRAIN_TIMEOUT(30);
 const std::string LOG_PATH = "/var/log/erss/proxy.log";
 //  const std::string LOG_PATH = "./log/proxy.log";
+// Write the log as compact binary records to BINARY_LOG_PATH instead, for
+// bin/log_decode to turn into the text log. Overridden by -b.
+const bool BINARY_LOG = false;
+const std::string BINARY_LOG_PATH = "/var/log/erss/proxy.bin";
+// Log the size of every response stored in the cache, which bin/cache_sim
+// needs to weigh objects. Overridden by -s.
+const bool LOG_OBJECT_SIZES = false;
+
+namespace {
+struct Options {
+    int port = PORT;
+    std::string log_path = LOG_PATH;
+    bool binary_log = BINARY_LOG;
+    bool object_sizes = LOG_OBJECT_SIZES;
+    std::vector<std::string> peers = PEERS;
+    std::string self = PEER_SELF;
+    int processes = WORKER_PROCESSES;
+    std::string restart_socket = HOT_RESTART_SOCKET;
+};
+
+volatile sig_atomic_t g_stopping = 0;
+Server *volatile g_server = nullptr;
+
+void stop_workers(int) {
+    g_stopping = 1;
+}
+
+void stop_server(int) {
+    Server *server = g_server;
+    if (server != nullptr) {
+        server->stop_accepting();
+    }
+}
+
+// The cache region handed over by the previous process, or a new one
+std::unique_ptr<SharedCache> open_shared_cache(int inherited_fd) {
+    if (inherited_fd != -1) {
+        try {
+            return SharedCache::attach(inherited_fd);
+        } catch (const std::exception &e) {
+            std::cerr << "Starting with an empty cache: " << e.what() << std::endl;
+        }
+    }
+    return std::make_unique<SharedCache>(SHARED_CACHE_SIZE);
+}
+
+// Runs the proxy in this process until SIGTERM or a hot restart, then drains
+// it. Workers are given the parent's cache and listen sockets; a single
+// process takes them over from its predecessor itself.
+int run_server(const Options &options, SharedCache *shared, std::vector<int> listen_sockets) {
+    std::unique_ptr<HotRestart> restart;
+    std::unique_ptr<SharedCache> own_cache;
+    if (shared == nullptr && !options.restart_socket.empty()) {
+        // 热重启需要把缓存放在可以交接的共享内存中
+        restart = std::make_unique<HotRestart>(options.restart_socket);
+        HotRestart::Handoff handoff;
+        if (restart->take_over(handoff)) {
+            std::cout << "Took over " << handoff.listen_fds.size() << " listen socket(s) from the running proxy"
+                      << std::endl;
+        }
+        own_cache = open_shared_cache(handoff.cache_fd);
+        shared = own_cache.get();
+        listen_sockets = handoff.listen_fds;
+    }
 
-int main() {
-    std::cout << "Proxy server is running on port " << PORT << std::endl;
     // Get instance of Logger
-    Logger &logger = Logger::GetInstance(LOG_PATH);
+    Logger &logger = Logger::GetInstance(options.log_path, options.binary_log ? LogFormat::BINARY : LogFormat::TEXT);
     // Get instance of Cache
     Cache &cache = Cache::getInstance(logger);
+    FreshnessPolicy freshness;
+    freshness.heuristic_fraction = HEURISTIC_FRESHNESS_FRACTION;
+    freshness.heuristic_cap = HEURISTIC_FRESHNESS_CAP;
+    cache.setFreshnessPolicy(freshness);
+    cache.setMaxBytes(CACHE_MAX_BYTES);
+    cache.setSizeNotes(options.object_sizes);
+    if (shared != nullptr) {
+        cache.useShared(shared);
+    } else if (EXPIRED_ENTRY_GRACE.count() >= 0) {
+        cache.enableSweeper(EXPIRED_ENTRY_GRACE);
+    }
     // 创建服务器实例并启动
-    Server server(std::to_string(PORT),
+    ServerConfig config;
+    config.backlog = LISTEN_BACKLOG;
+    config.listeners = REUSEPORT_LISTENERS > 0 ? REUSEPORT_LISTENERS : std::thread::hardware_concurrency();
+    config.listen_sockets = std::move(listen_sockets);
+    config.deadlines.header_read = HEADER_READ_TIMEOUT;
+    config.deadlines.body_read = BODY_READ_TIMEOUT;
+    config.deadlines.upstream_connect = UPSTREAM_CONNECT_TIMEOUT;
+    config.deadlines.upstream_idle = UPSTREAM_IDLE_TIMEOUT;
+    config.deadlines.tunnel_idle = TUNNEL_IDLE_TIMEOUT;
+    config.upstream_threads = UPSTREAM_WORKERS;
+    config.event_loops = EVENT_LOOPS;
+    config.tunnel_threads = TUNNEL_THREADS;
+    config.io_uring = USE_IO_URING;
+    config.negative.no_such_host_ttl = NO_SUCH_HOST_TTL;
+    config.negative.connect_failure_ttl = CONNECT_FAILURE_TTL;
+    config.negative.error_response_ttl = ERROR_RESPONSE_TTL;
+    config.negative.failure_threshold = CIRCUIT_FAILURE_THRESHOLD;
+    config.negative.open_time = CIRCUIT_OPEN_TIME;
+    config.prefetch.enabled = PREFETCH_SUBRESOURCES;
+    config.prefetch.per_page = PREFETCH_PER_PAGE;
+    config.prefetch.rate = PREFETCH_RATE;
+    config.cluster.peers = options.peers;
+    config.cluster.self = options.self;
+    config.spool_threshold = SPOOL_THRESHOLD;
+    config.spool_dir = SPOOL_DIR;
+    config.zerocopy_threshold = ZEROCOPY_THRESHOLD;
+    config.h2.stream_threads = H2_STREAM_THREADS;
+    config.h2.max_concurrent_streams = H2_MAX_CONCURRENT_STREAMS;
+    Server server(std::to_string(options.port),
                   NUMBER_OF_WORKERS,
                   logger,
-                  cache);
+                  cache,
+                  config);
+
+    // SIGTERM停止接收新连接，进行中的请求和隧道处理完后退出
+    g_server = &server;
+    struct sigaction action{};
+    action.sa_handler = stop_server;
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    // sendfile()没有MSG_NOSIGNAL，客户端断开连接时改为返回EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    // 工作进程在服务器创建前收到的SIGTERM由父进程的处理函数记录
+    if (g_stopping) {
+        server.stop_accepting();
+    }
+
+    if (restart) {
+        // 新进程可以接收连接后，旧进程才停止接收
+        restart->confirm();
+        restart->serve(server.listen_sockets(), shared->fd(), [&server]() { server.stop_accepting(); });
+    }
     server.start();
+    restart.reset();
+
+    if (!server.drain(DRAIN_TIMEOUT)) {
+        logger.warning("drain timed out, closing the remaining connections");
+        logger.flush();
+        // Workers still blocked on an origin would hold up the destructors
+        std::_Exit(0);
+    }
+    g_server = nullptr;
+    // Workers leave with _exit(), without running the Logger's destructor
+    logger.flush();
+    return 0;
+}
+
+// The parent's listen sockets served by one worker: every socket has one
+// worker, unless there are fewer sockets than workers
+std::vector<int> worker_sockets(const std::vector<int> &listeners, size_t worker, size_t processes) {
+    std::vector<int> sockets;
+    for (size_t i = worker; i < listeners.size(); i += processes) {
+        sockets.push_back(listeners[i]);
+    }
+    if (sockets.empty()) {
+        sockets.push_back(listeners[worker % listeners.size()]);
+    }
+    return sockets;
+}
+
+pid_t spawn_worker(const Options &options, SharedCache *shared, std::vector<int> listen_sockets) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(run_server(options, shared, std::move(listen_sockets)));
+    }
+    if (pid == -1) {
+        std::perror("fork");
+    }
+    return pid;
+}
+
+// Starts the worker processes and replaces any that dies; the shared cache
+// recovers from a worker that died while holding its lock, and the listen
+// sockets stay open in the parent, so no queued connection is lost
+int run_workers(const Options &options) {
+    std::unique_ptr<HotRestart> restart;
+    HotRestart::Handoff handoff;
+    if (!options.restart_socket.empty()) {
+        restart = std::make_unique<HotRestart>(options.restart_socket);
+        if (restart->take_over(handoff)) {
+            std::cout << "Took over " << handoff.listen_fds.size() << " listen socket(s) from the running proxy"
+                      << std::endl;
+        }
+    }
+    std::unique_ptr<SharedCache> shared = open_shared_cache(handoff.cache_fd);
+
+    // 每个工作进程一个SO_REUSEPORT监听套接字，由内核在它们之间分配连接
+    std::vector<int> listeners = handoff.listen_fds;
+    size_t processes = options.processes;
+    while (listeners.size() < processes) {
+        try {
+            listeners.push_back(Server::open_listen_socket(std::to_string(options.port), LISTEN_BACKLOG, true));
+        } catch (const std::exception &e) {
+            // 交接来的套接字没有SO_REUSEPORT时，工作进程共用这些套接字
+            if (listeners.empty()) {
+                throw;
+            }
+            break;
+        }
+    }
+
+    struct sigaction action{};
+    action.sa_handler = stop_workers;
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+
+    std::vector<pid_t> workers;
+    for (size_t i = 0; i < processes; i++) {
+        workers.push_back(spawn_worker(options, shared.get(), worker_sockets(listeners, i, processes)));
+    }
+    if (restart) {
+        restart->confirm();
+        // 交接完成后像收到SIGTERM一样让工作进程排空后退出
+        restart->serve(listeners, shared->fd(), []() { kill(getpid(), SIGTERM); });
+    }
+
+    while (!g_stopping) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i] == pid && !g_stopping) {
+                std::cerr << "Worker " << pid << " exited, starting a new one" << std::endl;
+                // 避免启动即崩溃时不停地重启
+                sleep(1);
+                workers[i] = spawn_worker(options, shared.get(), worker_sockets(listeners, i, processes));
+            }
+        }
+    }
+
+    for (pid_t worker : workers) {
+        if (worker > 0) {
+            kill(worker, SIGTERM);
+        }
+    }
+    while (waitpid(-1, nullptr, 0) > 0) {
+    }
     return 0;
 }
+}  // namespace
+
+// Usage: http_cache_proxy [-p port] [-l log file] [-b] [-s] [-n self] [-P peer]... [-w processes] [-r socket]
+// so several nodes of a cluster can run on one machine, e.g. on loopback:
+//   http_cache_proxy -p 12346 -l /tmp/b.log -n 127.0.0.1:12346 -P 127.0.0.1:12345 -P 127.0.0.1:12346
+// and a new binary can replace a running one started with the same -r socket.
+int main(int argc, char *argv[]) {
+    Options options;
+    bool peers_given = false;
+    bool log_given = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:l:bsn:P:w:r:")) != -1) {
+        switch (opt) {
+            case 'p':
+                options.port = std::stoi(optarg);
+                break;
+            case 'l':
+                options.log_path = optarg;
+                log_given = true;
+                break;
+            case 'b':
+                options.binary_log = true;
+                break;
+            case 's':
+                options.object_sizes = true;
+                break;
+            case 'n':
+                options.self = optarg;
+                break;
+            case 'P':
+                if (!peers_given) {
+                    options.peers.clear();
+                    peers_given = true;
+                }
+                options.peers.emplace_back(optarg);
+                break;
+            case 'w':
+                options.processes = std::stoi(optarg);
+                break;
+            case 'r':
+                options.restart_socket = optarg;
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [-p port] [-l log file] [-b] [-s] [-n self] [-P peer]... [-w processes] [-r socket]" << std::endl;
+                return 1;
+        }
+    }
+    if (options.binary_log && !log_given) {
+        options.log_path = BINARY_LOG_PATH;
+    }
+    if (!options.peers.empty() && options.self.empty()) {
+        options.self = "127.0.0.1:" + std::to_string(options.port);
+    }
+
+    std::cout << "Proxy server is running on port " << options.port << std::endl;
+    if (options.processes > 1) {
+        return run_workers(options);
+    }
+    return run_server(options, nullptr, {});
+}
@@ -0,0 +1,114 @@
+#include "origin_health.hpp"
+
+#include <algorithm>
+
+namespace {
+std::pmr::string make_key(std::string_view host, std::string_view port) {
+    std::pmr::string key(RequestArena::current());
+    key.reserve(host.size() + port.size() + 1);
+    key.append(host).append(":").append(port);
+    return key;
+}
+}  // namespace
+
+OriginHealth::OriginHealth(Logger &logger, const NegativeCacheConfig &config)
+        : m_logger(logger), m_config(config), m_tracked(0) {}
+
+const char *OriginHealth::name(OriginFailure failure) {
+    switch (failure) {
+        case OriginFailure::NO_SUCH_HOST:
+            return "no such host";
+        case OriginFailure::CONNECT:
+            return "connect failed";
+        default:
+            return "upstream error";
+    }
+}
+
+bool OriginHealth::allow(std::string_view host, std::string_view port) {
+    if (m_tracked.load(std::memory_order_relaxed) == 0) {
+        return true;
+    }
+    std::pmr::string key = make_key(host, port);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_states.find(std::string_view(key));
+    if (it == m_states.end()) {
+        return true;
+    }
+
+    State &state = it->second;
+    Clock::time_point now = Clock::now();
+    if (now < state.blocked_until) {
+        return false;
+    }
+    if (state.open) {
+        // Half open: this request is the probe, the others keep failing fast
+        // until it reports back or the open time passes again
+        state.probing = true;
+        state.blocked_until = now + m_config.open_time;
+    }
+    return true;
+}
+
+void OriginHealth::record_success(std::string_view host, std::string_view port) {
+    if (m_tracked.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    std::pmr::string key = make_key(host, port);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_states.find(std::string_view(key));
+    if (it == m_states.end()) {
+        return;
+    }
+    if (it->second.open) {
+        m_logger.note("circuit breaker closed for " + it->first);
+    }
+    m_states.erase(it);
+    m_tracked.store(m_states.size(), std::memory_order_relaxed);
+}
+
+void OriginHealth::record_failure(std::string_view host, std::string_view port, OriginFailure failure) {
+    std::pmr::string key = make_key(host, port);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+    auto it = m_states.find(std::string_view(key));
+    if (it == m_states.end()) {
+        if (m_states.size() >= MAX_ORIGINS) {
+            prune(now);
+        }
+        it = m_states.emplace(std::string(key), State()).first;
+        m_tracked.store(m_states.size(), std::memory_order_relaxed);
+    }
+
+    State &state = it->second;
+    state.failures++;
+    std::chrono::seconds ttl(0);
+    if (failure == OriginFailure::NO_SUCH_HOST) {
+        ttl = m_config.no_such_host_ttl;
+    } else if (failure == OriginFailure::CONNECT) {
+        ttl = m_config.connect_failure_ttl;
+    }
+
+    if (state.probing || (!state.open && state.failures >= m_config.failure_threshold)) {
+        m_logger.warning("circuit breaker " + std::string(state.probing ? "reopened" : "opened") + " for " +
+                         it->first + " after " + std::to_string(state.failures) + " consecutive failures (" +
+                         name(failure) + "), failing fast for " + std::to_string(m_config.open_time.count()) + "s");
+        state.open = true;
+        state.probing = false;
+        ttl = std::max(ttl, m_config.open_time);
+    } else if (ttl.count() > 0 && now >= state.blocked_until) {
+        m_logger.note("origin " + it->first + " unreachable (" + name(failure) + "), failing fast for " +
+                      std::to_string(ttl.count()) + "s");
+    }
+    state.blocked_until = std::max(state.blocked_until, now + ttl);
+}
+
+void OriginHealth::prune(Clock::time_point now) {
+    for (auto it = m_states.begin(); it != m_states.end();) {
+        if (!it->second.open && it->second.blocked_until <= now) {
+            it = m_states.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include "peer_cluster.hpp"
+
+#include <stdexcept>
+
+#include "header_scan.hpp"
+
+namespace {
+std::vector<PeerCluster::Peer> parse_peers(const std::vector<std::string> &names) {
+    std::vector<PeerCluster::Peer> peers;
+    for (const std::string &name : names) {
+        size_t colon = name.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == name.size()) {
+            throw std::invalid_argument("Peer \"" + name + "\" is not host:port.");
+        }
+        peers.push_back({name, name.substr(0, colon), name.substr(colon + 1)});
+    }
+    return peers;
+}
+
+size_t find_self(const std::vector<PeerCluster::Peer> &peers, const std::string &self) {
+    for (size_t i = 0; i < peers.size(); i++) {
+        if (peers[i].name == self) {
+            return i;
+        }
+    }
+    throw std::invalid_argument("This node (" + self + ") is not in the peer list.");
+}
+}  // namespace
+
+PeerCluster::PeerCluster(const PeerConfig &config)
+        : m_peers(parse_peers(config.peers)),
+          m_self(find_self(m_peers, config.self)),
+          m_ring(config.peers, config.virtual_nodes),
+          m_via("Via: 1.1 " + config.self + "\r\n") {}
+
+const PeerCluster::Peer *PeerCluster::owner(std::string_view url) const {
+    size_t node = m_ring.owner(url);
+    return node == m_self ? nullptr : &m_peers[node];
+}
+
+bool PeerCluster::is_peer_request(std::string_view request) const {
+    size_t header_end = HeaderScan::find_header_end(request);
+    std::string_view headers = request.substr(0, header_end);
+    // Via may be repeated, and each field lists the proxies the request
+    // passed through: "1.1 host:port, 1.0 other"
+    size_t line = headers.find("\r\n");
+    while (line != std::string_view::npos) {
+        line += 2;
+        size_t end = headers.find("\r\n", line);
+        std::string_view field = headers.substr(line, end == std::string_view::npos ? end : end - line);
+        line = end;
+        if (field.size() < 4 || !HeaderScan::iequals(field.substr(0, 4), "Via:")) {
+            continue;
+        }
+        for (const Peer &peer : m_peers) {
+            size_t pos = field.find(peer.name);
+            while (pos != std::string_view::npos) {
+                // Whole received-by names only, so 10.0.0.1:80 does not match 10.0.0.1:8080
+                size_t after = pos + peer.name.size();
+                if (field[pos - 1] == ' ' && (after == field.size() || field[after] == ',' || field[after] == ' ')) {
+                    return true;
+                }
+                pos = field.find(peer.name, after);
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,241 @@
+#include "prefetcher.hpp"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "header_scan.hpp"
+#include "html_link_scanner.hpp"
+
+namespace {
+// Nice value of the prefetch thread, relative to the request workers
+const int PREFETCH_NICE = 10;
+// Longer URLs are not prefetched
+const size_t MAX_URL_LENGTH = 2048;
+
+// Length of "http://", or 0 if url is not an http URL
+size_t http_prefix(std::string_view url) {
+    return url.size() > 7 && HeaderScan::iequals(url.substr(0, 7), "http://") ? 7 : 0;
+}
+
+// End of the authority of an absolute http URL
+size_t authority_end(std::string_view url) {
+    size_t end = url.find_first_of("/?#", 7);
+    return end == std::string_view::npos ? url.size() : end;
+}
+
+// RFC 3986 section 5.2.4, for a path starting with '/'
+std::string remove_dot_segments(std::string_view path) {
+    std::vector<std::string_view> segments;
+    bool directory = false;
+    size_t pos = 1;
+    while (true) {
+        size_t slash = path.find('/', pos);
+        std::string_view segment = path.substr(pos, slash == std::string_view::npos ? slash : slash - pos);
+        directory = segment == "." || segment == "..";
+        if (segment == "..") {
+            if (!segments.empty()) {
+                segments.pop_back();
+            }
+        } else if (segment != ".") {
+            segments.push_back(segment);
+        }
+        if (slash == std::string_view::npos) {
+            break;
+        }
+        pos = slash + 1;
+    }
+
+    std::string result;
+    result.reserve(path.size());
+    for (std::string_view segment : segments) {
+        result.append("/").append(segment);
+    }
+    if (directory || result.empty()) {
+        result.append("/");
+    }
+    return result;
+}
+}  // namespace
+
+Prefetcher::Prefetcher(Logger &logger, const PrefetchConfig &config, Fetch fetch)
+        : m_logger(logger),
+          m_config(config),
+          m_fetch(std::move(fetch)),
+          m_next_slot(Clock::now()),
+          m_stop(false),
+          m_thread(&Prefetcher::run, this) {}
+
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void Prefetcher::offer(std::string_view id, std::shared_ptr<CacheEntry> page) {
+    const ResponseMeta &meta = page->getMeta();
+    if (meta.status != 200) {
+        return;
+    }
+    std::string_view headers = std::string_view(page->getResponse()).substr(0, meta.header_length);
+    std::string_view type = HTTP_Parser::find_header_value(headers, "Content-Type");
+    if (type.size() < 9 || !HeaderScan::iequals(type.substr(0, 9), "text/html")) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pages.size() >= m_config.max_pending_pages) {
+            return;
+        }
+        m_pages.push_back(Page{std::string(id), std::move(page)});
+    }
+    m_cv.notify_one();
+}
+
+bool Prefetcher::resolve(std::string_view page_url, std::string_view base, std::string_view link, std::string &url) {
+    if (http_prefix(page_url) == 0) {
+        return false;
+    }
+    std::string base_url;
+    if (!base.empty()) {
+        // Relative links resolve against the <base>, which must be on the same origin itself
+        if (!resolve(page_url, "", base, base_url)) {
+            return false;
+        }
+        page_url = base_url;
+    }
+    std::string_view origin = page_url.substr(0, authority_end(page_url));
+
+    link = link.substr(0, link.find('#'));
+    if (link.empty()) {
+        return false;
+    }
+
+    // Path and query of the link, relative to the origin
+    std::string target;
+    if (link.compare(0, 2, "//") == 0 || http_prefix(link) != 0) {
+        std::string absolute = link[0] == '/' ? "http:" + std::string(link) : std::string(link);
+        std::string_view authority = std::string_view(absolute).substr(7, authority_end(absolute) - 7);
+        if (!HeaderScan::iequals(authority, origin.substr(7))) {
+            return false;
+        }
+        target = absolute.substr(authority_end(absolute));
+    } else {
+        size_t colon = link.find(':');
+        if (colon != std::string_view::npos && colon < link.find_first_of("/?")) {
+            // Another scheme: https:, data:, javascript:...
+            return false;
+        }
+        std::string_view page_path = page_url.substr(origin.size());
+        page_path = page_path.substr(0, page_path.find_first_of("?#"));
+        if (link[0] == '/') {
+            target = link;
+        } else if (link[0] == '?') {
+            target = std::string(page_path.empty() ? "/" : page_path).append(link);
+        } else {
+            size_t slash = page_path.rfind('/');
+            target = std::string(slash == std::string_view::npos ? "/" : page_path.substr(0, slash + 1)).append(link);
+        }
+    }
+    if (target.empty() || target[0] == '?') {
+        target.insert(0, "/");
+    }
+
+    size_t query = target.find('?');
+    url.assign(origin);
+    url.append(remove_dot_segments(std::string_view(target).substr(0, query)));
+    if (query != std::string::npos) {
+        url.append(target, query, std::string::npos);
+    }
+    return url.size() <= MAX_URL_LENGTH &&
+           std::none_of(url.begin(), url.end(), [](char c) { return static_cast<unsigned char>(c) <= ' '; });
+}
+
+void Prefetcher::run() {
+    // Prefetches queue behind client requests for the CPU too
+    if (::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), PREFETCH_NICE) == -1) {
+        m_logger.warning("failed to lower the priority of the prefetch thread");
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this]() { return m_stop || !m_pages.empty(); });
+        if (m_stop) {
+            return;
+        }
+        Page page = std::move(m_pages.front());
+        m_pages.pop_front();
+        lock.unlock();
+        prefetch(page);
+        lock.lock();
+    }
+}
+
+void Prefetcher::prefetch(const Page &page) {
+    const std::string &response = page.entry->getResponse();
+    std::string_view body = std::string_view(response).substr(page.entry->getMeta().body_offset());
+    body = body.substr(0, m_config.scan_limit);
+    HtmlLinkScanner scanner;
+    std::vector<std::string> links;
+
+    // The links of each piece are fetched before the next is scanned, so the
+    // first subresources are warm early and the rest of a page whose budget
+    // is spent is never scanned
+    size_t started = 0;
+    std::string url;
+    for (size_t offset = 0; offset < body.size() && started < m_config.per_page; offset += SCAN_CHUNK) {
+        links.clear();
+        scanner.feed(body.substr(offset, SCAN_CHUNK), links);
+        for (const std::string &link : links) {
+            if (started >= m_config.per_page) {
+                break;
+            }
+            if (!resolve(page.entry->getUrl(), scanner.base(), link, url)) {
+                continue;
+            }
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                Clock::time_point now = Clock::now();
+                auto seen = m_seen.find(url);
+                if (seen != m_seen.end() && now - seen->second < m_config.seen_for) {
+                    continue;
+                }
+                if (seen == m_seen.end() && m_seen.size() >= MAX_SEEN) {
+                    for (auto it = m_seen.begin(); it != m_seen.end();) {
+                        it = now - it->second < m_config.seen_for ? std::next(it) : m_seen.erase(it);
+                    }
+                    if (m_seen.size() >= MAX_SEEN) {
+                        m_seen.clear();
+                    }
+                }
+                m_seen[url] = now;
+                if (!wait_for_slot(lock)) {
+                    return;
+                }
+            }
+            started++;
+            try {
+                m_fetch(page.id, url);
+            } catch (const std::exception &e) {
+                m_logger.note_with_id(page.id, "prefetch of " + url + " failed: " + e.what());
+            }
+        }
+    }
+}
+
+bool Prefetcher::wait_for_slot(std::unique_lock<std::mutex> &lock) {
+    if (m_cv.wait_until(lock, m_next_slot, [this]() { return m_stop; })) {
+        return false;
+    }
+    auto interval = std::chrono::microseconds(1000000 / std::max(m_config.rate, 1u));
+    m_next_slot = std::max(m_next_slot, Clock::now()) + interval;
+    return true;
+}
@@ -0,0 +1,145 @@
+#include "request_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+namespace {
+// Free blocks of one thread, linked through their first word
+struct BlockCache {
+    void *head = nullptr;
+    size_t count = 0;
+
+    ~BlockCache() {
+        while (head != nullptr) {
+            void *next = *static_cast<void **>(head);
+            ::operator delete(head);
+            head = next;
+        }
+    }
+};
+
+thread_local BlockCache t_cache;
+thread_local RequestArena *t_current = nullptr;
+
+std::atomic<uint64_t> g_arenas{0};
+std::atomic<uint64_t> g_heap_blocks{0};
+std::atomic<uint64_t> g_reused_blocks{0};
+std::atomic<uint64_t> g_large{0};
+
+void *take_block() {
+    if (t_cache.head != nullptr) {
+        void *block = t_cache.head;
+        t_cache.head = *static_cast<void **>(block);
+        t_cache.count--;
+        g_reused_blocks.fetch_add(1, std::memory_order_relaxed);
+        return block;
+    }
+    g_heap_blocks.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(RequestArena::BLOCK_SIZE);
+}
+
+void give_block(void *block) {
+    if (t_cache.count >= RequestArena::CACHED_BLOCKS) {
+        ::operator delete(block);
+        return;
+    }
+    *static_cast<void **>(block) = t_cache.head;
+    t_cache.head = block;
+    t_cache.count++;
+}
+
+// Requests a bump block cannot serve well: over-aligned, or big enough to
+// waste most of a block
+bool is_large(size_t bytes, size_t alignment) {
+    return alignment > alignof(std::max_align_t) || bytes > RequestArena::BLOCK_SIZE / 4;
+}
+
+// Offset of the payload of a large allocation, after its header
+size_t large_offset(size_t header, size_t alignment) {
+    return (header + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+RequestArena::RequestArena()
+        : m_blocks(nullptr), m_large(nullptr), m_cursor(nullptr), m_end(nullptr), m_used(0), m_previous(t_current) {
+    t_current = this;
+    g_arenas.fetch_add(1, std::memory_order_relaxed);
+}
+
+RequestArena::~RequestArena() {
+    t_current = m_previous;
+    while (m_blocks != nullptr) {
+        Block *next = m_blocks->next;
+        give_block(m_blocks);
+        m_blocks = next;
+    }
+    while (m_large != nullptr) {
+        Block *next = m_large->next;
+        ::operator delete(m_large, std::align_val_t(m_large->alignment));
+        m_large = next;
+    }
+}
+
+std::pmr::memory_resource *RequestArena::current() {
+    return t_current != nullptr ? t_current : std::pmr::get_default_resource();
+}
+
+RequestArena::Stats RequestArena::stats() {
+    return {g_arenas.load(std::memory_order_relaxed), g_heap_blocks.load(std::memory_order_relaxed),
+            g_reused_blocks.load(std::memory_order_relaxed), g_large.load(std::memory_order_relaxed)};
+}
+
+void *RequestArena::do_allocate(size_t bytes, size_t alignment) {
+    if (is_large(bytes, alignment)) {
+        return allocate_large(bytes, alignment);
+    }
+
+    size_t padding = (0 - reinterpret_cast<uintptr_t>(m_cursor)) & (alignment - 1);
+    if (static_cast<size_t>(m_end - m_cursor) < padding + bytes) {
+        Block *block = static_cast<Block *>(take_block());
+        block->next = m_blocks;
+        m_blocks = block;
+        m_cursor = reinterpret_cast<char *>(block + 1);
+        m_end = reinterpret_cast<char *>(block) + BLOCK_SIZE;
+        padding = (0 - reinterpret_cast<uintptr_t>(m_cursor)) & (alignment - 1);
+    }
+
+    char *p = m_cursor + padding;
+    m_cursor = p + bytes;
+    m_used += padding + bytes;
+    return p;
+}
+
+void *RequestArena::allocate_large(size_t bytes, size_t alignment) {
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    size_t offset = large_offset(sizeof(Block), alignment);
+    auto *block = static_cast<Block *>(::operator new(offset + bytes, std::align_val_t(alignment)));
+    block->next = m_large;
+    block->alignment = alignment;
+    m_large = block;
+    m_used += bytes;
+    g_large.fetch_add(1, std::memory_order_relaxed);
+    return reinterpret_cast<char *>(block) + offset;
+}
+
+void RequestArena::do_deallocate(void *p, size_t bytes, size_t alignment) {
+    // Small allocations stay until the arena goes away. Large ones are freed
+    // now, so a growing request body does not keep every old buffer.
+    if (!is_large(bytes, alignment)) {
+        return;
+    }
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    auto *block = reinterpret_cast<Block *>(static_cast<char *>(p) - large_offset(sizeof(Block), alignment));
+    for (Block **link = &m_large; *link != nullptr; link = &(*link)->next) {
+        if (*link == block) {
+            *link = block->next;
+            ::operator delete(block, std::align_val_t(alignment));
+            return;
+        }
+    }
+}
+
+bool RequestArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,143 @@
+#include "response_meta.hpp"
+
+#include "header_scan.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+namespace {
+bool iequals(std::string_view a, std::string_view b) {
+    return HeaderScan::iequals(a, b);
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t' || value.back() == '\r')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// Parses a delta-seconds value, clamped to int32; returns false if it is not a number
+bool parse_seconds(std::string_view value, int32_t &seconds) {
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+    if (value.empty()) {
+        return false;
+    }
+    int64_t result = 0;
+    for (char c : value) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+        result = std::min<int64_t>(result * 10 + (c - '0'), std::numeric_limits<int32_t>::max());
+    }
+    seconds = static_cast<int32_t>(result);
+    return true;
+}
+
+void parse_cache_control(std::string_view value, ResponseMeta &meta) {
+    meta.cache_control |= ResponseMeta::CC_PRESENT;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view token = trim(value.substr(0, comma));
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+
+        size_t equal = token.find('=');
+        std::string_view name = trim(token.substr(0, equal));
+        std::string_view argument = equal == std::string_view::npos ? std::string_view() : trim(token.substr(equal + 1));
+
+        if (iequals(name, "no-store")) {
+            meta.cache_control |= ResponseMeta::NO_STORE;
+        } else if (iequals(name, "no-cache")) {
+            meta.cache_control |= ResponseMeta::NO_CACHE;
+        } else if (iequals(name, "must-revalidate")) {
+            meta.cache_control |= ResponseMeta::MUST_REVALIDATE;
+        } else if (iequals(name, "proxy-revalidate")) {
+            meta.cache_control |= ResponseMeta::PROXY_REVALIDATE;
+        } else if (iequals(name, "private")) {
+            meta.cache_control |= ResponseMeta::PRIVATE;
+        } else if (iequals(name, "public")) {
+            meta.cache_control |= ResponseMeta::PUBLIC;
+        } else if (iequals(name, "no-transform")) {
+            meta.cache_control |= ResponseMeta::NO_TRANSFORM;
+        } else if (iequals(name, "immutable")) {
+            meta.cache_control |= ResponseMeta::IMMUTABLE;
+        } else if (iequals(name, "max-age")) {
+            if (parse_seconds(argument, meta.max_age)) {
+                meta.cache_control |= ResponseMeta::MAX_AGE;
+            }
+        } else if (iequals(name, "s-maxage")) {
+            if (parse_seconds(argument, meta.s_maxage)) {
+                meta.cache_control |= ResponseMeta::S_MAXAGE;
+            }
+        }
+    }
+}
+}  // namespace
+
+ResponseMeta ResponseMeta::parse(const std::string &response) {
+    ResponseMeta meta;
+    std::string_view message(response);
+
+    size_t header_end = HeaderScan::find_header_end(message);
+    header_end = header_end == std::string_view::npos ? message.size() : header_end + 4;
+    if (header_end > std::numeric_limits<uint32_t>::max()) {
+        return meta;
+    }
+    meta.header_length = static_cast<uint32_t>(header_end);
+    meta.content_length = message.size() - header_end;
+
+    // Status line: "HTTP/1.x SSS reason"
+    size_t line_end = message.find("\r\n");
+    line_end = std::min(line_end, header_end);
+    std::string_view status_line = message.substr(0, line_end);
+    meta.status_line_length = static_cast<uint16_t>(std::min<size_t>(line_end, std::numeric_limits<uint16_t>::max()));
+    size_t space = status_line.find(' ');
+    if (status_line.compare(0, 5, "HTTP/") == 0 && space != std::string_view::npos && space + 4 <= status_line.size() &&
+        (space + 4 == status_line.size() || status_line[space + 4] == ' ')) {
+        uint16_t status = 0;
+        for (char c : status_line.substr(space + 1, 3)) {
+            status = std::isdigit(static_cast<unsigned char>(c)) ? status * 10 + (c - '0') : 0;
+        }
+        meta.status = status >= 100 ? status : 0;
+    }
+
+    // Header lines
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        size_t next = message.find("\r\n", pos);
+        if (next == std::string_view::npos || next >= header_end) {
+            next = header_end;
+        }
+        std::string_view line = message.substr(pos, next - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos) {
+            std::string_view name = line.substr(0, colon);
+            std::string_view value = trim(line.substr(colon + 1));
+            uint32_t offset = static_cast<uint32_t>(value.data() - message.data());
+            uint16_t length = static_cast<uint16_t>(std::min<size_t>(value.size(), std::numeric_limits<uint16_t>::max()));
+
+            if (iequals(name, "ETag")) {
+                meta.etag_offset = offset;
+                meta.etag_length = length;
+            } else if (iequals(name, "Last-Modified")) {
+                meta.last_modified_offset = offset;
+                meta.last_modified_length = length;
+            } else if (iequals(name, "Cache-Control")) {
+                // Repeated Cache-Control headers add up, the span keeps the first one
+                if (!meta.has(CC_PRESENT)) {
+                    meta.cache_control_offset = offset;
+                    meta.cache_control_length = length;
+                }
+                parse_cache_control(value, meta);
+            }
+        }
+        pos = next + 2;
+    }
+    return meta;
+}
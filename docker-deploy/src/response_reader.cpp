@@ -0,0 +1,147 @@
+#include "response_reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include "header_scan.hpp"
+#include "http_parser.hpp"
+
+ResponseReader::ResponseReader()
+        : m_state(State::HEADER), m_scanned(0), m_body_start(0), m_length(0), m_spool_threshold(0) {}
+
+void ResponseReader::spool_over(size_t threshold, const std::string &dir) {
+    m_spool_threshold = threshold;
+    m_spool_dir = dir;
+}
+
+void ResponseReader::start_spool(std::string &buffer, size_t body_start) {
+    m_spool = std::make_shared<SpooledBody>(m_spool_dir);
+    m_spool->append(buffer.data() + body_start, buffer.size() - body_start);
+    buffer.resize(body_start);
+}
+
+bool ResponseReader::feed(const char *data, size_t len) {
+    switch (m_state) {
+        case State::HEADER: {
+            m_response.append(data, len);
+            size_t header_end = HeaderScan::find_header_end(m_response, m_scanned);
+            if (header_end == std::string::npos) {
+                // Only new bytes are scanned next time, 3 kept for a separator split across reads
+                m_scanned = m_response.size() < 3 ? 0 : m_response.size() - 3;
+                return false;
+            }
+            m_body_start = header_end + 4;
+            start_body();
+            return done();
+        }
+        case State::LENGTH:
+            if (m_spool) {
+                m_spool->append(data, std::min(len, m_length - m_spool->size()));
+                if (m_spool->size() == m_length) {
+                    m_state = State::DONE;
+                }
+                return done();
+            }
+            m_response.append(data, std::min(len, m_body_start + m_length - m_response.size()));
+            if (m_response.size() == m_body_start + m_length) {
+                m_state = State::DONE;
+            }
+            return done();
+        case State::CHUNKED:
+            m_decoder.feed(data, len, m_body);
+            if (m_spool) {
+                m_spool->append(m_body.data(), m_body.size());
+                m_body.clear();
+            } else if (m_spool_threshold > 0 && m_body.size() > m_spool_threshold) {
+                start_spool(m_body, 0);
+            }
+            if (m_decoder.done()) {
+                m_state = State::DONE;
+            }
+            return done();
+        case State::CLOSE:
+            if (m_spool) {
+                m_spool->append(data, len);
+                return false;
+            }
+            m_response.append(data, len);
+            if (m_spool_threshold > 0 && m_response.size() - m_body_start > m_spool_threshold) {
+                start_spool(m_response, m_body_start);
+            }
+            return false;
+        case State::DONE:
+            return true;
+    }
+    return done();
+}
+
+void ResponseReader::start_body() {
+    // 1xx, 204 and 304 responses have no body
+    int status_code = HTTP_Parser::get_status_code(m_response);
+    if ((status_code >= 100 && status_code < 200) || status_code == 204 || status_code == 304) {
+        m_response.resize(m_body_start);
+        m_state = State::DONE;
+        return;
+    }
+
+    std::string_view header_block = std::string_view(m_response).substr(0, m_body_start);
+    std::string transfer_encoding(HTTP_Parser::find_header_value(header_block, "Transfer-Encoding"));
+    std::transform(transfer_encoding.begin(), transfer_encoding.end(), transfer_encoding.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    // Only a final chunked coding frames the body; otherwise it ends with the connection
+    std::string_view final_coding(transfer_encoding);
+    final_coding.remove_prefix(std::min(final_coding.size(), final_coding.rfind(',') + 1));
+    final_coding.remove_prefix(std::min(final_coding.size(), final_coding.find_first_not_of(" \t")));
+    if (final_coding == "chunked") {
+        // Decode what arrived with the header
+        std::string rest = m_response.substr(m_body_start);
+        m_response.resize(m_body_start);
+        m_state = State::CHUNKED;
+        feed(rest.data(), rest.size());
+        return;
+    }
+
+    std::string content_length(HTTP_Parser::find_header_value(header_block, "Content-Length"));
+    if (content_length.empty()) {
+        m_state = State::CLOSE;
+        if (m_spool_threshold > 0 && m_response.size() - m_body_start > m_spool_threshold) {
+            start_spool(m_response, m_body_start);
+        }
+        return;
+    }
+    try {
+        m_length = std::stoul(content_length);
+    } catch (const std::exception &) {
+        throw std::runtime_error("Invalid Content-Length in response.");
+    }
+    if (m_response.size() >= m_body_start + m_length) {
+        m_response.resize(m_body_start + m_length);
+        m_state = State::DONE;
+    } else {
+        m_state = State::LENGTH;
+    }
+    // Known to be large up front, so it never has to fit in memory
+    if (m_spool_threshold > 0 && m_length > m_spool_threshold) {
+        start_spool(m_response, m_body_start);
+    }
+}
+
+std::string ResponseReader::finish() {
+    if (m_state == State::HEADER) {
+        throw std::runtime_error("Connection closed before the end of the response header.");
+    }
+    if (m_state == State::LENGTH) {
+        throw std::runtime_error("Connection closed before the end of the Content-Length body.");
+    }
+    if (m_state == State::CHUNKED) {
+        throw std::runtime_error("Connection closed before the last chunk.");
+    }
+    if (m_decoder.done() && m_spool) {
+        return HTTP_Parser::make_dechunked_header(m_response, m_spool->size());
+    }
+    if (m_decoder.done()) {
+        return HTTP_Parser::make_dechunked_response(m_response, m_body);
+    }
+    return std::move(m_response);
+}
@@ -0,0 +1,288 @@
+#include "shared_cache.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "cache.hpp"
+#include "hash_ring.hpp"
+
+namespace {
+const uint64_t MAGIC = 0x3365686361435348ull;  // "HSCache3"
+// Expected average record size, sets the number of index slots
+const size_t AVERAGE_RECORD = 4096;
+
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t key_hash(std::string_view url) {
+    uint64_t hash = HashRing::hash(url);
+    return hash == 0 ? 1 : hash;  // 0 marks an empty slot
+}
+}  // namespace
+
+struct SharedCache::Header {
+    uint64_t magic;
+    pthread_mutex_t mutex;
+    uint64_t slot_count;
+    uint64_t ring_size;
+    uint64_t head;        // Bytes ever appended to the ring
+    uint64_t recoveries;
+};
+
+struct SharedCache::Slot {
+    uint64_t hash;        // 0 if empty
+    uint64_t position;    // Of the record, counted in bytes ever appended
+};
+
+// Followed by the URL and the response
+struct SharedCache::Record {
+    uint64_t hash;
+    uint64_t position;
+    uint64_t length;      // Whole record including padding
+    uint64_t url_length;
+    uint64_t response_length;
+    int64_t expire_time;  // system_clock ticks since the epoch
+    int64_t stored_time;
+    int64_t initial_age;  // Seconds
+    ResponseMeta meta;
+};
+
+SharedCache::SharedCache(size_t size) : m_fd(-1), m_base(MAP_FAILED), m_size(size) {
+    m_fd = ::memfd_create("http_cache_proxy", MFD_CLOEXEC);
+    if (m_fd == -1) {
+        throw std::runtime_error("memfd_create failed: " + std::string(std::strerror(errno)));
+    }
+    if (::ftruncate(m_fd, static_cast<off_t>(size)) == -1 ||
+        (m_base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0)) == MAP_FAILED) {
+        int error = errno;
+        ::close(m_fd);
+        throw std::runtime_error("Failed to map the shared cache: " + std::string(std::strerror(error)));
+    }
+
+    // The pages of a new memfd are zero, every slot starts empty
+    size_t slot_count = std::max(WAYS * 128, size / AVERAGE_RECORD / WAYS * WAYS);
+    size_t ring_offset = align_up(align_up(sizeof(Header), 64) + slot_count * sizeof(Slot), 64);
+    if (ring_offset + MAX_RECORD_FRACTION * 4096 > size) {
+        ::munmap(m_base, size);
+        ::close(m_fd);
+        throw std::runtime_error("The shared cache region is too small.");
+    }
+    locate(slot_count);
+
+    m_header->magic = MAGIC;
+    m_header->slot_count = slot_count;
+    m_header->ring_size = (size - ring_offset) / 8 * 8;
+    m_header->head = 0;
+    m_header->recoveries = 0;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&m_header->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+SharedCache::SharedCache(int fd, void *base, size_t size) : m_fd(fd), m_base(base), m_size(size) {
+    locate(static_cast<Header *>(base)->slot_count);
+}
+
+std::unique_ptr<SharedCache> SharedCache::attach(int fd) {
+    struct stat st {};
+    void *base = MAP_FAILED;
+    if (::fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(Header) ||
+        (base = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to map the shared cache: " + std::string(std::strerror(error)));
+    }
+
+    size_t size = st.st_size;
+    const auto *header = static_cast<const Header *>(base);
+    size_t slot_count = header->slot_count;
+    size_t ring_offset = align_up(align_up(sizeof(Header), 64) + slot_count * sizeof(Slot), 64);
+    if (header->magic != MAGIC || slot_count == 0 || slot_count % WAYS != 0 || slot_count > size / sizeof(Slot) ||
+        ring_offset + header->ring_size > size) {
+        ::munmap(base, size);
+        ::close(fd);
+        throw std::runtime_error("The shared cache region has a different layout.");
+    }
+    return std::unique_ptr<SharedCache>(new SharedCache(fd, base, size));
+}
+
+void SharedCache::locate(size_t slot_count) {
+    char *base = static_cast<char *>(m_base);
+    size_t slots_offset = align_up(sizeof(Header), 64);
+    m_header = reinterpret_cast<Header *>(base);
+    m_slots = reinterpret_cast<Slot *>(base + slots_offset);
+    m_ring = base + align_up(slots_offset + slot_count * sizeof(Slot), 64);
+}
+
+SharedCache::~SharedCache() {
+    // Other processes may still use the region, it goes away with the last mapping
+    ::munmap(m_base, m_size);
+    ::close(m_fd);
+}
+
+SharedCache::Lock::Lock(SharedCache &cache) : m_cache(cache) {
+    int status = pthread_mutex_lock(&cache.m_header->mutex);
+    if (status == EOWNERDEAD) {
+        // The previous owner died mid-update
+        cache.recover();
+        pthread_mutex_consistent(&cache.m_header->mutex);
+    } else if (status != 0) {
+        throw std::runtime_error("Failed to lock the shared cache: " + std::string(std::strerror(status)));
+    }
+}
+
+SharedCache::Lock::~Lock() {
+    pthread_mutex_unlock(&m_cache.m_header->mutex);
+}
+
+const SharedCache::Record *SharedCache::record(const Slot &slot) const {
+    uint64_t head = m_header->head;
+    uint64_t ring = m_header->ring_size;
+    // Bytes before head - ring have been overwritten
+    if (slot.hash == 0 || slot.position > head || head - slot.position > ring) {
+        return nullptr;
+    }
+    uint64_t offset = slot.position % ring;
+    const auto *r = reinterpret_cast<const Record *>(m_ring + offset);
+    if (r->hash != slot.hash || r->position != slot.position || r->length > ring - offset ||
+        slot.position + r->length > head || sizeof(Record) + r->url_length + r->response_length > r->length) {
+        return nullptr;
+    }
+    return r;
+}
+
+SharedCache::Slot *SharedCache::bucket(uint64_t hash) const {
+    return m_slots + hash % (m_header->slot_count / WAYS) * WAYS;
+}
+
+bool SharedCache::get(std::string_view url, std::shared_ptr<CacheEntry> &entry) {
+    uint64_t hash = key_hash(url);
+    std::string response;
+    ResponseMeta meta;
+    int64_t expire_time = 0;
+    int64_t stored_time = 0;
+    int64_t initial_age = 0;
+    {
+        Lock lock(*this);
+        Slot *ways = bucket(hash);
+        const Record *found = nullptr;
+        for (size_t i = 0; i < WAYS && found == nullptr; i++) {
+            const Record *r = ways[i].hash == hash ? record(ways[i]) : nullptr;
+            if (r != nullptr && std::string_view(reinterpret_cast<const char *>(r + 1), r->url_length) == url) {
+                found = r;
+            }
+        }
+        if (found == nullptr) {
+            return false;
+        }
+        response.assign(reinterpret_cast<const char *>(found + 1) + found->url_length, found->response_length);
+        meta = found->meta;
+        expire_time = found->expire_time;
+        stored_time = found->stored_time;
+        initial_age = found->initial_age;
+    }
+
+    std::chrono::system_clock::time_point expires{std::chrono::system_clock::duration(expire_time)};
+    std::chrono::system_clock::time_point stored{std::chrono::system_clock::duration(stored_time)};
+    entry = std::make_shared<CacheEntry>(url, std::move(response), meta, expires, std::chrono::seconds(initial_age),
+                                         stored);
+    return true;
+}
+
+bool SharedCache::put(const CacheEntry &entry) {
+    const std::string &url = entry.getUrl();
+    const std::string &response = entry.getResponse();
+    uint64_t length = align_up(sizeof(Record) + url.size() + response.size(), 8);
+    uint64_t hash = key_hash(url);
+
+    Lock lock(*this);
+    uint64_t ring = m_header->ring_size;
+    if (length > ring / MAX_RECORD_FRACTION) {
+        return false;
+    }
+
+    // Records are contiguous, one that does not fit before the end of the ring starts the next lap
+    uint64_t position = m_header->head;
+    if (position % ring + length > ring) {
+        position += ring - position % ring;
+    }
+    m_header->head = position + length;
+
+    // The record header goes in last, a record is only valid once it is complete
+    char *data = m_ring + position % ring;
+    std::memcpy(data + sizeof(Record), url.data(), url.size());
+    std::memcpy(data + sizeof(Record) + url.size(), response.data(), response.size());
+    Record header{hash,
+                  position,
+                  length,
+                  url.size(),
+                  response.size(),
+                  static_cast<int64_t>(entry.getExpireTime().time_since_epoch().count()),
+                  static_cast<int64_t>(entry.getStoredTime().time_since_epoch().count()),
+                  static_cast<int64_t>(entry.getInitialAge().count()),
+                  entry.getMeta()};
+    std::memcpy(data, &header, sizeof(Record));
+
+    // Reuse the slot of an older copy of the URL, else an empty or
+    // overwritten one, else the one with the oldest record
+    Slot *ways = bucket(hash);
+    Slot *target = nullptr;
+    for (size_t i = 0; i < WAYS; i++) {
+        const Record *r = ways[i].hash == hash ? record(ways[i]) : nullptr;
+        if (r != nullptr && r->position != position &&
+            std::string_view(reinterpret_cast<const char *>(r + 1), r->url_length) == url) {
+            ways[i].hash = 0;
+            if (target == nullptr) {
+                target = &ways[i];
+            }
+        }
+    }
+    for (size_t i = 0; i < WAYS && target == nullptr; i++) {
+        if (record(ways[i]) == nullptr) {
+            target = &ways[i];
+        }
+    }
+    if (target == nullptr) {
+        target = ways;
+        for (size_t i = 1; i < WAYS; i++) {
+            if (ways[i].position < target->position) {
+                target = &ways[i];
+            }
+        }
+    }
+    // A slot caught half-written by a crash fails the record check
+    target->hash = 0;
+    target->position = position;
+    target->hash = hash;
+    return true;
+}
+
+SharedCache::Stats SharedCache::stats() {
+    Lock lock(*this);
+    uint64_t entries = 0;
+    for (uint64_t i = 0; i < m_header->slot_count; i++) {
+        entries += record(m_slots[i]) != nullptr;
+    }
+    return {entries, m_header->ring_size, m_header->head, m_header->recoveries};
+}
+
+void SharedCache::recover() {
+    for (uint64_t i = 0; i < m_header->slot_count; i++) {
+        if (record(m_slots[i]) == nullptr) {
+            m_slots[i].hash = 0;
+        }
+    }
+    m_header->recoveries++;
+}
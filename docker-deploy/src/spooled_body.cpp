@@ -0,0 +1,61 @@
+#include "spooled_body.hpp"
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+SpooledBody::SpooledBody(const std::string &dir) : m_fd(-1), m_size(0) {
+#ifdef O_TMPFILE
+    m_fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+    if (m_fd == -1) {
+        // The file system does not support O_TMPFILE, unlink right away instead
+        std::string path = dir + "/proxy-body-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        m_fd = ::mkostemp(name.data(), O_CLOEXEC);
+        if (m_fd == -1) {
+            throw std::runtime_error("Failed to create spool file in " + dir + ": " + std::strerror(errno));
+        }
+        ::unlink(name.data());
+    }
+}
+
+SpooledBody::~SpooledBody() {
+    ::close(m_fd);
+}
+
+void SpooledBody::append(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(m_fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Failed to write spool file: ") + std::strerror(errno));
+        }
+        data += n;
+        len -= n;
+        m_size += n;
+    }
+}
+
+void SpooledBody::send_to(int socket, size_t offset, size_t length) const {
+    off_t position = offset;
+    size_t end = offset + length;
+    while (static_cast<size_t>(position) < end) {
+        ssize_t n = ::sendfile(socket, m_fd, &position, end - position);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("Failed to send response body to client.");
+        }
+    }
+}
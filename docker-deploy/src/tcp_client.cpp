@@ -4,40 +4,41 @@
 
 #include <tcp_client.hpp>
 
-Client::Client() : sockfd(-1) {}
+Client::Client(Deadlines *deadlines)
+        : sockfd(-1), m_deadlines(deadlines), m_connect_error(ConnectError::NONE), m_spool_threshold(0) {}
 
-bool Client::connect(const std::string &host, const std::string &port) {
+bool Client::connect(std::string_view host_name, std::string_view port_name) {
     struct addrinfo hints{
-    }, *res, *p;
+    }, *res;
     std::memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
 
+    // getaddrinfo需要以'\0'结尾的字符串
+    std::string host(host_name), port(port_name);
+    m_connect_error = ConnectError::NONE;
     int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
     if (status != 0) {
         std::cerr << "getaddrinfo error: " << gai_strerror(status) << std::endl;
-        return false;
-    }
-
-    for (p = res; p != nullptr; p = p->ai_next) {
-        sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (sockfd == -1) {
-            std::perror("socket");
-            continue;
+        // 区分域名不存在和解析器的临时故障，前者可以缓存更久
+        m_connect_error = ConnectError::RESOLVE;
+        if (status == EAI_NONAME) {
+            m_connect_error = ConnectError::NO_SUCH_HOST;
         }
-        if (::connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
-            std::perror("connect");
-            close();
-            sockfd = -1;
-            continue;
+#ifdef EAI_NODATA
+        if (status == EAI_NODATA) {
+            m_connect_error = ConnectError::NO_SUCH_HOST;
         }
-        break;
+#endif
+        return false;
     }
 
+    sockfd = race(AddressHealth::getInstance().order(res));
     freeaddrinfo(res);
 
-    if (p == nullptr) {
+    if (sockfd == -1) {
         std::cerr << "Failed to connect to " << host << ":" << port << std::endl;
+        m_connect_error = ConnectError::CONNECT;
         return false;
     }
 
@@ -50,90 +51,164 @@ bool Client::connect(const std::string &host, const std::string &port) {
     return true;
 }
 
-bool Client::send(const std::string &data) const {
-    int total_len = data.size();
-    const char *buf = data.c_str();
-    int sent_len = 0;
-    while (sent_len < total_len) {
-        int len = ::send(sockfd, buf + sent_len, total_len - sent_len, 0);
-        if (len == -1) {
-            std::perror("send");
-            return false;
-        }
-        sent_len += len;
-    }
-    return true;
-}
-
-std::string Client::receive(int original_client_fd) {
-    char buffer[BUFFER_SIZE];
-    std::string response;
-    int content_length = 0;
-    while (true) {
-        int len = ::recv(sockfd, buffer, BUFFER_SIZE, 0);
-        if (len == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // 超时，认为响应接收完毕
+int Client::race(const std::vector<const addrinfo *> &addresses) {
+    using Clock = std::chrono::steady_clock;
+    AddressHealth &health = AddressHealth::getInstance();
+    // 没有deadline时只受内核connect超时限制
+    bool limited = m_deadlines != nullptr && m_deadlines->timeout(DeadlineKind::UPSTREAM_CONNECT).count() > 0;
+    Clock::time_point give_up = limited ? Clock::now() + m_deadlines->timeout(DeadlineKind::UPSTREAM_CONNECT)
+                                        : Clock::time_point::max();
+
+    std::vector<pollfd> pending;
+    std::vector<const addrinfo *> pending_addresses;
+    size_t next = 0;
+    Clock::time_point next_start = Clock::now();
+    int winner = -1;
+    bool timed_out = false;
+
+    while (winner == -1 && (next < addresses.size() || !pending.empty())) {
+        // 到了错开的时间，或者没有正在进行的尝试，就开始下一个地址
+        while (next < addresses.size() && (pending.empty() || Clock::now() >= next_start)) {
+            const addrinfo *address = addresses[next++];
+            int fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                            address->ai_protocol);
+            if (fd == -1) {
+                std::perror("socket");
+                continue;
+            }
+            if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+                winner = fd;
+                pending_addresses.push_back(address);
+                pending.push_back({fd, POLLOUT, 0});
                 break;
             }
-            std::perror("recv");
+            if (errno != EINPROGRESS) {
+                std::perror("connect");
+                health.record_failure(address->ai_addr, address->ai_addrlen);
+                ::close(fd);
+                continue;
+            }
+            pending.push_back({fd, POLLOUT, 0});
+            pending_addresses.push_back(address);
+            next_start = Clock::now() + CONNECT_ATTEMPT_DELAY;
             break;
-        } else if (len == 0) {
-            // 连接关闭，认为响应接收完毕
+        }
+        if (winner != -1 || pending.empty()) {
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now >= give_up) {
+            m_deadlines->count_expired(DeadlineKind::UPSTREAM_CONNECT);
+            timed_out = true;
+            break;
+        }
+        Clock::time_point wake = next < addresses.size() ? std::min(next_start, give_up) : give_up;
+        int timeout = -1;
+        if (wake != Clock::time_point::max()) {
+            timeout = static_cast<int>(
+                    std::chrono::ceil<std::chrono::milliseconds>(std::max(wake - now, Clock::duration::zero()))
+                            .count());
+        }
+        int ready = poll(pending.data(), pending.size(), timeout);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::perror("poll");
             break;
-        } else {
-            response += std::string(buffer, len);
-            auto headers = HTTP_Parser::parse_headers(response);
-            std::string temp_content_length = HTTP_Parser::get_header_value("Content-Length", headers);
+        }
 
-            if (content_length ==0 && !temp_content_length.empty()) {
-                content_length = std::stoi(temp_content_length);
+        // 检查完成的连接，失败的关掉并记下，让出位置给下一个地址
+        for (size_t i = 0; i < pending.size() && winner == -1;) {
+            if (pending[i].revents == 0) {
+                i++;
+                continue;
             }
-            if (content_length != 0 && static_cast<int>(response.length()) >= content_length) {
-                break;
+            int error = 0;
+            socklen_t length = sizeof error;
+            if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+                error = errno;
             }
-            if( content_length == 0) {
+            if (error == 0) {
+                winner = pending[i].fd;
                 break;
             }
+            std::cerr << "connect: " << std::strerror(error) << std::endl;
+            health.record_failure(pending_addresses[i]->ai_addr, pending_addresses[i]->ai_addrlen);
+            ::close(pending[i].fd);
+            pending.erase(pending.begin() + i);
+            pending_addresses.erase(pending_addresses.begin() + i);
+            next_start = Clock::now();
         }
     }
 
-    auto headers = HTTP_Parser::parse_headers(response);
-    std::string chunked = HTTP_Parser::get_header_value("Transfer-Encoding", headers);
-    if (!chunked.empty()) {
-        handle_chunked_response(original_client_fd, response);
-        return "";
+    // 还在连接中的尝试直接关掉，只有超时的才记为失败；
+    // 输给赢家的地址可能只是慢一点，不影响下次的顺序
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].fd == winner) {
+            health.record_success(pending_addresses[i]->ai_addr, pending_addresses[i]->ai_addrlen);
+            continue;
+        }
+        if (timed_out) {
+            health.record_failure(pending_addresses[i]->ai_addr, pending_addresses[i]->ai_addrlen);
+        }
+        ::close(pending[i].fd);
     }
-    return response;
+    if (winner != -1) {
+        // 之后的收发仍然是阻塞的
+        int flags = fcntl(winner, F_GETFL);
+        fcntl(winner, F_SETFL, flags & ~O_NONBLOCK);
+    }
+    return winner;
 }
 
-void Client::handle_chunked_response(int original_client_fd, const std::string& response) const {
-    // 将 response 转换为 const char*
-    const char* response_ptr = response.c_str();
-
-    // 设置套接字的缓冲区大小
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &BUFFER_SIZE, sizeof(int));
-    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &BUFFER_SIZE, sizeof(int));
-
-    // 一次性发送整个响应
-    ssize_t sent = ::send(original_client_fd, response_ptr, response.size(), 0);
-    if (static_cast<size_t>(sent) != response.size()) {
-        throw std::runtime_error("Failed to forward response to client.");
+bool Client::send(std::string_view data) const {
+    int total_len = data.size();
+    const char *buf = data.data();
+    int sent_len = 0;
+    Deadline idle(m_deadlines, DeadlineKind::UPSTREAM_IDLE, sockfd);
+    while (sent_len < total_len) {
+        int len = ::send(sockfd, buf + sent_len, total_len - sent_len, 0);
+        if (len == -1) {
+            std::perror("send");
+            return false;
+        }
+        sent_len += len;
+        idle.touch();
     }
+    return true;
+}
+
+void Client::spool_over(size_t threshold, const std::string &dir) {
+    m_spool_threshold = threshold;
+    m_spool_dir = dir;
+}
 
-    // 使用缓冲区一次性接收和发送多个数据块
-    char buffer[BUFFER_SIZE];
-    while (true) {
-        ssize_t len = ::recv(sockfd, buffer, BUFFER_SIZE, 0);
+std::string Client::receive() {
+    ResponseReader reader;
+    reader.spool_over(m_spool_threshold, m_spool_dir);
+    Deadline idle(m_deadlines, DeadlineKind::UPSTREAM_IDLE, sockfd);
+    char chunk[BUFFER_SIZE];
+    while (!reader.done()) {
+        int len = ::recv(sockfd, chunk, BUFFER_SIZE, 0);
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
         if (len <= 0) {
+            if (len == -1) {
+                std::perror("recv");
+            }
+            // 连接关闭或出错；只有以关闭连接结束的消息体算完整，其余情况finish抛出异常
             break;
         }
-        sent = ::send(original_client_fd, buffer, len, 0);
-        if (sent != len) {
-            // 发生错误，抛出异常
-            throw std::runtime_error("Failed to forward response to client.");
-        }
+        idle.touch();
+        // 收到完整的响应即停止读取，连接保持在消息边界上
+        reader.feed(chunk, len);
     }
+    std::string response = reader.finish();
+    m_spooled_body = reader.spooled_body();
+    return response;
 }
 
 void Client::close() {
@@ -143,6 +218,12 @@ void Client::close() {
     }
 }
 
+int Client::release() {
+    int fd = sockfd;
+    sockfd = -1;
+    return fd;
+}
+
 Client::~Client() {
     close();
 }
@@ -3,37 +3,118 @@
 //
 #include "tcp_server.hpp"
 
-Server::Server(std::string port, size_t numThreads, Logger &logger, Cache &cache) : m_port(std::move(port)),
-                                                                                    m_threadPool(numThreads),
-                                                                                    m_logger(logger),
-                                                                                    m_cache(cache) {
+Server::Server(std::string port, size_t numThreads, Logger &logger, Cache &cache, const ServerConfig &config)
+        : m_port(std::move(port)),
+          m_backlog(config.backlog),
+          m_stop_fd(::eventfd(0, EFD_CLOEXEC)),
+          m_in_flight(0),
+          m_threadPool(workers_per_acceptor(numThreads, config)),
+          m_h2(config.h2),
+          m_logger(logger),
+          m_cache(cache),
+          m_deadlines(logger, config.deadlines),
+          m_origins(logger, config.negative),
+          m_error_response_ttl(config.negative.error_response_ttl),
+          m_spool_threshold(config.spool_threshold),
+          m_spool_dir(config.spool_dir),
+          m_zerocopy_threshold(config.zerocopy_threshold),
+          m_io_uring(config.io_uring && IoUring::supported()) {
+    if (config.io_uring && !m_io_uring) {
+        m_logger.warning("io_uring is not available, using epoll and blocking sockets");
+    }
+    if (config.upstream_threads > 0) {
+        m_slow_lane = std::make_unique<ThreadPool>(config.upstream_threads);
+    }
+    if (config.h2.stream_threads > 0) {
+        m_h2_streams = std::make_unique<ThreadPool>(config.h2.stream_threads);
+    }
+    if (config.tunnel_threads > 0) {
+        if (m_io_uring) {
+            m_tunnels = std::make_unique<UringTunnelReactor>(config.tunnel_threads, m_logger, &m_deadlines);
+        } else {
+            m_tunnels = std::make_unique<TunnelReactor>(config.tunnel_threads, m_logger, &m_deadlines);
+        }
+    }
+
+    if (!config.cluster.peers.empty()) {
+        m_cluster = std::make_unique<PeerCluster>(config.cluster);
+    }
+    if (config.prefetch.enabled) {
+        m_prefetcher = std::make_unique<Prefetcher>(
+                m_logger, config.prefetch,
+                [this](const std::string &id, const std::string &url) { prefetch(id, url); });
+    }
+
+#ifdef PROXY_COROUTINES
+    for (size_t i = 0; i < config.event_loops; i++) {
+        m_loops.push_back(std::make_unique<EventLoop>());
+    }
+#endif
+
+    if (m_stop_fd == -1) {
+        throw std::runtime_error("eventfd error: " + std::string(std::strerror(errno)));
+    }
+
+    size_t listeners = config.listeners;
+    if (!config.listen_sockets.empty()) {
+        // 使用父进程或上一个进程交接过来的监听套接字
+        m_listenSockets = config.listen_sockets;
+    } else if (listeners <= 1) {
+        m_listenSockets.push_back(open_listen_socket(m_port, m_backlog, false));
+    } else {
+        // 每个核心一个SO_REUSEPORT监听套接字，由内核在它们之间分配连接
+        for (size_t i = 0; i < listeners; i++) {
+            m_listenSockets.push_back(open_listen_socket(m_port, m_backlog, true));
+        }
+    }
+
+    // 每个接收线程有自己的工作线程和任务队列，互不争用同一个队列的锁
+    for (size_t i = 1; i < m_listenSockets.size(); i++) {
+        m_acceptor_pools.push_back(std::make_unique<ThreadPool>(workers_per_acceptor(numThreads, config)));
+    }
+
+    // 与其他进程共享监听套接字时，accept可能被别的进程抢先，接收超时避免一直阻塞
+    timeval timeout{ACCEPT_TIMEOUT_SECONDS, 0};
+    for (int listenSocket : m_listenSockets) {
+        ::setsockopt(listenSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+}
+
+size_t Server::workers_per_acceptor(size_t numThreads, const ServerConfig &config) {
+    size_t acceptors = config.listen_sockets.empty() ? config.listeners : config.listen_sockets.size();
+    return std::max<size_t>(numThreads / std::max<size_t>(acceptors, 1), 1);
+}
+
+int Server::open_listen_socket(const std::string &port, int backlog, bool reuse_port) {
     // Step 1: 获取地址信息
     addrinfo hints{}, *serverInfo, *p;
     std::memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_UNSPEC;      // 任何IP地址（IPv4或IPv6）
     hints.ai_socktype = SOCK_STREAM;  // 流式套接字
     hints.ai_flags = AI_PASSIVE;      // 用于监听的地址
-    int status = ::getaddrinfo(nullptr, m_port.c_str(), &hints, &serverInfo);
+    int status = ::getaddrinfo(nullptr, port.c_str(), &hints, &serverInfo);
     if (status != 0) {
         throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(status)));
     }
 
     // Step 2: 创建套接字并绑定
+    int listenSocket = -1;
     for (p = serverInfo; p != nullptr; p = p->ai_next) {
-        m_listenSocket = ::socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (m_listenSocket == -1) {
+        listenSocket = ::socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (listenSocket == -1) {
             continue;
         }
 
         int yes = 1;
-        if (::setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
-            ::close(m_listenSocket);
+        if (::setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1 ||
+            (reuse_port && ::setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1)) {
+            ::close(listenSocket);
             ::freeaddrinfo(serverInfo);
             throw std::runtime_error("setsockopt error: " + std::string(std::strerror(errno)));
         }
 
-        if (::bind(m_listenSocket, p->ai_addr, p->ai_addrlen) == -1) {
-            ::close(m_listenSocket);
+        if (::bind(listenSocket, p->ai_addr, p->ai_addrlen) == -1) {
+            ::close(listenSocket);
             continue;
         }
 
@@ -46,9 +127,11 @@ Server::Server(std::string port, size_t numThreads, Logger &logger, Cache &cache
         throw std::runtime_error("Failed to bind to any address.");
     }
 
-    if (::listen(m_listenSocket, BACKLOG) == -1) {
+    if (::listen(listenSocket, backlog) == -1) {
+        ::close(listenSocket);
         throw std::runtime_error("listen error: " + std::string(std::strerror(errno)));
     }
+    return listenSocket;
 }
 
 Server::~Server() {
@@ -56,285 +139,1110 @@ Server::~Server() {
 }
 
 void Server::end() {
-    // Stop all worker threads.
-    m_threadPool.~ThreadPool();
+    // Stop all worker threads. The pool is a member and is destroyed with the
+    // server, so it is only shut down here. Request workers hand work to the
+    // slow lane, they stop first.
+    m_threadPool.shutdown();
+    for (auto &pool : m_acceptor_pools) {
+        pool->shutdown();
+    }
+    if (m_h2_streams) {
+        m_h2_streams->shutdown();
+    }
+    if (m_slow_lane) {
+        m_slow_lane->shutdown();
+    }
+#ifdef PROXY_COROUTINES
+    // Pool tasks resume coroutines on the loops, which therefore stop last
+    m_loops.clear();
+#endif
     // Close all fd.
-    close(m_listenSocket);
+    for (int listenSocket : m_listenSockets) {
+        close(listenSocket);
+    }
+    m_listenSockets.clear();
+    if (m_stop_fd != -1) {
+        close(m_stop_fd);
+        m_stop_fd = -1;
+    }
+}
+
+void Server::stop_accepting() {
+    uint64_t one = 1;
+    ssize_t ignored = ::write(m_stop_fd, &one, sizeof(one));
+    (void) ignored;
+}
+
+bool Server::drain(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (m_in_flight > 0 || (m_tunnels && m_tunnels->active() > 0)) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return true;
 }
 
 void Server::start() {
+    if (m_listenSockets.size() == 1) {
+        accept_loop(m_listenSockets[0], m_threadPool);
+        return;
+    }
+
+    // 每个监听套接字一个接收线程，并绑定到各自的CPU上
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> acceptors;
+    for (size_t i = 0; i < m_listenSockets.size(); i++) {
+        int listenSocket = m_listenSockets[i];
+        ThreadPool &workers = i == 0 ? m_threadPool : *m_acceptor_pools[i - 1];
+        acceptors.emplace_back([this, listenSocket, &workers]() { accept_loop(listenSocket, workers); });
+
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(i % cpus, &cpuset);
+        if (pthread_setaffinity_np(acceptors.back().native_handle(), sizeof(cpu_set_t), &cpuset) != 0) {
+            m_logger.warning("failed to pin acceptor " + std::to_string(i) + " to a CPU");
+        }
+    }
+    for (std::thread &acceptor : acceptors) {
+        acceptor.join();
+    }
+}
+
+void Server::accept_loop(int listenSocket, ThreadPool &workers) {
+    if (m_io_uring) {
+        try {
+            accept_loop_uring(listenSocket, workers);
+            return;
+        } catch (const std::runtime_error &e) {
+            // 改用poll继续接收连接；已经停止时m_stop_fd仍可读，下面会立即返回
+            m_logger.warning(std::string(e.what()) + ", accepting with poll");
+        }
+    }
+    pollfd fds[2] = {{listenSocket, POLLIN, 0}, {m_stop_fd, POLLIN, 0}};
     while (true) {
-        int clientSocket = ::accept(m_listenSocket, nullptr, nullptr);
+        if (::poll(fds, 2, -1) == -1) {
+            continue;
+        }
+        // 停止接收连接后，队列中的连接留给接手监听套接字的进程
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        int clientSocket = ::accept(listenSocket, nullptr, nullptr);
         if (clientSocket == -1) {
-            // 将错误记录到日志中，并继续等待连接请求
-            std::cerr << "accept error: " << std::strerror(errno) << std::endl;
+            // 连接被共享此套接字的其他进程取走时accept超时返回，不是错误
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                // 将错误记录到日志中，并继续等待连接请求
+                std::cerr << "accept error: " << std::strerror(errno) << std::endl;
+            }
             continue;
         }
-        // 提交客户端请求到线程池处理
-        m_threadPool.enqueue([this, clientSocket]() {
-            try {
-                handle_request(clientSocket);
-            } catch (const std::exception &e) {
-                // 将异常记录到日志中，并关闭客户端连接
-                std::cerr << "handleClient error: " << e.what() << std::endl;
-                ::close(clientSocket);
+        dispatch(clientSocket, workers);
+    }
+}
+
+void Server::accept_loop_uring(int listenSocket, ThreadPool &workers) {
+    const uint64_t ACCEPT = 0, STOP = 1, CANCEL = 2;
+    // 一个multishot accept请求持续产生新连接，一次io_uring_enter可以收到一批连接
+    IoUring ring(64);
+    // 提交队列满且内核不接收时放弃io_uring
+    auto next_sqe = [&ring]() {
+        io_uring_sqe *sqe = ring.get_sqe();
+        if (sqe == nullptr) {
+            throw std::runtime_error("io_uring submission queue full");
+        }
+        return sqe;
+    };
+    io_uring_sqe *stop = next_sqe();
+    stop->opcode = IORING_OP_POLL_ADD;
+    stop->fd = m_stop_fd;
+    stop->poll32_events = POLLIN;
+    stop->user_data = STOP;
+    bool armed = false;
+    bool stopping = false;
+    // 停止时取消accept请求，并处理它结束前已接收的连接
+    while (armed || !stopping) {
+        if (!armed && !stopping) {
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = listenSocket;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->user_data = ACCEPT;
+            armed = true;
+        }
+        if (ring.submit(1) < 0) {
+            throw std::runtime_error("io_uring_enter error: " + std::string(std::strerror(errno)));
+        }
+        ring.for_each_cqe([&](const io_uring_cqe &cqe) {
+            if (cqe.user_data == STOP) {
+                stopping = true;
+                io_uring_sqe *cancel = next_sqe();
+                cancel->opcode = IORING_OP_ASYNC_CANCEL;
+                cancel->addr = ACCEPT;
+                cancel->user_data = CANCEL;
+                return;
+            }
+            if (cqe.user_data == CANCEL) {
+                return;
+            }
+            // 没有IORING_CQE_F_MORE标志时请求已结束，需要重新提交
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                armed = false;
+            }
+            if (cqe.res == -ECANCELED) {
+                return;
+            }
+            if (cqe.res < 0) {
+                std::cerr << "accept error: " << std::strerror(-cqe.res) << std::endl;
+                return;
             }
+            dispatch(cqe.res, workers);
         });
     }
 }
 
-std::string Server::receive_request(int clientSocket) {
+void Server::dispatch(int clientSocket, ThreadPool &workers) {
+    // 提交客户端请求到线程池处理
+    m_in_flight++;
+#ifdef PROXY_COROUTINES
+    // 协程版本：连接轮流分配给各个事件循环，每个连接一个协程
+    if (!m_loops.empty()) {
+        EventLoop &loop = *m_loops[m_next_loop++ % m_loops.size()];
+        loop.post([this, &loop, clientSocket]() { spawn(handle_request_async(loop, clientSocket)); });
+        return;
+    }
+#endif
+    workers.enqueue([this, clientSocket]() {
+        try {
+            handle_request(clientSocket);
+        } catch (const std::exception &e) {
+            // 将异常记录到日志中，并关闭客户端连接
+            std::cerr << "handleClient error: " << e.what() << std::endl;
+            ::close(clientSocket);
+        }
+        m_in_flight--;
+    });
+}
+
+std::pmr::string Server::receive_request(int clientSocket, std::pmr::memory_resource *arena) {
+    std::pmr::string request(arena);
+    request.reserve(2 * BUFFER_SIZE);
     char buffer[BUFFER_SIZE];
-    int numBytes = ::recv(clientSocket, buffer, sizeof(buffer), 0);
-    if (numBytes == -1) {
-        throw std::runtime_error("Failed to receive message from client.");
+    size_t header_end = std::string::npos;
+
+    // 读取完整的请求头，慢速客户端受header-read期限约束
+    {
+        Deadline deadline(&m_deadlines, DeadlineKind::HEADER_READ, clientSocket);
+        // 只扫描新到达的数据（保留3个字节以覆盖跨越两次recv的"\r\n\r\n"）
+        size_t scanned = 0;
+        while ((header_end = HeaderScan::find_header_end(request, scanned)) == std::string::npos) {
+            scanned = request.size() < 3 ? 0 : request.size() - 3;
+            if (request.size() > MAX_HEADER_SIZE) {
+                throw std::runtime_error("Request header too large.");
+            }
+            int numBytes = ::recv(clientSocket, buffer, sizeof(buffer), 0);
+            if (numBytes == 0 && request.empty()) {
+                return request;
+            }
+            if (numBytes <= 0) {
+                throw std::runtime_error("Failed to receive message from client.");
+            }
+            request.append(buffer, numBytes);
+        }
     }
-    buffer[numBytes] = '\0';
-    // std::cout << "Received request from client:\n" << buffer << std::endl;
-    return std::string(buffer, numBytes);
+
+    // 读取请求体（如有）
+    int content_length = HTTP_Parser::get_content_length(request);
+    if (content_length > 0) {
+        size_t total_len = header_end + 4 + content_length;
+        request.reserve(total_len);
+        Deadline deadline(&m_deadlines, DeadlineKind::BODY_READ, clientSocket);
+        while (request.size() < total_len) {
+            int numBytes = ::recv(clientSocket, buffer, sizeof(buffer), 0);
+            if (numBytes <= 0) {
+                throw std::runtime_error("Failed to receive message from client.");
+            }
+            request.append(buffer, numBytes);
+        }
+    }
+    // std::cout << "Received request from client:\n" << request << std::endl;
+    return request;
 }
 
-std::string Server::generate_uuid() {
+std::pmr::string Server::generate_uuid(std::pmr::memory_resource *arena) {
     uuid_t uuid;
     uuid_generate(uuid);
     char uuid_str[37];
     uuid_unparse(uuid, uuid_str);
-    return std::string(uuid_str);
+    return std::pmr::string(uuid_str, arena);
 }
 
-std::string Server::forward_request(int clientSocket, const std::string &host, const std::string &port, const std::string &request) {
-    // 连接目标服务器
-    Client client;
+// 新鲜、无需重新验证、可以直接回答的完整响应
+static bool answers_fresh(const CacheEntry &entry) {
+    return !entry.isValidatorOnly() && !entry.isMustRevalidate() && !entry.isNoCache() && entry.isFresh();
+}
+
+static OriginFailure origin_failure(ConnectError error) {
+    if (error == ConnectError::NO_SUCH_HOST) {
+        return OriginFailure::NO_SUCH_HOST;
+    }
+    if (error == ConnectError::CONNECT) {
+        return OriginFailure::CONNECT;
+    }
+    return OriginFailure::UPSTREAM;
+}
+
+void Server::connect_origin(Client &client, std::string_view host, std::string_view port) {
+    // 源服务器最近失败过，直接失败，不再占用工作线程等待DNS和连接超时
+    if (!m_origins.allow(host, port)) {
+        throw OriginError(OriginFailure::CONNECT, "Target server is failing, not retried yet.");
+    }
     if (!client.connect(host, port)) {
-        throw std::runtime_error("Failed to connect to target server.");
+        OriginFailure failure = origin_failure(client.connect_error());
+        m_origins.record_failure(host, port, failure);
+        throw OriginError(failure, "Failed to connect to target server.");
+    }
+}
+
+std::string Server::forward_request(std::string_view host, std::string_view port, std::string_view request,
+                                    std::shared_ptr<SpooledBody> *body) {
+    // 连接目标服务器
+    Client client(&m_deadlines);
+    connect_origin(client, host, port);
+    // 大的响应体边接收边写入临时文件，不占用内存
+    if (body != nullptr && m_spool_threshold > 0) {
+        client.spool_over(m_spool_threshold, m_spool_dir);
     }
     // std::cout << "Connected to target server: " << host << ":" << port << std::endl;
 
-    // 发送请求到目标服务器
-    if (!client.send(request)) {
-        throw std::runtime_error("Failed to send request to target server.");
+    try {
+        // 发送请求到目标服务器
+        if (!client.send(request)) {
+            throw OriginError(OriginFailure::UPSTREAM, "Failed to send request to target server.");
+        }
+        // std::cout << "Sent request to target server:\n" << request << std::endl;
+
+        // 接收目标服务器的响应（chunked响应已被解码）
+        std::string response = client.receive();
+        // std::cout << "Received response from target server:\n" << response << std::endl;
+
+        m_origins.record_success(host, port);
+        if (body != nullptr) {
+            *body = client.spooled_body();
+        }
+        return response;
+    } catch (const std::runtime_error &) {
+        m_origins.record_failure(host, port, OriginFailure::UPSTREAM);
+        throw;
+    }
+}
+
+void Server::forward_response(int clientSocket, std::string_view response, const SpooledBody *body) {
+    // 一次send可能只发出一部分，循环直到全部发送
+    size_t sent_len = 0;
+    while (sent_len < response.size()) {
+        ssize_t len = ::send(clientSocket, response.data() + sent_len, response.size() - sent_len, MSG_NOSIGNAL);
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
+        if (len < 0) {
+            throw std::runtime_error("Failed to send response to client.");
+        }
+        sent_len += len;
     }
-    // std::cout << "Sent request to target server:\n" << request << std::endl;
+    // 写入临时文件的响应体由内核直接从文件发送
+    if (body != nullptr) {
+        body->send_to(clientSocket);
+    }
+}
+
+std::pmr::string Server::hit_header(const CacheEntry &entry, std::pmr::memory_resource *resource) {
+    std::string_view response = entry.getResponse();
+    size_t header_length = entry.getMeta().header_length;
+    if (header_length == 0 || header_length > response.size()) {
+        return std::pmr::string(resource);
+    }
+    return HTTP_Parser::make_hit_header(response.substr(0, header_length), entry.getCurrentAge().count(), resource);
+}
+
+void Server::forward_entry(int clientSocket, const CacheEntry &entry) {
+    std::pmr::string header = hit_header(entry, RequestArena::current());
+    if (header.empty()) {
+        // 无法解析头部的响应原样转发
+        forward_response(clientSocket, entry.getResponse(), entry.getBody());
+        return;
+    }
+    std::string_view body = std::string_view(entry.getResponse()).substr(entry.getMeta().header_length);
+    if (entry.getBody() != nullptr) {
+        // 头部与随后sendfile发送的响应体合并成尽量少的报文
+        send_gather(clientSocket, header, body, MSG_MORE);
+        entry.getBody()->send_to(clientSocket);
+    } else if (m_zerocopy_threshold > 0 && body.size() >= m_zerocopy_threshold) {
+        send_zerocopy(clientSocket, header, body);
+    } else {
+        send_gather(clientSocket, header, body);
+    }
+}
+
+namespace {
+// 跳过sendmsg已发送的字节
+void advance(msghdr &message, size_t sent) {
+    while (message.msg_iovlen > 0 && sent >= message.msg_iov->iov_len) {
+        sent -= message.msg_iov->iov_len;
+        message.msg_iov++;
+        message.msg_iovlen--;
+    }
+    if (message.msg_iovlen > 0) {
+        message.msg_iov->iov_base = static_cast<char *>(message.msg_iov->iov_base) + sent;
+        message.msg_iov->iov_len -= sent;
+    }
+}
 
-    // 接收目标服务器的响应
-    std::string response = client.receive(clientSocket);
-    // std::cout << "Received response from target server:\n" << response << std::endl;
+msghdr gather(iovec (&parts)[2], std::string_view header, std::string_view body) {
+    parts[0] = {const_cast<char *>(header.data()), header.size()};
+    parts[1] = {const_cast<char *>(body.data()), body.size()};
+    msghdr message{};
+    message.msg_iov = parts;
+    message.msg_iovlen = body.empty() ? 1 : 2;
+    return message;
+}
 
-    return response;
+// 读取错误队列中的MSG_ZEROCOPY完成通知，返回其覆盖的sendmsg次数
+uint32_t read_completions(int clientSocket) {
+    uint32_t completed = 0;
+    while (true) {
+        char control[128];
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (::recvmsg(clientSocket, &message, MSG_ERRQUEUE) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return completed;
+        }
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if ((cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) &&
+                (cmsg->cmsg_level != SOL_IPV6 || cmsg->cmsg_type != IPV6_RECVERR)) {
+                continue;
+            }
+            sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+            // ee_info到ee_data是一段连续的已完成调用编号
+            if (error.ee_origin == SO_EE_ORIGIN_ZEROCOPY && error.ee_errno == 0) {
+                completed += error.ee_data - error.ee_info + 1;
+            }
+        }
+    }
 }
+}  // namespace
+
+void Server::send_gather(int clientSocket, std::string_view header, std::string_view body, int flags) {
+    iovec parts[2];
+    msghdr message = gather(parts, header, body);
+    // 一次sendmsg可能只发出一部分，跳过已发送的部分继续
+    while (message.msg_iovlen > 0) {
+        ssize_t len = ::sendmsg(clientSocket, &message, MSG_NOSIGNAL | flags);
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
+        if (len < 0) {
+            throw std::runtime_error("Failed to send response to client.");
+        }
+        advance(message, len);
+    }
+}
+
+void Server::send_zerocopy(int clientSocket, std::string_view header, std::string_view body) {
+    int one = 1;
+    if (::setsockopt(clientSocket, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1) {
+        send_gather(clientSocket, header, body);
+        return;
+    }
+    iovec parts[2];
+    msghdr message = gather(parts, header, body);
+    int zerocopy = MSG_ZEROCOPY;
+    uint32_t pending = 0;
+    bool failed = false;
+    while (message.msg_iovlen > 0) {
+        ssize_t len = ::sendmsg(clientSocket, &message, MSG_NOSIGNAL | zerocopy);
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
+        if (len == -1 && errno == ENOBUFS && zerocopy != 0) {
+            // 超出可锁定内存的限制，剩余部分改为复制发送
+            zerocopy = 0;
+            continue;
+        }
+        if (len < 0) {
+            failed = true;
+            break;
+        }
+        if (zerocopy != 0) {
+            pending++;
+        }
+        advance(message, len);
+    }
 
-void Server::forward_response(int clientSocket, const std::string &response) {
-    ssize_t total_len = response.size();
-    const char *buf = response.c_str();
-    ssize_t len = ::send(clientSocket, buf, total_len, 0);
-    if (len <0) {
+    // 内核发送完成前仍在读取缓存条目的内存，条目在此之前不能释放
+    auto deadline = std::chrono::steady_clock::now() + CLIENT_SEND_TIMEOUT;
+    while (true) {
+        pending -= std::min(pending, read_completions(clientSocket));
+        if (pending == 0) {
+            break;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline -
+                                                                               std::chrono::steady_clock::now());
+        // 完成通知以POLLERR报告；连接断开后发送队列已清空，不会再有通知
+        pollfd pfd{clientSocket, 0, 0};
+        if (remaining.count() > 0 && ::poll(&pfd, 1, static_cast<int>(remaining.count())) >= 0 &&
+            (pfd.revents & POLLHUP) == 0) {
+            continue;
+        }
+        if ((pfd.revents & POLLHUP) != 0) {
+            pending -= std::min(pending, read_completions(clientSocket));
+        }
+        if (pending > 0) {
+            // 客户端不再接收：重置连接，丢弃发送队列中引用条目内存的数据
+            sockaddr reset{};
+            reset.sa_family = AF_UNSPEC;
+            ::connect(clientSocket, &reset, sizeof(reset));
+            throw std::runtime_error("Client did not take the response, connection reset.");
+        }
+        break;
+    }
+    if (failed) {
         throw std::runtime_error("Failed to send response to client.");
     }
 }
 
-void Server::handle_GET(int clientSocket, const std::string &id, const std::string &host, const std::string &port,
-                        const std::string &request) {
+void Server::handle_GET(int clientSocket, std::pmr::memory_resource *arena, std::string_view id, std::string_view host,
+                        std::string_view port, std::string_view request) {
+    std::pmr::string url = HTTP_Parser::get_cache_key(request, host, port, arena);
+
+    // Range请求单独处理
+    std::string_view range = HTTP_Parser::find_header_value(request, "Range");
+    if (!range.empty()) {
+        handle_range(clientSocket, arena, id, host, port, url, request, range);
+        return;
+    }
+
     // 尝试从缓存中获取条目
     std::shared_ptr<CacheEntry> entry;
-    bool found = m_cache.get(host, entry);
+    bool found = m_cache.get(url, entry);
     if (found) {
         // 条目已存在于缓存中
-        m_logger.cache_status(id, entry);
+        m_logger.cache_status(id, *entry);
 
-        if (entry->isMustRevalidate() || entry->isNoCache()) {
+        if (entry->isValidatorOnly()) {
+            // 只剩校验器的条目，只能用于条件请求
+            handle_validators(clientSocket, arena, id, host, port, url, request, entry);
+        } else if (entry->isMustRevalidate() || entry->isNoCache()) {
             // 需要重新验证
-            handle_revalidate(clientSocket, id, host, port, request, entry);
+            handle_revalidate(clientSocket, arena, id, host, port, url, request, entry);
         } else if (entry->isFresh()) {
             // 条目未过期，直接返回缓存的响应
-            m_logger.responding(id, entry->getResponse());
-            forward_response(clientSocket, entry->getResponse());
+            m_logger.responding(id, *entry);
+            forward_entry(clientSocket, *entry);
         } else if (entry->isExpired()) {
             // 条目已过期，但未标记为不可缓存
-            handle_refresh(clientSocket, id, host, port, request, entry);
+            handle_refresh(clientSocket, id, host, port, url, request, entry);
         }
     } else {
         // 条目不存在于缓存中，需要从目标服务器获取响应
-        handle_miss(clientSocket, id, host, port, request);
+        handle_miss(clientSocket, arena, id, host, port, url, request);
     }
 }
 
-void Server::handle_revalidate(int clientSocket, const std::string &id, const std::string &host, const std::string &port,
-                               const std::string &request, std::shared_ptr<CacheEntry> entry) {
+void Server::handle_revalidate(int clientSocket, std::pmr::memory_resource *arena, std::string_view id,
+                               std::string_view host, std::string_view port, std::string_view url,
+                               std::string_view request, std::shared_ptr<CacheEntry> entry) {
     // 构造重新验证请求
-    std::string revalidate_request = request;
-    HTTP_Parser::make_revalidate_request(revalidate_request, entry->getResponse());
+    std::pmr::string revalidate_request(request, arena);
+    HTTP_Parser::make_revalidate_request(revalidate_request, entry->getETag(), entry->getLastModified());
     m_logger.forward_request(id, revalidate_request);
 
     // 转发重新验证请求到目标服务器
     try {
-        std::string response = forward_request(clientSocket, host, port, revalidate_request);
-        // response为空说明为chunked response已进行转发
-        if (response.empty()) {
-            return;
-        }
-
+        std::shared_ptr<SpooledBody> body;
+        std::string response = forward_request(host, port, revalidate_request, &body);
+        ResponseMeta meta = ResponseMeta::parse(response);
         // 接收到响应，记录日志
-        m_logger.received_response(id, host, response);
+        m_logger.received_response(id, host, response, meta);
 
         // 检查响应状态码
-        int status_code = HTTP_Parser::get_status_code(response);
-
-        if (status_code == 200) {
+        if (meta.status == 200) {
             // 重新验证成功，将响应放入缓存
-            std::shared_ptr<CacheEntry> cached_entry = m_cache.insert(id, host, response);
-            m_logger.cache_result(id, cached_entry);
+            store_response(id, url, response, meta, body);
 
             // 将响应转发给客户端
             m_logger.responding(id, response);
-            forward_response(clientSocket, response);
+            forward_response(clientSocket, response, body.get());
         } else {
             // 重新验证失败，返回缓存的响应
-            m_logger.responding(id, entry->getResponse());
-            forward_response(clientSocket, entry->getResponse());
+            m_logger.responding(id, *entry);
+            forward_entry(clientSocket, *entry);
         }
     } catch (const std::runtime_error &ex) {
         // 发生异常，返回缓存的响应
-        m_logger.responding(id, entry->getResponse());
-        forward_response(clientSocket, entry->getResponse());
+        m_logger.responding(id, *entry);
+        forward_entry(clientSocket, *entry);
     }
 }
 
-void Server::handle_refresh(int clientSocket, const std::string &id, const std::string &host, const std::string &port,
-                            const std::string &request, std::shared_ptr<CacheEntry> entry) {
-    // 转发请求到目标服务器
+void Server::handle_validators(int clientSocket, std::pmr::memory_resource *arena, std::string_view id,
+                               std::string_view host, std::string_view port, std::string_view url,
+                               std::string_view request, std::shared_ptr<CacheEntry> entry) {
+    // 客户端没有以这些校验器发出条件请求，按未命中处理
+    if (!HTTP_Parser::matches_validators(request, entry->getETag(), entry->getLastModified())) {
+        handle_miss(clientSocket, arena, id, host, port, url, request);
+        return;
+    }
+    if (entry->isFresh()) {
+        // 校验器仍然新鲜，直接返回304
+        m_logger.responding(id, *entry);
+        forward_entry(clientSocket, *entry);
+        return;
+    }
+
+    // 转发客户端的条件请求，源服务器返回304时刷新校验器的有效期
     m_logger.forward_request(id, request);
     try {
-        // 获取目标服务器的响应
-        std::string response = forward_request(clientSocket, host, port, request);
-        // response为空说明为chunked response已进行转发
-        if (response.empty()) {
-            return;
+        std::shared_ptr<SpooledBody> body;
+        std::string response = forward_request(host, port, request, &body);
+        ResponseMeta meta = ResponseMeta::parse(response);
+        m_logger.received_response(id, host, response, meta);
+
+        if (meta.status == 304) {
+            // 304中的Cache-Control覆盖保存的Cache-Control
+            std::string_view cache_control = meta.has(ResponseMeta::CC_PRESENT)
+                                                     ? meta.cache_control_value(response)
+                                                     : entry->getMeta().cache_control_value(entry->getResponse());
+            // 只有校验器的条目没有明确的有效期时立即过期，不按Last-Modified估算有效期
+            std::string validators =
+                    CacheEntry::makeValidatorResponse(entry->getETag(), entry->getLastModified(), cache_control);
+            std::shared_ptr<CacheEntry> cached_entry =
+                    m_cache.insert(id, url, validators, ResponseMeta::parse(validators), std::chrono::seconds(0));
+            m_logger.cache_result(id, cached_entry);
+        } else {
+            store_response(id, url, response, meta, body);
         }
 
+        m_logger.responding(id, response);
+        forward_response(clientSocket, response, body.get());
+    } catch (const std::runtime_error &ex) {
+        m_logger.note_with_id(id, ex.what());
+        std::pmr::string error_response = HTTP_Parser::make_error_response(503, "Service Unavailable", arena);
+        m_logger.responding(id, error_response);
+        forward_response(clientSocket, error_response);
+    }
+}
+
+void Server::handle_refresh(int clientSocket, std::string_view id, std::string_view host, std::string_view port,
+                            std::string_view url, std::string_view request, std::shared_ptr<CacheEntry> entry) {
+    // 转发请求到目标服务器
+    m_logger.forward_request(id, request);
+    try {
+        // 获取目标服务器的响应
+        std::shared_ptr<SpooledBody> body;
+        std::string response = forward_request(host, port, request, &body);
+        ResponseMeta meta = ResponseMeta::parse(response);
         // 接收到响应，记录日志
-        m_logger.received_response(id, host, response);
+        m_logger.received_response(id, host, response, meta);
 
-        if (!HTTP_Parser::has_no_store(response)) {
-            // 将响应放入缓存
-            std::shared_ptr<CacheEntry> cached_entry = m_cache.insert(id, host, response);
-            m_logger.cache_result(id, cached_entry);
-        }  else {
-            m_logger.no_store(id);
-        }
+        // 将响应放入缓存
+        std::shared_ptr<CacheEntry> cached_entry = store_response(id, url, response, meta, body);
 
         // 将响应转发给客户端
         m_logger.responding(id, response);
-        forward_response(clientSocket, response);
+        forward_response(clientSocket, response, body.get());
+
+        // HTML页面引用的资源在后台预取
+        if (m_prefetcher && cached_entry) {
+            m_prefetcher->offer(id, std::move(cached_entry));
+        }
     } catch (const std::runtime_error &ex) {
         // 发生异常，返回缓存的响应
-        m_logger.responding(id, entry->getResponse());
-        forward_response(clientSocket, entry->getResponse());
+        m_logger.responding(id, *entry);
+        forward_entry(clientSocket, *entry);
     }
 }
 
-void Server::handle_miss(int clientSocket, const std::string &id, const std::string &host, const std::string &port,
-                         const std::string &request) {
+void Server::handle_miss(int clientSocket, std::pmr::memory_resource *arena, std::string_view id, std::string_view host,
+                         std::string_view port, std::string_view url, std::string_view request) {
     m_logger.not_in_cache(id);
+    // 由集群中其他节点负责的URL先向该节点获取，来自其他节点的请求不再转发
+    if (m_cluster && !m_cluster->is_peer_request(request) && fetch_from_peer(clientSocket, arena, id, url, request)) {
+        return;
+    }
     // 转发请求到目标服务器
     m_logger.forward_request(id, request);
     try {
         // 获取目标服务器的响应
-        std::string response = forward_request(clientSocket, host, port, request);
-        // response为空说明为chunked response已进行转发
-        if (response.empty()) {
+        std::shared_ptr<SpooledBody> body;
+        std::string response = forward_request(host, port, request, &body);
+        ResponseMeta meta = ResponseMeta::parse(response);
+        // 接收到响应，记录日志
+        m_logger.received_response(id, host, response, meta);
+
+        // 将响应放入缓存
+        std::shared_ptr<CacheEntry> cached_entry = store_response(id, url, response, meta, body);
+
+        // 将响应转发给客户端
+        m_logger.responding(id, response);
+        forward_response(clientSocket, response, body.get());
+
+        // HTML页面引用的资源在后台预取
+        if (m_prefetcher && cached_entry) {
+            m_prefetcher->offer(id, std::move(cached_entry));
+        }
+    } catch (const std::runtime_error &ex) {
+        // 发生异常，返回错误响应
+        m_logger.note_with_id(id, ex.what());
+        std::pmr::string error_response = HTTP_Parser::make_error_response(503, "Service Unavailable", arena);
+        m_logger.responding(id, error_response);
+        forward_response(clientSocket, error_response);
+    }
+}
+
+bool Server::fetch_from_peer(int clientSocket, std::pmr::memory_resource *arena, std::string_view id,
+                             std::string_view url, std::string_view request) {
+    const PeerCluster::Peer *owner = m_cluster->owner(url);
+    if (owner == nullptr) {
+        return false;
+    }
+
+    // 在请求行后加上Via，负责节点据此识别来自集群内的请求
+    size_t line_end = request.find("\r\n") + 2;
+    std::pmr::string peer_request(arena);
+    peer_request.reserve(request.size() + m_cluster->via().size());
+    peer_request.append(request.substr(0, line_end)).append(m_cluster->via()).append(request.substr(line_end));
+    m_logger.note_with_id(id, "fetching from peer " + owner->name);
+
+    std::string response;
+    std::shared_ptr<SpooledBody> body;
+    try {
+        response = forward_request(owner->host, owner->port, peer_request, &body);
+    } catch (const std::runtime_error &ex) {
+        // 负责节点不可用，退回到源服务器
+        m_logger.note_with_id(id, "peer " + owner->name + " unavailable (" + ex.what() + "), fetching from origin");
+        return false;
+    }
+    // 响应由负责节点缓存，本节点不再保存一份
+    m_logger.received_response(id, owner->name, response);
+    m_logger.responding(id, response);
+    forward_response(clientSocket, response, body.get());
+    return true;
+}
+
+std::shared_ptr<CacheEntry> Server::store_response(std::string_view id, std::string_view url,
+                                                   const std::string &response, const ResponseMeta &meta,
+                                                   std::shared_ptr<SpooledBody> body) {
+    if (meta.has(ResponseMeta::NO_STORE)) {
+        m_logger.no_store(id);
+        return nullptr;
+    }
+    // 本代理是共享缓存，不保存只给单个用户的响应
+    if (meta.has(ResponseMeta::PRIVATE)) {
+        m_logger.not_cacheable(id, "\"private\" found");
+        return nullptr;
+    }
+    // 解码chunked后仍带有传输编码（如gzip）的响应没有长度，也不能按范围切分
+    std::string_view header_block = std::string_view(response).substr(0, meta.header_length);
+    if (!HTTP_Parser::find_header_value(header_block, "Transfer-Encoding").empty()) {
+        m_logger.not_cacheable(id, "transfer coding other than chunked found");
+        return nullptr;
+    }
+
+    std::optional<std::chrono::seconds> lifetime;
+    switch (meta.status) {
+        case 200:
+        case 203:
+        case 204:
+        case 300:
+        case 301:
+        case 308:
+            break;
+        case 404:
+        case 405:
+        case 410:
+        case 414:
+        case 501:
+            // 可启发式缓存的错误响应，没有明确的新鲜度时只缓存很短的时间
+            lifetime = m_error_response_ttl;
+            break;
+        default:
+            // 其他状态码只有明确给出新鲜度或标记为public时才缓存
+            if (!meta.has(ResponseMeta::PUBLIC) && !Freshness::is_explicit(response, meta)) {
+                char reason[48];
+                std::snprintf(reason, sizeof(reason), "status %u has no explicit freshness", meta.status);
+                m_logger.not_cacheable(id, reason);
+                return nullptr;
+            }
+    }
+
+    std::shared_ptr<CacheEntry> cached_entry = m_cache.insert(id, url, response, meta, lifetime, std::move(body));
+    m_logger.cache_result(id, cached_entry);
+    return cached_entry;
+}
+
+void Server::prefetch(const std::string &id, const std::string &url) {
+    // 由其他节点负责的URL留给该节点，已经缓存且新鲜的不再获取
+    if (m_cluster && m_cluster->owner(url) != nullptr) {
+        return;
+    }
+    {
+        EpochReclaimer::Guard guard;
+        std::shared_ptr<CacheEntry> holder;
+        const CacheEntry *entry = m_cache.peek(url, holder);
+        if (entry != nullptr && entry->isFresh() && !entry->isValidatorOnly()) {
             return;
         }
+    }
 
-        // 接收到响应，记录日志
-        m_logger.received_response(id, host, response);
+    // 不带客户端的Cookie等头部，预取的响应对所有用户都一样
+    size_t path = url.find_first_of("/?", 7);
+    std::string authority = url.substr(7, path == std::string::npos ? std::string::npos : path - 7);
+    std::string request = "GET " + url + " HTTP/1.1\r\nHost: " + authority +
+                          "\r\nAccept: */*\r\nConnection: close\r\n\r\n";
+    auto [host, port] = HTTP_Parser::extract_host_and_port(request);
+    std::shared_ptr<SpooledBody> body;
+    std::string response = forward_request(host, port, request, &body);
+    ResponseMeta meta = ResponseMeta::parse(response);
+    if (meta.status != 200) {
+        m_logger.note_with_id(id, "prefetch of " + url + " returned " + std::to_string(meta.status));
+        return;
+    }
+    m_logger.note_with_id(id, "prefetched " + url);
+    store_response(id, url, response, meta, body);
+}
 
-        if (!HTTP_Parser::has_no_store(response)) {
-            // 将响应放入缓存
-            std::shared_ptr<CacheEntry> cached_entry = m_cache.insert(id, host, response);
-            m_logger.cache_result(id, cached_entry);
-        }  else {
-            m_logger.no_store(id);
+void Server::handle_range(int clientSocket, std::pmr::memory_resource *arena, std::string_view id,
+                          std::string_view host, std::string_view port, std::string_view url,
+                          std::string_view request, std::string_view range) {
+    std::shared_ptr<CacheEntry> entry;
+    bool found = m_cache.get(url, entry);
+    if (found) {
+        m_logger.cache_status(id, *entry);
+    } else {
+        m_logger.not_in_cache(id);
+    }
+
+    // 只有新鲜且完整的200响应才能直接切片返回
+    if (found && entry->isFresh() && !entry->isMustRevalidate() && !entry->isNoCache() &&
+        entry->getMeta().status == 200) {
+        const std::string &cached = entry->getResponse();
+        size_t length = entry->getMeta().content_length;
+
+        // If-Range不匹配时返回完整响应
+        bool if_range_matches = true;
+        std::string_view if_range = HTTP_Parser::find_header_value(request, "If-Range");
+        if (!if_range.empty()) {
+            if (if_range[0] == '"' || if_range.compare(0, 2, "W/") == 0) {
+                // 只有强ETag可以匹配
+                if_range_matches = if_range[0] == '"' && if_range == entry->getETag();
+            } else {
+                if_range_matches = if_range == entry->getLastModified();
+            }
         }
 
-        // 将响应转发给客户端
+        // 完整响应直接发送缓存中的数据，不再复制
+        const SpooledBody *body = entry->getBody();
+        std::string_view response;
+        std::pmr::string partial(arena);
+        std::vector<std::pair<size_t, size_t>> ranges;
+        if (!if_range_matches || !HTTP_Parser::parse_byte_ranges(range, length, ranges) || ranges.size() > MAX_RANGES ||
+            (body != nullptr && ranges.size() > 1)) {
+            // 响应体在文件中时多个范围也返回完整响应
+            response = cached;
+        } else if (ranges.empty()) {
+            partial = HTTP_Parser::make_range_not_satisfiable(length, arena);
+            response = partial;
+            body = nullptr;
+        } else if (body != nullptr) {
+            // 从文件中直接发送请求的这一段
+            auto [first, last] = ranges[0];
+            partial = HTTP_Parser::make_partial_header(cached, first, last, length, arena);
+            m_logger.responding(id, partial);
+            forward_response(clientSocket, partial);
+            body->send_to(clientSocket, first, last - first + 1);
+            return;
+        } else {
+            std::pmr::string boundary = generate_uuid(arena);
+            boundary.erase(std::remove(boundary.begin(), boundary.end(), '-'), boundary.end());
+            partial = HTTP_Parser::make_partial_response(cached, ranges, boundary, arena);
+            response = partial;
+        }
         m_logger.responding(id, response);
-        forward_response(clientSocket, response);
+        forward_response(clientSocket, response, body);
+        return;
+    }
+
+    // 未命中：原样转发Range请求，同时在后台获取一次完整对象
+    m_logger.forward_request(id, request);
+    try {
+        std::shared_ptr<SpooledBody> body;
+        std::string response = forward_request(host, port, request, &body);
+        ResponseMeta meta = ResponseMeta::parse(response);
+        m_logger.received_response(id, host, response, meta);
+
+        if (meta.status == 200) {
+            // 源服务器忽略了Range，直接缓存完整响应
+            store_response(id, url, response, meta, body);
+        } else if (meta.status == 206) {
+            fetch_full_object(arena, id, host, port, url, request);
+        }
+
+        m_logger.responding(id, response);
+        forward_response(clientSocket, response, body.get());
     } catch (const std::runtime_error &ex) {
-        // 发生异常，返回错误响应
-        std::string error_response = HTTP_Parser::make_error_response(503, "Service Unavailable");
+        std::pmr::string error_response = HTTP_Parser::make_error_response(503, "Service Unavailable", arena);
         m_logger.responding(id, error_response);
         forward_response(clientSocket, error_response);
     }
 }
 
+void Server::fetch_full_object(std::pmr::memory_resource *arena, std::string_view id, std::string_view host,
+                               std::string_view port, std::string_view url, std::string_view request) {
+    {
+        // 同一个URL同时只取一次
+        std::lock_guard<std::mutex> lock(m_range_mutex);
+        if (!m_range_fetches.insert(std::string(url)).second) {
+            return;
+        }
+    }
+
+    std::pmr::string full_request(request, arena);
+    for (const char *header : {"Range", "If-Range", "If-None-Match", "If-Modified-Since"}) {
+        full_request = HTTP_Parser::remove_header(full_request, header, arena);
+    }
+    m_logger.note_with_id(id, "fetching full object for range requests in background");
+
+    // 后台任务比当前请求存活得久，不能引用arena中的数据
+    upstream_pool().enqueue([this, id = std::string(id), host = std::string(host), port = std::string(port),
+                          url = std::string(url), full_request = std::string(full_request)]() {
+        try {
+            std::shared_ptr<SpooledBody> body;
+            std::string response = forward_request(host, port, full_request, &body);
+            ResponseMeta meta = ResponseMeta::parse(response);
+            if (meta.status == 200) {
+                store_response(id, url, response, meta, body);
+            }
+        } catch (const std::exception &e) {
+            m_logger.note_with_id(id, std::string("background fetch failed: ") + e.what());
+        }
+        std::lock_guard<std::mutex> lock(m_range_mutex);
+        m_range_fetches.erase(url);
+    });
+}
+
 void Server::handle_request(int clientSocket) {
     try {
+        // 本次请求的临时数据都分配在arena中，请求结束时一起释放
+        RequestArena arena;
+
         // Generate UUID for request
-        std::string request_id = generate_uuid();
+        std::pmr::string request_id = generate_uuid(&arena);
 
         // Get request from fd
-        std::string request = receive_request(clientSocket);
+        std::pmr::string request = receive_request(clientSocket, &arena);
+
+        // HTTP/2客户端的连接前言在HTTP/1.1读取器看来是一个"PRI *"请求
+        if (m_h2_streams && H2Connection::is_preface(request)) {
+            serve_h2(clientSocket, request);
+            return;
+        }
 
         // Handle null request
         if (request.empty()) {
-            std::string error_response = HTTP_Parser::make_error_response(400, "Bad Request");
+            std::pmr::string error_response = HTTP_Parser::make_error_response(400, "Bad Request", &arena);
             m_logger.responding(request_id, error_response);
             forward_response(clientSocket, error_response);
+            ::close(clientSocket);
+            return;
+        }
+
+        // 拒绝字段名不合法的请求（例如冒号前有空白），避免请求走私
+        if (!HTTP_Parser::has_valid_header_names(request)) {
+            std::pmr::string error_response = HTTP_Parser::make_error_response(400, "Bad Request", &arena);
+            m_logger.responding(request_id, error_response);
+            forward_response(clientSocket, error_response);
+            ::close(clientSocket);
+            return;
         }
 
         // Extract request
-        std::string host, port, method;
-        std::tie(host, port) = HTTP_Parser::extract_host_and_port(request);
-        method = HTTP_Parser::extract_http_method(request);
+        auto [host, port] = HTTP_Parser::extract_host_and_port(request, &arena);
+        std::string_view method = HTTP_Parser::extract_http_method(request);
 
         // Log Request
         m_logger.request(request_id, clientSocket, request);
-        // Handle CONNECT
-        if (method == "CONNECT") {
-            handle_CONNECT(clientSocket, request_id, host, port);
-        }
-        // Handle POST
-        else if (method == "POST") {
-            handle_POST(clientSocket, request_id, host, port, request);
-        }
-        // Handle GET
-        else if (method == "GET") {
-            handle_GET(clientSocket, request_id, host, port, request);
+
+        // 新鲜的缓存命中直接在本线程返回，不必排在等待源服务器的请求之后
+        if (method == "GET" && serve_fresh_hit(clientSocket, &arena, request_id, host, port, request)) {
+            ::close(clientSocket);
+            return;
         }
-        // Handle Other
-        else {
-            std::string error_response = HTTP_Parser::make_error_response(400, "Bad Request");
-            m_logger.responding(request_id, error_response);
-            forward_response(clientSocket, error_response);
+        if (m_slow_lane) {
+            // 需要访问源服务器的请求交给并发数受限的慢速通道，本线程继续处理新请求
+            m_in_flight++;
+            m_slow_lane->enqueue([this, clientSocket, id = std::string(request_id), request = std::string(request)]() {
+                handle_slow(clientSocket, id, request);
+                m_in_flight--;
+            });
+            return;
         }
-
+        handle_upstream(clientSocket, &arena, request_id, host, port, method, request);
+    } catch (const std::exception &e) {
+        std::cerr << "Exception caught: " << e.what() << std::endl;
         ::close(clientSocket);
+    }
+}
+
+void Server::handle_slow(int clientSocket, const std::string &id, const std::string &request) {
+    try {
+        RequestArena arena;
+        auto [host, port] = HTTP_Parser::extract_host_and_port(request, &arena);
+        handle_upstream(clientSocket, &arena, id, host, port, HTTP_Parser::extract_http_method(request), request);
     } catch (const std::exception &e) {
         std::cerr << "Exception caught: " << e.what() << std::endl;
         ::close(clientSocket);
     }
 }
 
-void Server::handle_CONNECT(int clientSocket, const std::string &id, const std::string &host, const std::string &port) {
+void Server::serve_h2(int clientSocket, std::string_view request) {
+    // 每个流作为一个HTTP/1.1请求交给流线程池，响应写入socketpair的另一端
+    H2Connection connection(
+            clientSocket, request.substr(H2Connection::REQUEST_LINE.size()), m_logger, m_h2, m_stop_fd,
+            [this, clientSocket](int streamSocket, std::string stream_request) {
+                RequestArena arena;
+                std::string id(generate_uuid(&arena));
+                m_logger.request(id, clientSocket, stream_request);
+                m_in_flight++;
+                m_h2_streams->enqueue([this, streamSocket, id = std::move(id),
+                                       stream_request = std::move(stream_request)]() {
+                    handle_slow(streamSocket, id, stream_request);
+                    m_in_flight--;
+                });
+            });
+    connection.serve();
+    ::close(clientSocket);
+}
+
+void Server::handle_upstream(int clientSocket,
+                             std::pmr::memory_resource *arena,
+                             std::string_view id,
+                             std::string_view host,
+                             std::string_view port,
+                             std::string_view method,
+                             std::string_view request) {
+    // Handle CONNECT
+    if (method == "CONNECT") {
+        if (handle_CONNECT(clientSocket, id, host, port)) {
+            // 隧道已交给TunnelReactor，由它负责关闭连接
+            return;
+        }
+    }
+    // Handle POST
+    else if (method == "POST") {
+        handle_POST(clientSocket, arena, id, host, port, request);
+    }
+    // Handle GET
+    else if (method == "GET") {
+        handle_GET(clientSocket, arena, id, host, port, request);
+    }
+    // Handle Other
+    else {
+        std::pmr::string error_response = HTTP_Parser::make_error_response(400, "Bad Request", arena);
+        m_logger.responding(id, error_response);
+        forward_response(clientSocket, error_response);
+    }
+
+    ::close(clientSocket);
+}
+
+bool Server::serve_fresh_hit(int clientSocket,
+                             std::pmr::memory_resource *arena,
+                             std::string_view id,
+                             std::string_view host,
+                             std::string_view port,
+                             std::string_view request) {
+    // Range请求和需要重新验证的条目都不走快速通道
+    if (!HTTP_Parser::find_header_value(request, "Range").empty()) {
+        return false;
+    }
+    std::pmr::string url = HTTP_Parser::get_cache_key(request, host, port, arena);
+    std::shared_ptr<CacheEntry> owned;
+    {
+        // 不增加条目的引用计数，热点条目的控制块不会在各核之间来回传递；
+        // 持有guard期间条目不会被释放
+        EpochReclaimer::Guard guard;
+        const CacheEntry *entry = m_cache.peek(url, owned);
+        if (entry == nullptr || !answers_fresh(*entry)) {
+            return false;
+        }
+        if (!owned && quick_to_send(*entry)) {
+            m_logger.cache_status(id, *entry);
+            m_logger.responding(id, *entry);
+            forward_entry(clientSocket, *entry);
+            return true;
+        }
+    }
+    // sendfile和等待MSG_ZEROCOPY完成通知可能很久，持有引用发送，不拖住其他线程的内存回收
+    if (!owned && (!m_cache.get(url, owned) || !answers_fresh(*owned))) {
+        return false;
+    }
+    m_logger.cache_status(id, *owned);
+    m_logger.responding(id, *owned);
+    forward_entry(clientSocket, *owned);
+    return true;
+}
+
+bool Server::quick_to_send(const CacheEntry &entry) const {
+    size_t body_size = entry.getResponse().size() - std::min<size_t>(entry.getMeta().header_length, entry.getResponse().size());
+    return entry.getBody() == nullptr && (m_zerocopy_threshold == 0 || body_size < m_zerocopy_threshold);
+}
+
+bool Server::handle_CONNECT(int clientSocket, std::string_view id, std::string_view host, std::string_view port) {
+    // 先连接目标服务器，连接失败时返回502而不是建立一个空隧道
+    Client server(&m_deadlines);
+    try {
+        connect_origin(server, host, port);
+    } catch (const OriginError &ex) {
+        m_logger.note_with_id(id, ex.what());
+        std::string_view error_response = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+        m_logger.responding(id, error_response);
+        forward_response(clientSocket, error_response);
+        return false;
+    }
+    m_origins.record_success(host, port);
+
     // 将响应发送给客户端
-    std::string response = "HTTP/1.1 200 Connection Established\r\n\r\n";
+    std::string_view response = "HTTP/1.1 200 Connection Established\r\n\r\n";
     forward_response(clientSocket, response);
     m_logger.responding(id, response);
 
-    // 连接目标服务器
-    Client server;
-    if (!server.connect(host, port)) {
-        throw std::runtime_error("Failed to connect to target server.");
+    // 交给隧道线程转发，立即释放当前工作线程
+    if (m_tunnels) {
+        m_tunnels->add(clientSocket, server.release(), std::string(id));
+        return true;
     }
 
     // 处理连接
     int serverSocket = server.getFd();
     forward_data(clientSocket, serverSocket, id);
+    return false;
 }
 
-void Server::forward_data(int client_fd, int server_fd, const std::string &id) {
+void Server::forward_data(int client_fd, int server_fd, std::string_view id) {
     fd_set readfds;
     int nfds = server_fd > client_fd ? server_fd + 1 : client_fd + 1;
+    // 隧道空闲超时后关闭客户端连接，select随之返回
+    Deadline idle(&m_deadlines, DeadlineKind::TUNNEL_IDLE, client_fd);
 
     while (true) {
         FD_ZERO(&readfds);
@@ -362,24 +1270,20 @@ void Server::forward_data(int client_fd, int server_fd, const std::string &id) {
                     }
                     sent_len += len;
                 }
+                idle.touch();
             }
         }
     }
 }
 
-void Server::handle_POST(int clientSocket, const std::string &id, const std::string &host, const std::string &port,
-                         const std::string &request) {
+void Server::handle_POST(int clientSocket, std::pmr::memory_resource *arena, std::string_view id,
+                         std::string_view host, std::string_view port, std::string_view request) {
     // 获取请求体的长度
     int post_len = HTTP_Parser::get_content_length(request);
 
     if (post_len != -1) {
         // 获取响应体
-        std::string response = forward_request(clientSocket, host, port, request);
-        // response为空说明为chunked response已进行转发
-        if (response.empty()) {
-            return;
-        }
-
+        std::string response = forward_request(host, port, request);
         // 将响应发送给客户端
         forward_response(clientSocket, response);
 
@@ -388,8 +1292,214 @@ void Server::handle_POST(int clientSocket, const std::string &id, const std::str
         m_logger.responding(id, response);
     } else {
         // 请求不合法，返回错误响应
-        std::string error_response = HTTP_Parser::make_error_response(411, "Length Required");
+        std::pmr::string error_response = HTTP_Parser::make_error_response(411, "Length Required", arena);
         m_logger.responding(id, error_response);
         forward_response(clientSocket, error_response);
     }
 }
+
+#ifdef PROXY_COROUTINES
+Task<void> Server::handle_request_async(EventLoop &loop, int clientSocket) {
+    // RequestArena是线程局部的后进先出链，同一线程上交替运行的协程不能使用，
+    // 每个连接改用自己的monotonic_buffer_resource
+    std::pmr::monotonic_buffer_resource arena(CONNECTION_ARENA_SIZE);
+    AsyncSocket client(loop, clientSocket);
+    try {
+        co_await serve_async(loop, client, &arena);
+    } catch (const std::exception &e) {
+        std::cerr << "Exception caught: " << e.what() << std::endl;
+    }
+    m_in_flight--;
+}
+
+Task<void> Server::serve_async(EventLoop &loop, AsyncSocket &client, std::pmr::memory_resource *arena) {
+    std::pmr::string request_id = generate_uuid(arena);
+    std::pmr::string request = co_await receive_request_async(client, arena);
+
+    // HTTP/2连接会长时间占用线程，交给工作线程处理
+    if (m_h2_streams && H2Connection::is_preface(request)) {
+        int clientSocket = client.release();
+        m_in_flight++;
+        m_threadPool.enqueue([this, clientSocket, request = std::string(request)]() {
+            serve_h2(clientSocket, request);
+            m_in_flight--;
+        });
+        co_return;
+    }
+
+    // 拒绝空请求和字段名不合法的请求
+    if (request.empty() || !HTTP_Parser::has_valid_header_names(request)) {
+        std::pmr::string error_response = HTTP_Parser::make_error_response(400, "Bad Request", arena);
+        m_logger.responding(request_id, error_response);
+        co_await client.send(error_response, CLIENT_SEND_TIMEOUT);
+        co_return;
+    }
+
+    auto [host, port] = HTTP_Parser::extract_host_and_port(request, arena);
+    std::string_view method = HTTP_Parser::extract_http_method(request);
+    m_logger.request(request_id, client.fd(), request);
+
+    // CONNECT、POST和Range请求仍由工作线程上的阻塞处理函数负责
+    if (method != "GET" || !HTTP_Parser::find_header_value(request, "Range").empty()) {
+        hand_off(client, request_id, request);
+        co_return;
+    }
+
+    std::pmr::string url = HTTP_Parser::get_cache_key(request, host, port, arena);
+    std::shared_ptr<CacheEntry> entry;
+    if (m_cache.get(url, entry)) {
+        m_logger.cache_status(request_id, *entry);
+        // 响应体在文件中的条目由工作线程用sendfile发送
+        if (entry->getBody() == nullptr && !entry->isValidatorOnly() && !entry->isMustRevalidate() &&
+            !entry->isNoCache() && entry->isFresh()) {
+            // 新鲜的缓存命中
+            m_logger.responding(request_id, *entry);
+            co_await send_entry_async(client, arena, *entry);
+            co_return;
+        }
+        if (entry->getBody() != nullptr || entry->isValidatorOnly() || entry->isMustRevalidate() ||
+            entry->isNoCache() || !entry->isExpired()) {
+            hand_off(client, request_id, request);
+            co_return;
+        }
+    } else {
+        // 由集群中其他节点负责的URL交给阻塞处理函数向该节点获取
+        if (m_cluster && !m_cluster->is_peer_request(request) && m_cluster->owner(url) != nullptr) {
+            hand_off(client, request_id, request);
+            co_return;
+        }
+        m_logger.not_in_cache(request_id);
+    }
+    co_await handle_get_async(loop, client, arena, request_id, host, port, url, request, std::move(entry));
+}
+
+Task<void> Server::send_entry_async(AsyncSocket &client, std::pmr::memory_resource *arena,
+                                    const CacheEntry &entry) {
+    std::pmr::string header = hit_header(entry, arena);
+    if (header.empty()) {
+        co_await client.send(entry.getResponse(), CLIENT_SEND_TIMEOUT);
+        co_return;
+    }
+    co_await client.send(header, CLIENT_SEND_TIMEOUT);
+    co_await client.send(std::string_view(entry.getResponse()).substr(entry.getMeta().header_length),
+                         CLIENT_SEND_TIMEOUT);
+}
+
+Task<void> Server::handle_get_async(EventLoop &loop, AsyncSocket &client, std::pmr::memory_resource *arena,
+                                    std::string_view id, std::string_view host, std::string_view port,
+                                    std::string_view url, std::string_view request,
+                                    std::shared_ptr<CacheEntry> entry) {
+    m_logger.forward_request(id, request);
+    std::string response;
+    std::string error;
+    try {
+        response = co_await forward_request_async(loop, host, port, request);
+    } catch (const std::runtime_error &ex) {
+        error = ex.what();
+    }
+
+    if (!error.empty()) {
+        if (entry) {
+            // 源服务器不可用，返回过期的缓存响应
+            m_logger.responding(id, *entry);
+            co_await send_entry_async(client, arena, *entry);
+        } else {
+            m_logger.note_with_id(id, error);
+            std::pmr::string error_response = HTTP_Parser::make_error_response(503, "Service Unavailable", arena);
+            m_logger.responding(id, error_response);
+            co_await client.send(error_response, CLIENT_SEND_TIMEOUT);
+        }
+        co_return;
+    }
+
+    ResponseMeta meta = ResponseMeta::parse(response);
+    m_logger.received_response(id, host, response, meta);
+    std::shared_ptr<CacheEntry> cached_entry = store_response(id, url, response, meta);
+    m_logger.responding(id, response);
+    co_await client.send(response, CLIENT_SEND_TIMEOUT);
+
+    if (m_prefetcher && cached_entry) {
+        m_prefetcher->offer(id, std::move(cached_entry));
+    }
+}
+
+Task<std::pmr::string> Server::receive_request_async(AsyncSocket &client, std::pmr::memory_resource *arena) {
+    std::pmr::string request(arena);
+    request.reserve(2 * BUFFER_SIZE);
+    char buffer[BUFFER_SIZE];
+    size_t header_end = std::string::npos;
+
+    // 期限覆盖整个请求头，而不是每次recv
+    auto remaining = [](EventLoop::Clock::time_point deadline) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - EventLoop::Clock::now());
+        return std::max(left, std::chrono::milliseconds(0));
+    };
+    EventLoop::Clock::time_point deadline = EventLoop::Clock::now() + m_deadlines.timeout(DeadlineKind::HEADER_READ);
+    size_t scanned = 0;
+    while ((header_end = HeaderScan::find_header_end(request, scanned)) == std::string::npos) {
+        scanned = request.size() < 3 ? 0 : request.size() - 3;
+        if (request.size() > MAX_HEADER_SIZE) {
+            throw std::runtime_error("Request header too large.");
+        }
+        size_t numBytes = co_await client.recv(buffer, sizeof(buffer), remaining(deadline));
+        if (numBytes == 0 && request.empty()) {
+            co_return request;
+        }
+        if (numBytes == 0) {
+            throw std::runtime_error("Failed to receive message from client.");
+        }
+        request.append(buffer, numBytes);
+    }
+
+    int content_length = HTTP_Parser::get_content_length(request);
+    if (content_length > 0) {
+        size_t total_len = header_end + 4 + content_length;
+        request.reserve(total_len);
+        deadline = EventLoop::Clock::now() + m_deadlines.timeout(DeadlineKind::BODY_READ);
+        while (request.size() < total_len) {
+            size_t numBytes = co_await client.recv(buffer, sizeof(buffer), remaining(deadline));
+            if (numBytes == 0) {
+                throw std::runtime_error("Failed to receive message from client.");
+            }
+            request.append(buffer, numBytes);
+        }
+    }
+    co_return request;
+}
+
+Task<std::string> Server::forward_request_async(EventLoop &loop, std::string_view host, std::string_view port,
+                                                std::string_view request) {
+    if (!m_origins.allow(host, port)) {
+        throw OriginError(OriginFailure::CONNECT, "Target server is failing, not retried yet.");
+    }
+    // DNS解析在upstream_pool上进行，连接和读写都不占用线程
+    AsyncSocket origin(loop);
+    ConnectError error = co_await origin.connect(std::string(host), std::string(port), upstream_pool(),
+                                                 m_deadlines.timeout(DeadlineKind::UPSTREAM_CONNECT));
+    if (error != ConnectError::NONE) {
+        OriginFailure failure = origin_failure(error);
+        m_origins.record_failure(host, port, failure);
+        throw OriginError(failure, "Failed to connect to target server.");
+    }
+
+    std::chrono::milliseconds idle = m_deadlines.timeout(DeadlineKind::UPSTREAM_IDLE);
+    try {
+        co_await origin.send(request, idle);
+        std::string response = co_await origin.receive_response(idle);
+        m_origins.record_success(host, port);
+        co_return response;
+    } catch (const std::runtime_error &) {
+        m_origins.record_failure(host, port, OriginFailure::UPSTREAM);
+        throw;
+    }
+}
+
+void Server::hand_off(AsyncSocket &client, std::string_view id, std::string_view request) {
+    int clientSocket = client.release();
+    m_in_flight++;
+    upstream_pool().enqueue([this, clientSocket, id = std::string(id), request = std::string(request)]() {
+        handle_slow(clientSocket, id, request);
+        m_in_flight--;
+    });
+}
+#endif
@@ -31,6 +31,10 @@ ThreadPool::ThreadPool(size_t numThreads)
 }
 
 ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+void ThreadPool::shutdown() {
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         // Set the stop flag and notify worker threads to exit.
@@ -42,6 +46,7 @@ ThreadPool::~ThreadPool() {
     for (std::thread &worker: m_workers) {
         worker.join();
     }
+    m_workers.clear();
 }
 
 void ThreadPool::enqueue(std::function<void()> task) {
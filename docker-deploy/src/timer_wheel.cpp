@@ -0,0 +1,114 @@
+#include "timer_wheel.hpp"
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+        : m_tick(tick),
+          m_now(0),
+          m_next_id(1),
+          m_start(std::chrono::steady_clock::now()),
+          m_stop(false),
+          m_thread(&TimerWheel::run, this) {}
+
+TimerWheel::~TimerWheel() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+TimerWheel::TimerId TimerWheel::schedule(std::chrono::milliseconds delay, std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Round up so a timer never fires early, and always at least one tick ahead
+    uint64_t ticks = (std::max<int64_t>(delay.count(), 0) + m_tick.count() - 1) / m_tick.count();
+    TimerId id = m_next_id++;
+    place(Timer{id, m_now + std::max<uint64_t>(ticks, 1), std::move(callback)});
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(id);
+    if (it == m_index.end()) {
+        return false;
+    }
+    it->second.slot->erase(it->second.it);
+    m_index.erase(it);
+    return true;
+}
+
+size_t TimerWheel::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.size();
+}
+
+void TimerWheel::place(Timer timer) {
+    // Clamp timers beyond the wheel's range to its far end
+    const uint64_t max_delta = (uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1;
+    if (timer.expires - m_now > max_delta) {
+        timer.expires = m_now + max_delta;
+    }
+
+    // The level is chosen by how far away the timer is, the slot by its expiry
+    uint64_t delta = timer.expires - m_now;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (LEVEL_BITS * (level + 1)))) {
+        level++;
+    }
+    Slot &slot = m_slots[level][(timer.expires >> (LEVEL_BITS * level)) & (SLOTS - 1)];
+    TimerId id = timer.id;
+    slot.push_back(std::move(timer));
+    m_index[id] = Location{&slot, std::prev(slot.end())};
+}
+
+void TimerWheel::advance(std::vector<std::function<void()>> &due) {
+    m_now++;
+
+    // Cascade the coarser levels whose slot comes around with this tick
+    for (int level = LEVELS - 1; level > 0; level--) {
+        if ((m_now & ((uint64_t(1) << (LEVEL_BITS * level)) - 1)) != 0) {
+            continue;
+        }
+        Slot &slot = m_slots[level][(m_now >> (LEVEL_BITS * level)) & (SLOTS - 1)];
+        Slot pending;
+        pending.splice(pending.end(), slot);
+        for (Timer &timer : pending) {
+            m_index.erase(timer.id);
+            place(std::move(timer));
+        }
+    }
+
+    Slot &slot = m_slots[0][m_now & (SLOTS - 1)];
+    for (auto it = slot.begin(); it != slot.end();) {
+        if (it->expires <= m_now) {
+            due.push_back(std::move(it->callback));
+            m_index.erase(it->id);
+            it = slot.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void TimerWheel::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        // Sleep until the next tick boundary, measured from the start to avoid drift
+        auto next_tick = m_start + m_tick * (m_now + 1);
+        if (m_cv.wait_until(lock, next_tick, [this]() { return m_stop; })) {
+            break;
+        }
+
+        std::vector<std::function<void()>> due;
+        uint64_t target = (std::chrono::steady_clock::now() - m_start) / m_tick;
+        while (m_now < target) {
+            advance(due);
+        }
+
+        lock.unlock();
+        for (auto &callback : due) {
+            callback();
+        }
+        lock.lock();
+    }
+}
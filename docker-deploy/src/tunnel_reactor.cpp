@@ -0,0 +1,298 @@
+#include "tunnel_reactor.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+TunnelReactor::TunnelReactor(size_t numThreads, Logger &logger, Deadlines *deadlines)
+        : m_logger(logger), m_deadlines(deadlines), m_next(0), m_stop(false) {
+    for (size_t i = 0; i < numThreads; i++) {
+        auto loop = std::make_unique<Loop>();
+        loop->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        loop->wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->epoll_fd == -1 || loop->wake_fd == -1) {
+            throw std::runtime_error("tunnel reactor setup error: " + std::string(std::strerror(errno)));
+        }
+        // The wake-up eventfd is registered with a null pointer
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        ::epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &ev);
+        m_loops.push_back(std::move(loop));
+    }
+    for (auto &loop : m_loops) {
+        loop->thread = std::thread(&TunnelReactor::run, this, std::ref(*loop));
+    }
+}
+
+TunnelReactor::~TunnelReactor() {
+    m_stop = true;
+    for (auto &loop : m_loops) {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(loop->wake_fd, &one, sizeof(one));
+        (void) ignored;
+        loop->thread.join();
+        while (!loop->tunnels.empty()) {
+            close_tunnel(*loop, loop->tunnels.begin()->first);
+        }
+        // Added after the loop's last wake-up
+        for (auto &tunnel : loop->pending) {
+            release(*tunnel);
+        }
+        loop->pending.clear();
+        loop->closed.clear();
+        ::close(loop->epoll_fd);
+        ::close(loop->wake_fd);
+    }
+}
+
+void TunnelReactor::add(int client_fd, int server_fd, const std::string &id) {
+    ::fcntl(client_fd, F_SETFL, ::fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+    ::fcntl(server_fd, F_SETFL, ::fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+
+    auto tunnel = std::make_unique<Tunnel>();
+    tunnel->id = id;
+    tunnel->client.fd = client_fd;
+    tunnel->client.tunnel = tunnel.get();
+    tunnel->server.fd = server_fd;
+    tunnel->server.tunnel = tunnel.get();
+    tunnel->upstream.data.reset(new char[BUFFER_CAPACITY]);
+    tunnel->downstream.data.reset(new char[BUFFER_CAPACITY]);
+    tunnel->idle = std::make_unique<Deadline>(m_deadlines, DeadlineKind::TUNNEL_IDLE, client_fd);
+    m_active++;
+
+    // Spread tunnels over the loops round-robin
+    Loop &loop = *m_loops[m_next++ % m_loops.size()];
+    {
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        loop.pending.push_back(std::move(tunnel));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = ::write(loop.wake_fd, &one, sizeof(one));
+    (void) ignored;
+}
+
+void TunnelReactor::run(Loop &loop) {
+    epoll_event events[64];
+    while (!m_stop) {
+        int n = ::epoll_wait(loop.epoll_fd, events, 64, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_logger.error("tunnel reactor epoll_wait: " + std::string(std::strerror(errno)));
+            return;
+        }
+
+        bool woken = false;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == nullptr) {
+                woken = true;
+                continue;
+            }
+            auto *endpoint = static_cast<Endpoint *>(events[i].data.ptr);
+            Tunnel *tunnel = endpoint->tunnel;
+            // The tunnel may have been closed by an earlier event of this batch,
+            // it stays allocated in loop.closed until the batch is done
+            if (loop.tunnels.count(tunnel) == 0) {
+                continue;
+            }
+            if (on_event(*tunnel, *endpoint, events[i].events)) {
+                update_interest(loop, *tunnel);
+            } else {
+                close_tunnel(loop, tunnel);
+            }
+        }
+        loop.closed.clear();
+
+        // New tunnels are registered after the batch so no address is reused within it
+        if (woken) {
+            uint64_t count;
+            ssize_t ignored = ::read(loop.wake_fd, &count, sizeof(count));
+            (void) ignored;
+            std::vector<std::unique_ptr<Tunnel>> pending;
+            {
+                std::lock_guard<std::mutex> lock(loop.mutex);
+                pending.swap(loop.pending);
+            }
+            for (auto &tunnel : pending) {
+                register_tunnel(loop, std::move(tunnel));
+            }
+        }
+    }
+}
+
+void TunnelReactor::register_tunnel(Loop &loop, std::unique_ptr<Tunnel> tunnel) {
+    Tunnel *raw = tunnel.get();
+    loop.tunnels[raw] = std::move(tunnel);
+    for (Endpoint *endpoint : {&raw->client, &raw->server}) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = endpoint;
+        if (::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, endpoint->fd, &ev) == -1) {
+            close_tunnel(loop, raw);
+            return;
+        }
+        endpoint->events = EPOLLIN;
+    }
+}
+
+bool TunnelReactor::on_event(Tunnel &tunnel, Endpoint &endpoint, uint32_t events) {
+    bool is_client = &endpoint == &tunnel.client;
+    Direction &in = is_client ? tunnel.upstream : tunnel.downstream;   // Read from this side
+    Direction &out = is_client ? tunnel.downstream : tunnel.upstream;  // Written to this side
+    Endpoint &peer = is_client ? tunnel.server : tunnel.client;
+
+    if (events & EPOLLERR) {
+        return false;
+    }
+    if (events & EPOLLHUP) {
+        // Still readable up to its EOF, but reported on every wait from now
+        // on: it is taken out of the epoll set and drained below instead
+        endpoint.hup = true;
+    }
+    if (events & EPOLLIN) {
+        if (!fill(in, endpoint.fd) || !flush(in, peer.fd)) {
+            return false;
+        }
+    }
+    if (events & EPOLLOUT) {
+        if (!flush(out, endpoint.fd)) {
+            return false;
+        }
+    }
+    for (Endpoint *hung_up : {&tunnel.client, &tunnel.server}) {
+        if (hung_up->hup) {
+            bool from_client = hung_up == &tunnel.client;
+            Direction &direction = from_client ? tunnel.upstream : tunnel.downstream;
+            if (!drain(direction, hung_up->fd, from_client ? tunnel.server.fd : tunnel.client.fd)) {
+                return false;
+            }
+        }
+    }
+    tunnel.idle->touch();
+
+    // Pass a half-close on once everything before it has been delivered
+    for (auto route : {std::make_pair(&tunnel.upstream, tunnel.server.fd),
+                       std::make_pair(&tunnel.downstream, tunnel.client.fd)}) {
+        Direction &direction = *route.first;
+        if (direction.eof && !direction.shut && direction.start == direction.end) {
+            ::shutdown(route.second, SHUT_WR);
+            direction.shut = true;
+        }
+    }
+    // A hung-up socket can take nothing more, the tunnel ends once what it
+    // sent has been delivered
+    if ((tunnel.client.hup && tunnel.upstream.shut) || (tunnel.server.hup && tunnel.downstream.shut)) {
+        return false;
+    }
+    return !(tunnel.upstream.shut && tunnel.downstream.shut);
+}
+
+bool TunnelReactor::drain(Direction &direction, int fd, int peer_fd) {
+    while (!direction.eof) {
+        size_t buffered = direction.end - direction.start;
+        if (!fill(direction, fd)) {
+            return false;
+        }
+        bool received = direction.end - direction.start > buffered;
+        if (!flush(direction, peer_fd)) {
+            return false;
+        }
+        // The peer is full and its EPOLLOUT continues, or nothing arrived
+        if (direction.start < direction.end || (!received && !direction.eof)) {
+            break;
+        }
+    }
+    return flush(direction, peer_fd);
+}
+
+bool TunnelReactor::fill(Direction &direction, int fd) {
+    // Move pending bytes to the front to make room
+    if (direction.start > 0) {
+        std::memmove(direction.data.get(), direction.data.get() + direction.start, direction.end - direction.start);
+        direction.end -= direction.start;
+        direction.start = 0;
+    }
+    while (direction.end < BUFFER_CAPACITY && !direction.eof) {
+        ssize_t n = ::recv(fd, direction.data.get() + direction.end, BUFFER_CAPACITY - direction.end, 0);
+        if (n > 0) {
+            direction.end += n;
+        } else if (n == 0) {
+            direction.eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TunnelReactor::flush(Direction &direction, int fd) {
+    while (direction.start < direction.end) {
+        ssize_t n = ::send(fd, direction.data.get() + direction.start, direction.end - direction.start, MSG_NOSIGNAL);
+        if (n > 0) {
+            direction.start += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    if (direction.start == direction.end) {
+        direction.start = direction.end = 0;
+    }
+    return true;
+}
+
+void TunnelReactor::update_interest(Loop &loop, Tunnel &tunnel) {
+    for (Endpoint *endpoint : {&tunnel.client, &tunnel.server}) {
+        bool is_client = endpoint == &tunnel.client;
+        const Direction &in = is_client ? tunnel.upstream : tunnel.downstream;
+        const Direction &out = is_client ? tunnel.downstream : tunnel.upstream;
+
+        if (endpoint->hup) {
+            if (!endpoint->removed) {
+                ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, endpoint->fd, nullptr);
+                endpoint->removed = true;
+            }
+            continue;
+        }
+        // Backpressure: stop reading a side while its peer has not taken the buffer
+        uint32_t wanted = 0;
+        if (!in.eof && in.end - in.start < BUFFER_CAPACITY) {
+            wanted |= EPOLLIN;
+        }
+        if (out.start < out.end) {
+            wanted |= EPOLLOUT;
+        }
+        if (wanted != endpoint->events) {
+            epoll_event ev{};
+            ev.events = wanted;
+            ev.data.ptr = endpoint;
+            ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, endpoint->fd, &ev);
+            endpoint->events = wanted;
+        }
+    }
+}
+
+void TunnelReactor::close_tunnel(Loop &loop, Tunnel *tunnel) {
+    auto it = loop.tunnels.find(tunnel);
+    release(*tunnel);
+    loop.closed.push_back(std::move(it->second));
+    loop.tunnels.erase(it);
+}
+
+void TunnelReactor::release(Tunnel &tunnel) {
+    // The deadline must be disarmed while the sockets are still open
+    tunnel.idle.reset();
+    ::close(tunnel.client.fd);
+    ::close(tunnel.server.fd);
+    m_logger.tunnel_closed(tunnel.id);
+    m_active--;
+}
@@ -0,0 +1,297 @@
+#include "uring_tunnel_reactor.hpp"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+UringTunnelReactor::UringTunnelReactor(size_t numThreads, Logger &logger, Deadlines *deadlines)
+        : m_logger(logger), m_deadlines(deadlines), m_next(0), m_stop(false) {
+    for (size_t i = 0; i < numThreads; i++) {
+        auto loop = std::make_unique<Loop>();
+        loop->ring = std::make_unique<IoUring>(RING_ENTRIES);
+        loop->buffers = std::make_unique<IoUring::BufferRing>(*loop->ring, BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE);
+        loop->wake_fd = ::eventfd(0, EFD_CLOEXEC);
+        if (loop->wake_fd == -1) {
+            throw std::runtime_error("tunnel reactor setup error: " + std::string(std::strerror(errno)));
+        }
+        m_loops.push_back(std::move(loop));
+    }
+    for (auto &loop : m_loops) {
+        loop->thread = std::thread(&UringTunnelReactor::run, this, std::ref(*loop));
+    }
+}
+
+UringTunnelReactor::~UringTunnelReactor() {
+    m_stop = true;
+    for (auto &loop : m_loops) {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(loop->wake_fd, &one, sizeof(one));
+        (void) ignored;
+        loop->thread.join();
+
+        // The kernel may still be filling buffers, wait for every operation before freeing them
+        for (auto &entry : loop->tunnels) {
+            close_tunnel(*loop, *entry.second);
+        }
+        while (!loop->tunnels.empty()) {
+            if (loop->ring->submit(1) < 0) {
+                break;
+            }
+            loop->ring->for_each_cqe([&](const io_uring_cqe &cqe) { dispatch(*loop, cqe); });
+        }
+        for (auto &tunnel : loop->pending) {
+            ::close(tunnel->client_fd);
+            ::close(tunnel->server_fd);
+        }
+        loop->buffers.reset();
+        loop->ring.reset();
+        ::close(loop->wake_fd);
+    }
+}
+
+void UringTunnelReactor::add(int client_fd, int server_fd, const std::string &id) {
+    auto tunnel = std::make_unique<Tunnel>();
+    tunnel->id = id;
+    tunnel->client_fd = client_fd;
+    tunnel->server_fd = server_fd;
+    tunnel->idle = std::make_unique<Deadline>(m_deadlines, DeadlineKind::TUNNEL_IDLE, client_fd);
+    m_active++;
+
+    // Spread tunnels over the loops round-robin
+    Loop &loop = *m_loops[m_next++ % m_loops.size()];
+    {
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        loop.pending.push_back(std::move(tunnel));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = ::write(loop.wake_fd, &one, sizeof(one));
+    (void) ignored;
+}
+
+void UringTunnelReactor::run(Loop &loop) {
+    while (!m_stop) {
+        // Retried here if the queue was full when the last wake-up completed
+        if (!loop.wake_armed) {
+            arm_wake(loop);
+        }
+        if (loop.ring->submit(1) < 0) {
+            m_logger.error("tunnel reactor io_uring_enter: " + std::string(std::strerror(errno)));
+            return;
+        }
+
+        bool woken = false;
+        loop.ring->for_each_cqe([&](const io_uring_cqe &cqe) {
+            if (!dispatch(loop, cqe)) {
+                woken = true;
+            }
+        });
+
+        if (woken && !m_stop) {
+            std::vector<std::unique_ptr<Tunnel>> pending;
+            {
+                std::lock_guard<std::mutex> lock(loop.mutex);
+                pending.swap(loop.pending);
+            }
+            for (auto &tunnel : pending) {
+                register_tunnel(loop, std::move(tunnel));
+            }
+        }
+    }
+}
+
+bool UringTunnelReactor::dispatch(Loop &loop, const io_uring_cqe &cqe) {
+    if (cqe.user_data == 0) {
+        loop.wake_armed = false;
+        return false;
+    }
+    auto *op = reinterpret_cast<Op *>(cqe.user_data);
+    Direction &direction = *op->direction;
+    Tunnel &tunnel = *direction.tunnel;
+    tunnel.inflight--;
+    switch (op->kind) {
+        case OpKind::RECV:
+            on_recv(loop, direction, cqe);
+            break;
+        case OpKind::SEND:
+            on_send(loop, direction, cqe);
+            break;
+        case OpKind::HUP:
+            // Both directions of this socket are gone; finish once what it still holds was read
+            direction.hup = true;
+            if (direction.eof) {
+                close_tunnel(loop, tunnel);
+            }
+            break;
+    }
+    finish_if_idle(loop, tunnel);
+    return true;
+}
+
+void UringTunnelReactor::arm_wake(Loop &loop) {
+    io_uring_sqe *sqe = loop.ring->get_sqe();
+    if (sqe == nullptr) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = loop.wake_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&loop.wake_value);
+    sqe->len = sizeof(loop.wake_value);
+    sqe->user_data = 0;
+    loop.wake_armed = true;
+}
+
+void UringTunnelReactor::register_tunnel(Loop &loop, std::unique_ptr<Tunnel> tunnel) {
+    Tunnel *raw = tunnel.get();
+    loop.tunnels[raw] = std::move(tunnel);
+    raw->upstream.src = raw->downstream.dst = raw->client_fd;
+    raw->upstream.dst = raw->downstream.src = raw->server_fd;
+    for (Direction *direction : {&raw->upstream, &raw->downstream}) {
+        direction->tunnel = raw;
+        direction->recv_op = {direction, OpKind::RECV};
+        direction->send_op = {direction, OpKind::SEND};
+        direction->hup_op = {direction, OpKind::HUP};
+
+        io_uring_sqe *sqe = loop.ring->get_sqe();
+        if (sqe != nullptr) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = direction->src;
+            sqe->poll32_events = POLLHUP | POLLERR;
+            sqe->user_data = reinterpret_cast<uint64_t>(&direction->hup_op);
+            raw->inflight++;
+        }
+        if (sqe == nullptr || !submit_recv(loop, *direction)) {
+            // Whatever was submitted completes once the sockets are shut down
+            close_tunnel(loop, *raw);
+            break;
+        }
+    }
+    finish_if_idle(loop, *raw);
+}
+
+bool UringTunnelReactor::submit_recv(Loop &loop, Direction &direction) {
+    // The kernel picks a buffer from the ring once data is there
+    io_uring_sqe *sqe = loop.ring->get_sqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = direction.src;
+    sqe->len = static_cast<uint32_t>(BUFFER_SIZE);
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = loop.buffers->group();
+    sqe->user_data = reinterpret_cast<uint64_t>(&direction.recv_op);
+    direction.tunnel->inflight++;
+    return true;
+}
+
+bool UringTunnelReactor::submit_send(Loop &loop, Direction &direction) {
+    // Send the buffer and only then read again: one submission, ordered by the link
+    io_uring_sqe *sqe = loop.ring->get_sqe();
+    if (sqe == nullptr) {
+        release_buffer(loop, direction);
+        return false;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = direction.dst;
+    sqe->addr = reinterpret_cast<uint64_t>(loop.buffers->buffer(static_cast<uint16_t>(direction.bid)));
+    sqe->len = static_cast<uint32_t>(direction.length);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = reinterpret_cast<uint64_t>(&direction.send_op);
+    direction.tunnel->inflight++;
+    // Without the receive the link ends at the send, which still completes
+    return submit_recv(loop, direction);
+}
+
+void UringTunnelReactor::on_recv(Loop &loop, Direction &direction, const io_uring_cqe &cqe) {
+    Tunnel &tunnel = *direction.tunnel;
+    int bid = (cqe.flags & IORING_CQE_F_BUFFER) ? static_cast<int>(cqe.flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    if (tunnel.closing || cqe.res <= 0) {
+        if (bid != -1) {
+            loop.buffers->recycle(static_cast<uint16_t>(bid));
+        }
+    }
+    if (tunnel.closing) {
+        return;
+    }
+
+    if (cqe.res > 0) {
+        tunnel.idle->touch();
+        direction.bid = bid;
+        direction.length = static_cast<size_t>(cqe.res);
+        if (!submit_send(loop, direction)) {
+            close_tunnel(loop, tunnel);
+        }
+    } else if (cqe.res == 0) {
+        // Pass the half-close on, the linked send before it has already delivered everything
+        direction.eof = true;
+        ::shutdown(direction.dst, SHUT_WR);
+        if (direction.hup || (tunnel.upstream.eof && tunnel.downstream.eof)) {
+            close_tunnel(loop, tunnel);
+        }
+    } else if (cqe.res == -ENOBUFS) {
+        loop.starved.push_back(&direction);
+    } else if (cqe.res != -ECANCELED) {
+        // A cancelled receive means its linked send failed, which closes the tunnel
+        close_tunnel(loop, tunnel);
+    }
+}
+
+void UringTunnelReactor::on_send(Loop &loop, Direction &direction, const io_uring_cqe &cqe) {
+    Tunnel &tunnel = *direction.tunnel;
+    release_buffer(loop, direction);
+    // MSG_WAITALL only completes short on errors
+    if (tunnel.closing || cqe.res < 0 || static_cast<size_t>(cqe.res) != direction.length) {
+        close_tunnel(loop, tunnel);
+        return;
+    }
+    tunnel.idle->touch();
+}
+
+void UringTunnelReactor::release_buffer(Loop &loop, Direction &direction) {
+    if (direction.bid == -1) {
+        return;
+    }
+    loop.buffers->recycle(static_cast<uint16_t>(direction.bid));
+    direction.bid = -1;
+
+    // Retry receives that ran out of buffers
+    std::vector<Direction *> starved;
+    starved.swap(loop.starved);
+    for (Direction *waiting : starved) {
+        // A full queue leaves it waiting for the next buffer
+        if (!waiting->tunnel->closing && !submit_recv(loop, *waiting)) {
+            loop.starved.push_back(waiting);
+        }
+    }
+}
+
+void UringTunnelReactor::close_tunnel(Loop &loop, Tunnel &tunnel) {
+    (void) loop;
+    if (tunnel.closing) {
+        return;
+    }
+    tunnel.closing = true;
+    // The deadline must be disarmed while the sockets are still open
+    tunnel.idle.reset();
+    // Wake every pending operation, the tunnel is freed once all have completed
+    ::shutdown(tunnel.client_fd, SHUT_RDWR);
+    ::shutdown(tunnel.server_fd, SHUT_RDWR);
+}
+
+void UringTunnelReactor::finish_if_idle(Loop &loop, Tunnel &tunnel) {
+    if (!tunnel.closing || tunnel.inflight > 0) {
+        return;
+    }
+    loop.starved.erase(std::remove_if(loop.starved.begin(), loop.starved.end(),
+                                      [&](Direction *direction) { return direction->tunnel == &tunnel; }),
+                       loop.starved.end());
+    ::close(tunnel.client_fd);
+    ::close(tunnel.server_fd);
+    m_logger.tunnel_closed(tunnel.id);
+    loop.tunnels.erase(&tunnel);
+    m_active--;
+}
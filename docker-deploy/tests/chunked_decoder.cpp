@@ -0,0 +1,96 @@
+// ChunkedDecoder and de-chunked header tests. Every message is also fed one
+// byte at a time, so each state has to carry over a buffer boundary.
+//
+// Usage: test_chunked_decoder
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "chunked_decoder.hpp"
+#include "http_parser.hpp"
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::printf("FAIL %s\n", what);
+        ++failures;
+    }
+}
+
+// Feeds message in pieces of step bytes. Returns the bytes consumed and
+// sets done; throws what the decoder throws.
+size_t decode(const std::string &message, size_t step, std::string &body, bool &done) {
+    ChunkedDecoder decoder;
+    size_t consumed = 0;
+    while (consumed < message.size() && !decoder.done()) {
+        size_t len = std::min(step, message.size() - consumed);
+        consumed += decoder.feed(message.data() + consumed, len, body);
+    }
+    done = decoder.done();
+    return consumed;
+}
+
+// Checks message decodes to expected whole and byte by byte, consuming
+// everything up to suffix
+void expect_body(const std::string &message, const std::string &suffix, const std::string &expected,
+                 const char *what) {
+    for (size_t step : {message.size() + suffix.size(), size_t(1)}) {
+        std::string body;
+        bool done = false;
+        size_t consumed = decode(message + suffix, step, body, done);
+        check(done && consumed == message.size() && body == expected, what);
+    }
+}
+
+void expect_error(const std::string &message, const char *what) {
+    for (size_t step : {message.size(), size_t(1)}) {
+        std::string body;
+        bool done = false;
+        bool threw = false;
+        try {
+            decode(message, step, body, done);
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        check(threw, what);
+    }
+}
+}  // namespace
+
+int main() {
+    expect_body("5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n", "", "hello world", "two chunks");
+    expect_body("A\r\n0123456789\r\n0\r\n\r\n", "", "0123456789", "upper-case hex size");
+    expect_body("5;name=value\r\nhello\r\n0\r\n\r\n", "", "hello", "chunk extension");
+    expect_body("5\r\nhello\r\n0\r\nExpires: 0\r\nX-Trailer: a\r\n\r\n", "", "hello", "trailer fields dropped");
+    expect_body("0\r\n\r\n", "HTTP/1.1 200 OK\r\n", "", "stops before the next message");
+    expect_body("3\r\nabc\r\n0\r\nX: y\r\n\r\n", "GET / HTTP/1.1\r\n", "abc", "stops after the trailer");
+
+    expect_error("fffffffffffffffff\r\n", "overflowing chunk size");
+    expect_error("1000000000000000\r\n", "chunk size past 15 digits");
+    expect_error("\r\n", "empty chunk size");
+    expect_error("5x\r\nhello\r\n", "garbage after chunk size");
+    expect_error("5\rhello\r\n", "chunk size line without LF");
+    expect_error("5\r\nhelloX\r\n", "chunk data without CRLF");
+    expect_error("0\r\nX: y\rZ", "trailer line without LF");
+
+    // make_dechunked_header keeps the codings applied before chunked, and
+    // then no Content-Length (RFC 9112 6.2)
+    std::string header = HTTP_Parser::make_dechunked_header(
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, Chunked\r\nContent-Length: 9\r\nX: y\r\n\r\n", 7);
+    check(header == "HTTP/1.1 200 OK\r\nX: y\r\nTransfer-Encoding: gzip\r\n\r\n", "dechunked header keeps gzip");
+    header = HTTP_Parser::make_dechunked_header("HTTP/1.1 200 OK\r\ntransfer-encoding: chunked\r\n\r\n", 0);
+    check(header == "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", "dechunked header drops chunked");
+    header = HTTP_Parser::make_dechunked_header(
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n", 3);
+    check(header == "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip\r\n\r\n",
+          "dechunked header joins split Transfer-Encoding lines");
+
+    if (failures == 0) {
+        std::printf("chunked_decoder: ok\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+// HPACK tests: the request and response sequences of RFC 7541 Appendix C,
+// checking the dynamic table after each block through indexed references,
+// Huffman padding and EOS, and integers too large for a header block.
+//
+// Usage: test_hpack
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hpack.hpp"
+
+namespace {
+using Headers = std::vector<Hpack::Header>;
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::printf("FAIL %s\n", what);
+        ++failures;
+    }
+}
+
+// "8286 8441" as in the RFC, spaces ignored
+std::string hex(std::string_view digits) {
+    std::string bytes;
+    int high = -1;
+    for (char c : digits) {
+        if (c == ' ') {
+            continue;
+        }
+        int value = c <= '9' ? c - '0' : c - 'a' + 10;
+        if (high < 0) {
+            high = value;
+        } else {
+            bytes.push_back(static_cast<char>(high << 4 | value));
+            high = -1;
+        }
+    }
+    return bytes;
+}
+
+Headers decode(Hpack &hpack, const std::string &block) {
+    Headers headers;
+    try {
+        hpack.decode(block, headers);
+    } catch (const std::runtime_error &e) {
+        headers.emplace_back("error", e.what());
+    }
+    return headers;
+}
+
+bool throws(Hpack &hpack, const std::string &block) {
+    Headers headers;
+    try {
+        hpack.decode(block, headers);
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+// The dynamic table, newest first, read back through indexed fields 62...,
+// and nothing past its last entry
+bool table_is(Hpack &hpack, const Headers &expected) {
+    std::string block;
+    for (size_t i = 0; i < expected.size(); i++) {
+        block.push_back(static_cast<char>(0x80 | (62 + i)));
+    }
+    std::string past(1, static_cast<char>(0x80 | (62 + expected.size())));
+    return decode(hpack, block) == expected && throws(hpack, past);
+}
+
+bool huffman_throws(const std::string &in) {
+    std::string out;
+    try {
+        Hpack::huffman_decode(in, out);
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+// C.3 and C.4 decode to the same requests and table, without and with Huffman
+void requests(const char *block1, const char *block2, const char *block3) {
+    const Hpack::Header authority{":authority", "www.example.com"};
+    const Hpack::Header no_cache{"cache-control", "no-cache"};
+    const Hpack::Header custom{"custom-key", "custom-value"};
+    Hpack hpack;
+    check(decode(hpack, hex(block1)) == Headers{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, authority},
+          "first request");
+    check(table_is(hpack, {authority}), "table after the first request");
+    check(decode(hpack, hex(block2)) ==
+                  Headers{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, authority, no_cache},
+          "second request");
+    check(table_is(hpack, {no_cache, authority}), "table after the second request");
+    check(decode(hpack, hex(block3)) ==
+                  Headers{{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, authority, custom},
+          "third request");
+    check(table_is(hpack, {custom, no_cache, authority}), "table after the third request");
+}
+}  // namespace
+
+int main() {
+    // C.3 without Huffman coding, C.4 with it
+    requests("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+             "8286 84be 5808 6e6f 2d63 6163 6865",
+             "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65");
+    requests("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+             "8286 84be 5886 a8eb 1064 9cbf",
+             "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf");
+
+    // C.5: responses into a 256-byte table, which evicts the oldest entries
+    {
+        const Hpack::Header location{"location", "https://www.example.com"};
+        const Hpack::Header date21{"date", "Mon, 21 Oct 2013 20:13:21 GMT"};
+        const Hpack::Header date22{"date", "Mon, 21 Oct 2013 20:13:22 GMT"};
+        const Hpack::Header private_cc{"cache-control", "private"};
+        const Hpack::Header gzip{"content-encoding", "gzip"};
+        const Hpack::Header cookie{"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"};
+        Hpack hpack(256);
+        check(decode(hpack, hex("4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 "
+                                "3133 2032 303a 3133 3a32 3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 "
+                                "7861 6d70 6c65 2e63 6f6d")) ==
+                      Headers{{":status", "302"}, private_cc, date21, location},
+              "first response");
+        check(table_is(hpack, {location, date21, private_cc, {":status", "302"}}), "table after the first response");
+        check(decode(hpack, hex("4803 3330 37c1 c0bf")) == Headers{{":status", "307"}, private_cc, date21, location},
+              "second response");
+        check(table_is(hpack, {{":status", "307"}, location, date21, private_cc}),
+              "table after the second response evicts :status 302");
+        check(decode(hpack, hex("88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 "
+                                "474d 54c0 5a04 677a 6970 7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 "
+                                "454f 5049 5541 5851 5745 4f49 553b 206d 6178 2d61 6765 3d33 3630 303b 2076 "
+                                "6572 7369 6f6e 3d31")) ==
+                      Headers{{":status", "200"}, private_cc, date22, location, gzip, cookie},
+              "third response");
+        check(table_is(hpack, {cookie, gzip, date22}), "table after the third response");
+    }
+
+    // Huffman: the code of the RFC, padded with the start of EOS only
+    std::string coded;
+    Hpack::huffman_encode("www.example.com", coded);
+    check(coded == hex("f1e3 c2e5 f23a 6ba0 ab90 f4ff"), "Huffman code of www.example.com");
+    std::string decoded;
+    Hpack::huffman_decode(coded, decoded);
+    check(decoded == "www.example.com", "Huffman round trip");
+    check(Hpack::huffman_length("www.example.com") == 12, "Huffman length");
+    check(!huffman_throws(hex("1f")), "'a' padded with three ones");
+    check(huffman_throws(hex("18")), "'a' padded with zeros");
+    check(huffman_throws(hex("1fff")), "padding longer than 7 bits");
+    check(huffman_throws(hex("ffff fffc")), "EOS in a string");
+    check(huffman_throws(hex("ffff ffff")), "EOS padded with ones");
+
+    // Integers: C.1.2's 1337 in a 5-bit prefix, as a table size update
+    Hpack sized;
+    check(!throws(sized, hex("3f9a 0a")), "table size update to 1337");
+    check(throws(sized, hex("3fe2 1f")), "table size update past the announced 4096");
+    check(throws(sized, hex("82 3f9a 0a")), "table size update after a field");
+    Hpack overflow;
+    check(throws(overflow, hex("ff ffff ffff ffff ffff ffff 01")), "index past 32 bits");
+    check(throws(overflow, hex("ff80")), "integer truncated");
+    check(throws(overflow, hex("0f ffff ffff 0f")), "literal name index past the table");
+
+    // Round trip through the encoder, and the header list limit
+    Headers response{{":status", "200"}, {"content-type", "text/html"}, {"x-custom", "value"}};
+    std::string block;
+    Hpack::encode(response, block);
+    Hpack decoder;
+    check(decode(decoder, block) == response, "encode round trip");
+    check(table_is(decoder, {}), "encoder adds nothing to the table");
+    Hpack small(4096, 64);
+    Headers headers;
+    check(!small.decode(block, headers) && headers.empty(), "header list over the limit");
+
+    if (failures == 0) {
+        std::printf("hpack: ok\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
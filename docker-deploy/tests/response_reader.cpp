@@ -0,0 +1,86 @@
+// ResponseReader framing tests: complete responses in every framing, and
+// responses cut short by the connection closing, which must not come back
+// as if they were complete.
+//
+// Usage: test_response_reader
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "response_reader.hpp"
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::printf("FAIL %s\n", what);
+        ++failures;
+    }
+}
+
+// Feeds message whole and byte by byte, then finishes as if the connection
+// closed; checks the result is expected
+void expect_response(const std::string &message, const std::string &expected, const char *what) {
+    for (size_t step : {message.size(), size_t(1)}) {
+        ResponseReader reader;
+        for (size_t pos = 0; pos < message.size() && !reader.done(); pos += step) {
+            reader.feed(message.data() + pos, std::min(step, message.size() - pos));
+        }
+        std::string response;
+        try {
+            response = reader.finish();
+        } catch (const std::runtime_error &) {
+        }
+        check(response == expected, what);
+    }
+}
+
+// Same, but finish must throw
+void expect_truncated(const std::string &message, const char *what) {
+    for (size_t step : {message.size(), size_t(1)}) {
+        ResponseReader reader;
+        for (size_t pos = 0; pos < message.size(); pos += step) {
+            reader.feed(message.data() + pos, std::min(step, message.size() - pos));
+        }
+        bool threw = false;
+        try {
+            reader.finish();
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        check(threw, what);
+    }
+}
+}  // namespace
+
+int main() {
+    const std::string header = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n";
+    expect_response(header + "hello", header + "hello", "Content-Length body");
+    expect_response(header + "helloHTTP/1.1", header + "hello", "bytes after the body ignored");
+    expect_response("HTTP/1.1 200 OK\r\n\r\nuntil close", "HTTP/1.1 200 OK\r\n\r\nuntil close",
+                    "body delimited by the close");
+    expect_response("HTTP/1.1 304 Not Modified\r\nContent-Length: 5\r\n\r\n",
+                    "HTTP/1.1 304 Not Modified\r\nContent-Length: 5\r\n\r\n", "304 has no body");
+    expect_response("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n",
+                    "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello", "chunked body decoded");
+    expect_response("HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n",
+                    "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip\r\n\r\nabc", "gzip kept without a Content-Length");
+    expect_response("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked, gzip\r\n\r\n3\r\nabc",
+                    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked, gzip\r\n\r\n3\r\nabc",
+                    "chunked not final, body delimited by the close");
+
+    expect_truncated("", "nothing received");
+    expect_truncated("HTTP/1.1 200 OK\r\nContent-Le", "header cut short");
+    expect_truncated(header + "hel", "Content-Length body cut short");
+    expect_truncated(header, "Content-Length body missing");
+    expect_truncated("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n",
+                     "chunked body cut short");
+
+    if (failures == 0) {
+        std::printf("response_reader: ok\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
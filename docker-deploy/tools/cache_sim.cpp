@@ -0,0 +1,487 @@
+// Trace-driven cache simulator. Converts a proxy log into a compact binary
+// trace of its GET requests, then replays the trace at memory speed against
+// cache configurations: the proxy's own CacheIndex (CLOCK eviction) and
+// reference LRU and FIFO caches, each bounded by entry count and bytes.
+// Reports hit ratio, byte hit ratio and replay throughput.
+//
+// A request is a hit if its URL is in the simulated cache; freshness is not
+// simulated. URLs the proxy never stored (no-store, uncacheable status) are
+// never inserted. Object sizes come from the "Size: N bytes" notes the cache
+// logs when it stores a response (proxy run with -s); requests for URLs never
+// stored use the mean size of the others, or -s.
+//
+// Usage:
+//   cache_sim convert <proxy.log> <trace>
+//   cache_sim replay <trace> [-p clock,lru,fifo] [-n entries,...] [-b bytes,...]
+//                            [-t threads,...] [-s default size]
+// Byte counts take K, M and G suffixes; 0 entries or bytes is unbounded.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cache.hpp"
+#include "cache_index.hpp"
+
+namespace {
+const char MAGIC[8] = {'P', 'X', 'T', 'R', 'A', 'C', 'E', '1'};
+
+// What the proxy logged for the request
+enum Outcome : uint8_t {
+    UNKNOWN,
+    MISS,   // not in cache
+    HIT,    // in cache, valid
+    STALE,  // in cache but expired, or needing revalidation
+};
+
+// Fixed size so a trace is read with one read() per record array
+struct Record {
+    uint32_t url;     // Index in the URL table
+    uint32_t time;    // Seconds since the first request
+    uint32_t size;    // Bytes, 0 if never logged
+    uint8_t outcome;
+    uint8_t cacheable;  // The proxy stored this URL at least once
+    uint16_t reserved;
+};
+
+static_assert(sizeof(Record) == 16, "Record is written as is");
+
+struct Trace {
+    std::vector<std::string> urls;
+    std::vector<Record> records;
+};
+
+// "Tue Feb 28 04:17:33 2023", UTC
+bool parse_time(const std::string &text, time_t &time) {
+    std::tm tm{};
+    if (strptime(text.c_str(), "%a %b %d %H:%M:%S %Y", &tm) == nullptr) {
+        return false;
+    }
+    time = timegm(&tm);
+    return true;
+}
+
+Trace convert_log(std::istream &log) {
+    Trace trace;
+    std::unordered_map<std::string, uint32_t> url_ids;
+    // Requests whose lines may still follow, by request ID
+    std::unordered_map<std::string, size_t> open;
+    std::vector<uint32_t> url_sizes;
+    std::vector<uint8_t> url_cacheable;
+    time_t first_time = -1;
+
+    std::string line;
+    while (std::getline(log, line)) {
+        size_t colon = line.find(": ");
+        if (colon == std::string::npos || colon == 0 || line[0] == '[') {
+            continue;
+        }
+        std::string id = line.substr(0, colon);
+        std::string_view rest = std::string_view(line).substr(colon + 2);
+
+        if (!rest.empty() && rest[0] == '"') {
+            // "GET http://host/path HTTP/1.1" from 1.2.3.4 @ Tue Feb 28 04:17:33 2023
+            size_t method_end = rest.find(' ');
+            size_t target_end = rest.find(' ', method_end + 1);
+            size_t at = rest.rfind(" @ ");
+            if (method_end == std::string::npos || target_end == std::string::npos || at == std::string::npos ||
+                rest.substr(1, method_end - 1) != "GET") {
+                continue;
+            }
+            std::string url(rest.substr(method_end + 1, target_end - method_end - 1));
+            auto [it, added] = url_ids.emplace(url, trace.urls.size());
+            if (added) {
+                trace.urls.push_back(url);
+                url_sizes.push_back(0);
+                url_cacheable.push_back(0);
+            }
+            time_t time = 0;
+            parse_time(std::string(rest.substr(at + 3)), time);
+            if (first_time == -1) {
+                first_time = time;
+            }
+            Record record{};
+            record.url = it->second;
+            record.time = static_cast<uint32_t>(std::max<time_t>(0, time - first_time));
+            open[id] = trace.records.size();
+            trace.records.push_back(record);
+            continue;
+        }
+
+        auto it = open.find(id);
+        if (it == open.end()) {
+            continue;
+        }
+        Record &record = trace.records[it->second];
+        if (rest == "not in cache") {
+            record.outcome = MISS;
+        } else if (rest == "in cache, valid") {
+            record.outcome = HIT;
+            url_cacheable[record.url] = 1;
+        } else if (rest.compare(0, 10, "in cache, ") == 0) {
+            record.outcome = STALE;
+        } else if (rest.compare(0, 8, "cached, ") == 0) {
+            url_cacheable[record.url] = 1;
+        } else if (rest.compare(0, 13, "[INFO] Size: ") == 0) {
+            record.size = static_cast<uint32_t>(std::stoul(std::string(rest.substr(13))));
+            url_sizes[record.url] = record.size;
+        } else if (rest.compare(0, 11, "Responding ") == 0) {
+            open.erase(it);
+        }
+    }
+
+    // Hits are not logged with a size, they weigh what the URL was stored with
+    for (Record &record : trace.records) {
+        if (record.size == 0) {
+            record.size = url_sizes[record.url];
+        }
+        record.cacheable = url_cacheable[record.url];
+    }
+    return trace;
+}
+
+void write_trace(const Trace &trace, std::ostream &out) {
+    uint64_t counts[2] = {trace.urls.size(), trace.records.size()};
+    out.write(MAGIC, sizeof(MAGIC));
+    out.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+    for (const std::string &url : trace.urls) {
+        uint32_t length = url.size();
+        out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        out.write(url.data(), length);
+    }
+    out.write(reinterpret_cast<const char *>(trace.records.data()), trace.records.size() * sizeof(Record));
+}
+
+Trace read_trace(std::istream &in) {
+    char magic[sizeof(MAGIC)];
+    uint64_t counts[2];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        !in.read(reinterpret_cast<char *>(counts), sizeof(counts))) {
+        throw std::runtime_error("not a cache_sim trace");
+    }
+    Trace trace;
+    trace.urls.resize(counts[0]);
+    for (std::string &url : trace.urls) {
+        uint32_t length;
+        in.read(reinterpret_cast<char *>(&length), sizeof(length));
+        url.resize(length);
+        in.read(url.data(), length);
+    }
+    trace.records.resize(counts[1]);
+    in.read(reinterpret_cast<char *>(trace.records.data()), trace.records.size() * sizeof(Record));
+    if (!in) {
+        throw std::runtime_error("truncated trace");
+    }
+    return trace;
+}
+
+// The proxy's index, with entries standing in for responses of the logged size
+class ClockCache {
+public:
+    ClockCache(size_t max_entries, size_t max_bytes) : m_index(max_entries, max_bytes) {}
+
+    bool find(std::string_view url) {
+        EpochReclaimer::Guard guard;
+        return m_index.find(url) != nullptr;
+    }
+
+    void insert(const std::string &url, size_t size) {
+        static const std::string header = "HTTP/1.1 200 OK\r\n\r\n";
+        static const ResponseMeta header_meta = ResponseMeta::parse(header);
+        ResponseMeta meta = header_meta;
+        meta.content_length = size > header.size() ? size - header.size() : 0;
+        m_index.insert(std::make_shared<CacheEntry>(url, header, meta));
+    }
+
+private:
+    CacheIndex m_index;
+};
+
+// Reference policies: a list in eviction order, LRU moves hits to the front
+class ListCache {
+public:
+    ListCache(size_t max_entries, size_t max_bytes, bool lru)
+            : m_max_entries(max_entries), m_max_bytes(max_bytes), m_lru(lru), m_bytes(0) {}
+
+    bool find(std::string_view url) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_map.find(url);
+        if (it == m_map.end()) {
+            return false;
+        }
+        if (m_lru) {
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+        }
+        return true;
+    }
+
+    void insert(const std::string &url, size_t size) {
+        if (m_max_bytes > 0 && size > m_max_bytes) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_map.count(url) != 0) {
+            return;
+        }
+        while (!m_entries.empty() && ((m_max_entries > 0 && m_entries.size() >= m_max_entries) ||
+                                      (m_max_bytes > 0 && m_bytes + size > m_max_bytes))) {
+            m_bytes -= m_entries.back().second;
+            m_map.erase(m_entries.back().first);
+            m_entries.pop_back();
+        }
+        m_entries.emplace_front(url, size);
+        m_map.emplace(m_entries.front().first, m_entries.begin());
+        m_bytes += size;
+    }
+
+private:
+    using Entries = std::list<std::pair<std::string_view, size_t>>;
+
+    const size_t m_max_entries;
+    const size_t m_max_bytes;
+    const bool m_lru;
+    size_t m_bytes;
+    Entries m_entries;
+    std::unordered_map<std::string_view, Entries::iterator> m_map;
+    std::mutex m_mutex;
+};
+
+struct Result {
+    uint64_t requests = 0;
+    uint64_t hits = 0;
+    uint64_t bytes = 0;
+    uint64_t hit_bytes = 0;
+    double seconds = 0;
+};
+
+// Thread t replays records t, t + threads, ..., so all threads move through
+// the trace together and keep its locality
+template <typename Cache>
+Result replay(Cache &cache, const Trace &trace, size_t default_size, int threads) {
+    std::vector<Result> results(threads);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            Result local;
+            for (size_t i = t; i < trace.records.size(); i += threads) {
+                const Record &record = trace.records[i];
+                const std::string &url = trace.urls[record.url];
+                size_t size = record.size != 0 ? record.size : default_size;
+                local.requests++;
+                local.bytes += size;
+                if (cache.find(url)) {
+                    local.hits++;
+                    local.hit_bytes += size;
+                } else if (record.cacheable) {
+                    cache.insert(url, size);
+                }
+            }
+            results[t] = local;
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    Result total;
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const Result &r : results) {
+        total.requests += r.requests;
+        total.hits += r.hits;
+        total.bytes += r.bytes;
+        total.hit_bytes += r.hit_bytes;
+    }
+    return total;
+}
+
+size_t parse_bytes(const std::string &text) {
+    size_t end;
+    double value = std::stod(text, &end);
+    switch (end < text.size() ? std::toupper(text[end]) : 0) {
+        case 'K':
+            value *= 1024;
+            break;
+        case 'M':
+            value *= 1024 * 1024;
+            break;
+        case 'G':
+            value *= 1024.0 * 1024 * 1024;
+            break;
+    }
+    return static_cast<size_t>(value);
+}
+
+std::vector<std::string> split(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+std::string format_bytes(size_t bytes) {
+    if (bytes == 0) {
+        return "-";
+    }
+    const char *units[] = {"", "K", "M", "G"};
+    int unit = 0;
+    double value = bytes;
+    while (value >= 1024 && unit < 3) {
+        value /= 1024;
+        unit++;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.4g%s", value, units[unit]);
+    return text;
+}
+
+int usage() {
+    std::cerr << "usage: cache_sim convert <proxy.log> <trace>\n"
+                 "       cache_sim replay <trace> [-p clock,lru,fifo] [-n entries,...] [-b bytes,...]\n"
+                 "                                [-t threads,...] [-s default size]\n";
+    return 2;
+}
+
+int convert(const std::string &log_path, const std::string &trace_path) {
+    std::ifstream log(log_path);
+    if (!log) {
+        std::cerr << "cannot open " << log_path << std::endl;
+        return 1;
+    }
+    Trace trace = convert_log(log);
+    std::ofstream out(trace_path, std::ios::binary);
+    write_trace(trace, out);
+    if (!out) {
+        std::cerr << "cannot write " << trace_path << std::endl;
+        return 1;
+    }
+    std::printf("%zu GET requests for %zu URLs written to %s\n", trace.records.size(), trace.urls.size(),
+                trace_path.c_str());
+    return 0;
+}
+
+int replay(const std::string &trace_path, int argc, char *argv[]) {
+    std::vector<std::string> policies = {"clock", "lru", "fifo"};
+    std::vector<std::string> entry_limits = {"10240"};
+    std::vector<std::string> byte_limits = {"0"};
+    std::vector<std::string> thread_counts = {"1"};
+    size_t default_size = 0;
+    if (argc % 2 != 0) {
+        return usage();
+    }
+    for (int i = 0; i < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "-p") {
+            policies = split(value);
+        } else if (option == "-n") {
+            entry_limits = split(value);
+        } else if (option == "-b") {
+            byte_limits = split(value);
+        } else if (option == "-t") {
+            thread_counts = split(value);
+        } else if (option == "-s") {
+            default_size = parse_bytes(value);
+        } else {
+            return usage();
+        }
+    }
+
+    std::ifstream in(trace_path, std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << trace_path << std::endl;
+        return 1;
+    }
+    Trace trace = read_trace(in);
+    if (trace.records.empty()) {
+        std::cerr << "empty trace" << std::endl;
+        return 1;
+    }
+
+    // The proxy's own hit ratio, over the requests whose outcome was logged
+    uint64_t logged = 0, logged_hits = 0, known_bytes = 0, known = 0;
+    for (const Record &record : trace.records) {
+        logged += record.outcome != UNKNOWN;
+        logged_hits += record.outcome == HIT;
+        if (record.size != 0) {
+            known_bytes += record.size;
+            known++;
+        }
+    }
+    if (default_size == 0 && known > 0) {
+        default_size = known_bytes / known;
+    }
+    std::printf("%zu requests, %zu URLs, %u s, logged hit ratio %.2f%%, default size %zu\n", trace.records.size(),
+                trace.urls.size(), trace.records.back().time, logged ? 100.0 * logged_hits / logged : 0.0,
+                default_size);
+    std::printf("%-8s %10s %10s %8s %8s %10s %10s\n", "policy", "entries", "bytes", "threads", "hit %",
+                "byte hit %", "M req/s");
+
+    for (const std::string &policy : policies) {
+        for (const std::string &entries_text : entry_limits) {
+            for (const std::string &bytes_text : byte_limits) {
+                for (const std::string &threads_text : thread_counts) {
+                    size_t entries = std::stoul(entries_text);
+                    size_t bytes = parse_bytes(bytes_text);
+                    int threads = std::max(1, std::stoi(threads_text));
+                    Result result;
+                    if (policy == "clock") {
+                        // CacheIndex needs a bound, it can never hold more than every URL
+                        ClockCache cache(entries != 0 ? entries : trace.urls.size(), bytes);
+                        result = replay(cache, trace, default_size, threads);
+                    } else if (policy == "lru" || policy == "fifo") {
+                        ListCache cache(entries, bytes, policy == "lru");
+                        result = replay(cache, trace, default_size, threads);
+                    } else {
+                        std::cerr << "unknown policy " << policy << std::endl;
+                        return 2;
+                    }
+                    std::printf("%-8s %10s %10s %8d %8.2f %10.2f %10.2f\n", policy.c_str(),
+                                entries != 0 ? entries_text.c_str() : "-", format_bytes(bytes).c_str(), threads,
+                                100.0 * result.hits / result.requests,
+                                result.bytes ? 100.0 * result.hit_bytes / result.bytes : 0.0,
+                                result.requests / result.seconds / 1e6);
+                }
+            }
+        }
+    }
+    return 0;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        return usage();
+    }
+    std::string command = argv[1];
+    try {
+        if (command == "convert" && argc == 4) {
+            return convert(argv[2], argv[3]);
+        }
+        if (command == "replay") {
+            return replay(argv[2], argc - 3, argv + 3);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "cache_sim: " << e.what() << std::endl;
+        return 1;
+    }
+    return usage();
+}
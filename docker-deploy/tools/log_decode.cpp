@@ -0,0 +1,267 @@
+// Turns a binary proxy log (Logger in binary mode, see BinaryLog) back into
+// the text log, line for line as the proxy would have written it. Request
+// times are printed from the record times, expire times in the local time
+// zone of the decoder. Blocks of several processes sharing the file are
+// printed in the order they were written, so their lines interleave in
+// blocks rather than in lines.
+//
+// Usage:
+//   log_decode <proxy.bin> [proxy.log]
+// writes the text to proxy.log, or to the standard output.
+
+#include <arpa/inet.h>
+#include <uuid/uuid.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "binary_log.hpp"
+
+namespace {
+struct Session {
+    int64_t start = 0;  // Wall-clock nanoseconds at record time 0
+    std::vector<std::string> strings;
+    std::unordered_map<uint64_t, std::string> ids;
+};
+
+class Decoder {
+public:
+    explicit Decoder(std::ostream &out) : m_out(out) {}
+
+    void block(uint64_t session_id, const std::vector<char> &records) {
+        Session &session = m_sessions[session_id];
+        size_t offset = 0;
+        while (offset + sizeof(BinaryLog::RecordHeader) <= records.size()) {
+            BinaryLog::RecordHeader header;
+            std::memcpy(&header, records.data() + offset, sizeof(header));
+            offset += sizeof(header);
+            if (header.length > records.size() - offset) {
+                throw std::runtime_error("record runs past the end of its block");
+            }
+            record(session, header, std::string_view(records.data() + offset, header.length));
+            offset += header.length;
+        }
+    }
+
+private:
+    template <typename T>
+    static T read(std::string_view payload, size_t offset = 0) {
+        T value{};
+        if (offset + sizeof(T) > payload.size()) {
+            throw std::runtime_error("record payload too short");
+        }
+        std::memcpy(&value, payload.data() + offset, sizeof(T));
+        return value;
+    }
+
+    static const std::string &string(const Session &session, std::string_view payload, size_t offset) {
+        auto index = read<uint32_t>(payload, offset);
+        if (index >= session.strings.size()) {
+            throw std::runtime_error("string " + std::to_string(index) + " used before it was defined");
+        }
+        return session.strings[index];
+    }
+
+    // As getCurrentTime() in logger.cpp prints it, UTC
+    static std::string request_time(const Session &session, uint64_t time) {
+        std::time_t seconds = (session.start + static_cast<int64_t>(time)) / 1000000000;
+        std::tm tm;
+        gmtime_r(&seconds, &tm);
+        char text[80];
+        std::strftime(text, sizeof(text), "%a %b %d %H:%M:%S %Y", &tm);
+        return text;
+    }
+
+    // As formatExpireTime() in logger.cpp prints it, local time
+    static std::string expire_time(std::string_view payload) {
+        std::time_t seconds = read<int64_t>(payload);
+        std::tm tm;
+        localtime_r(&seconds, &tm);
+        char text[80];
+        std::strftime(text, sizeof(text), "%c %Z", &tm);
+        return text;
+    }
+
+    void record(Session &session, const BinaryLog::RecordHeader &header, std::string_view payload) {
+        if (header.event == BinaryLog::SESSION) {
+            session.start = read<int64_t>(payload);
+            return;
+        }
+        if (header.event == BinaryLog::STRING) {
+            auto index = read<uint32_t>(payload);
+            if (index >= session.strings.size()) {
+                session.strings.resize(index + 1);
+            }
+            session.strings[index] = payload.substr(sizeof(index));
+            return;
+        }
+        if (header.event == BinaryLog::ID) {
+            if (header.variant == BinaryLog::UUID) {
+                uuid_t uuid;
+                char text[37];
+                std::memcpy(uuid, payload.data(), std::min(payload.size(), sizeof(uuid)));
+                uuid_unparse_lower(uuid, text);
+                session.ids[header.request] = text;
+            } else {
+                session.ids[header.request] = payload;
+            }
+            return;
+        }
+
+        const std::string &id = header.request != 0 ? session.ids[header.request] : m_no_id;
+        switch (header.event) {
+            case BinaryLog::REQUEST: {
+                char client[INET_ADDRSTRLEN] = "";
+                in_addr address{};
+                address.s_addr = read<uint32_t>(payload, 4);
+                if (header.variant != BinaryLog::NO_CLIENT) {
+                    inet_ntop(AF_INET, &address, client, sizeof(client));
+                }
+                m_out << id << ": \"" << string(session, payload, 0) << "\" from " << client << " @ "
+                      << request_time(session, header.time) << '\n';
+                break;
+            }
+            case BinaryLog::NOT_IN_CACHE:
+                m_out << id << ": not in cache\n";
+                break;
+            case BinaryLog::CACHE_STATUS:
+                switch (header.variant) {
+                    case BinaryLog::VALIDATORS_FRESH:
+                        m_out << id << ": in cache, validators only\n";
+                        break;
+                    case BinaryLog::VALIDATORS_EXPIRED:
+                        m_out << id << ": in cache, validators only, expired\n";
+                        break;
+                    case BinaryLog::VALID:
+                        m_out << id << ": in cache, valid\n";
+                        break;
+                    case BinaryLog::EXPIRED:
+                        m_out << id << ": in cache, but expired at " << expire_time(payload) << '\n';
+                        break;
+                    case BinaryLog::MUST_REVALIDATE:
+                        m_out << id << ": in cache, requires validation\n";
+                        break;
+                    default:
+                        m_out << id << ": in cache, \n";
+                }
+                break;
+            case BinaryLog::FORWARD_REQUEST:
+                m_out << id << ": Requesting \"" << string(session, payload, 0) << "\" from "
+                      << string(session, payload, 4) << '\n';
+                break;
+            case BinaryLog::RECEIVED:
+                m_out << id << ": Received \"" << string(session, payload, 0) << "\" from "
+                      << string(session, payload, 4) << '\n';
+                break;
+            case BinaryLog::CACHE_RESULT:
+                if (header.variant == BinaryLog::NEVER_EXPIRES) {
+                    m_out << id << ": cached, never expires\n";
+                } else if (header.variant == BinaryLog::REVALIDATE) {
+                    m_out << id << ": cached, but requires re-validation\n";
+                } else {
+                    m_out << id << ": cached, expires at " << expire_time(payload) << '\n';
+                }
+                break;
+            case BinaryLog::NO_STORE:
+                m_out << id << ": not cacheable, \"no-store\" founded.\n";
+                break;
+            case BinaryLog::NOT_CACHEABLE:
+                m_out << id << ": not cacheable because " << string(session, payload, 0) << '\n';
+                break;
+            case BinaryLog::RESPONDING:
+                m_out << id << ": Responding \"" << string(session, payload, 0) << "\"\n";
+                break;
+            case BinaryLog::TUNNEL_CLOSED:
+                m_out << id << ": Tunnel closed\n";
+                break;
+            case BinaryLog::NOTE:
+                m_out << "[INFO] " << payload << '\n';
+                break;
+            case BinaryLog::NOTE_WITH_ID:
+                m_out << id << ": [INFO] " << payload << '\n';
+                break;
+            case BinaryLog::WARNING:
+                m_out << "[WARN] " << payload << '\n';
+                break;
+            case BinaryLog::ERROR:
+                m_out << "[ERROR] " << payload << '\n';
+                break;
+            default:
+                throw std::runtime_error("unknown event " + std::to_string(header.event));
+        }
+    }
+
+    std::ostream &m_out;
+    std::unordered_map<uint64_t, Session> m_sessions;
+    const std::string m_no_id;
+};
+
+int usage() {
+    std::cerr << "usage: log_decode <proxy.bin> [proxy.log]\n";
+    return 2;
+}
+
+int decode(std::istream &in, std::ostream &out) {
+    Decoder decoder(out);
+    std::vector<char> records;
+    BinaryLog::BlockHeader header;
+    while (in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        if (std::memcmp(header.magic, BinaryLog::MAGIC, sizeof(header.magic)) != 0) {
+            std::cerr << "log_decode: not a binary proxy log block at offset "
+                      << static_cast<size_t>(in.tellg()) - sizeof(header) << std::endl;
+            return 1;
+        }
+        records.resize(header.length);
+        if (!in.read(records.data(), records.size())) {
+            // The proxy died while writing the block
+            std::cerr << "log_decode: last block truncated" << std::endl;
+            return 1;
+        }
+        decoder.block(header.session, records);
+    }
+    if (in.gcount() != 0) {
+        std::cerr << "log_decode: last block truncated" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        return usage();
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::ofstream file;
+    if (argc == 3) {
+        file.open(argv[2]);
+        if (!file) {
+            std::cerr << "cannot write " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+    try {
+        int status = decode(in, argc == 3 ? file : std::cout);
+        if (argc == 3 && !file.flush()) {
+            std::cerr << "cannot write " << argv[2] << std::endl;
+            return 1;
+        }
+        return status;
+    } catch (const std::exception &e) {
+        std::cerr << "log_decode: " << e.what() << std::endl;
+        return 1;
+    }
+}